@@ -19,21 +19,55 @@
 
 /*
  * Simple addr2line like utility.
+ *
+ * When given GNU addr2line style options, or no addresses, image VMAs are
+ * read from the command line, @FILE, or stdin, and resolved against the
+ * image's DWARF information and symbol table directly, without loading it.
  */
 
 
 #define __STDC_FORMAT_MACROS 1
 
 #include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
+#include <getopt.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
 #include <windows.h>
 #include <dbghelp.h>
 
 #include "symbols.h"
 
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "paths.h"
+#include "thread.h"
+
+#include "pe_image.h"
+#include "pe_find.h"
+#include "dwarf_pe.h"
+#include "dwarf_find.h"
+#include "dwarf_cache.h"
+
+#include "demangle.h"
+
+
+#ifdef _WIN32
 
 static BOOL CALLBACK
 callback(HANDLE hProcess,
@@ -50,19 +84,17 @@ callback(HANDLE hProcess,
 }
 
 
-int
-main(int argc, char **argv)
+/*
+ * Verbose mode, which loads the module and queries DbgHelp (through
+ * MgwHelp) for every address given relative to the module base.
+ */
+static int
+dbghelpMain(const char *szModule, int argc, char **argv)
 {
     BOOL bRet;
     DWORD dwRet;
 
-    if (argc < 3) {
-        fprintf(stderr, "usage: %s <dll> <addr> ...\n", argv[0]);
-        return 1;
-    }
-
     // Load the module
-    char *szModule = argv[1];
     HMODULE hModule = NULL;
 #ifdef _WIN64
     hModule = LoadLibraryExA(szModule, NULL, LOAD_LIBRARY_AS_DATAFILE);
@@ -111,7 +143,7 @@ main(int argc, char **argv)
     }
 
 
-    for (int i = 2; i < argc; ++i) {
+    for (int i = 0; i < argc; ++i) {
         const char *arg = argv[i];
         DWORD64 dwRelAddr;
         if (arg[0] == '0' && arg[1] == 'x') {
@@ -162,3 +194,438 @@ main(int argc, char **argv)
 
     return 0;
 }
+
+#endif /* _WIN32 */
+
+
+struct options
+{
+    bool addresses;
+    bool functions;
+    bool demangle;
+    bool inlines;
+    bool pretty;
+    bool basenames;
+    unsigned jobs;
+};
+
+
+/*
+ * An image opened as a data file, with its lookup indices built upfront.
+ */
+struct image
+{
+    struct pe_image *pe;
+    Dwarf_Debug dbg;
+    struct dwarf_function_index *functions;
+    struct dwarf_line_cache *lines;
+    struct dwarf_cache *cache;
+    struct pe_symbol_index *symbols;
+    int addressWidth;
+};
+
+
+static bool
+openImage(struct image *image, const char *szImageName)
+{
+    memset(image, 0, sizeof *image);
+
+    image->pe = pe_image_open_file(szImageName);
+    if (!image->pe) {
+        return false;
+    }
+
+    image->addressWidth = image->pe->pNtHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ? 16 : 8;
+
+    const char *szCacheDir = dwarf_cache_dir();
+    if (szCacheDir) {
+        image->cache = dwarf_cache_open(szCacheDir, szImageName, image->pe);
+    }
+
+    Dwarf_Error error = 0;
+    if (image->cache) {
+        image->dbg = 0;
+    } else if (dwarf_pe_init(image->pe, szImageName, 0, 0, &image->dbg, &error) == DW_DLV_OK) {
+        image->functions = dwarf_function_index_create(image->dbg);
+        image->lines = dwarf_line_cache_create(image->dbg);
+        if (szCacheDir) {
+            dwarf_cache_save(szCacheDir, szImageName, image->pe, image->functions, image->lines);
+        }
+    } else {
+        image->dbg = 0;
+    }
+
+    image->symbols = pe_symbol_index_create(image->pe);
+
+    return true;
+}
+
+
+static void
+closeImage(struct image *image)
+{
+    pe_symbol_index_destroy(image->symbols);
+    if (image->cache) {
+        dwarf_cache_close(image->cache);
+    }
+    if (image->dbg) {
+        dwarf_line_cache_destroy(image->lines);
+        dwarf_function_index_destroy(image->functions);
+        Dwarf_Error error = 0;
+        dwarf_pe_finish(image->dbg, &error);
+    }
+    pe_image_unref(image->pe);
+}
+
+
+static void
+appendf(std::string &output, const char *format, ...)
+{
+    char buffer[512];
+    va_list ap;
+    va_start(ap, format);
+    int len = vsnprintf(buffer, sizeof buffer, format, ap);
+    va_end(ap);
+    if (len > 0) {
+        output.append(buffer, std::min<size_t>(len, sizeof buffer - 1));
+    }
+}
+
+
+/*
+ * Append one frame, GNU addr2line style.
+ */
+static void
+appendFrame(std::string &output, const struct options *options, bool inlinedBy,
+            const char *szFunction, const char *szFileName, unsigned line)
+{
+    if (inlinedBy && options->pretty) {
+        output += " (inlined by) ";
+    }
+
+    if (options->functions) {
+        char *szDemangled = NULL;
+        if (szFunction && options->demangle) {
+            szDemangled = cplus_demangle_v3(szFunction, DMGL_PARAMS | DMGL_ANSI);
+        }
+        output += szDemangled ? szDemangled : szFunction ? szFunction : "??";
+        // Like GNU addr2line, which omits the "at" for unknown functions
+        output += options->pretty ? (szFunction ? " at " : " ") : "\n";
+        free(szDemangled);
+    }
+
+    if (szFileName) {
+        if (options->basenames) {
+            szFileName = getBaseName(szFileName);
+        }
+        appendf(output, "%s:%u\n", szFileName, line);
+    } else {
+        output += "??:0\n";
+    }
+}
+
+
+/*
+ * Resolve an address, appending the result to output.
+ *
+ * Only reads from the image's indices, so it may run concurrently.
+ */
+static void
+resolveAddress(const struct image *image, const struct options *options, uint64_t addr, std::string &output)
+{
+    struct find_dwarf_info info;
+    memset(&info, 0, sizeof info);
+    struct find_dwarf_inline inlines[64];
+    unsigned inlineCount = 0;
+    if (image->cache) {
+        dwarf_cache_find(image->cache, addr, &info);
+        if (options->inlines) {
+            inlineCount = dwarf_cache_find_inlines(image->cache, addr, inlines, 64);
+        }
+    } else if (image->dbg) {
+        find_dwarf_symbol(image->dbg, image->functions, image->lines, addr, &info);
+        if (options->inlines) {
+            inlineCount = find_dwarf_inlines(image->functions, addr, inlines, 64);
+        }
+    }
+    inlineCount = std::min(inlineCount, 64U);
+
+    if (options->addresses) {
+        appendf(output, "0x%0*" PRIx64 "%s", image->addressWidth, addr, options->pretty ? ": " : "\n");
+    }
+
+    char szSymbolName[1024];
+    const char *szFunction = info.functionname;
+    if (!szFunction && options->functions) {
+        DWORD64 SymbolAddr;
+        DWORD64 SymbolSize;
+        if (pe_find_symbol(image->symbols, addr, sizeof szSymbolName, szSymbolName, &SymbolAddr, &SymbolSize)) {
+            szSymbolName[sizeof szSymbolName - 1] = '\0';
+            szFunction = szSymbolName;
+        }
+    }
+
+    // Innermost inlined subroutine first, each at the call site of the
+    // previous one, and the outermost function last
+    const char *szFileName = info.filename;
+    unsigned line = info.line;
+    for (unsigned i = 0; i < inlineCount; ++i) {
+        appendFrame(output, options, i > 0, inlines[i].functionname, szFileName, line);
+        szFileName = inlines[i].callfile;
+        line = inlines[i].callline;
+    }
+    appendFrame(output, options, inlineCount > 0, szFunction, szFileName, line);
+}
+
+
+/*
+ * A contiguous slice of a batch, resolved by one thread.
+ */
+struct job
+{
+    const struct image *image;
+    const struct options *options;
+    const uint64_t *addresses;
+    size_t count;
+    std::string output;
+};
+
+
+static void
+runJob(void *arg)
+{
+    struct job *job = (struct job *)arg;
+    for (size_t i = 0; i < job->count; ++i) {
+        resolveAddress(job->image, job->options, job->addresses[i], job->output);
+    }
+}
+
+
+/*
+ * Resolve pending addresses across options->jobs threads, and print the
+ * results in the original order.
+ */
+static void
+resolveBatch(const struct image *image, const struct options *options, std::vector<uint64_t> &addresses)
+{
+    // Not worth spawning threads for a handful of addresses
+    size_t jobCount = std::min<size_t>(options->jobs, addresses.size() / 64);
+    if (jobCount < 1) {
+        jobCount = 1;
+    }
+
+    std::vector<job> jobs(jobCount);
+    size_t begin = 0;
+    for (size_t i = 0; i < jobCount; ++i) {
+        size_t end = addresses.size() * (i + 1) / jobCount;
+        jobs[i].image = image;
+        jobs[i].options = options;
+        jobs[i].addresses = addresses.data() + begin;
+        jobs[i].count = end - begin;
+        begin = end;
+    }
+
+    // The calling thread takes the first slice
+    std::vector<thread_t> threads(jobCount);
+    std::vector<bool> started(jobCount, false);
+    for (size_t i = 1; i < jobCount; ++i) {
+        started[i] = thread_create(&threads[i], runJob, &jobs[i]);
+    }
+    runJob(&jobs[0]);
+    for (size_t i = 1; i < jobCount; ++i) {
+        if (started[i]) {
+            thread_join(threads[i]);
+        } else {
+            runJob(&jobs[i]);
+        }
+    }
+
+    for (size_t i = 0; i < jobCount; ++i) {
+        fwrite(jobs[i].output.data(), 1, jobs[i].output.size(), stdout);
+    }
+
+    addresses.clear();
+}
+
+
+/*
+ * Resolve all whitespace separated addresses in a stream.
+ */
+static void
+resolveStream(const struct image *image, const struct options *options, FILE *fp, bool interactive)
+{
+    // Large enough batches for all threads to get a decent share
+    size_t batchSize = 1024 * options->jobs;
+
+    std::vector<uint64_t> addresses;
+    char szLine[4096];
+    while (fgets(szLine, sizeof szLine, fp)) {
+        static const char szSpace[] = " \t\r\n";
+        char *p = szLine;
+        while (*(p += strspn(p, szSpace))) {
+            size_t len = strcspn(p, szSpace);
+            addresses.push_back(strtoull(p, NULL, 16));
+            p += len;
+        }
+
+        // So that one typing addresses gets each answer right away
+        if (interactive) {
+            resolveBatch(image, options, addresses);
+            fflush(stdout);
+        } else if (addresses.size() >= batchSize) {
+            resolveBatch(image, options, addresses);
+        }
+    }
+
+    resolveBatch(image, options, addresses);
+}
+
+
+static int
+streamMain(const char *szImageName, const struct options *options, int argc, char **argv)
+{
+    struct image image;
+    if (!openImage(&image, szImageName)) {
+        fprintf(stderr, "addr2line: error: failed to open %s\n", szImageName);
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 0) {
+        resolveStream(&image, options, stdin, isatty(fileno(stdin)) != 0);
+    }
+
+    std::vector<uint64_t> addresses;
+    for (int i = 0; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] == '@') {
+            resolveBatch(&image, options, addresses);
+            FILE *fp = fopen(&arg[1], "rt");
+            if (!fp) {
+                fprintf(stderr, "addr2line: error: failed to open %s\n", &arg[1]);
+                closeImage(&image);
+                return EXIT_FAILURE;
+            }
+            resolveStream(&image, options, fp, false);
+            fclose(fp);
+        } else {
+            addresses.push_back(strtoull(arg, NULL, 16));
+        }
+    }
+    resolveBatch(&image, options, addresses);
+
+    closeImage(&image);
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+Usage(void)
+{
+    fputs("usage: addr2line [options] [-e] <image> [addr|@file] ...\n"
+          "\n"
+          "Resolves image VMAs given as arguments, in files, or from stdin.\n"
+          "\n"
+          "options:\n"
+          "  -?         displays command line help text\n"
+          "  -a         show addresses\n"
+          "  -C         demangle function names\n"
+          "  -e IMAGE   image to resolve addresses against\n"
+          "  -f         show function names\n"
+          "  -i         show inlined frames\n"
+          "  -j N       resolve addresses on N threads\n"
+          "  -p         print each address on a single line\n"
+          "  -s         strip directories from file names\n"
+          "\n"
+          "Set MGWHELP_CACHE_DIR to keep each image's symbol index on disk between runs.\n"
+#ifdef _WIN32
+          "\n"
+          "Without options, addresses are offsets relative to the module base,\n"
+          "and are resolved through DbgHelp with verbose output.\n"
+#endif
+          ,
+          stderr);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    struct options options;
+    memset(&options, 0, sizeof options);
+    options.jobs = 1;
+    const char *szImageName = NULL;
+    bool stream = false;
+
+    while (1) {
+        int opt = getopt(argc, argv, "?aCe:fhij:ps");
+
+        switch (opt) {
+        case 'h':
+            Usage();
+            return 0;
+        case 'a':
+            options.addresses = true;
+            break;
+        case 'C':
+            options.demangle = true;
+            break;
+        case 'e':
+            szImageName = optarg;
+            break;
+        case 'f':
+            options.functions = true;
+            break;
+        case 'i':
+            options.inlines = true;
+            break;
+        case 'j':
+            options.jobs = strtoul(optarg, NULL, 0);
+            if (options.jobs < 1) {
+                fprintf(stderr, "addr2line: error: invalid number of jobs %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p':
+            options.pretty = true;
+            break;
+        case 's':
+            options.basenames = true;
+            break;
+        case '?':
+            if (optopt == '?') {
+                Usage();
+                return 0;
+            }
+            Usage();
+            return EXIT_FAILURE;
+        default:
+            opt = -1;
+            break;
+        }
+
+        if (opt == -1) {
+            break;
+        }
+
+        stream = true;
+    }
+
+    if (!szImageName) {
+        if (optind >= argc) {
+            Usage();
+            return EXIT_FAILURE;
+        }
+        szImageName = argv[optind++];
+    }
+
+#ifdef _WIN32
+    if (!stream && optind < argc) {
+        return dbghelpMain(szImageName, argc - optind, argv + optind);
+    }
+#else
+    (void)stream;
+#endif
+
+    return streamMain(szImageName, &options, argc - optind, argv + optind);
+}
@@ -146,7 +146,9 @@ Usage(void)
           "  -v         enables verbose output from the debugger\n"
           "  -t SECONDS specifies a timeout in seconds \n"
           "  -1         dump stack on first chance exceptions \n"
-          "  -H         use debug heap\n" ,
+          "  -H         use debug heap\n"
+          "  -u         unwind MinGW frames with DWARF call frame information\n"
+          "  -j         report in JSON lines rather than text\n" ,
           stderr);
 }
 
@@ -267,7 +269,7 @@ main(int argc, char** argv)
 
     bool debugHeap = false;
     while (1) {
-        int opt = getopt(argc, argv, "?1dhHt:v");
+        int opt = getopt(argc, argv, "?1dhHjt:uv");
 
         switch (opt) {
         case 'h':
@@ -288,6 +290,12 @@ main(int argc, char** argv)
         case 'H':
             debugHeap = true;
             break;
+        case 'u':
+            setDwarfUnwind(TRUE);
+            break;
+        case 'j':
+            setJsonReport(TRUE);
+            break;
         case '?':
             if (optopt == '?') {
                 Usage();
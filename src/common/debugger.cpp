@@ -127,7 +127,7 @@ static BOOL
 symCallbackDeferedSymbol(const char *szVerb, ULONG64 CallbackData)
 {
     PIMAGEHLP_DEFERRED_SYMBOL_LOAD64 pData = (PIMAGEHLP_DEFERRED_SYMBOL_LOAD64)(UINT_PTR)CallbackData;
-    lprintf("%s deferred symbol load of: %s (hFile = %p)\n", szVerb, pData->FileName, pData->hFile);
+    lprintfMessage("message", "%s deferred symbol load of: %s (hFile = %p)\n", szVerb, pData->FileName, pData->hFile);
     return FALSE;
 }
 
@@ -139,14 +139,14 @@ symCallback(HANDLE hProcess,
             ULONG64 UserContext)
 {
     if (ActionCode == CBA_DEBUG_INFO) {
-        lprintf("%s", (LPCSTR)(UINT_PTR)CallbackData);
+        lprintfMessage("message", "%s", (LPCSTR)(UINT_PTR)CallbackData);
         return TRUE;
     }
 
     if (1) {
         if (ActionCode == CBA_DEFERRED_SYMBOL_LOAD_PARTIAL) {
             PIMAGEHLP_DEFERRED_SYMBOL_LOAD64 pData = (PIMAGEHLP_DEFERRED_SYMBOL_LOAD64)(UINT_PTR)CallbackData;
-            lprintf("error: partial symbol load of %s\n", pData->FileName);
+            lprintfMessage("message", "error: partial symbol load of %s\n", pData->FileName);
             return FALSE;
         }
     } else {
@@ -354,11 +354,11 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
             // status parameter (dwContinueStatus). This value
             // is used by the ContinueDebugEvent function.
             if (pOptions->verbose_flag) {
-                lprintf("EXCEPTION PID=%lu TID=%lu ExceptionCode=0x%lx dwFirstChance=%lu\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        pExceptionRecord->ExceptionCode,
-                        DebugEvent.u.Exception.dwFirstChance
+                lprintfMessage("event", "EXCEPTION PID=%lu TID=%lu ExceptionCode=0x%lx dwFirstChance=%lu\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               pExceptionRecord->ExceptionCode,
+                               DebugEvent.u.Exception.dwFirstChance
                 );
             }
 
@@ -388,7 +388,7 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
                                 dwRet = ResumeThread(hThread);
                             }
                             if (dwRet == dwFailed) {
-                                lprintf("error: failed to resume thread %lu\n", dwThreadId);
+                                lprintfMessage("message", "error: failed to resume thread %lu\n", dwThreadId);
                             }
                         }
 
@@ -435,8 +435,11 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
                 }
             }
 
+            beginReport();
+
             dumpException(pProcessInfo->hProcess,
                           &DebugEvent.u.Exception.ExceptionRecord);
+            flushReport();
 
             // Find the thread in the thread list
             THREAD_INFO_LIST::const_iterator it;
@@ -452,8 +455,11 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
                 }
 
                 dumpStack(pProcessInfo->hProcess, hThread, NULL);
+                flushReport();
             }
 
+            endReport();
+
             if (!DebugEvent.u.Exception.dwFirstChance) {
                 /*
                  * Terminate the process. As continuing would cause the JIT debugger
@@ -468,9 +474,9 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case CREATE_THREAD_DEBUG_EVENT:
             if (pOptions->verbose_flag) {
-                lprintf("CREATE_THREAD PID=%lu TID=%lu\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId
+                lprintfMessage("event", "CREATE_THREAD PID=%lu TID=%lu\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId
                 );
             }
 
@@ -492,11 +498,11 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
             if (pOptions->verbose_flag) {
                 PCSTR lpModuleName = lpImageName ? getBaseName(lpImageName) : "";
 
-                lprintf("CREATE_PROCESS PID=%lu TID=%lu lpBaseOfImage=%p %s\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        DebugEvent.u.CreateProcessInfo.lpBaseOfImage,
-                        lpModuleName
+                lprintfMessage("event", "CREATE_PROCESS PID=%lu TID=%lu lpBaseOfImage=%p %s\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               DebugEvent.u.CreateProcessInfo.lpBaseOfImage,
+                               lpModuleName
                 );
             }
 
@@ -522,10 +528,10 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case EXIT_THREAD_DEBUG_EVENT:
             if (pOptions->verbose_flag) {
-                lprintf("EXIT_THREAD PID=%lu TID=%lu dwExitCode=0x%lx\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        DebugEvent.u.ExitThread.dwExitCode
+                lprintfMessage("event", "EXIT_THREAD PID=%lu TID=%lu dwExitCode=0x%lx\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               DebugEvent.u.ExitThread.dwExitCode
                 );
             }
 
@@ -544,10 +550,10 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case EXIT_PROCESS_DEBUG_EVENT: {
             if (pOptions->verbose_flag) {
-                lprintf("EXIT_PROCESS PID=%lu TID=%lu dwExitCode=0x%lx\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        DebugEvent.u.ExitProcess.dwExitCode
+                lprintfMessage("event", "EXIT_PROCESS PID=%lu TID=%lu dwExitCode=0x%lx\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               DebugEvent.u.ExitProcess.dwExitCode
                 );
             }
 
@@ -586,11 +592,11 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
             if (pOptions->verbose_flag) {
                 PCSTR lpModuleName = lpImageName ? getBaseName(lpImageName) : "";
 
-                lprintf("LOAD_DLL PID=%lu TID=%lu lpBaseOfDll=%p %s\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        DebugEvent.u.LoadDll.lpBaseOfDll,
-                        lpModuleName
+                lprintfMessage("event", "LOAD_DLL PID=%lu TID=%lu lpBaseOfDll=%p %s\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               DebugEvent.u.LoadDll.lpBaseOfDll,
+                               lpModuleName
                 );
             }
 
@@ -604,10 +610,10 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case UNLOAD_DLL_DEBUG_EVENT:
             if (pOptions->verbose_flag) {
-                lprintf("UNLOAD_DLL PID=%lu TID=%lu lpBaseOfDll=%p\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId,
-                        DebugEvent.u.UnloadDll.lpBaseOfDll
+                lprintfMessage("event", "UNLOAD_DLL PID=%lu TID=%lu lpBaseOfDll=%p\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId,
+                               DebugEvent.u.UnloadDll.lpBaseOfDll
                 );
             }
 
@@ -620,9 +626,9 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case OUTPUT_DEBUG_STRING_EVENT: {
             if (pOptions->verbose_flag) {
-                lprintf("OUTPUT_DEBUG_STRING PID=%lu TID=%lu\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId
+                lprintfMessage("event", "OUTPUT_DEBUG_STRING PID=%lu TID=%lu\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId
                 );
             }
 
@@ -634,7 +640,7 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
                                                         DebugEvent.u.DebugString.lpDebugStringData,
                                                         DebugEvent.u.DebugString.nDebugStringLength);
 
-            lprintf("%s", lpDebugStringData);
+            lprintfMessage("debug_string", "%s", lpDebugStringData);
 
             free(lpDebugStringData);
             break;
@@ -642,19 +648,19 @@ BOOL DebugMainLoop(const DebugOptions *pOptions)
 
         case RIP_EVENT:
             if (pOptions->verbose_flag) {
-                lprintf("RIP PID=%lu TID=%lu\n",
-                        DebugEvent.dwProcessId,
-                        DebugEvent.dwThreadId
+                lprintfMessage("event", "RIP PID=%lu TID=%lu\n",
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId
                 );
             }
             break;
 
         default:
             if (pOptions->verbose_flag) {
-                lprintf("EVENT%lu PID=%lu TID=%lu\n",
-                    DebugEvent.dwDebugEventCode,
-                    DebugEvent.dwProcessId,
-                    DebugEvent.dwThreadId
+                lprintfMessage("event", "EVENT%lu PID=%lu TID=%lu\n",
+                               DebugEvent.dwDebugEventCode,
+                               DebugEvent.dwProcessId,
+                               DebugEvent.dwThreadId
                 );
             }
             break;
@@ -27,11 +27,14 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "outdbg.h"
 #include "paths.h"
 #include "symbols.h"
+#include "mgwhelp.h"
 #include "log.h"
+#include "thread.h"
 
 
 #ifndef STATUS_CPP_EH_EXCEPTION
@@ -59,6 +62,137 @@ setDumpCallback(DumpCallback cb)
 }
 
 
+static BOOL g_bDwarfUnwind = FALSE;
+
+
+void
+setDwarfUnwind(BOOL bEnable)
+{
+    g_bDwarfUnwind = bEnable;
+}
+
+
+static BOOL g_bJsonReport = FALSE;
+
+
+void
+setJsonReport(BOOL bEnable)
+{
+    g_bJsonReport = bEnable;
+}
+
+
+/*
+ * Report being built, by the thread in g_dwReportThreadId.  The memory comes
+ * straight from VirtualAlloc, as the CRT heap may well be what crashed, and is
+ * kept for the next report.
+ */
+static volatile LONG g_dwReportThreadId = 0;
+static unsigned g_nReportDepth = 0;
+static DWORD g_dwReportId = 0;
+static DWORD g_dwReportSeq = 0;
+static char *g_pReport = NULL;
+static size_t g_cbReport = 0;
+static size_t g_cbReportAlloc = 0;
+
+
+static BOOL
+reserveReport(size_t cbNeeded)
+{
+    if (g_cbReport + cbNeeded < g_cbReportAlloc) {
+        return TRUE;
+    }
+
+    size_t cbAlloc = g_cbReportAlloc ? g_cbReportAlloc * 2 : 64 * 1024;
+    while (g_cbReport + cbNeeded >= cbAlloc) {
+        cbAlloc *= 2;
+    }
+
+    char *pReport = (char *)VirtualAlloc(NULL, cbAlloc, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!pReport) {
+        return FALSE;
+    }
+    if (g_pReport) {
+        memcpy(pReport, g_pReport, g_cbReport);
+        VirtualFree(g_pReport, 0, MEM_RELEASE);
+    }
+    g_pReport = pReport;
+    g_cbReportAlloc = cbAlloc;
+    return TRUE;
+}
+
+
+void
+flushReport(void)
+{
+    if (g_dwReportThreadId != (LONG)GetCurrentThreadId()) {
+        return;
+    }
+
+    if (g_cbReport) {
+        g_pReport[g_cbReport] = '\0';
+        g_Cb(g_pReport);
+        g_cbReport = 0;
+    }
+}
+
+
+void
+beginReport(void)
+{
+    LONG dwThreadId = (LONG)GetCurrentThreadId();
+    if (g_dwReportThreadId == dwThreadId) {
+        ++g_nReportDepth;
+    } else if (InterlockedCompareExchange(&g_dwReportThreadId, dwThreadId, 0) == 0) {
+        g_nReportDepth = 1;
+        ++g_dwReportId;
+        g_dwReportSeq = 0;
+    }
+}
+
+
+static void
+freeSourceFiles(void);
+
+
+void
+endReport(void)
+{
+    if (g_dwReportThreadId != (LONG)GetCurrentThreadId()) {
+        return;
+    }
+
+    assert(g_nReportDepth > 0);
+    if (--g_nReportDepth == 0) {
+        flushReport();
+        InterlockedExchange(&g_dwReportThreadId, 0);
+        freeSourceFiles();
+    }
+}
+
+
+/*
+ * Same as lprintf("%s", szText), but without truncating long text.
+ */
+static void
+lputs(const char *szText)
+{
+    if (g_dwReportThreadId == (LONG)GetCurrentThreadId()) {
+        size_t cbText = strlen(szText);
+        if (reserveReport(cbText)) {
+            memcpy(g_pReport + g_cbReport, szText, cbText);
+            g_cbReport += cbText;
+            return;
+        }
+
+        // Out of memory, so stop batching
+        flushReport();
+    }
+
+    g_Cb(szText);
+}
+
+
 #ifdef __GNUC__
     __attribute__ ((format (printf, 1, 2)))
 #endif
@@ -72,17 +206,152 @@ int lprintf(const char * format, ...)
     retValue = _vsnprintf(szBuffer, sizeof szBuffer, format, ap);
     va_end(ap);
 
-    g_Cb(szBuffer);
+    // _vsnprintf doesn't terminate truncated output
+    szBuffer[sizeof szBuffer - 1] = '\0';
+
+    lputs(szBuffer);
 
     return retValue;
 }
 
 
+/*
+ * Print a JSON string literal.  Text is in the ANSI code page, as given by
+ * the *A APIs, so any other characters are converted to UTF-8.
+ */
+static void
+jsonString(const char *s)
+{
+    char szBuffer[256];
+    size_t cbBuffer = 0;
+
+    szBuffer[cbBuffer++] = '"';
+    for (; *s; ++s) {
+        // Room for the longest escape or UTF-8 sequence, plus the closing
+        // quote
+        if (cbBuffer + 8 > sizeof szBuffer) {
+            szBuffer[cbBuffer] = '\0';
+            lputs(szBuffer);
+            cbBuffer = 0;
+        }
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            szBuffer[cbBuffer++] = '\\';
+            szBuffer[cbBuffer++] = c;
+        } else if (c < 0x20) {
+            cbBuffer += _snprintf(szBuffer + cbBuffer, 7, "\\u%04x", c);
+        } else if (c < 0x80) {
+            szBuffer[cbBuffer++] = c;
+        } else {
+            int cbChar = IsDBCSLeadByte(c) && s[1] ? 2 : 1;
+            WCHAR wc[2];
+            int cchWide = MultiByteToWideChar(CP_ACP, 0, s, cbChar, wc, 2);
+            int cbUtf8 = cchWide ? WideCharToMultiByte(CP_UTF8, 0, wc, cchWide, szBuffer + cbBuffer, 6, NULL, NULL) : 0;
+            if (cbUtf8 > 0) {
+                cbBuffer += cbUtf8;
+            } else {
+                cbBuffer += _snprintf(szBuffer + cbBuffer, 7, "\\ufffd");
+            }
+            s += cbChar - 1;
+        }
+    }
+    szBuffer[cbBuffer++] = '"';
+    szBuffer[cbBuffer] = '\0';
+    lputs(szBuffer);
+}
+
+
+/*
+ * Start a JSON record.  Every record names the report it belongs to, and its
+ * position within it.
+ */
+static void
+jsonBegin(const char *szType)
+{
+    DWORD dwReportId = 0;
+    DWORD dwSeq = 0;
+    if (g_dwReportThreadId == (LONG)GetCurrentThreadId()) {
+        dwReportId = g_dwReportId;
+        dwSeq = g_dwReportSeq++;
+    }
+    lprintf("{\"report\":%lu,\"seq\":%lu,\"type\":\"%s\"", dwReportId, dwSeq, szType);
+}
+
+
+/*
+ * End a JSON record, and pass it on right away rather than when the report
+ * ends, so that consumers see each record as soon as it is produced.
+ */
+static void
+jsonEnd(void)
+{
+    lprintf("}\n");
+    flushReport();
+}
+
+
+#ifdef __GNUC__
+    __attribute__ ((format (printf, 2, 3)))
+#endif
+void lprintfMessage(const char *szType, const char * format, ...)
+{
+    char szBuffer[1024];
+    va_list ap;
+
+    va_start(ap, format);
+    _vsnprintf(szBuffer, sizeof szBuffer, format, ap);
+    va_end(ap);
+
+    // _vsnprintf doesn't terminate truncated output
+    szBuffer[sizeof szBuffer - 1] = '\0';
+
+    if (g_bJsonReport) {
+        jsonBegin(szType);
+        lprintf(",\"text\":");
+        jsonString(szBuffer);
+        jsonEnd();
+    } else {
+        lputs(szBuffer);
+    }
+}
+
+
+/*
+ * One stack frame as a JSON line.  Inlined functions get frames of their own,
+ * at the same pc, with inline depths counting from 1 for the outermost.
+ */
+static void
+jsonFrame(DWORD dwThreadId, DWORD dwFrame, DWORD dwInlineDepth, DWORD64 AddrPC,
+          HMODULE hModule, LPCSTR szModule, LPCSTR szSymName,
+          LPCSTR szFileName, DWORD dwLineNumber)
+{
+    jsonBegin("frame");
+    lprintf(",\"thread\":%lu,\"frame\":%lu,\"inline\":%lu,\"pc\":\"0x%I64x\"",
+            dwThreadId, dwFrame, dwInlineDepth, AddrPC);
+    if (szModule) {
+        lprintf(",\"module\":");
+        jsonString(getBaseName(szModule));
+        lprintf(",\"offset\":\"0x%I64x\"", AddrPC - (DWORD64)(UINT_PTR)hModule);
+    }
+    if (szSymName) {
+        lprintf(",\"symbol\":");
+        jsonString(szSymName);
+    }
+    if (szFileName) {
+        lprintf(",\"file\":");
+        jsonString(szFileName);
+        lprintf(",\"line\":%lu", dwLineNumber);
+    }
+    jsonEnd();
+}
+
+
 static BOOL
 dumpSourceCode(LPCSTR lpFileName, DWORD dwLineNumber);
 
 
 #define MAX_SYM_NAME_SIZE 512
+#define MAX_INLINE_FRAMES 16
 
 
 static void
@@ -94,6 +363,11 @@ dumpContext(
 #endif
 )
 {
+    // Not part of the JSON report
+    if (g_bJsonReport) {
+        return;
+    }
+
     // Show the registers
     lprintf("Registers:\n");
     if (pContext->ContextFlags & CONTEXT_INTEGER) {
@@ -155,6 +429,54 @@ dumpContext(
 }
 
 
+/*
+ * Copy the program counter, stack and frame pointers between a context and a
+ * stack frame.
+ */
+static void
+getContextFrame(DWORD MachineType, PCONTEXT pContext, LPSTACKFRAME64 pStackFrame)
+{
+#ifdef _WIN64
+    if (MachineType == IMAGE_FILE_MACHINE_I386) {
+        PWOW64_CONTEXT pWow64Context = (PWOW64_CONTEXT)pContext;
+        pStackFrame->AddrPC.Offset = pWow64Context->Eip;
+        pStackFrame->AddrStack.Offset = pWow64Context->Esp;
+        pStackFrame->AddrFrame.Offset = pWow64Context->Ebp;
+    } else {
+        pStackFrame->AddrPC.Offset = pContext->Rip;
+        pStackFrame->AddrStack.Offset = pContext->Rsp;
+        pStackFrame->AddrFrame.Offset = pContext->Rbp;
+    }
+#else
+    pStackFrame->AddrPC.Offset = pContext->Eip;
+    pStackFrame->AddrStack.Offset = pContext->Esp;
+    pStackFrame->AddrFrame.Offset = pContext->Ebp;
+#endif
+}
+
+
+static void
+setContextFrame(DWORD MachineType, PCONTEXT pContext, const STACKFRAME64 *pStackFrame)
+{
+#ifdef _WIN64
+    if (MachineType == IMAGE_FILE_MACHINE_I386) {
+        PWOW64_CONTEXT pWow64Context = (PWOW64_CONTEXT)pContext;
+        pWow64Context->Eip = (DWORD)pStackFrame->AddrPC.Offset;
+        pWow64Context->Esp = (DWORD)pStackFrame->AddrStack.Offset;
+        pWow64Context->Ebp = (DWORD)pStackFrame->AddrFrame.Offset;
+    } else {
+        pContext->Rip = pStackFrame->AddrPC.Offset;
+        pContext->Rsp = pStackFrame->AddrStack.Offset;
+        pContext->Rbp = pStackFrame->AddrFrame.Offset;
+    }
+#else
+    pContext->Eip = (DWORD)pStackFrame->AddrPC.Offset;
+    pContext->Esp = (DWORD)pStackFrame->AddrStack.Offset;
+    pContext->Ebp = (DWORD)pStackFrame->AddrFrame.Offset;
+#endif
+}
+
+
 // http://wiki.winehq.org/DeveloperFaq#detect-wine
 static inline BOOL
 isInsideWine(void)
@@ -186,6 +508,8 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
         assert((pTargetContext->ContextFlags & CONTEXT_FULL) == CONTEXT_FULL);
     }
 
+    beginReport();
+
 #ifdef _WIN64
     BOOL bWow64 = FALSE;
     WOW64_CONTEXT Wow64Context;
@@ -196,6 +520,7 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
         Wow64Context.ContextFlags = WOW64_CONTEXT_FULL;
         if (!Wow64GetThreadContext(hThread, &Wow64Context)) {
             // XXX: This happens with WINE after EXIT_PROCESS_DEBUG_EVENT
+            endReport();
             return;
         }
         assert(pTargetContext == NULL);
@@ -216,6 +541,7 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
         } else {
             if (!GetThreadContext(hThread, &Context)) {
                 // XXX: This happens with WINE after EXIT_PROCESS_DEBUG_EVENT
+                endReport();
                 return;
             }
         }
@@ -241,7 +567,12 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
 #endif
     }
 
-    if (MachineType == IMAGE_FILE_MACHINE_I386) {
+    DWORD dwThreadId = GetThreadId(hThread);
+    if (g_bJsonReport) {
+        jsonBegin("thread");
+        lprintf(",\"thread\":%lu", dwThreadId);
+        jsonEnd();
+    } else if (MachineType == IMAGE_FILE_MACHINE_I386) {
         lprintf( "AddrPC   Params\n" );
     } else {
         lprintf( "AddrPC           Params\n" );
@@ -251,43 +582,44 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
 
     DWORD64 PrevFrameStackOffset = StackFrame.AddrStack.Offset - 1;
     int nudge = 0;
+    DWORD dwFrame = 0;
 
     while (TRUE) {
         char szSymName[MAX_SYM_NAME_SIZE] = "";
         char szFileName[MAX_PATH] = "";
         DWORD dwLineNumber = 0;
 
-        if (!StackWalk64(
-                MachineType,
-                hProcess,
-                hThread,
-                &StackFrame,
-                pContext,
-                NULL, // ReadMemoryRoutine
-                SymFunctionTableAccess64,
-                SymGetModuleBase64,
-                NULL // TranslateAddress
+        /*
+         * MinGW code built with -fomit-frame-pointer can only be unwound with
+         * its DWARF call frame information, so try that first when enabled,
+         * and fall back to StackWalk64 for frames without it.  The context is
+         * then kept in sync with the frame, as StackWalk64 only updates the
+         * former on x64.
+         */
+        if (g_bDwarfUnwind && dwFrame > 0 &&
+            MgwUnwindContext(hProcess, MachineType, pContext, dwFrame > 1)) {
+            getContextFrame(MachineType, pContext, &StackFrame);
+            ZeroMemory(StackFrame.Params, sizeof StackFrame.Params);
+        } else {
+            if (!StackWalk64(
+                    MachineType,
+                    hProcess,
+                    hThread,
+                    &StackFrame,
+                    pContext,
+                    NULL, // ReadMemoryRoutine
+                    SymFunctionTableAccess64,
+                    SymGetModuleBase64,
+                    NULL // TranslateAddress
+                )
             )
-        )
-            break;
+                break;
 
-        if (MachineType == IMAGE_FILE_MACHINE_I386) {
-            lprintf(
-                "%08lX %08lX %08lX %08lX",
-                (DWORD)StackFrame.AddrPC.Offset,
-                (DWORD)StackFrame.Params[0],
-                (DWORD)StackFrame.Params[1],
-                (DWORD)StackFrame.Params[2]
-            );
-        } else {
-            lprintf(
-                "%016I64X %016I64X %016I64X %016I64X",
-                StackFrame.AddrPC.Offset,
-                StackFrame.Params[0],
-                StackFrame.Params[1],
-                StackFrame.Params[2]
-            );
+            if (g_bDwarfUnwind && MachineType == IMAGE_FILE_MACHINE_I386) {
+                setContextFrame(MachineType, pContext, &StackFrame);
+            }
         }
+        ++dwFrame;
 
         BOOL bSymbol = TRUE;
         BOOL bLine = FALSE;
@@ -295,28 +627,109 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
         DWORD64 AddrPC = StackFrame.AddrPC.Offset;
         HMODULE hModule = (HMODULE)(INT_PTR)SymGetModuleBase64(hProcess, AddrPC);
         char szModule[MAX_PATH];
-        if (hModule &&
-            GetModuleFileNameExA(hProcess, hModule, szModule, MAX_PATH)) {
-
-            lprintf( "  %s", getBaseName(szModule));
+        BOOL bModule = hModule &&
+                       GetModuleFileNameExA(hProcess, hModule, szModule, MAX_PATH);
 
+        /*
+         * Functions inlined at this address get a frame of their own, with no
+         * parameters, innermost first.  The innermost one is where the line
+         * table points to, and each is called from where the next says.
+         */
+        MGWHELP_INLINE_FRAME InlineFrames[MAX_INLINE_FRAMES];
+        DWORD dwInlineCount = 0;
+        if (bModule) {
+            dwInlineCount = MgwSymGetInlineFrames(hProcess, AddrPC + nudge, MAX_INLINE_FRAMES, InlineFrames);
+            if (dwInlineCount > MAX_INLINE_FRAMES) {
+                dwInlineCount = MAX_INLINE_FRAMES;
+            }
             bSymbol = GetSymFromAddr(hProcess, AddrPC + nudge, szSymName, MAX_SYM_NAME_SIZE);
             if (bSymbol) {
-                lprintf( "!%s", szSymName);
-
                 bLine = GetLineFromAddr(hProcess, AddrPC + nudge, szFileName, MAX_PATH, &dwLineNumber);
+            }
+        }
+
+        for (DWORD i = 0; i < dwInlineCount; ++i) {
+            if (g_bJsonReport) {
+                jsonFrame(dwThreadId, dwFrame - 1, dwInlineCount - i, AddrPC, hModule, szModule,
+                          InlineFrames[i].Name,
+                          i ? InlineFrames[i - 1].CallFileName : bLine ? szFileName : NULL,
+                          i ? InlineFrames[i - 1].CallLineNumber : dwLineNumber);
+                continue;
+            }
+
+            if (MachineType == IMAGE_FILE_MACHINE_I386) {
+                lprintf("%08lX %-26s", (DWORD)AddrPC, "");
+            } else {
+                lprintf("%016I64X %-50s", AddrPC, "");
+            }
+
+            lprintf( "  %s!%s", getBaseName(szModule), InlineFrames[i].Name);
+            if (i == 0) {
                 if (bLine) {
                     lprintf( "  [%s @ %ld]", szFileName, dwLineNumber);
                 }
             } else {
-                lprintf( "!0x%I64x", AddrPC - (DWORD)(INT_PTR)hModule);
+                lprintf( "  [%s @ %ld]", InlineFrames[i - 1].CallFileName, InlineFrames[i - 1].CallLineNumber);
+            }
+            lprintf("\n");
+
+            if (i == 0 && bLine) {
+                dumpSourceCode(szFileName, dwLineNumber);
             }
         }
 
-        lprintf("\n");
+        if (dwInlineCount) {
+            // The outer function is at the call site of the outermost inline
+            bLine = TRUE;
+            strncpy(szFileName, InlineFrames[dwInlineCount - 1].CallFileName, MAX_PATH);
+            szFileName[MAX_PATH - 1] = '\0';
+            dwLineNumber = InlineFrames[dwInlineCount - 1].CallLineNumber;
+        }
+
+        if (g_bJsonReport) {
+            jsonFrame(dwThreadId, dwFrame - 1, 0, AddrPC, hModule,
+                      bModule ? szModule : NULL,
+                      bModule && bSymbol ? szSymName : NULL,
+                      bModule && bSymbol && bLine ? szFileName : NULL,
+                      dwLineNumber);
+        } else {
+            if (MachineType == IMAGE_FILE_MACHINE_I386) {
+                lprintf(
+                    "%08lX %08lX %08lX %08lX",
+                    (DWORD)StackFrame.AddrPC.Offset,
+                    (DWORD)StackFrame.Params[0],
+                    (DWORD)StackFrame.Params[1],
+                    (DWORD)StackFrame.Params[2]
+                );
+            } else {
+                lprintf(
+                    "%016I64X %016I64X %016I64X %016I64X",
+                    StackFrame.AddrPC.Offset,
+                    StackFrame.Params[0],
+                    StackFrame.Params[1],
+                    StackFrame.Params[2]
+                );
+            }
+
+            if (bModule) {
+                lprintf( "  %s", getBaseName(szModule));
+
+                if (bSymbol) {
+                    lprintf( "!%s", szSymName);
 
-        if (bLine) {
-            dumpSourceCode(szFileName, dwLineNumber);
+                    if (bLine) {
+                        lprintf( "  [%s @ %ld]", szFileName, dwLineNumber);
+                    }
+                } else {
+                    lprintf( "!0x%I64x", AddrPC - (DWORD)(INT_PTR)hModule);
+                }
+            }
+
+            lprintf("\n");
+
+            if (bLine) {
+                dumpSourceCode(szFileName, dwLineNumber);
+            }
         }
 
         // Basic sanity check to make sure  the frame is OK.  Bail if not.
@@ -343,7 +756,11 @@ dumpStack(HANDLE hProcess, HANDLE hThread,
         nudge = -1;
     }
 
-    lprintf("\n");
+    if (!g_bJsonReport) {
+        lprintf("\n");
+    }
+
+    endReport();
 }
 
 
@@ -444,6 +861,63 @@ getExceptionString(DWORD ExceptionCode)
 }
 
 
+static void
+jsonException(HANDLE hProcess,
+              PEXCEPTION_RECORD pExceptionRecord,
+              LPCSTR lpcszProcess)
+{
+    NTSTATUS ExceptionCode = pExceptionRecord->ExceptionCode;
+    DWORD64 dwAddress = (DWORD64)(UINT_PTR)pExceptionRecord->ExceptionAddress;
+
+    jsonBegin("exception");
+    lprintf(",\"process\":");
+    jsonString(lpcszProcess);
+    lprintf(",\"code\":\"0x%08lx\"", ExceptionCode);
+
+    LPCSTR lpcszException = getExceptionString(ExceptionCode);
+    if (lpcszException) {
+        lprintf(",\"name\":");
+        jsonString(lpcszException);
+    }
+
+    lprintf(",\"address\":\"0x%I64x\"", dwAddress);
+
+    char szModule[MAX_PATH];
+    HMODULE hModule = (HMODULE)(INT_PTR)SymGetModuleBase64(hProcess, dwAddress);
+    if (hModule &&
+        GetModuleFileNameExA(hProcess, hModule, szModule, sizeof szModule)) {
+        lprintf(",\"module\":");
+        jsonString(getBaseName(szModule));
+        lprintf(",\"offset\":\"0x%I64x\"", dwAddress - (DWORD64)(UINT_PTR)hModule);
+    }
+
+    if ((ExceptionCode == EXCEPTION_ACCESS_VIOLATION ||
+         ExceptionCode == EXCEPTION_IN_PAGE_ERROR) &&
+        pExceptionRecord->NumberParameters >= 2) {
+        LPCSTR lpszAccess;
+        switch (pExceptionRecord->ExceptionInformation[0]) {
+        case 0:
+            lpszAccess = "read";
+            break;
+        case 1:
+            lpszAccess = "write";
+            break;
+        case 8:
+            lpszAccess = "execute";
+            break;
+        default:
+            lpszAccess = "unknown";
+            break;
+        }
+
+        lprintf(",\"access\":\"%s\",\"location\":\"0x%I64x\"",
+                lpszAccess, (DWORD64)pExceptionRecord->ExceptionInformation[1]);
+    }
+
+    jsonEnd();
+}
+
+
 void
 dumpException(HANDLE hProcess,
               PEXCEPTION_RECORD pExceptionRecord)
@@ -460,6 +934,14 @@ dumpException(HANDLE hProcess,
         lpcszProcess = "Application";
     }
 
+    beginReport();
+
+    if (g_bJsonReport) {
+        jsonException(hProcess, pExceptionRecord, lpcszProcess);
+        endReport();
+        return;
+    }
+
     // First print information about the type of fault
     lprintf("%s caused", lpcszProcess);
 
@@ -515,48 +997,254 @@ dumpException(HANDLE hProcess,
     }
 
     lprintf(".\n\n");
+
+    endReport();
+}
+
+
+/*
+ * Source files shown in stack traces, mapped once per report, with the offsets
+ * of their lines found as far as needed.  Files that can't be opened are tried
+ * again next time, as they may just not be there yet.  The least recently used
+ * file is dropped when the cache is full, and all are when the outermost
+ * report ends, so that they aren't kept locked or stale.
+ */
+struct SourceFile
+{
+    char szFileName[MAX_PATH];
+    HANDLE hFileMapping;
+    const char *pData;
+    DWORD cbData;
+
+    DWORD *pLineOffsets; /* start of each line indexed so far */
+    DWORD nLines;
+    DWORD nLinesAlloc;
+    BOOL bIndexed;       /* whether all lines are */
+
+    DWORD dwLastUse;
+};
+
+
+#define MAX_SOURCE_FILES 32
+
+static struct SourceFile *g_SourceFiles[MAX_SOURCE_FILES];
+static unsigned g_nSourceFiles = 0;
+static DWORD g_dwSourceFileUse = 0;
+static mutex_t g_SourceFilesMutex = MUTEX_INIT;
+
+static DWORD g_dwSourceContext = 2;
+
+
+void
+setSourceContext(DWORD dwLines)
+{
+    g_dwSourceContext = dwLines;
+}
+
+
+static void
+mapSourceFile(struct SourceFile *pFile)
+{
+    HANDLE hFile = CreateFileA(pFile->szFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    // Empty files can't be mapped, and have no lines to show anyway
+    DWORD dwFileSizeHi = 0;
+    DWORD dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
+    if (!dwFileSizeHi && dwFileSizeLo) {
+        pFile->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (pFile->hFileMapping) {
+            pFile->pData = (const char *)MapViewOfFile(pFile->hFileMapping, FILE_MAP_READ, 0, 0, 0);
+            if (pFile->pData) {
+                pFile->cbData = dwFileSizeLo;
+            } else {
+                CloseHandle(pFile->hFileMapping);
+                pFile->hFileMapping = NULL;
+            }
+        }
+    }
+
+    CloseHandle(hFile);
+}
+
+
+static void
+freeSourceFile(struct SourceFile *pFile)
+{
+    if (pFile->pData) {
+        UnmapViewOfFile(pFile->pData);
+    }
+    if (pFile->hFileMapping) {
+        CloseHandle(pFile->hFileMapping);
+    }
+    free(pFile->pLineOffsets);
+    free(pFile);
+}
+
+
+static struct SourceFile *
+lookupSourceFile(LPCSTR szFileName)
+{
+    struct SourceFile *pFile;
+    unsigned i;
+
+    for (i = 0; i < g_nSourceFiles; ++i) {
+        pFile = g_SourceFiles[i];
+        if (stricmp(pFile->szFileName, szFileName) == 0) {
+            pFile->dwLastUse = ++g_dwSourceFileUse;
+            return pFile;
+        }
+    }
+
+    pFile = (struct SourceFile *)calloc(1, sizeof *pFile);
+    if (!pFile) {
+        return NULL;
+    }
+    strncpy(pFile->szFileName, szFileName, MAX_PATH);
+    pFile->szFileName[MAX_PATH - 1] = '\0';
+    pFile->dwLastUse = ++g_dwSourceFileUse;
+    mapSourceFile(pFile);
+    if (!pFile->hFileMapping) {
+        freeSourceFile(pFile);
+        return NULL;
+    }
+
+    if (g_nSourceFiles < MAX_SOURCE_FILES) {
+        i = g_nSourceFiles++;
+    } else {
+        unsigned iOldest = 0;
+        for (i = 1; i < g_nSourceFiles; ++i) {
+            if (g_SourceFiles[i]->dwLastUse < g_SourceFiles[iOldest]->dwLastUse) {
+                iOldest = i;
+            }
+        }
+        i = iOldest;
+        freeSourceFile(g_SourceFiles[i]);
+    }
+    g_SourceFiles[i] = pFile;
+
+    return pFile;
+}
+
+
+static void
+freeSourceFiles(void)
+{
+    mutex_lock(&g_SourceFilesMutex);
+    for (unsigned i = 0; i < g_nSourceFiles; ++i) {
+        freeSourceFile(g_SourceFiles[i]);
+    }
+    g_nSourceFiles = 0;
+    mutex_unlock(&g_SourceFilesMutex);
+}
+
+
+/*
+ * Index the lines of a source file up to (1-based) dwLineNumber, or the end of
+ * the file.
+ */
+static void
+indexSourceLines(struct SourceFile *pFile, DWORD dwLineNumber)
+{
+    if (!pFile->nLines) {
+        if (!pFile->cbData) {
+            pFile->bIndexed = TRUE;
+            return;
+        }
+        pFile->nLinesAlloc = 1024;
+        pFile->pLineOffsets = (DWORD *)malloc(pFile->nLinesAlloc * sizeof *pFile->pLineOffsets);
+        if (!pFile->pLineOffsets) {
+            pFile->bIndexed = TRUE;
+            return;
+        }
+        pFile->pLineOffsets[0] = 0;
+        pFile->nLines = 1;
+    }
+
+    while (!pFile->bIndexed && pFile->nLines < dwLineNumber) {
+        DWORD dwOffset = pFile->pLineOffsets[pFile->nLines - 1];
+        const char *pEnd = (const char *)memchr(pFile->pData + dwOffset, '\n', pFile->cbData - dwOffset);
+        if (!pEnd || (DWORD)(pEnd + 1 - pFile->pData) >= pFile->cbData) {
+            pFile->bIndexed = TRUE;
+            break;
+        }
+
+        if (pFile->nLines == pFile->nLinesAlloc) {
+            DWORD *pLineOffsets = (DWORD *)realloc(pFile->pLineOffsets, 2 * pFile->nLinesAlloc * sizeof *pLineOffsets);
+            if (!pLineOffsets) {
+                pFile->bIndexed = TRUE;
+                break;
+            }
+            pFile->pLineOffsets = pLineOffsets;
+            pFile->nLinesAlloc *= 2;
+        }
+        pFile->pLineOffsets[pFile->nLines++] = pEnd + 1 - pFile->pData;
+    }
 }
 
 
 static BOOL
 dumpSourceCode(LPCSTR lpFileName, DWORD dwLineNumber)
 {
-    FILE *fp;
-    unsigned i;
     char szFileName[MAX_PATH] = "";
-    DWORD dwContext = 2;
+    DWORD dwContext = g_dwSourceContext;
 
     if(lpFileName[0] == '/' && lpFileName[1] == '/')
     {
         szFileName[0] = lpFileName[2];
         szFileName[1] = ':';
-        strcpy(szFileName + 2, lpFileName + 3);
+        strncpy(szFileName + 2, lpFileName + 3, MAX_PATH - 2);
     }
     else
-        strcpy(szFileName, lpFileName);
+        strncpy(szFileName, lpFileName, MAX_PATH);
+    szFileName[MAX_PATH - 1] = '\0';
+
+    // Held while reading the mapping, so it can't be dropped meanwhile
+    mutex_lock(&g_SourceFilesMutex);
 
-    if((fp = fopen(szFileName, "r")) == NULL)
+    struct SourceFile *pFile = lookupSourceFile(szFileName);
+    if (!pFile) {
+        mutex_unlock(&g_SourceFilesMutex);
         return FALSE;
+    }
 
-    i = 0;
-    while(!feof(fp) && ++i <= dwLineNumber + dwContext)
-    {
-        int c;
-
-        if((int)i >= (int) dwLineNumber - (int)dwContext)
-        {
-            lprintf(i == dwLineNumber ? ">%5i: " : "%6i: ", i);
-            while(!feof(fp) && (c = fgetc(fp)) != '\n')
-                if(isprint(c))
-                    lprintf("%c", c);
-            lprintf("\n");
+    indexSourceLines(pFile, dwLineNumber + dwContext);
+
+    DWORD dwFirst = dwLineNumber > dwContext ? dwLineNumber - dwContext : 1;
+    DWORD dwLast = dwLineNumber + dwContext;
+    if (dwLast > pFile->nLines) {
+        dwLast = pFile->nLines;
+    }
+    for (DWORD i = dwFirst; i <= dwLast; ++i) {
+        const char *p = pFile->pData + pFile->pLineOffsets[i - 1];
+        const char *pEnd = (const char *)memchr(p, '\n', pFile->pData + pFile->cbData - p);
+        if (!pEnd) {
+            pEnd = pFile->pData + pFile->cbData;
         }
-        else
-            while(!feof(fp) && (c = fgetc(fp)) != '\n')
-                ;
+
+        lprintf(i == dwLineNumber ? ">%5lu: " : "%6lu: ", i);
+
+        // Whole runs of printable characters at a time, skipping the
+        // newline, carriage returns, tabs, etc.
+        while (p < pEnd) {
+            const char *pRun = p;
+            while (p < pEnd && p - pRun < 512 && isprint((unsigned char)*p)) {
+                ++p;
+            }
+            if (p > pRun) {
+                lprintf("%.*s", (int)(p - pRun), pRun);
+            } else {
+                ++p;
+            }
+        }
+
+        lprintf("\n");
     }
 
-    fclose(fp);
+    mutex_unlock(&g_SourceFilesMutex);
     return TRUE;
 }
 
@@ -596,13 +1284,28 @@ dumpModules(HANDLE hProcess)
         return;
     }
 
+    beginReport();
+
     MODULEENTRY32 me32;
     me32.dwSize = sizeof me32;
     if (Module32First(hModuleSnap, &me32)) {
         do  {
             const char *szBaseName = getBaseName(me32.szExePath);
             DWORD dwVInfo[4];
-            if (getModuleVersionInfo(me32.szExePath, dwVInfo)) {
+            if (g_bJsonReport) {
+                jsonBegin("module");
+                lprintf(",\"name\":");
+                jsonString(szBaseName);
+                lprintf(",\"path\":");
+                jsonString(me32.szExePath);
+                lprintf(",\"base\":\"0x%I64x\",\"size\":%lu",
+                        (DWORD64)(UINT_PTR)me32.modBaseAddr, me32.modBaseSize);
+                if (getModuleVersionInfo(me32.szExePath, dwVInfo)) {
+                    lprintf(",\"version\":\"%lu.%lu.%lu.%lu\"",
+                            dwVInfo[0], dwVInfo[1], dwVInfo[2], dwVInfo[3]);
+                }
+                jsonEnd();
+            } else if (getModuleVersionInfo(me32.szExePath, dwVInfo)) {
                 lprintf(
                     "%-12s\t%lu.%lu.%lu.%lu\n",
                     szBaseName,
@@ -615,8 +1318,12 @@ dumpModules(HANDLE hProcess)
                 lprintf( "%s\n", szBaseName);
             }
         } while (Module32Next(hModuleSnap, &me32));
-        lprintf("\n");
+        if (!g_bJsonReport) {
+            lprintf("\n");
+        }
     }
 
+    endReport();
+
     CloseHandle(hModuleSnap);
 }
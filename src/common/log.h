@@ -32,6 +32,60 @@ EXTERN_C int
 #endif
 lprintf(const char * format, ...);
 
+/*
+ * lprintf for text besides the report proper, such as debug strings or event
+ * traces.  When reporting in JSON it becomes a record of the given type
+ * instead, with the text as its "text".
+ */
+EXTERN_C void
+#ifdef __GNUC__
+    __attribute__ ((format (printf, 2, 3)))
+#endif
+lprintfMessage(const char *szType, const char * format, ...);
+
+/*
+ * Batch lprintf output between these calls, passing it to the DumpCallback in
+ * one piece when the outermost beginReport is matched, instead of once per
+ * fragment.  Reports nest.  Only the thread that opened the report batches;
+ * others keep calling the DumpCallback directly.
+ */
+EXTERN_C void
+beginReport(void);
+
+EXTERN_C void
+endReport(void);
+
+/*
+ * Pass what the current thread's report holds so far to the DumpCallback,
+ * so that it survives should anything after fault.
+ */
+EXTERN_C void
+flushReport(void);
+
+/*
+ * Unwind MinGW frames in dumpStack with their DWARF call frame information
+ * rather than with StackWalk64 alone.
+ */
+EXTERN_C void
+setDwarfUnwind(BOOL bEnable);
+
+/*
+ * Report in JSON lines rather than text: one object per line, with a "type"
+ * of "exception", "thread", "frame", or "module", or the one lprintfMessage
+ * was given.  Records are passed to the DumpCallback as soon as each is
+ * complete, even within beginReport, and carry the "report" they belong to,
+ * numbered from 1, and their "seq" number within it.  Records written outside
+ * of a report, or while another thread's report is open, get report 0.
+ */
+EXTERN_C void
+setJsonReport(BOOL bEnable);
+
+/*
+ * Lines of source code shown before and after each frame's line, 2 by default.
+ */
+EXTERN_C void
+setSourceContext(DWORD dwLines);
+
 EXTERN_C void
 dumpException(HANDLE hProcess, PEXCEPTION_RECORD pExceptionRecord);
 
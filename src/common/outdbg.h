@@ -19,7 +19,9 @@
 #pragma once
 
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -31,7 +33,12 @@ OutputDebug(const char *format, ... )
     char buf[512];
     va_list ap;
     va_start(ap, format);
+#ifdef _WIN32
     _vsnprintf(buf, sizeof(buf), format, ap);
     OutputDebugStringA(buf);
+#else
+    vsnprintf(buf, sizeof(buf), format, ap);
+    fputs(buf, stderr);
+#endif
     va_end(ap);
 }
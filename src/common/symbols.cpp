@@ -94,13 +94,20 @@ InitializeSym(HANDLE hProcess, BOOL fInvadeProcess)
 
 BOOL GetSymFromAddr(HANDLE hProcess, DWORD64 dwAddress, LPSTR lpSymName, DWORD nSize)
 {
-    PSYMBOL_INFO pSymbol = (PSYMBOL_INFO)malloc(sizeof(SYMBOL_INFO) + nSize * sizeof(char));
+    // Too large for the stack of a crashing thread, and called for every
+    // frame of a stack trace.  Stack traces are only dumped by the thread
+    // owning the report, so a static buffer will do.
+    static struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[MAX_SYM_NAME];
+    } sym;
+    PSYMBOL_INFO pSymbol = &sym.Symbol;
 
     DWORD64 dwDisplacement = 0;  // Displacement of the input address, relative to the start of the symbol
     BOOL bRet;
 
     pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
-    pSymbol->MaxNameLen = nSize;
+    pSymbol->MaxNameLen = nSize < MAX_SYM_NAME ? nSize : MAX_SYM_NAME;
 
     DWORD dwOptions = SymGetOptions();
 
@@ -114,8 +121,6 @@ BOOL GetSymFromAddr(HANDLE hProcess, DWORD64 dwAddress, LPSTR lpSymName, DWORD n
         }
     }
 
-    free(pSymbol);
-
     return bRet;
 }
 
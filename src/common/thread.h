@@ -0,0 +1,196 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Minimal mutex and thread wrappers.
+ *
+ * MinGW toolchains built with the win32 threading model lack std::mutex and
+ * std::thread, so use the native APIs directly.
+ */
+
+#pragma once
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+typedef SRWLOCK mutex_t;
+#define MUTEX_INIT SRWLOCK_INIT
+
+static inline void
+mutex_init(mutex_t *mutex)
+{
+    InitializeSRWLock(mutex);
+}
+
+static inline void
+mutex_destroy(mutex_t *mutex)
+{
+}
+
+static inline void
+mutex_lock(mutex_t *mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static inline void
+mutex_unlock(mutex_t *mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+
+#else /* !_WIN32 */
+
+typedef pthread_mutex_t mutex_t;
+#define MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+
+static inline void
+mutex_init(mutex_t *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+static inline void
+mutex_destroy(mutex_t *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void
+mutex_lock(mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void
+mutex_unlock(mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+#endif /* !_WIN32 */
+
+
+typedef void (*thread_func)(void *arg);
+
+struct thread_start
+{
+    thread_func func;
+    void *arg;
+};
+
+
+#ifdef _WIN32
+
+typedef HANDLE thread_t;
+
+static inline DWORD WINAPI
+thread_trampoline(LPVOID lpParameter)
+{
+    struct thread_start start = *(struct thread_start *)lpParameter;
+    free(lpParameter);
+    start.func(start.arg);
+    return 0;
+}
+
+static inline bool
+thread_create(thread_t *thread, thread_func func, void *arg)
+{
+    struct thread_start *start = (struct thread_start *)malloc(sizeof *start);
+    if (!start) {
+        return false;
+    }
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+static inline void
+thread_join(thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static inline unsigned
+thread_processor_count(void)
+{
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    return SystemInfo.dwNumberOfProcessors;
+}
+
+#else /* !_WIN32 */
+
+typedef pthread_t thread_t;
+
+static inline void *
+thread_trampoline(void *lpParameter)
+{
+    struct thread_start start = *(struct thread_start *)lpParameter;
+    free(lpParameter);
+    start.func(start.arg);
+    return NULL;
+}
+
+static inline bool
+thread_create(thread_t *thread, thread_func func, void *arg)
+{
+    struct thread_start *start = (struct thread_start *)malloc(sizeof *start);
+    if (!start) {
+        return false;
+    }
+    start->func = func;
+    start->arg = arg;
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+static inline void
+thread_join(thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+static inline unsigned
+thread_processor_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+}
+
+#endif /* !_WIN32 */
@@ -60,6 +60,7 @@ help(void)
         "  -b, --breakpoint\tTreat debug breakpoints as exceptions\r\n"
         "  -v, --verbose\tVerbose output\r\n"
         "  -d, --debug\tDebug output\r\n"
+        "  -j, --json\tReport in JSON lines rather than text\r\n"
         ,
         PACKAGE,
         MB_OK | MB_ICONINFORMATION
@@ -246,10 +247,11 @@ main(int argc, char **argv)
             { "breakpoint", 0, NULL, 'b'},
             { "verbose", 0, NULL, 'v'},
             { "debug", 0, NULL, 'd'},
+            { "json", 0, NULL, 'j'},
             { NULL, 0, NULL, 0}
         };
 
-        c = getopt_long_only(argc, argv, "?hViaup:e:t:vbd", long_options, &option_index);
+        c = getopt_long_only(argc, argv, "?hViaup:e:t:vbdj", long_options, &option_index);
 
         if (c == -1)
             break;    /* Exit from `while (1)' loop.  */
@@ -395,6 +397,10 @@ main(int argc, char **argv)
                 debug_options.debug_flag = 1;
                 break;
 
+            case 'j':    /* JSON lines report.  */
+                setJsonReport(TRUE);
+                break;
+
             default:    /* bug: option not considered.  */
             {
                 char szErrMsg[512];
@@ -44,18 +44,24 @@ static void
 writeReport(const char *szText)
 {
     if (REPORT_FILE) {
+        // Translate newlines in a static buffer, rather than on the stack, as
+        // we might be handling a stack overflow.  The exception filter is
+        // never reentered.
+        static char szBuffer[8192];
+        DWORD cbBuffer = 0;
         DWORD cbWritten;
-        while (*szText != '\0') {
-            const char *p = szText;
-            while (*p != '\0' && *p != '\n') {
-                ++p;
+        for (; *szText != '\0'; ++szText) {
+            if (cbBuffer + 2 > sizeof szBuffer) {
+                WriteFile(g_hReportFile, szBuffer, cbBuffer, &cbWritten, 0);
+                cbBuffer = 0;
             }
-            WriteFile(g_hReportFile, szText, p - szText, &cbWritten, 0);
-            if (*p == '\n') {
-                WriteFile(g_hReportFile, "\r\n", 2, &cbWritten, 0);
-                ++p;
+            if (*szText == '\n') {
+                szBuffer[cbBuffer++] = '\r';
             }
-            szText = p;
+            szBuffer[cbBuffer++] = *szText;
+        }
+        if (cbBuffer) {
+            WriteFile(g_hReportFile, szBuffer, cbBuffer, &cbWritten, 0);
         }
     } else {
         OutputDebugStringA(szText);
@@ -68,6 +74,10 @@ void GenerateExceptionReport(PEXCEPTION_POINTERS pExceptionInfo)
 {
     PEXCEPTION_RECORD pExceptionRecord = pExceptionInfo->ExceptionRecord;
 
+    // Write the report in a few pieces, each as soon as it is complete, as
+    // symbolizing may fault too
+    beginReport();
+
     // Start out with a banner
     lprintf("-------------------\n\n");
 
@@ -87,6 +97,7 @@ void GenerateExceptionReport(PEXCEPTION_POINTERS pExceptionInfo)
     if (InitializeSym(hProcess, TRUE)) {
 
         dumpException(hProcess, pExceptionRecord);
+        flushReport();
 
         PCONTEXT pContext = pExceptionInfo->ContextRecord;
 
@@ -102,6 +113,7 @@ void GenerateExceptionReport(PEXCEPTION_POINTERS pExceptionInfo)
         }
 
         dumpStack(hProcess, GetCurrentThread(), pContext);
+        flushReport();
 
         if (!SymCleanup(hProcess)) {
             assert(0);
@@ -109,6 +121,7 @@ void GenerateExceptionReport(PEXCEPTION_POINTERS pExceptionInfo)
     }
 
     dumpModules(hProcess);
+    flushReport();
 
     // TODO: Use GetFileVersionInfo on kernel32.dll as recommended on
     // https://msdn.microsoft.com/en-us/library/windows/desktop/ms724429.aspx
@@ -124,6 +137,8 @@ void GenerateExceptionReport(PEXCEPTION_POINTERS pExceptionInfo)
             PACKAGE_VERSION_MAJOR, PACKAGE_VERSION_MINOR, PACKAGE_VERSION_PATCH);
 
     lprintf("\n");
+
+    endReport();
 }
 
 #include <stdio.h>
@@ -0,0 +1,394 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Times libiberty's demangler on a corpus of mangled names, taken from the
+ * COFF symbol tables of MinGW images (e.g., the tests/apps binaries) and from
+ * text files with one name per line, such as demangle_corpus.txt:
+ *
+ * - v3: cplus_demangle_v3, which mallocs each result;
+ * - callback: cplus_demangle_v3_callback into a reusable buffer;
+ * - cache: mgwhelp's demangle_cache, first empty then with all names in it.
+ *
+ * All results are checked against cplus_demangle_v3's.  Allocations are
+ * counted by interposing malloc, which is only possible with glibc.
+ *
+ * Built with -DDEMANGLE_FUZZER (see ENABLE_FUZZING), the same checks become
+ * a libFuzzer harness.
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "demangle.h"
+#include "demangle_cache.h"
+#include "pe_image.h"
+
+
+// Sanitizers interpose malloc themselves
+#if defined(__SANITIZE_ADDRESS__)
+#  define HAVE_SANITIZER 1
+#elif defined(__has_feature)
+#  if __has_feature(address_sanitizer)
+#    define HAVE_SANITIZER 1
+#  endif
+#endif
+
+#if defined(__GLIBC__) && !defined(HAVE_SANITIZER) && !defined(DEMANGLE_FUZZER)
+#define HAVE_ALLOC_COUNT 1
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t alloc_count = 0;
+
+extern "C" void *
+malloc(size_t size) noexcept
+{
+    ++alloc_count;
+    return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t nmemb, size_t size) noexcept
+{
+    ++alloc_count;
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *
+realloc(void *ptr, size_t size) noexcept
+{
+    ++alloc_count;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+
+/*
+ * Check the callback and cache paths against cplus_demangle_v3, aborting on
+ * any difference.
+ */
+static void
+check_name(const char *mangled, int options, struct demangle_cache *cache)
+{
+    char *expected = NULL;
+    if (mangled[0] == '_' && mangled[1] == 'Z') {
+        expected = cplus_demangle_v3(mangled, options);
+    }
+
+    // Also exercise truncation
+    char small[32];
+    size_t length = demangle_to_buffer(mangled, options, small, sizeof small);
+    const char *cached = demangle_cache_lookup(cache, mangled);
+
+    bool ok;
+    if (expected) {
+        size_t expected_length = strlen(expected);
+        size_t small_length = std::min(expected_length, sizeof small - 1);
+        ok = length == expected_length &&
+             strlen(small) == small_length &&
+             memcmp(small, expected, small_length) == 0 &&
+             cached && strcmp(cached, expected) == 0 &&
+             demangle_cache_lookup(cache, mangled) == cached;
+    } else {
+        ok = length == 0 && small[0] == '\0' && !cached;
+    }
+    if (!ok) {
+        fprintf(stderr, "error: mismatch demangling %s\n", mangled);
+        fprintf(stderr, "  expected: %s\n", expected ? expected : "(null)");
+        fprintf(stderr, "  callback: %s (%u)\n", small, (unsigned)length);
+        fprintf(stderr, "  cache:    %s\n", cached ? cached : "(null)");
+        abort();
+    }
+
+    free(expected);
+}
+
+
+#ifdef DEMANGLE_FUZZER
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static struct demangle_cache *caches[2] = {
+        demangle_cache_create(DMGL_NO_OPTS),
+        demangle_cache_create(DMGL_PARAMS | DMGL_TYPES),
+    };
+
+    // Embedded NULs just truncate the name
+    std::string name((const char *)data, size);
+    check_name(name.c_str(), DMGL_NO_OPTS, caches[0]);
+    check_name(name.c_str(), DMGL_PARAMS | DMGL_TYPES, caches[1]);
+    return 0;
+}
+
+#else /* !DEMANGLE_FUZZER */
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static double
+elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+
+/*
+ * Mangled names in an image's COFF symbol table.
+ */
+static void
+read_image_names(const struct pe_image *image, std::vector<std::string> &names)
+{
+    if (!image->pSymbolTable) {
+        return;
+    }
+
+    bool bUnderscore = image->pNtHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+
+    DWORD NumberOfSymbols = image->pNtHeaders->FileHeader.NumberOfSymbols;
+    for (DWORD i = 0; i < NumberOfSymbols; ++i) {
+        PIMAGE_SYMBOL pSymbol = &image->pSymbolTable[i];
+
+        char ShortName[9];
+        const char *SymbolName;
+        if (pSymbol->N.Name.Short != 0) {
+            memcpy(ShortName, pSymbol->N.ShortName, 8);
+            ShortName[8] = '\0';
+            SymbolName = ShortName;
+        } else {
+            SymbolName = &image->pStringTable[pSymbol->N.Name.Long];
+        }
+        if (bUnderscore && SymbolName[0] == '_') {
+            ++SymbolName;
+        }
+
+        if (SymbolName[0] == '_' && SymbolName[1] == 'Z') {
+            names.push_back(SymbolName);
+        }
+
+        i += pSymbol->NumberOfAuxSymbols;
+    }
+}
+
+
+static bool
+is_image_file(const char *szFileName)
+{
+    FILE *fp = fopen(szFileName, "rb");
+    if (!fp) {
+        return false;
+    }
+    char magic[2] = {0, 0};
+    size_t n = fread(magic, 1, sizeof magic, fp);
+    fclose(fp);
+    return n == sizeof magic && magic[0] == 'M' && magic[1] == 'Z';
+}
+
+
+static bool
+read_text_names(const char *szFileName, std::vector<std::string> &names)
+{
+    FILE *fp = fopen(szFileName, "rt");
+    if (!fp) {
+        return false;
+    }
+
+    std::string line;
+    int c;
+    do {
+        c = fgetc(fp);
+        if (c == '\n' || c == EOF) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                line.pop_back();
+            }
+            if (!line.empty() && line[0] != '#') {
+                names.push_back(line);
+            }
+            line.clear();
+        } else {
+            line.push_back((char)c);
+        }
+    } while (c != EOF);
+
+    fclose(fp);
+    return true;
+}
+
+
+static void
+report(const char *szName, double ms, size_t count, uint64_t allocs)
+{
+    printf("%-14s %10.0f names/s", szName, count / ms * 1e3);
+#ifdef HAVE_ALLOC_COUNT
+    printf(" %8.2f allocations/name", (double)allocs / count);
+#else
+    (void)allocs;
+#endif
+    printf("\n");
+}
+
+
+static uint64_t
+get_alloc_count(void)
+{
+#ifdef HAVE_ALLOC_COUNT
+    return alloc_count;
+#else
+    return 0;
+#endif
+}
+
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n COUNT] [-N] IMAGE|NAMES.txt...\n", argv0);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned count = 10;
+    int options = DMGL_PARAMS | DMGL_TYPES;
+
+    int i;
+    for (i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            break;
+        }
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc) {
+            count = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "-N") == 0) {
+            // As SymFromAddr with SYMOPT_UNDNAME
+            options = DMGL_NO_OPTS;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc || count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    for (; i < argc; ++i) {
+        if (is_image_file(argv[i])) {
+            struct pe_image *image = pe_image_open_file(argv[i]);
+            if (!image) {
+                fprintf(stderr, "error: failed to open %s\n", argv[i]);
+                return 1;
+            }
+            read_image_names(image, names);
+            pe_image_unref(image);
+        } else if (!read_text_names(argv[i], names)) {
+            fprintf(stderr, "error: failed to read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (names.empty()) {
+        fprintf(stderr, "error: no mangled names\n");
+        return 1;
+    }
+
+    size_t mangled_bytes = 0;
+    for (const std::string &name : names) {
+        mangled_bytes += name.size();
+    }
+
+    struct demangle_cache *cache = demangle_cache_create(options);
+    for (const std::string &name : names) {
+        check_name(name.c_str(), options, cache);
+    }
+    demangle_cache_destroy(cache);
+
+    printf("%u names, %.1f bytes/name\n", (unsigned)names.size(), (double)mangled_bytes / names.size());
+
+    size_t total = (size_t)count * names.size();
+
+    uint64_t allocs = get_alloc_count();
+    bench_clock::time_point start = bench_clock::now();
+    for (unsigned k = 0; k < count; ++k) {
+        for (const std::string &name : names) {
+            free(cplus_demangle_v3(name.c_str(), options));
+        }
+    }
+    report("v3", elapsed_ms(start), total, get_alloc_count() - allocs);
+
+    std::vector<char> buffer(64 * 1024);
+    allocs = get_alloc_count();
+    start = bench_clock::now();
+    for (unsigned k = 0; k < count; ++k) {
+        for (const std::string &name : names) {
+            demangle_to_buffer(name.c_str(), options, &buffer[0], buffer.size());
+        }
+    }
+    report("callback", elapsed_ms(start), total, get_alloc_count() - allocs);
+
+    double cold_ms = 0;
+    uint64_t cold_allocs = 0;
+    for (unsigned k = 0; k < count; ++k) {
+        cache = demangle_cache_create(options);
+        allocs = get_alloc_count();
+        start = bench_clock::now();
+        for (const std::string &name : names) {
+            demangle_cache_lookup(cache, name.c_str());
+        }
+        cold_ms += elapsed_ms(start);
+        cold_allocs += get_alloc_count() - allocs;
+        if (k + 1 < count) {
+            demangle_cache_destroy(cache);
+        }
+    }
+    report("cache (cold)", cold_ms, total, cold_allocs);
+
+    allocs = get_alloc_count();
+    start = bench_clock::now();
+    for (unsigned k = 0; k < count; ++k) {
+        for (const std::string &name : names) {
+            demangle_cache_lookup(cache, name.c_str());
+        }
+    }
+    report("cache (warm)", elapsed_ms(start), total, get_alloc_count() - allocs);
+
+    struct demangle_cache_stats stats;
+    demangle_cache_get_stats(cache, &stats);
+    printf("cache: %" PRIu64 " names, %" PRIu64 " bytes\n", stats.names, stats.bytes);
+    demangle_cache_destroy(cache);
+
+    return 0;
+}
+
+#endif /* !DEMANGLE_FUZZER */
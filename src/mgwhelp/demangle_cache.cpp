@@ -0,0 +1,290 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "demangle.h"
+#include "thread.h"
+
+#include "demangle_cache.h"
+
+
+struct demangle_output
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+};
+
+
+static void
+demangle_append(const char *s, size_t l, void *opaque)
+{
+    struct demangle_output *output = (struct demangle_output *)opaque;
+    if (output->length + 1 < output->size) {
+        size_t n = output->size - 1 - output->length;
+        if (n > l) {
+            n = l;
+        }
+        memcpy(output->buffer + output->length, s, n);
+        output->buffer[output->length + n] = '\0';
+    }
+    output->length += l;
+}
+
+
+size_t
+demangle_to_buffer(const char *mangled, int options, char *buffer, size_t size)
+{
+    if (size) {
+        buffer[0] = '\0';
+    }
+
+    // There can be false negatives, such as "_ZwTerminateProcess@8"
+    if (mangled[0] != '_' || mangled[1] != 'Z') {
+        return 0;
+    }
+
+    struct demangle_output output = {buffer, size, 0};
+    if (!cplus_demangle_v3_callback(mangled, options, demangle_append, &output)) {
+        if (size) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    return output.length;
+}
+
+
+/*
+ * Like demangle_output, but moving to the heap when the initial buffer is
+ * too small, instead of truncating.
+ */
+struct demangle_growable
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+    char *initial;
+    bool failed;
+};
+
+
+static void
+demangle_grow_append(const char *s, size_t l, void *opaque)
+{
+    struct demangle_growable *output = (struct demangle_growable *)opaque;
+    if (output->failed) {
+        return;
+    }
+    if (output->length + l >= output->size) {
+        size_t size = output->size * 2;
+        while (output->length + l >= size) {
+            size *= 2;
+        }
+        char *buffer;
+        if (output->buffer == output->initial) {
+            buffer = (char *)malloc(size);
+            if (buffer) {
+                memcpy(buffer, output->buffer, output->length);
+            }
+        } else {
+            buffer = (char *)realloc(output->buffer, size);
+        }
+        if (!buffer) {
+            output->failed = true;
+            return;
+        }
+        output->buffer = buffer;
+        output->size = size;
+    }
+    memcpy(output->buffer + output->length, s, l);
+    output->length += l;
+}
+
+
+/* Names longer than a quarter of this get a block of their own */
+#define DEMANGLE_ARENA_BLOCK (64 * 1024)
+
+
+struct demangle_name_hash
+{
+    size_t operator() (const char *s) const {
+        // FNV-1a
+        size_t h = 2166136261u;
+        for (; *s; ++s) {
+            h = (h ^ (unsigned char)*s) * 16777619u;
+        }
+        return h;
+    }
+};
+
+
+struct demangle_name_equal
+{
+    bool operator() (const char *a, const char *b) const {
+        return strcmp(a, b) == 0;
+    }
+};
+
+
+struct demangle_cache
+{
+    int options;
+
+    mutex_t mutex;
+
+    /* From the interned mangled name, to the interned demangled one, or NULL
+     * if the demangler failed */
+    std::unordered_map<const char *, const char *, demangle_name_hash, demangle_name_equal> names;
+
+    std::vector<char *> blocks;
+    char *free_ptr;
+    size_t free_size;
+    size_t bytes;
+
+    uint64_t hits;
+    uint64_t misses;
+};
+
+
+static const char *
+demangle_cache_intern(struct demangle_cache *cache, const char *s, size_t length)
+{
+    size_t size = length + 1;
+    char *p;
+    if (size > DEMANGLE_ARENA_BLOCK / 4) {
+        p = (char *)malloc(size);
+        if (!p) {
+            return NULL;
+        }
+        cache->blocks.push_back(p);
+    } else {
+        if (size > cache->free_size) {
+            char *block = (char *)malloc(DEMANGLE_ARENA_BLOCK);
+            if (!block) {
+                return NULL;
+            }
+            cache->blocks.push_back(block);
+            cache->free_ptr = block;
+            cache->free_size = DEMANGLE_ARENA_BLOCK;
+        }
+        p = cache->free_ptr;
+        cache->free_ptr += size;
+        cache->free_size -= size;
+    }
+    memcpy(p, s, length);
+    p[length] = '\0';
+    cache->bytes += size;
+    return p;
+}
+
+
+struct demangle_cache *
+demangle_cache_create(int options)
+{
+    struct demangle_cache *cache = new demangle_cache;
+    cache->options = options;
+    mutex_init(&cache->mutex);
+    cache->free_ptr = NULL;
+    cache->free_size = 0;
+    cache->bytes = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    return cache;
+}
+
+
+void
+demangle_cache_destroy(struct demangle_cache *cache)
+{
+    for (char *block : cache->blocks) {
+        free(block);
+    }
+    mutex_destroy(&cache->mutex);
+    delete cache;
+}
+
+
+const char *
+demangle_cache_lookup(struct demangle_cache *cache, const char *mangled)
+{
+    if (mangled[0] != '_' || mangled[1] != 'Z') {
+        return NULL;
+    }
+
+    mutex_lock(&cache->mutex);
+    auto it = cache->names.find(mangled);
+    if (it != cache->names.end()) {
+        ++cache->hits;
+        const char *demangled = it->second;
+        mutex_unlock(&cache->mutex);
+        return demangled;
+    }
+    ++cache->misses;
+    mutex_unlock(&cache->mutex);
+
+    // Demangle without holding the lock, on the stack unless the name is
+    // unusually long
+    char stack_buffer[1024];
+    struct demangle_growable output = {stack_buffer, sizeof stack_buffer, 0, stack_buffer, false};
+    size_t length = 0;
+    if (cplus_demangle_v3_callback(mangled, cache->options, demangle_grow_append, &output) &&
+        !output.failed) {
+        length = output.length;
+    }
+    char *buffer = output.buffer;
+
+    mutex_lock(&cache->mutex);
+    const char *demangled;
+    it = cache->names.find(mangled);
+    if (it != cache->names.end()) {
+        // Another thread got here first
+        demangled = it->second;
+    } else {
+        const char *key = demangle_cache_intern(cache, mangled, strlen(mangled));
+        demangled = length ? demangle_cache_intern(cache, buffer, length) : NULL;
+        if (key) {
+            cache->names.emplace(key, demangled);
+        }
+    }
+    mutex_unlock(&cache->mutex);
+
+    if (buffer != stack_buffer) {
+        free(buffer);
+    }
+    return demangled;
+}
+
+
+void
+demangle_cache_get_stats(struct demangle_cache *cache,
+                         struct demangle_cache_stats *stats)
+{
+    mutex_lock(&cache->mutex);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->names = cache->names.size();
+    stats->bytes = cache->bytes;
+    mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Demangle a g++ name, with cplus_demangle_v3_callback's DMGL_* options, into
+ * buffer, which is always NUL terminated, truncating the name as needed.
+ * Returns the full length of the demangled name, or zero if it isn't a
+ * mangled C++ name.  Never allocates.
+ */
+size_t
+demangle_to_buffer(const char *mangled, int options, char *buffer, size_t size);
+
+
+/*
+ * Cache of demangled names, keyed by the mangled name, with both interned in
+ * an arena owned by the cache, so repeated lookups neither demangle nor
+ * allocate.  Thread-safe.
+ */
+struct demangle_cache;
+
+
+struct demangle_cache_stats
+{
+    uint64_t hits;   /* lookups answered by the cache */
+    uint64_t misses; /* lookups that ran the demangler */
+    uint64_t names;  /* names in the cache now */
+    uint64_t bytes;  /* arena bytes in use */
+};
+
+
+struct demangle_cache *
+demangle_cache_create(int options);
+
+void
+demangle_cache_destroy(struct demangle_cache *cache);
+
+/*
+ * Demangled name, valid until the cache is destroyed, or NULL if mangled
+ * isn't a mangled C++ name.
+ */
+const char *
+demangle_cache_lookup(struct demangle_cache *cache, const char *mangled);
+
+void
+demangle_cache_get_stats(struct demangle_cache *cache,
+                         struct demangle_cache_stats *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,351 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Times mgwhelp's address -> function/line lookups on a MinGW image file,
+ * without loading it into a process, so it also runs on non-Windows hosts.
+ *
+ * Addresses are image VMAs (i.e., as printed by objdump or addr2line).  When
+ * none are given, they are sampled uniformly across the .text section.
+ *
+ * The names of the functions found are then looked up back, checking that
+ * each resolves to a function of that name.
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "pe_image.h"
+#include "pe_find.h"
+#include "dwarf_pe.h"
+#include "dwarf_find.h"
+#include "dwarf_cache.h"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static double
+elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n COUNT] [-j THREADS] [-c CACHE_DIR] [-M] [-v] IMAGE [ADDRESS...]\n", argv0);
+}
+
+
+static void
+print_alloc_stats(Dwarf_Debug dbg, const char *what)
+{
+    Dwarf_Unsigned alloc_count, alloc_bytes, malloc_count;
+    if (dbg && dwarf_get_alloc_stats(dbg, &alloc_count, &alloc_bytes, &malloc_count) == DW_DLV_OK) {
+        printf("%s allocations: %" PRIu64 " objects, %" PRIu64 " bytes, %" PRIu64 " mallocs\n",
+               what, (uint64_t)alloc_count, (uint64_t)alloc_bytes, (uint64_t)malloc_count);
+    }
+}
+
+
+struct lookup_stats
+{
+    unsigned functions;
+    unsigned lines;
+    unsigned pe_symbols;
+    unsigned inlines;
+};
+
+
+static void
+find_symbol(Dwarf_Debug dbg,
+            const struct dwarf_function_index *functions,
+            struct dwarf_line_cache *lines,
+            const struct dwarf_cache *cache,
+            DWORD64 addr,
+            struct find_dwarf_info *info)
+{
+    memset(info, 0, sizeof *info);
+    if (cache) {
+        dwarf_cache_find(cache, addr, info);
+    } else if (dbg) {
+        find_dwarf_symbol(dbg, functions, lines, addr, info);
+    }
+}
+
+
+static void
+lookup_all(Dwarf_Debug dbg,
+           const struct dwarf_function_index *functions,
+           struct dwarf_line_cache *lines,
+           const struct dwarf_cache *cache,
+           const struct pe_symbol_index *pe_symbols,
+           const std::vector<DWORD64> &addresses,
+           bool verbose,
+           struct lookup_stats *stats)
+{
+    memset(stats, 0, sizeof *stats);
+
+    for (DWORD64 addr : addresses) {
+        struct find_dwarf_info info;
+        find_symbol(dbg, functions, lines, cache, addr, &info);
+
+        char SymbolName[512];
+        DWORD64 SymbolAddr = 0;
+        DWORD64 SymbolSize;
+        if (info.functionname) {
+            ++stats->functions;
+        } else if (pe_find_symbol(pe_symbols, addr, sizeof SymbolName, SymbolName, &SymbolAddr, &SymbolSize)) {
+            ++stats->pe_symbols;
+        } else {
+            SymbolName[0] = '\0';
+        }
+        if (info.filename) {
+            ++stats->lines;
+        }
+
+        struct find_dwarf_inline frames[64];
+        unsigned inline_count = 0;
+        if (cache) {
+            inline_count = dwarf_cache_find_inlines(cache, addr, frames, 64);
+        } else if (functions) {
+            inline_count = find_dwarf_inlines(functions, addr, frames, 64);
+        }
+        stats->inlines += inline_count;
+
+        if (verbose) {
+            if (info.functionname) {
+                printf("0x%08" PRIx64 " %s+0x%" PRIx64,
+                       (uint64_t)addr, info.functionname, (uint64_t)(addr - info.functionaddr));
+            } else if (SymbolName[0]) {
+                printf("0x%08" PRIx64 " %s+0x%" PRIx64,
+                       (uint64_t)addr, SymbolName, (uint64_t)(addr - SymbolAddr));
+            } else {
+                printf("0x%08" PRIx64 " ??", (uint64_t)addr);
+            }
+            if (info.filename) {
+                printf(" %s:%u", info.filename, info.line);
+            }
+            for (unsigned i = 0; i < inline_count && i < 64; ++i) {
+                printf(" [inlined %s at %s:%u]", frames[i].functionname, frames[i].callfile, frames[i].callline);
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+static void
+lookup_names(Dwarf_Debug dbg,
+             const struct dwarf_function_index *functions,
+             struct dwarf_line_cache *lines,
+             const struct dwarf_cache *cache,
+             const std::vector<DWORD64> &addresses)
+{
+    std::set<std::string> names;
+    for (DWORD64 addr : addresses) {
+        struct find_dwarf_info info;
+        find_symbol(dbg, functions, lines, cache, addr, &info);
+        if (info.functionname) {
+            names.insert(info.functionname);
+        }
+    }
+    if (names.empty()) {
+        return;
+    }
+
+    std::vector<std::pair<const std::string *, DWORD64>> found;
+    found.reserve(names.size());
+    bench_clock::time_point start = bench_clock::now();
+    for (const std::string &name : names) {
+        struct find_dwarf_info info;
+        memset(&info, 0, sizeof info);
+        if (cache) {
+            dwarf_cache_find_name(cache, name.c_str(), &info);
+        } else {
+            find_dwarf_name(dbg, functions, lines, name.c_str(), &info);
+        }
+        if (info.found) {
+            found.push_back(std::make_pair(&name, info.functionaddr));
+        }
+    }
+    double ms = elapsed_ms(start);
+
+    // Static functions may share a name, so check names rather than addresses
+    unsigned mismatches = 0;
+    for (const auto &f : found) {
+        struct find_dwarf_info info;
+        find_symbol(dbg, functions, lines, cache, f.second, &info);
+        if (!info.functionname || *f.first != info.functionname) {
+            ++mismatches;
+        }
+    }
+
+    printf("name lookups: %.3f ms, %.1f ns/name (%u names, %u found, %u mismatches)\n",
+           ms, ms * 1e6 / names.size(), (unsigned)names.size(), (unsigned)found.size(), mismatches);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned count = 100000;
+    const char *szCacheDir = NULL;
+    bool arena = true;
+    bool verbose = false;
+
+    int i;
+    for (i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            break;
+        }
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc) {
+            count = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            dwarf_set_index_threads(strtoul(argv[++i], NULL, 0));
+        } else if (strcmp(arg, "-c") == 0 && i + 1 < argc) {
+            szCacheDir = argv[++i];
+        } else if (strcmp(arg, "-M") == 0) {
+            arena = false;
+        } else if (strcmp(arg, "-v") == 0) {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *szImageName = argv[i++];
+
+    bench_clock::time_point start = bench_clock::now();
+    struct pe_image *image = pe_image_open_file(szImageName);
+    if (!image) {
+        fprintf(stderr, "error: failed to open %s\n", szImageName);
+        return 1;
+    }
+
+    struct dwarf_cache *cache = NULL;
+    if (szCacheDir) {
+        cache = dwarf_cache_open(szCacheDir, szImageName, image);
+        printf("cache %s\n", cache ? "hit" : "miss");
+    }
+
+    Dwarf_Debug dbg = 0;
+    Dwarf_Error error = 0;
+    if (cache) {
+        dbg = 0;
+    } else if (dwarf_pe_init(image, szImageName, 0, 0, &dbg, &error) != DW_DLV_OK) {
+        fprintf(stderr, "warning: no DWARF information in %s\n", szImageName);
+        dbg = 0;
+    }
+    if (dbg && !arena) {
+        // Compare against plain malloc + per-object tracking
+        dwarf_set_arena_mode(dbg, false);
+    }
+    printf("open: %.3f ms\n", elapsed_ms(start));
+
+    std::vector<DWORD64> addresses;
+    for (; i < argc; ++i) {
+        addresses.push_back(strtoull(argv[i], NULL, 16));
+    }
+    if (addresses.empty()) {
+        PIMAGE_SECTION_HEADER pText = pe_image_find_section(image, ".text");
+        if (!pText || !pText->Misc.VirtualSize || !count) {
+            fprintf(stderr, "error: no .text section in %s\n", szImageName);
+            return 1;
+        }
+        DWORD64 base = image->ImageBase + pText->VirtualAddress;
+        for (unsigned j = 0; j < count; ++j) {
+            addresses.push_back(base + (DWORD64)j * pText->Misc.VirtualSize / count);
+        }
+        // Visit in random order, as a crash report or profiler would
+        std::shuffle(addresses.begin(), addresses.end(), std::minstd_rand(1));
+    }
+
+    start = bench_clock::now();
+    struct dwarf_function_index *functions = dbg ? dwarf_function_index_create(dbg) : NULL;
+    printf("function index: %.3f ms\n", elapsed_ms(start));
+    print_alloc_stats(dbg, "function index");
+
+    start = bench_clock::now();
+    struct pe_symbol_index *pe_symbols = pe_symbol_index_create(image);
+    printf("symbol table index: %.3f ms\n", elapsed_ms(start));
+
+    struct dwarf_line_cache *lines = dbg ? dwarf_line_cache_create(dbg) : NULL;
+
+    if (szCacheDir && dbg) {
+        start = bench_clock::now();
+        bool saved = dwarf_cache_save(szCacheDir, szImageName, image, functions, lines);
+        printf("cache save: %.3f ms%s\n", elapsed_ms(start), saved ? "" : " (failed)");
+    }
+
+    // The first pass includes decoding the line tables on demand
+    const char *passes[] = {"cold", "warm"};
+    for (const char *pass : passes) {
+        struct lookup_stats stats;
+        start = bench_clock::now();
+        lookup_all(dbg, functions, lines, cache, pe_symbols, addresses, verbose, &stats);
+        double ms = elapsed_ms(start);
+        printf("%s lookups: %.3f ms, %.1f ns/address (%u addresses, %u functions, %u lines, %u symbols, %u inline frames)\n",
+               pass, ms, ms * 1e6 / addresses.size(), (unsigned)addresses.size(),
+               stats.functions, stats.lines, stats.pe_symbols, stats.inlines);
+        verbose = false;
+    }
+    print_alloc_stats(dbg, "total");
+
+    lookup_names(dbg, functions, lines, cache, addresses);
+
+    start = bench_clock::now();
+
+    if (lines) {
+        dwarf_line_cache_destroy(lines);
+    }
+    if (cache) {
+        dwarf_cache_close(cache);
+    }
+    pe_symbol_index_destroy(pe_symbols);
+    if (functions) {
+        dwarf_function_index_destroy(functions);
+    }
+    if (dbg) {
+        dwarf_pe_finish(dbg, &error);
+    }
+    pe_image_unref(image);
+    printf("cleanup: %.3f ms\n", elapsed_ms(start));
+
+    return 0;
+}
@@ -0,0 +1,629 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include "dwarf_cache.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf_index.h"
+#include "outdbg.h"
+#include "paths.h"
+
+
+/*
+ * File layout: a header followed by 8-byte aligned tables, all in host byte
+ * order.  Rows are the in-memory types from dwarf_index.h, except that line
+ * rows index a single file name table shared by all CUs.
+ */
+
+#define DWARF_CACHE_MAGIC "MGWDIDX"
+#define DWARF_CACHE_VERSION 4
+
+
+struct dwarf_cache_key
+{
+    uint32_t TimeDateStamp;
+    uint32_t CheckSum;
+    uint64_t FileSize;
+    uint32_t DebugLinkCrc;
+    uint32_t Reserved;
+};
+
+
+struct dwarf_cache_table
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+
+struct dwarf_cache_cu
+{
+    uint32_t first_row;
+    uint32_t row_count;
+};
+
+
+struct dwarf_cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    dwarf_cache_key key;
+
+    dwarf_cache_table functions; /* dwarf_function */
+    dwarf_cache_table by_name;   /* uint32_t indices into functions */
+    dwarf_cache_table inlines;   /* dwarf_inline */
+    dwarf_cache_table inline_ranges; /* dwarf_inline_range */
+    dwarf_cache_table ranges;    /* dwarf_cu_range */
+    dwarf_cache_table cus;       /* dwarf_cache_cu */
+    dwarf_cache_table rows;      /* dwarf_line_row */
+    dwarf_cache_table files;     /* uint32_t offsets into strings */
+    dwarf_cache_table strings;   /* char */
+};
+
+
+static_assert(sizeof(dwarf_line_row) == 16, "unexpected dwarf_line_row layout");
+
+
+struct dwarf_cache
+{
+#ifdef _WIN32
+    HANDLE hFileMapping;
+#endif
+    const uint8_t *pData;
+    size_t nSize;
+
+    const dwarf_function *functions;
+    size_t function_count;
+    const uint32_t *by_name;
+    const dwarf_inline *inlines;
+    const dwarf_inline_range *inline_ranges;
+    size_t inline_range_count;
+    const dwarf_cu_range *ranges;
+    size_t range_count;
+    const dwarf_cache_cu *cus;
+    const dwarf_line_row *rows;
+    const uint32_t *files;
+    const char *strings;
+};
+
+
+const char *
+dwarf_cache_dir(void)
+{
+    const char *szCacheDir = getenv("MGWHELP_CACHE_DIR");
+    if (szCacheDir && szCacheDir[0]) {
+        return szCacheDir;
+    }
+    return NULL;
+}
+
+
+static void
+dwarf_cache_key_init(dwarf_cache_key *key, const struct pe_image *image)
+{
+    memset(key, 0, sizeof *key);
+    key->TimeDateStamp = image->pNtHeaders->FileHeader.TimeDateStamp;
+    // Same offset in both optional header flavours
+    key->CheckSum = image->pNtHeaders->OptionalHeader.CheckSum;
+    key->FileSize = image->nFileSize;
+
+    // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
+    PIMAGE_SECTION_HEADER pDebugLink = pe_image_find_section(image, ".gnu_debuglink");
+    if (pDebugLink &&
+        (uint64_t)pDebugLink->PointerToRawData + pDebugLink->SizeOfRawData <= image->nFileSize) {
+        const char *debuglink = (const char *)(image->lpFileBase + pDebugLink->PointerToRawData);
+        size_t offset = (strnlen(debuglink, pDebugLink->SizeOfRawData) + 4) & ~3;
+        if (offset + sizeof key->DebugLinkCrc <= pDebugLink->SizeOfRawData) {
+            memcpy(&key->DebugLinkCrc, debuglink + offset, sizeof key->DebugLinkCrc);
+        }
+    }
+}
+
+
+static std::string
+dwarf_cache_path(const char *szCacheDir,
+                 const char *szImageName,
+                 const dwarf_cache_key *key)
+{
+    std::string path(szCacheDir);
+    if (!path.empty() && path.back() != '/' && path.back() != '\\') {
+        path.push_back('/');
+    }
+
+    char szKey[64];
+    snprintf(szKey, sizeof szKey, "-%08x-%08x-%" PRIx64 "-%08x.idx",
+             key->TimeDateStamp, key->CheckSum, key->FileSize, key->DebugLinkCrc);
+
+    path.append(getBaseName(szImageName));
+    path.append(szKey);
+    return path;
+}
+
+
+static bool
+dwarf_cache_table_valid(const dwarf_cache *cache,
+                        const dwarf_cache_table &table,
+                        size_t element_size)
+{
+    return table.offset % 8 == 0 &&
+           table.offset <= cache->nSize &&
+           table.count <= (cache->nSize - table.offset) / element_size;
+}
+
+
+template <class T>
+static const T *
+dwarf_cache_table_data(const dwarf_cache *cache,
+                       const dwarf_cache_table &table)
+{
+    return (const T *)(cache->pData + table.offset);
+}
+
+
+/*
+ * Check that all indices stay within bounds, so that lookups need no checks
+ * of their own.
+ */
+static bool
+dwarf_cache_validate(dwarf_cache *cache, const dwarf_cache_key *key)
+{
+    if (cache->nSize < sizeof(dwarf_cache_header)) {
+        return false;
+    }
+
+    const dwarf_cache_header *header = (const dwarf_cache_header *)cache->pData;
+    if (memcmp(header->magic, DWARF_CACHE_MAGIC, sizeof header->magic) != 0 ||
+        header->version != DWARF_CACHE_VERSION ||
+        header->header_size != sizeof *header ||
+        memcmp(&header->key, key, sizeof *key) != 0) {
+        return false;
+    }
+
+    if (!dwarf_cache_table_valid(cache, header->functions, sizeof(dwarf_function)) ||
+        !dwarf_cache_table_valid(cache, header->by_name, sizeof(uint32_t)) ||
+        !dwarf_cache_table_valid(cache, header->inlines, sizeof(dwarf_inline)) ||
+        !dwarf_cache_table_valid(cache, header->inline_ranges, sizeof(dwarf_inline_range)) ||
+        !dwarf_cache_table_valid(cache, header->ranges, sizeof(dwarf_cu_range)) ||
+        !dwarf_cache_table_valid(cache, header->cus, sizeof(dwarf_cache_cu)) ||
+        !dwarf_cache_table_valid(cache, header->rows, sizeof(dwarf_line_row)) ||
+        !dwarf_cache_table_valid(cache, header->files, sizeof(uint32_t)) ||
+        !dwarf_cache_table_valid(cache, header->strings, sizeof(char))) {
+        return false;
+    }
+
+    cache->functions = dwarf_cache_table_data<dwarf_function>(cache, header->functions);
+    cache->function_count = header->functions.count;
+    cache->by_name = dwarf_cache_table_data<uint32_t>(cache, header->by_name);
+    cache->inlines = dwarf_cache_table_data<dwarf_inline>(cache, header->inlines);
+    cache->inline_ranges = dwarf_cache_table_data<dwarf_inline_range>(cache, header->inline_ranges);
+    cache->inline_range_count = header->inline_ranges.count;
+    cache->ranges = dwarf_cache_table_data<dwarf_cu_range>(cache, header->ranges);
+    cache->range_count = header->ranges.count;
+    cache->cus = dwarf_cache_table_data<dwarf_cache_cu>(cache, header->cus);
+    cache->rows = dwarf_cache_table_data<dwarf_line_row>(cache, header->rows);
+    cache->files = dwarf_cache_table_data<uint32_t>(cache, header->files);
+    cache->strings = dwarf_cache_table_data<char>(cache, header->strings);
+
+    uint64_t string_count = header->strings.count;
+    if (!string_count || cache->strings[string_count - 1] != '\0') {
+        return false;
+    }
+    for (size_t i = 0; i < cache->function_count; ++i) {
+        if (cache->functions[i].name >= string_count) {
+            return false;
+        }
+    }
+    if (header->by_name.count != cache->function_count) {
+        return false;
+    }
+    for (size_t i = 0; i < cache->function_count; ++i) {
+        if (cache->by_name[i] >= cache->function_count) {
+            return false;
+        }
+    }
+    // Parents precede their children, so that inline stacks always end
+    for (uint64_t i = 0; i < header->inlines.count; ++i) {
+        const dwarf_inline &inline_ = cache->inlines[i];
+        if (inline_.name >= string_count ||
+            inline_.call_file >= string_count ||
+            (inline_.parent != UINT32_MAX && inline_.parent >= i)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < cache->inline_range_count; ++i) {
+        if (cache->inline_ranges[i].inline_ >= header->inlines.count) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < cache->range_count; ++i) {
+        if (cache->ranges[i].cu >= header->cus.count) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->cus.count; ++i) {
+        if ((uint64_t)cache->cus[i].first_row + cache->cus[i].row_count > header->rows.count) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->rows.count; ++i) {
+        if (cache->rows[i].file >= header->files.count) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->files.count; ++i) {
+        if (cache->files[i] >= string_count) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+#ifdef _WIN32
+
+static bool
+dwarf_cache_map(dwarf_cache *cache, const char *szFileName)
+{
+    HANDLE hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD dwFileSizeHi = 0;
+    DWORD dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
+    if (dwFileSizeHi || !dwFileSizeLo) {
+        goto no_file_mapping;
+    }
+    cache->nSize = dwFileSizeLo;
+
+    cache->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!cache->hFileMapping) {
+        goto no_file_mapping;
+    }
+
+    cache->pData = (const uint8_t *)MapViewOfFile(cache->hFileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!cache->pData) {
+        goto no_view_of_file;
+    }
+
+    CloseHandle(hFile);
+    return true;
+
+no_view_of_file:
+    CloseHandle(cache->hFileMapping);
+no_file_mapping:
+    CloseHandle(hFile);
+    return false;
+}
+
+
+static void
+dwarf_cache_unmap(dwarf_cache *cache)
+{
+    UnmapViewOfFile(cache->pData);
+    CloseHandle(cache->hFileMapping);
+}
+
+#else /* !_WIN32 */
+
+static bool
+dwarf_cache_map(dwarf_cache *cache, const char *szFileName)
+{
+    struct stat st;
+    void *pData;
+
+    int fd = open(szFileName, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        goto no_map;
+    }
+
+    pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED) {
+        goto no_map;
+    }
+
+    cache->pData = (const uint8_t *)pData;
+    cache->nSize = st.st_size;
+
+    close(fd);
+    return true;
+
+no_map:
+    close(fd);
+    return false;
+}
+
+
+static void
+dwarf_cache_unmap(dwarf_cache *cache)
+{
+    munmap((void *)cache->pData, cache->nSize);
+}
+
+#endif /* !_WIN32 */
+
+
+struct dwarf_cache *
+dwarf_cache_open(const char *szCacheDir,
+                 const char *szImageName,
+                 const struct pe_image *image)
+{
+    dwarf_cache_key key;
+    dwarf_cache_key_init(&key, image);
+    std::string path = dwarf_cache_path(szCacheDir, szImageName, &key);
+
+    dwarf_cache *cache = (dwarf_cache *)calloc(1, sizeof *cache);
+    if (!cache) {
+        return NULL;
+    }
+
+    if (!dwarf_cache_map(cache, path.c_str())) {
+        free(cache);
+        return NULL;
+    }
+
+    if (!dwarf_cache_validate(cache, &key)) {
+        OutputDebug("MGWHELP: %s - invalid cache file\n", path.c_str());
+        dwarf_cache_close(cache);
+        // Make way for a fresh one
+        remove(path.c_str());
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+void
+dwarf_cache_close(struct dwarf_cache *cache)
+{
+    dwarf_cache_unmap(cache);
+    free(cache);
+}
+
+
+static bool
+dwarf_cache_write_table(FILE *fp,
+                        const dwarf_cache_table &table,
+                        const void *data,
+                        size_t element_size)
+{
+    static const char padding[8] = {0};
+    long pos = ftell(fp);
+    if (pos < 0 || (uint64_t)pos > table.offset) {
+        return false;
+    }
+    if (fwrite(padding, 1, table.offset - pos, fp) != table.offset - pos) {
+        return false;
+    }
+    size_t size = table.count * element_size;
+    return fwrite(data, 1, size, fp) == size;
+}
+
+
+bool
+dwarf_cache_save(const char *szCacheDir,
+                 const char *szImageName,
+                 const struct pe_image *image,
+                 const struct dwarf_function_index *functions,
+                 struct dwarf_line_cache *lines)
+{
+    dwarf_cache_header header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, DWARF_CACHE_MAGIC, sizeof header.magic);
+    header.version = DWARF_CACHE_VERSION;
+    header.header_size = sizeof header;
+    dwarf_cache_key_init(&header.key, image);
+
+    // Function names come first, so their offsets stay valid
+    std::vector<char> strings(functions->names);
+    if (strings.empty()) {
+        strings.push_back('\0');
+    }
+
+    // Merge all CUs' line tables, renumbering their file names.  File names
+    // are interned by the line cache, so their pointers identify them.
+    std::vector<dwarf_cache_cu> cus(lines->cu_count);
+    std::vector<dwarf_line_row> rows;
+    std::vector<uint32_t> files;
+    std::unordered_map<const char *, uint32_t> file_indices;
+    for (uint32_t cu = 0; cu < lines->cu_count; ++cu) {
+        const dwarf_line_table *table = dwarf_line_cache_table(lines, cu);
+
+        std::vector<uint32_t> filemap(table->files.size());
+        for (size_t i = 0; i < table->files.size(); ++i) {
+            const char *file = table->files[i];
+            auto inserted = file_indices.insert(std::make_pair(file, (uint32_t)files.size()));
+            if (inserted.second) {
+                files.push_back(strings.size());
+                strings.insert(strings.end(), file, file + strlen(file) + 1);
+            }
+            filemap[i] = inserted.first->second;
+        }
+
+        cus[cu].first_row = rows.size();
+        cus[cu].row_count = table->rows.size();
+        for (dwarf_line_row row : table->rows) {
+            row.file = filemap[row.file];
+            rows.push_back(row);
+        }
+    }
+
+    uint64_t offset = sizeof header;
+    auto layout = [&offset](dwarf_cache_table &table, size_t count, size_t element_size) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        table.offset = offset;
+        table.count = count;
+        offset += count * element_size;
+    };
+    layout(header.functions, functions->functions.size(), sizeof(dwarf_function));
+    layout(header.by_name, functions->by_name.size(), sizeof(uint32_t));
+    layout(header.inlines, functions->inlines.size(), sizeof(dwarf_inline));
+    layout(header.inline_ranges, functions->inline_ranges.size(), sizeof(dwarf_inline_range));
+    layout(header.ranges, lines->cu_ranges.size(), sizeof(dwarf_cu_range));
+    layout(header.cus, cus.size(), sizeof(dwarf_cache_cu));
+    layout(header.rows, rows.size(), sizeof(dwarf_line_row));
+    layout(header.files, files.size(), sizeof(uint32_t));
+    layout(header.strings, strings.size(), sizeof(char));
+
+#ifdef _WIN32
+    CreateDirectoryA(szCacheDir, NULL);
+    unsigned long pid = GetCurrentProcessId();
+#else
+    mkdir(szCacheDir, 0777);
+    unsigned long pid = getpid();
+#endif
+
+    // Write to a temporary file first, so that concurrent readers never see
+    // a partial index
+    std::string path = dwarf_cache_path(szCacheDir, szImageName, &header.key);
+    char szSuffix[32];
+    snprintf(szSuffix, sizeof szSuffix, ".%lu.tmp", pid);
+    std::string tmpPath = path + szSuffix;
+
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        OutputDebug("MGWHELP: %s - failed to create cache file\n", tmpPath.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof header, 1, fp) == 1 &&
+              dwarf_cache_write_table(fp, header.functions, functions->functions.data(), sizeof(dwarf_function)) &&
+              dwarf_cache_write_table(fp, header.by_name, functions->by_name.data(), sizeof(uint32_t)) &&
+              dwarf_cache_write_table(fp, header.inlines, functions->inlines.data(), sizeof(dwarf_inline)) &&
+              dwarf_cache_write_table(fp, header.inline_ranges, functions->inline_ranges.data(),
+                                      sizeof(dwarf_inline_range)) &&
+              dwarf_cache_write_table(fp, header.ranges, lines->cu_ranges.data(), sizeof(dwarf_cu_range)) &&
+              dwarf_cache_write_table(fp, header.cus, cus.data(), sizeof(dwarf_cache_cu)) &&
+              dwarf_cache_write_table(fp, header.rows, rows.data(), sizeof(dwarf_line_row)) &&
+              dwarf_cache_write_table(fp, header.files, files.data(), sizeof(uint32_t)) &&
+              dwarf_cache_write_table(fp, header.strings, strings.data(), sizeof(char));
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        OutputDebug("MGWHELP: %s - failed to write cache file\n", tmpPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    // Replace any existing file, as CRT's rename won't
+#ifdef _WIN32
+    ok = MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok) {
+        OutputDebug("MGWHELP: %s - failed to rename cache file\n", tmpPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+dwarf_cache_find(const struct dwarf_cache *cache,
+                 Dwarf_Addr addr,
+                 struct find_dwarf_info *info)
+{
+    const dwarf_function *function = dwarf_find_function(cache->functions,
+                                                         cache->functions + cache->function_count,
+                                                         addr);
+    if (function) {
+        info->functionname = cache->strings + function->name;
+        info->functionaddr = function->lowpc;
+        info->functionsize = function->highpc - function->lowpc;
+        info->found = true;
+    }
+
+    const dwarf_cu_range *range = dwarf_find_cu_range(cache->ranges,
+                                                      cache->ranges + cache->range_count,
+                                                      addr);
+    if (!range) {
+        return;
+    }
+
+    const dwarf_cache_cu *cu = &cache->cus[range->cu];
+    const dwarf_line_row *begin = cache->rows + cu->first_row;
+    const dwarf_line_row *row = dwarf_find_line(begin, begin + cu->row_count, addr);
+    if (row) {
+        info->filename = cache->strings + cache->files[row->file];
+        info->lineaddr = row->addr;
+        info->line = row->line;
+    }
+}
+
+
+unsigned
+dwarf_cache_find_inlines(const struct dwarf_cache *cache,
+                         Dwarf_Addr addr,
+                         struct find_dwarf_inline *frames,
+                         unsigned max_count)
+{
+    return dwarf_find_inlines(cache->inlines,
+                              cache->inline_ranges,
+                              cache->inline_ranges + cache->inline_range_count,
+                              cache->strings,
+                              addr, frames, max_count);
+}
+
+
+void
+dwarf_cache_find_name(const struct dwarf_cache *cache,
+                      const char *name,
+                      struct find_dwarf_info *info)
+{
+    const dwarf_function *function = dwarf_find_function_name(cache->functions,
+                                                              cache->by_name,
+                                                              cache->by_name + cache->function_count,
+                                                              cache->strings,
+                                                              name);
+    if (function) {
+        info->functionname = cache->strings + function->name;
+        info->functionaddr = function->lowpc;
+        info->functionsize = function->highpc - function->lowpc;
+        info->found = true;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "pe_image.h"
+#include "dwarf_find.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Persistent on-disk copy of a module's function and line indices.
+ *
+ * Cache files are named after the image, and keyed by its timestamp,
+ * checksum, and size, plus the CRC of its .gnu_debuglink (if any), so a
+ * rebuilt image or debug file never matches a stale entry.  Valid entries
+ * are mapped read-only and looked up in place, without involving libdwarf.
+ */
+struct dwarf_cache;
+
+
+/*
+ * Directory named by the MGWHELP_CACHE_DIR environment variable, or NULL
+ * when caching is disabled.
+ */
+const char *
+dwarf_cache_dir(void);
+
+struct dwarf_cache *
+dwarf_cache_open(const char *szCacheDir,
+                 const char *szImageName,
+                 const struct pe_image *image);
+
+/*
+ * Write the indices for an image into the cache directory.  Decodes all
+ * line tables not decoded yet.
+ */
+bool
+dwarf_cache_save(const char *szCacheDir,
+                 const char *szImageName,
+                 const struct pe_image *image,
+                 const struct dwarf_function_index *functions,
+                 struct dwarf_line_cache *lines);
+
+void
+dwarf_cache_close(struct dwarf_cache *cache);
+
+/*
+ * Same as find_dwarf_symbol.  Thread-safe.
+ */
+void
+dwarf_cache_find(const struct dwarf_cache *cache,
+                 Dwarf_Addr addr,
+                 struct find_dwarf_info *info);
+
+/*
+ * Same as find_dwarf_inlines.  Thread-safe.
+ */
+unsigned
+dwarf_cache_find_inlines(const struct dwarf_cache *cache,
+                         Dwarf_Addr addr,
+                         struct find_dwarf_inline *frames,
+                         unsigned max_count);
+
+/*
+ * Same as find_dwarf_name, by DW_AT_name only.  Thread-safe.
+ */
+void
+dwarf_cache_find_name(const struct dwarf_cache *cache,
+                      const char *name,
+                      struct find_dwarf_info *info);
+
+
+#ifdef __cplusplus
+}
+#endif
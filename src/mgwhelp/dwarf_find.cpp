@@ -29,127 +29,1233 @@
  */
 
 
-#include "dwarf_find.h"
+#include "dwarf_index.h"
+#include "dwarf_pe.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
 
 #include "outdbg.h"
+#include "thread.h"
+
+
+static char unknown[] = { '?', '?', '\0' };
+
+
+typedef std::unordered_map<const char *, uint32_t> name_map;
+
+
+static const char *
+get_die_name_at(Dwarf_Debug dbg, Dwarf_Off offset, unsigned depth = 0);
+
+
+static const char *
+get_die_name(Dwarf_Debug dbg, Dwarf_Die die, unsigned depth = 0)
+{
+    Dwarf_Error de = 0;
+    Dwarf_Attribute ref_at;
+    Dwarf_Off ref;
+    char *name = unknown;
+    int ret;
+
+    ret = dwarf_diename(die, &name, &de);
+    if (ret == DW_DLV_OK) {
+        return name;
+    }
+    if (ret == DW_DLV_ERROR) {
+        return unknown;
+    }
+
+    /*
+     * If DW_AT_name is not present, but DW_AT_abstract_origin (for inlined
+     * and out-of-line instances) or DW_AT_specification is present, then
+     * probably the actual name is in the DIE referenced by it.
+     */
+    if (depth > 4 ||
+        (dwarf_attr(die, DW_AT_abstract_origin, &ref_at, &de) != DW_DLV_OK &&
+         dwarf_attr(die, DW_AT_specification, &ref_at, &de) != DW_DLV_OK)) {
+        return unknown;
+    }
+    ret = dwarf_global_formref(ref_at, &ref, &de);
+    dwarf_dealloc(dbg, ref_at, DW_DLA_ATTR);
+    if (ret != DW_DLV_OK) {
+        return unknown;
+    }
+
+    return get_die_name_at(dbg, ref, depth + 1);
+}
+
+
+/*
+ * Same as get_die_name, for the DIE at the given offset.
+ */
+static const char *
+get_die_name_at(Dwarf_Debug dbg, Dwarf_Off offset, unsigned depth)
+{
+    Dwarf_Error de = 0;
+    Dwarf_Die die;
+    const char *name;
+
+    if (dwarf_offdie(dbg, offset, &die, &de) != DW_DLV_OK) {
+        return unknown;
+    }
+    name = get_die_name(dbg, die, depth);
+    dwarf_dealloc(dbg, die, DW_DLA_DIE);
+
+    return name;
+}
+
+
+/*
+ * Name of the cursor's current DIE, given its DW_AT_name, and the
+ * DW_AT_abstract_origin and DW_AT_specification chain.  Falls back to the
+ * Dwarf_Die interfaces for references to other CUs, or forms the cursor
+ * doesn't decode.
+ */
+static const char *
+get_function_name(Dwarf_Debug dbg,
+                  Dwarf_Die_Cursor *cursor,
+                  const Dwarf_Die_Attrs *attrs)
+{
+    const Dwarf_Unsigned want = DW_DCA_NAME | DW_DCA_SPECIFICATION | DW_DCA_ABSTRACT_ORIGIN;
+    Dwarf_Error de = 0;
+    Dwarf_Die_Attrs ref_attrs;
+    Dwarf_Off ref;
+    int ret;
+
+    for (unsigned depth = 0; depth <= 4; ++depth) {
+        if (attrs->dca_present & DW_DCA_NAME) {
+            return attrs->dca_name;
+        }
+        if (attrs->dca_other_form & want) {
+            return get_die_name_at(dbg, cursor->dc_offset);
+        }
+        if (attrs->dca_present & DW_DCA_ABSTRACT_ORIGIN) {
+            ref = attrs->dca_abstract_origin;
+        } else if (attrs->dca_present & DW_DCA_SPECIFICATION) {
+            ref = attrs->dca_specification;
+        } else {
+            return unknown;
+        }
+
+        ret = dwarf_die_cursor_attrs_at(cursor, ref, want, &ref_attrs, &de);
+        if (ret == DW_DLV_ERROR) {
+            return unknown;
+        }
+        if (ret == DW_DLV_NO_ENTRY) {
+            return get_die_name_at(dbg, cursor->dc_offset);
+        }
+        attrs = &ref_attrs;
+    }
+    return unknown;
+}
+
+
+/*
+ * An address range of a DIE.
+ */
+struct die_range
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+};
+
+
+/*
+ * Get the non-empty address ranges of a DIE, given its DW_AT_low_pc and
+ * DW_AT_high_pc, or DW_AT_ranges, whose entries are relative to the base
+ * address of the CU.
+ */
+static void
+get_die_ranges(Dwarf_Debug dbg,
+               const Dwarf_Die_Attrs *attrs,
+               Dwarf_Addr cu_base,
+               std::vector<die_range> &ranges)
+{
+    Dwarf_Error de = 0;
+    die_range range;
+
+    ranges.clear();
+
+    if (attrs->dca_present & DW_DCA_RANGES) {
+        Dwarf_Ranges *entries;
+        Dwarf_Signed entry_count;
+        if (dwarf_get_ranges(dbg, attrs->dca_ranges, &entries, &entry_count, NULL, &de) != DW_DLV_OK) {
+            OutputDebug("MGWHELP: dwarf_get_ranges failed - %s\n", dwarf_errmsg(de));
+            return;
+        }
+        Dwarf_Addr base = cu_base;
+        for (Dwarf_Signed i = 0; i < entry_count; ++i) {
+            if (entries[i].dwr_type == DW_RANGES_ADDRESS_SELECTION) {
+                base = entries[i].dwr_addr2;
+            } else if (entries[i].dwr_type == DW_RANGES_ENTRY &&
+                       entries[i].dwr_addr1 < entries[i].dwr_addr2) {
+                range.lowpc = base + entries[i].dwr_addr1;
+                range.highpc = base + entries[i].dwr_addr2;
+                ranges.push_back(range);
+            }
+        }
+        dwarf_ranges_dealloc(dbg, entries, entry_count);
+    } else if ((attrs->dca_present & DW_DCA_HIGH_PC) &&
+               attrs->dca_lowpc < attrs->dca_highpc) {
+        range.lowpc = attrs->dca_lowpc;
+        range.highpc = attrs->dca_highpc;
+        ranges.push_back(range);
+    }
+}
+
+
+/*
+ * An address range of an inline, before flattening.
+ */
+struct inline_entry
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    uint32_t inline_;
+    uint32_t depth;
+};
+
+
+/*
+ * A name as first added to the names blob.
+ */
+struct interned_name
+{
+    uint32_t offset;
+    const char *key; /* what it is interned by, or NULL for file names */
+};
+
+
+/*
+ * State carried across CUs while building a function index.
+ */
+struct index_state
+{
+    name_map names;
+
+    /* File names come from the arena, so go by value */
+    std::unordered_map<std::string, uint32_t> files;
+
+    /* All of the above, in the order they were added, so that merge_index
+     * can add them again in the same order */
+    std::vector<interned_name> interned;
+
+    std::vector<inline_entry> inline_entries;
+
+    /* Scratch space for get_die_ranges */
+    std::vector<die_range> ranges;
+};
+
+
+static uint32_t
+intern_name(struct dwarf_function_index *index,
+            index_state &state,
+            const char *name)
+{
+    auto it = state.names.find(name);
+    if (it != state.names.end()) {
+        return it->second;
+    }
+
+    uint32_t offset = index->names.size();
+    index->names.insert(index->names.end(), name, name + strlen(name) + 1);
+    state.names.emplace(name, offset);
+    state.interned.push_back({offset, name});
+    return offset;
+}
+
+
+static uint32_t
+intern_file(struct dwarf_function_index *index,
+            index_state &state,
+            const char *file)
+{
+    auto inserted = state.files.emplace(file, (uint32_t)index->names.size());
+    if (inserted.second) {
+        uint32_t offset = inserted.first->second;
+        index->names.insert(index->names.end(), file, file + strlen(file) + 1);
+        state.interned.push_back({offset, NULL});
+    }
+    return inserted.first->second;
+}
+
+
+/*
+ * Map a CU's line table file numbers to names, for DW_AT_call_file.
+ */
+static void
+read_call_files(Dwarf_Debug dbg,
+                struct dwarf_function_index *index,
+                index_state &state,
+                Dwarf_Off cu_die_offset,
+                std::vector<uint32_t> &call_files)
+{
+    Dwarf_Error de = 0;
+    Dwarf_Die cu_die;
+    char **srcfiles;
+    Dwarf_Signed srcfile_count;
+
+    if (dwarf_offdie_b(dbg, cu_die_offset, 1, &cu_die, &de) != DW_DLV_OK) {
+        return;
+    }
+    if (dwarf_srcfiles(cu_die, &srcfiles, &srcfile_count, &de) == DW_DLV_OK) {
+        call_files.resize(srcfile_count);
+        for (Dwarf_Signed i = 0; i < srcfile_count; ++i) {
+            call_files[i] = intern_file(index, state, srcfiles[i]);
+            dwarf_dealloc(dbg, srcfiles[i], DW_DLA_STRING);
+        }
+        dwarf_dealloc(dbg, srcfiles, DW_DLA_LIST);
+    }
+    dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+}
+
+
+/*
+ * Record a DW_TAG_inlined_subroutine, and its address ranges.  Returns its
+ * index, or UINT32_MAX if it has no code.
+ */
+static uint32_t
+index_inline(Dwarf_Debug dbg,
+             struct dwarf_function_index *index,
+             index_state &state,
+             Dwarf_Die_Cursor *cursor,
+             const Dwarf_Die_Attrs *attrs,
+             Dwarf_Addr cu_base,
+             const std::vector<uint32_t> &call_files,
+             uint32_t parent,
+             uint32_t depth)
+{
+    uint32_t inline_ = index->inlines.size();
+
+    get_die_ranges(dbg, attrs, cu_base, state.ranges);
+    if (state.ranges.empty()) {
+        return UINT32_MAX;
+    }
+
+    dwarf_inline record;
+    record.lowpc = state.ranges[0].lowpc;
+    for (const die_range &range : state.ranges) {
+        inline_entry entry;
+        entry.lowpc = range.lowpc;
+        entry.highpc = range.highpc;
+        entry.inline_ = inline_;
+        entry.depth = depth;
+        state.inline_entries.push_back(entry);
+        record.lowpc = std::min(record.lowpc, range.lowpc);
+    }
+    record.name = intern_name(index, state, get_function_name(dbg, cursor, attrs));
+    /* File numbers are 1-based, as in the line table */
+    Dwarf_Unsigned call_file = attrs->dca_call_file;
+    if ((attrs->dca_present & DW_DCA_CALL_FILE) &&
+        call_file >= 1 && call_file <= call_files.size()) {
+        record.call_file = call_files[call_file - 1];
+    } else {
+        record.call_file = intern_name(index, state, unknown);
+    }
+    record.call_line = (attrs->dca_present & DW_DCA_CALL_LINE) ? attrs->dca_call_line : 0;
+    record.parent = parent;
+    index->inlines.push_back(record);
+
+    return inline_;
+}
+
+
+/*
+ * Walk the current CU's DIEs, recording the address range of every
+ * DW_TAG_subprogram, and of the DW_TAG_inlined_subroutine DIEs within them.
+ */
+static void
+index_functions(Dwarf_Debug dbg,
+                struct dwarf_function_index *index,
+                index_state &state)
+{
+    Dwarf_Die_Cursor cursor;
+    Dwarf_Die_Attrs attrs;
+    Dwarf_Error de = 0;
+    int ret;
+
+    /* Enclosing inlines, as (DIE level, inline index) pairs */
+    std::vector<std::pair<int, uint32_t>> inline_stack;
+    Dwarf_Off cu_die_offset = 0;
+    Dwarf_Addr cu_base = 0;
+    std::vector<uint32_t> call_files;
+    bool call_files_read = false;
+
+    if (dwarf_die_cursor_init(dbg, 1, &cursor, &de) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: dwarf_die_cursor_init failed - %s\n", dwarf_errmsg(de));
+        return;
+    }
+
+    while ((ret = dwarf_die_cursor_next(&cursor, &de)) == DW_DLV_OK) {
+        while (!inline_stack.empty() && inline_stack.back().first >= cursor.dc_level) {
+            inline_stack.pop_back();
+        }
+
+        switch (cursor.dc_tag) {
+        case DW_TAG_compile_unit:
+            /* Base address for DW_AT_ranges */
+            cu_die_offset = cursor.dc_offset;
+            if (dwarf_die_cursor_attrs(&cursor, DW_DCA_LOW_PC, &attrs, &de) == DW_DLV_OK &&
+                (attrs.dca_present & DW_DCA_LOW_PC)) {
+                cu_base = attrs.dca_lowpc;
+            }
+            continue;
+        case DW_TAG_subprogram:
+        case DW_TAG_inlined_subroutine:
+            break;
+        case DW_TAG_array_type:
+        case DW_TAG_enumeration_type:
+        case DW_TAG_subroutine_type:
+            /* Can't contain code */
+            dwarf_die_cursor_skip_children(&cursor);
+            continue;
+        default:
+            continue;
+        }
+
+        if (dwarf_die_cursor_attrs(&cursor,
+                                   DW_DCA_NAME | DW_DCA_HIGH_PC | DW_DCA_SPECIFICATION | DW_DCA_ABSTRACT_ORIGIN |
+                                       DW_DCA_RANGES | DW_DCA_CALL_FILE | DW_DCA_CALL_LINE,
+                                   &attrs, &de) != DW_DLV_OK) {
+            OutputDebug("MGWHELP: dwarf_die_cursor_attrs failed - %s\n", dwarf_errmsg(de));
+            return;
+        }
+
+        if (cursor.dc_tag == DW_TAG_inlined_subroutine) {
+            if (!call_files_read) {
+                read_call_files(dbg, index, state, cu_die_offset, call_files);
+                call_files_read = true;
+            }
+            uint32_t parent = inline_stack.empty() ? UINT32_MAX : inline_stack.back().second;
+            uint32_t inline_ = index_inline(dbg, index, state, &cursor, &attrs, cu_base, call_files, parent,
+                                            inline_stack.size() + 1);
+            if (inline_ != UINT32_MAX) {
+                inline_stack.push_back(std::make_pair(cursor.dc_level, inline_));
+            }
+            continue;
+        }
+
+        /* Functions split into hot and cold parts have several ranges */
+        get_die_ranges(dbg, &attrs, cu_base, state.ranges);
+        if (!state.ranges.empty()) {
+            dwarf_function function;
+            function.name = intern_name(index, state, get_function_name(dbg, &cursor, &attrs));
+            function.reserved = 0;
+            for (const die_range &range : state.ranges) {
+                function.lowpc = range.lowpc;
+                function.highpc = range.highpc;
+                index->functions.push_back(function);
+            }
+        }
+    }
+    if (ret == DW_DLV_ERROR) {
+        OutputDebug("MGWHELP: dwarf_die_cursor_next failed - %s\n", dwarf_errmsg(de));
+    }
+}
+
+
+static bool
+inline_entry_less(const inline_entry &a, const inline_entry &b)
+{
+    return a.lowpc < b.lowpc || (a.lowpc == b.lowpc && a.depth < b.depth);
+}
+
+
+/*
+ * Split the nested inline ranges into disjoint ones, each mapped to the
+ * innermost inline containing it, so that a single binary search finds the
+ * whole inline stack of an address.
+ */
+static void
+flatten_inline_ranges(std::vector<inline_entry> &entries,
+                      std::vector<dwarf_inline_range> &ranges)
+{
+    std::stable_sort(entries.begin(), entries.end(), inline_entry_less);
+
+    std::vector<inline_entry> active;
+    Dwarf_Addr pos = 0;
+    auto emit = [&](Dwarf_Addr end, uint32_t inline_) {
+        if (pos >= end) {
+            return;
+        }
+        if (!ranges.empty() && ranges.back().highpc == pos && ranges.back().inline_ == inline_) {
+            ranges.back().highpc = end;
+        } else {
+            dwarf_inline_range range;
+            range.lowpc = pos;
+            range.highpc = end;
+            range.inline_ = inline_;
+            range.reserved = 0;
+            ranges.push_back(range);
+        }
+        pos = end;
+    };
+
+    for (inline_entry entry : entries) {
+        /* Close the ranges ending before this one, and its overlapping
+         * siblings */
+        while (!active.empty()) {
+            const inline_entry &top = active.back();
+            if (top.highpc <= entry.lowpc) {
+                emit(top.highpc, top.inline_);
+            } else if (top.depth >= entry.depth) {
+                emit(entry.lowpc, top.inline_);
+            } else {
+                break;
+            }
+            active.pop_back();
+        }
+        if (!active.empty()) {
+            emit(entry.lowpc, active.back().inline_);
+            entry.highpc = std::min(entry.highpc, active.back().highpc);
+        }
+        pos = std::max(pos, entry.lowpc);
+        if (entry.lowpc < entry.highpc) {
+            active.push_back(entry);
+        }
+    }
+    while (!active.empty()) {
+        emit(active.back().highpc, active.back().inline_);
+        active.pop_back();
+    }
+}
+
+
+static bool
+function_less(const dwarf_function &a, const dwarf_function &b)
+{
+    return a.lowpc < b.lowpc;
+}
+
+
+static bool
+function_same_lowpc(const dwarf_function &a, const dwarf_function &b)
+{
+    return a.lowpc == b.lowpc;
+}
+
+
+/*
+ * Index the current CU.
+ */
+static bool
+index_cu(Dwarf_Debug dbg,
+         struct dwarf_function_index *index,
+         index_state &state)
+{
+    Dwarf_Error error = 0;
+
+    /* Release what the slow paths allocate for each CU in one go */
+    if (dwarf_arena_begin(dbg, &error) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: dwarf_arena_begin failed - %s\n", dwarf_errmsg(error));
+        return false;
+    }
+    index_functions(dbg, index, state);
+    dwarf_arena_end(dbg);
+    return true;
+}
+
+
+static int
+next_cu(Dwarf_Debug dbg, Dwarf_Error *error)
+{
+    Dwarf_Unsigned next_cu_header = 0;
+    return dwarf_next_cu_header_d(dbg, 1, NULL, NULL, NULL, NULL, NULL,
+                                  NULL, NULL, NULL, &next_cu_header,
+                                  NULL, error);
+}
+
+
+/*
+ * What indexing one CU on its own yields.
+ */
+struct cu_index
+{
+    dwarf_function_index index;
+    index_state state;
+};
+
+
+/*
+ * Append a CU's own index to the module's.  The CU's names are interned
+ * again in the order it added them, so that merging CUs in .debug_info order
+ * gives the same index as indexing them all in turn.
+ */
+static void
+merge_index(struct dwarf_function_index *index,
+            index_state &state,
+            const cu_index &part)
+{
+    std::vector<uint32_t> offsets(part.index.names.size());
+    for (const interned_name &interned : part.state.interned) {
+        if (interned.key) {
+            offsets[interned.offset] = intern_name(index, state, interned.key);
+        } else {
+            offsets[interned.offset] = intern_file(index, state, &part.index.names[interned.offset]);
+        }
+    }
+
+    for (dwarf_function function : part.index.functions) {
+        function.name = offsets[function.name];
+        index->functions.push_back(function);
+    }
+
+    uint32_t inline_base = index->inlines.size();
+    for (dwarf_inline record : part.index.inlines) {
+        record.name = offsets[record.name];
+        record.call_file = offsets[record.call_file];
+        if (record.parent != UINT32_MAX) {
+            record.parent += inline_base;
+        }
+        index->inlines.push_back(record);
+    }
+    for (inline_entry entry : part.state.inline_entries) {
+        entry.inline_ += inline_base;
+        state.inline_entries.push_back(entry);
+    }
+}
+
+
+/*
+ * A thread indexing CUs, on a Dwarf_Debug of its own.  CUs are handed out
+ * in order, so that each worker only needs one pass over the CU headers.
+ */
+struct index_worker
+{
+    Dwarf_Debug dbg;
+    std::atomic<size_t> *next;
+    cu_index *cus;
+    size_t cu_count;
+};
+
+
+static void
+index_worker_run(void *arg)
+{
+    struct index_worker *worker = (struct index_worker *)arg;
+    Dwarf_Error error = 0;
+    size_t cu = 0;
+    size_t claimed = worker->next->fetch_add(1);
+    while (claimed < worker->cu_count && next_cu(worker->dbg, &error) == DW_DLV_OK) {
+        if (cu++ != claimed) {
+            continue;
+        }
+        cu_index &part = worker->cus[claimed];
+        if (!index_cu(worker->dbg, &part.index, part.state)) {
+            break;
+        }
+        claimed = worker->next->fetch_add(1);
+    }
+}
+
+
+/* Fewer CUs per thread aren't worth a Dwarf_Debug and a thread each */
+#define INDEX_MIN_CUS_PER_THREAD 4
+
+static unsigned index_thread_count = 0;
+
+
+void
+dwarf_set_index_threads(unsigned count)
+{
+    index_thread_count = count;
+}
+
+
+/*
+ * Index the CUs over several threads, or return false if not worth it.
+ */
+static bool
+index_cus_parallel(Dwarf_Debug dbg,
+                   struct dwarf_function_index *index,
+                   index_state &state)
+{
+    unsigned thread_count = index_thread_count ? index_thread_count : thread_processor_count();
+    if (thread_count <= 1) {
+        return false;
+    }
+
+    Dwarf_Error error = 0;
+    size_t cu_count = 0;
+    int ret;
+    while ((ret = next_cu(dbg, &error)) == DW_DLV_OK) {
+        ++cu_count;
+    }
+    if (ret == DW_DLV_ERROR) {
+        return false;
+    }
+    thread_count = std::min<size_t>(thread_count, cu_count / INDEX_MIN_CUS_PER_THREAD);
+    if (thread_count <= 1) {
+        return false;
+    }
+
+    std::unique_ptr<cu_index[]> cus(new cu_index[cu_count]);
+    std::atomic<size_t> next(0);
+    std::vector<index_worker> workers(thread_count);
+    unsigned worker_count = 0;
+    for (index_worker &worker : workers) {
+        if (dwarf_pe_clone(dbg, &worker.dbg, &error) != DW_DLV_OK) {
+            break;
+        }
+        worker.next = &next;
+        worker.cus = cus.get();
+        worker.cu_count = cu_count;
+        ++worker_count;
+    }
+
+    if (worker_count) {
+        // The calling thread is a worker too
+        std::vector<thread_t> threads(worker_count);
+        std::vector<bool> started(worker_count, false);
+        for (unsigned i = 1; i < worker_count; ++i) {
+            started[i] = thread_create(&threads[i], index_worker_run, &workers[i]);
+        }
+        index_worker_run(&workers[0]);
+        for (unsigned i = 1; i < worker_count; ++i) {
+            if (started[i]) {
+                thread_join(threads[i]);
+            }
+        }
+
+        for (size_t cu = 0; cu < cu_count; ++cu) {
+            merge_index(index, state, cus[cu]);
+            cus[cu] = cu_index();
+        }
+    }
+
+    for (unsigned i = 0; i < worker_count; ++i) {
+        dwarf_pe_finish(workers[i].dbg, &error);
+    }
+
+    return worker_count != 0;
+}
+
+
+struct dwarf_function_index *
+dwarf_function_index_create(Dwarf_Debug dbg)
+{
+    struct dwarf_function_index *index = new dwarf_function_index;
+    index_state state;
+
+    // The frame index may be using dbg already
+    dwarf_pe_lock(dbg);
+    if (!index_cus_parallel(dbg, index, state)) {
+        Dwarf_Error error = 0;
+        int ret;
+        while ((ret = next_cu(dbg, &error)) == DW_DLV_OK) {
+            if (!index_cu(dbg, index, state)) {
+                break;
+            }
+        }
+        if (ret == DW_DLV_ERROR) {
+            OutputDebug("MGWHELP: dwarf_next_cu_header_d failed - %s\n", dwarf_errmsg(error));
+        }
+    }
+    dwarf_pe_unlock(dbg);
+
+    /*
+     * Subprogram ranges don't overlap, except for the odd duplicate DIE, in
+     * which case the first one in .debug_info order wins, as before.
+     */
+    std::stable_sort(index->functions.begin(), index->functions.end(), function_less);
+    index->functions.erase(std::unique(index->functions.begin(), index->functions.end(), function_same_lowpc),
+                           index->functions.end());
+    index->functions.shrink_to_fit();
+    index->names.shrink_to_fit();
+
+    flatten_inline_ranges(state.inline_entries, index->inline_ranges);
+    index->inlines.shrink_to_fit();
+    index->inline_ranges.shrink_to_fit();
+
+    dwarf_sort_function_names(index->functions.data(), index->functions.size(), index->names.data(),
+                              index->by_name);
+
+    return index;
+}
+
+
+void
+dwarf_function_index_destroy(struct dwarf_function_index *index)
+{
+    delete index;
+}
+
+
+const dwarf_function *
+dwarf_find_function(const dwarf_function *begin,
+                    const dwarf_function *end,
+                    Dwarf_Addr addr)
+{
+    auto it = std::upper_bound(begin, end, addr,
+                               [](Dwarf_Addr a, const dwarf_function &f) { return a < f.lowpc; });
+    if (it == begin) {
+        return NULL;
+    }
+    --it;
+    if (addr >= it->highpc) {
+        return NULL;
+    }
+    return it;
+}
+
+
+void
+dwarf_sort_function_names(const dwarf_function *functions,
+                          size_t count,
+                          const char *names,
+                          std::vector<uint32_t> &by_name)
+{
+    by_name.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        by_name[i] = i;
+    }
+    std::stable_sort(by_name.begin(), by_name.end(),
+                     [functions, names](uint32_t a, uint32_t b) {
+                         return strcmp(&names[functions[a].name], &names[functions[b].name]) < 0;
+                     });
+}
+
+
+const dwarf_function *
+dwarf_find_function_name(const dwarf_function *functions,
+                         const uint32_t *begin,
+                         const uint32_t *end,
+                         const char *names,
+                         const char *name)
+{
+    auto it = std::lower_bound(begin, end, name,
+                               [functions, names](uint32_t i, const char *n) {
+                                   return strcmp(&names[functions[i].name], n) < 0;
+                               });
+    if (it == end || strcmp(&names[functions[*it].name], name) != 0) {
+        return NULL;
+    }
+    return &functions[*it];
+}
+
+
+unsigned
+dwarf_find_inlines(const dwarf_inline *inlines,
+                   const dwarf_inline_range *begin,
+                   const dwarf_inline_range *end,
+                   const char *names,
+                   Dwarf_Addr addr,
+                   struct find_dwarf_inline *frames,
+                   unsigned max_count)
+{
+    auto it = std::upper_bound(begin, end, addr,
+                               [](Dwarf_Addr a, const dwarf_inline_range &r) { return a < r.lowpc; });
+    if (it == begin) {
+        return 0;
+    }
+    --it;
+    if (addr >= it->highpc) {
+        return 0;
+    }
+
+    unsigned count = 0;
+    for (uint32_t i = it->inline_; i != UINT32_MAX; i = inlines[i].parent) {
+        if (count < max_count) {
+            frames[count].functionname = &names[inlines[i].name];
+            frames[count].functionaddr = inlines[i].lowpc;
+            frames[count].callfile = &names[inlines[i].call_file];
+            frames[count].callline = inlines[i].call_line;
+        }
+        ++count;
+    }
+    return count;
+}
 
 
-static char unknown[] = { '?', '?', '\0' };
+unsigned
+find_dwarf_inlines(const struct dwarf_function_index *functions,
+                   Dwarf_Addr addr,
+                   struct find_dwarf_inline *frames,
+                   unsigned max_count)
+{
+    return dwarf_find_inlines(functions->inlines.data(),
+                              functions->inline_ranges.data(),
+                              functions->inline_ranges.data() + functions->inline_ranges.size(),
+                              functions->names.data(),
+                              addr, frames, max_count);
+}
 
 
-static void
-search_func(Dwarf_Debug dbg,
-            Dwarf_Die die,
-            Dwarf_Addr addr,
-            char **rlt_func)
-{
-    Dwarf_Die spec_die;
-    Dwarf_Die child_die;
-    Dwarf_Die sibling_die;
-    Dwarf_Error de;
-    Dwarf_Half tag, return_form;
-    Dwarf_Unsigned lopc, hipc;
-    Dwarf_Off ref;
-    Dwarf_Attribute sub_at, spec_at;
-    char *func0;
-    int ret;
-    enum Dwarf_Form_Class return_class;
+static bool
+cu_range_less(const dwarf_cu_range &a, const dwarf_cu_range &b)
+{
+    return a.lowpc < b.lowpc;
+}
 
-    do {
 
-        if (*rlt_func != NULL)
-            return;
+typedef std::unordered_map<Dwarf_Off, uint32_t> cu_map;
 
-        if (dwarf_tag(die, &tag, &de) != DW_DLV_OK) {
-            OutputDebug("MGWHELP: dwarf_tag failed - %s", dwarf_errmsg(de));
-            goto cont_search;
-        }
-
-        if (tag == DW_TAG_subprogram) {
-            if (dwarf_lowpc(die, &lopc, &de) != DW_DLV_OK ||
-                dwarf_highpc_b(die, &hipc, &return_form, &return_class, &de) != DW_DLV_OK)
-                goto cont_search;
-            if (return_class == DW_FORM_CLASS_CONSTANT)
-                hipc += lopc;
-            if (addr < lopc || addr >= hipc)
-                goto cont_search;
-
-            /* Found it! */
-
-            *rlt_func = unknown;
-            ret = dwarf_attr(die, DW_AT_name, &sub_at, &de);
-            if (ret == DW_DLV_ERROR)
-                return;
-            if (ret == DW_DLV_OK) {
-                if (dwarf_formstring(sub_at, &func0, &de) != DW_DLV_OK)
-                    *rlt_func = unknown;
-                else
-                    *rlt_func = func0;
-                return;
-            }
-
-            /*
-             * If DW_AT_name is not present, but DW_AT_specification is
-             * present, then probably the actual name is in the DIE
-             * referenced by DW_AT_specification.
-             */
-            if (dwarf_attr(die, DW_AT_specification, &spec_at, &de) != DW_DLV_OK)
-                return;
-            if (dwarf_global_formref(spec_at, &ref, &de) != DW_DLV_OK)
-                return;
-            if (dwarf_offdie(dbg, ref, &spec_die, &de) != DW_DLV_OK)
-                return;
-            if (dwarf_diename(spec_die, rlt_func, &de) != DW_DLV_OK)
-                *rlt_func = unknown;
 
-            return;
+static uint32_t
+intern_cu(cu_map &cu_indices,
+          std::vector<Dwarf_Off> &cu_offsets,
+          Dwarf_Off cu_die_offset)
+{
+    auto inserted = cu_indices.insert(std::make_pair(cu_die_offset, (uint32_t)cu_offsets.size()));
+    if (inserted.second) {
+        cu_offsets.push_back(cu_die_offset);
+    }
+    return inserted.first->second;
+}
+
+
+/*
+ * Take the CUs, in order, from .gdb_index's CU list, and their ranges from
+ * its address area, if not empty.  Returns whether ranges were found.
+ */
+static bool
+read_gdbindex(Dwarf_Debug dbg,
+              struct dwarf_line_cache *cache,
+              cu_map &cu_indices,
+              std::vector<Dwarf_Off> &cu_offsets)
+{
+    Dwarf_Error error = 0;
+    Dwarf_Unsigned version, cu_list_offset, types_cu_list_offset, address_area_offset;
+    Dwarf_Unsigned symbol_table_offset, constant_pool_offset, section_size, reserved;
+    const char *section_name;
+    int ret;
+
+    ret = dwarf_gdbindex_header(dbg, &cache->gdbindex, &version, &cu_list_offset, &types_cu_list_offset,
+                                &address_area_offset, &symbol_table_offset, &constant_pool_offset,
+                                &section_size, &reserved, &section_name, &error);
+    if (ret != DW_DLV_OK) {
+        if (ret == DW_DLV_ERROR) {
+            OutputDebug("MGWHELP: dwarf_gdbindex_header failed - %s\n", dwarf_errmsg(error));
         }
+        return false;
+    }
 
-    cont_search:
+    /* Older versions lack the symbol kinds */
+    Dwarf_Unsigned cu_count = 0;
+    if (version < 7 || version > 8 ||
+        dwarf_gdbindex_culist_array(cache->gdbindex, &cu_count, &error) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: unsupported .gdb_index version %u\n", (unsigned)version);
+        goto no_gdbindex;
+    }
+    cache->gdbindex_version = version;
 
-        /* Recurse into children. */
-        ret = dwarf_child(die, &child_die, &de);
-        if (ret == DW_DLV_ERROR)
-            OutputDebug("MGWHELP: dwarf_child failed - %s\n", dwarf_errmsg(de));
-        else if (ret == DW_DLV_OK)
-            search_func(dbg, child_die, addr, rlt_func);
+    for (Dwarf_Unsigned i = 0; i < cu_count; ++i) {
+        Dwarf_Unsigned cu_offset, cu_length;
+        Dwarf_Off cu_die_offset;
+        if (dwarf_gdbindex_culist_entry(cache->gdbindex, i, &cu_offset, &cu_length, &error) != DW_DLV_OK ||
+            dwarf_get_cu_die_offset_given_cu_header_offset_b(dbg, cu_offset, 1, &cu_die_offset, &error) !=
+                DW_DLV_OK) {
+            OutputDebug("MGWHELP: bad .gdb_index CU list - %s\n", dwarf_errmsg(error));
+            cu_indices.clear();
+            cu_offsets.clear();
+            goto no_gdbindex;
+        }
+        intern_cu(cu_indices, cu_offsets, cu_die_offset);
+    }
+    if (cu_offsets.size() != cu_count) {
+        OutputDebug("MGWHELP: duplicate .gdb_index CUs\n");
+        cu_indices.clear();
+        cu_offsets.clear();
+        goto no_gdbindex;
+    }
 
-        /* Advance to next sibling. */
-        ret = dwarf_siblingof(dbg, die, &sibling_die, &de);
-        if (ret != DW_DLV_OK) {
-            if (ret == DW_DLV_ERROR)
-                OutputDebug("MGWHELP: dwarf_siblingof failed - %s\n", dwarf_errmsg(de));
-            break;
+    Dwarf_Unsigned area_count;
+    if (dwarf_gdbindex_addressarea(cache->gdbindex, &area_count, &error) != DW_DLV_OK) {
+        return false;
+    }
+    cache->cu_ranges.reserve(area_count);
+    for (Dwarf_Unsigned i = 0; i < area_count; ++i) {
+        Dwarf_Unsigned lowpc, highpc, cu_index;
+        if (dwarf_gdbindex_addressarea_entry(cache->gdbindex, i, &lowpc, &highpc, &cu_index, &error) ==
+                DW_DLV_OK &&
+            lowpc < highpc &&
+            cu_index < cu_count) {
+            dwarf_cu_range range;
+            range.lowpc = lowpc;
+            range.highpc = highpc;
+            range.cu = cu_index;
+            range.reserved = 0;
+            cache->cu_ranges.push_back(range);
         }
-        die = sibling_die;
-    } while (true);
+    }
+    return !cache->cu_ranges.empty();
+
+no_gdbindex:
+    dwarf_gdbindex_free(cache->gdbindex);
+    cache->gdbindex = NULL;
+    return false;
 }
 
 
-void
-find_dwarf_symbol(Dwarf_Debug dbg,
-                  Dwarf_Addr addr,
-                  struct find_dwarf_info *info)
+static void
+read_aranges(Dwarf_Debug dbg,
+             struct dwarf_line_cache *cache,
+             cu_map &cu_indices,
+             std::vector<Dwarf_Off> &cu_offsets)
 {
     Dwarf_Error error = 0;
-    char *funcname = NULL;
-
     Dwarf_Arange *aranges;
     Dwarf_Signed arange_count;
+
     if (dwarf_get_aranges(dbg, &aranges, &arange_count, &error) != DW_DLV_OK) {
-        goto no_aranges;
+        if (error) {
+            OutputDebug("MGWHELP: dwarf_get_aranges failed - %s\n", dwarf_errmsg(error));
+        }
+        return;
+    }
+
+    cache->cu_ranges.reserve(arange_count);
+    for (Dwarf_Signed i = 0; i < arange_count; ++i) {
+        Dwarf_Addr start;
+        Dwarf_Unsigned length;
+        Dwarf_Off cu_die_offset;
+        if (dwarf_get_arange_info(aranges[i], &start, &length, &cu_die_offset, &error) == DW_DLV_OK &&
+            length) {
+            dwarf_cu_range range;
+            range.lowpc = start;
+            range.highpc = start + length;
+            range.cu = intern_cu(cu_indices, cu_offsets, cu_die_offset);
+            range.reserved = 0;
+            cache->cu_ranges.push_back(range);
+        }
+        dwarf_dealloc(dbg, aranges[i], DW_DLA_ARANGE);
+    }
+    dwarf_dealloc(dbg, aranges, DW_DLA_LIST);
+}
+
+
+/*
+ * Add the ranges of each CU DIE's DW_AT_low_pc/DW_AT_high_pc or DW_AT_ranges,
+ * which also cover CUs that .debug_aranges omits or describes partially,
+ * as it often does with -ffunction-sections or LTO.
+ */
+static void
+read_cu_dies(Dwarf_Debug dbg,
+             struct dwarf_line_cache *cache,
+             cu_map &cu_indices,
+             std::vector<Dwarf_Off> &cu_offsets)
+{
+    Dwarf_Error error = 0;
+    Dwarf_Unsigned next_cu_header = 0;
+    std::vector<die_range> ranges;
+    int ret;
+
+    while ((ret = dwarf_next_cu_header_d(dbg, 1, NULL, NULL, NULL, NULL, NULL,
+                                         NULL, NULL, NULL, &next_cu_header,
+                                         NULL, &error)) == DW_DLV_OK) {
+        if (dwarf_arena_begin(dbg, &error) != DW_DLV_OK) {
+            OutputDebug("MGWHELP: dwarf_arena_begin failed - %s\n", dwarf_errmsg(error));
+            break;
+        }
+
+        Dwarf_Die_Cursor cursor;
+        Dwarf_Die_Attrs attrs;
+        if (dwarf_die_cursor_init(dbg, 1, &cursor, &error) != DW_DLV_OK ||
+            dwarf_die_cursor_next(&cursor, &error) != DW_DLV_OK ||
+            dwarf_die_cursor_attrs(&cursor, DW_DCA_LOW_PC | DW_DCA_HIGH_PC | DW_DCA_RANGES,
+                                   &attrs, &error) != DW_DLV_OK) {
+            OutputDebug("MGWHELP: failed to read CU DIE - %s\n", dwarf_errmsg(error));
+            dwarf_arena_end(dbg);
+            continue;
+        }
+
+        /* The CU's own DW_AT_low_pc is its base address */
+        Dwarf_Addr cu_base = (attrs.dca_present & DW_DCA_LOW_PC) ? attrs.dca_lowpc : 0;
+        get_die_ranges(dbg, &attrs, cu_base, ranges);
+
+        dwarf_cu_range range;
+        range.cu = intern_cu(cu_indices, cu_offsets, cursor.dc_offset);
+        range.reserved = 0;
+        for (const die_range &extent : ranges) {
+            range.lowpc = extent.lowpc;
+            range.highpc = extent.highpc;
+            cache->cu_ranges.push_back(range);
+        }
+
+        dwarf_arena_end(dbg);
+    }
+    if (ret == DW_DLV_ERROR) {
+        OutputDebug("MGWHELP: dwarf_next_cu_header_d failed - %s\n", dwarf_errmsg(error));
+    }
+}
+
+
+/*
+ * Sort ranges and trim overlaps, lowest range first.
+ */
+static void
+make_cu_ranges_disjoint(std::vector<dwarf_cu_range> &ranges)
+{
+    std::stable_sort(ranges.begin(), ranges.end(), cu_range_less);
+
+    size_t count = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        dwarf_cu_range range = ranges[i];
+        if (count && range.lowpc < ranges[count - 1].highpc) {
+            if (range.highpc <= ranges[count - 1].highpc) {
+                continue;
+            }
+            range.lowpc = ranges[count - 1].highpc;
+        }
+        ranges[count++] = range;
+    }
+    ranges.resize(count);
+}
+
+
+/*
+ * Merge the ranges from the CU DIEs into those from the index sections,
+ * filling only the gaps between the latter, so that every address falls in
+ * at most one range, and binary search finds it.
+ */
+static void
+merge_cu_ranges(std::vector<dwarf_cu_range> &ranges,
+                size_t indexed_count)
+{
+    std::vector<dwarf_cu_range> indexed(ranges.begin(), ranges.begin() + indexed_count);
+    std::vector<dwarf_cu_range> dies(ranges.begin() + indexed_count, ranges.end());
+    make_cu_ranges_disjoint(indexed);
+    make_cu_ranges_disjoint(dies);
+
+    ranges = indexed;
+    auto it = indexed.cbegin();
+    for (const dwarf_cu_range &die : dies) {
+        dwarf_cu_range range = die;
+        while (range.lowpc < die.highpc) {
+            while (it != indexed.cend() && it->highpc <= range.lowpc) {
+                ++it;
+            }
+            if (it == indexed.cend() || it->lowpc >= die.highpc) {
+                range.highpc = die.highpc;
+                ranges.push_back(range);
+                break;
+            }
+            if (range.lowpc < it->lowpc) {
+                range.highpc = it->lowpc;
+                ranges.push_back(range);
+            }
+            range.lowpc = it->highpc;
+        }
     }
+    std::sort(ranges.begin(), ranges.end(), cu_range_less);
 
-    Dwarf_Arange arange;
-    if (dwarf_get_arange(aranges, arange_count, addr, &arange, &error) != DW_DLV_OK) {
-        goto no_arange;
+    /* Coalesce adjacent ranges of the same CU */
+    size_t count = 0;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (count &&
+            ranges[count - 1].highpc == ranges[i].lowpc &&
+            ranges[count - 1].cu == ranges[i].cu) {
+            ranges[count - 1].highpc = ranges[i].highpc;
+        } else {
+            ranges[count++] = ranges[i];
+        }
+    }
+    ranges.resize(count);
+    ranges.shrink_to_fit();
+}
+
+
+static void
+build_cu_ranges(Dwarf_Debug dbg,
+                struct dwarf_line_cache *cache)
+{
+    cu_map cu_indices;
+    std::vector<Dwarf_Off> cu_offsets;
+
+    if (!read_gdbindex(dbg, cache, cu_indices, cu_offsets)) {
+        read_aranges(dbg, cache, cu_indices, cu_offsets);
+    }
+    size_t indexed_count = cache->cu_ranges.size();
+    read_cu_dies(dbg, cache, cu_indices, cu_offsets);
+    merge_cu_ranges(cache->cu_ranges, indexed_count);
+
+    cache->cu_count = cu_offsets.size();
+    cache->cus.reset(new dwarf_cu[cache->cu_count]);
+    for (size_t i = 0; i < cache->cu_count; ++i) {
+        cache->cus[i].cu_die_offset = cu_offsets[i];
+        cache->cus[i].table.store(NULL, std::memory_order_relaxed);
+    }
+}
+
+
+struct dwarf_line_cache *
+dwarf_line_cache_create(Dwarf_Debug dbg)
+{
+    struct dwarf_line_cache *cache = new dwarf_line_cache;
+    cache->dbg = dbg;
+    cache->cu_count = 0;
+    cache->gdbindex = NULL;
+    cache->gdbindex_version = 0;
+    // The frame index may be using dbg already
+    dwarf_pe_lock(dbg);
+    build_cu_ranges(dbg, cache);
+    dwarf_pe_trim(dbg);
+    dwarf_pe_unlock(dbg);
+    return cache;
+}
+
+
+void
+dwarf_line_cache_destroy(struct dwarf_line_cache *cache)
+{
+    for (size_t i = 0; i < cache->cu_count; ++i) {
+        delete cache->cus[i].table.load(std::memory_order_relaxed);
+    }
+    if (cache->gdbindex) {
+        dwarf_gdbindex_free(cache->gdbindex);
+    }
+    delete cache;
+}
+
+
+const dwarf_cu_range *
+dwarf_find_cu_range(const dwarf_cu_range *begin,
+                    const dwarf_cu_range *end,
+                    Dwarf_Addr addr)
+{
+    auto it = std::upper_bound(begin, end, addr,
+                               [](Dwarf_Addr a, const dwarf_cu_range &r) { return a < r.lowpc; });
+    if (it == begin) {
+        return NULL;
     }
+    --it;
+    if (addr >= it->highpc) {
+        return NULL;
+    }
+    return it;
+}
+
+
+static bool
+line_row_less(const dwarf_line_row &a, const dwarf_line_row &b)
+{
+    /* End of sequence rows go first, so that a sequence starting right where
+     * another ends takes precedence. */
+    return a.addr < b.addr || (a.addr == b.addr && a.end_sequence > b.end_sequence);
+}
 
-    Dwarf_Off cu_die_offset;
-    if (dwarf_get_cu_die_offset(arange, &cu_die_offset, &error) != DW_DLV_OK) {
-        goto no_die_offset;
+
+static dwarf_line_table *
+decode_line_table(Dwarf_Debug dbg,
+                  struct dwarf_line_cache *cache,
+                  Dwarf_Off cu_die_offset)
+{
+    Dwarf_Error error = 0;
+    dwarf_line_table *table = new dwarf_line_table;
+
+    /* Release the CU's lines, strings, and DIE in one go.  The table gets
+     * cached for good, so should that fail decode it all the same, with the
+     * deallocations below doing the job. */
+    bool arena = dwarf_arena_begin(dbg, &error) == DW_DLV_OK;
+    if (!arena) {
+        OutputDebug("MGWHELP: dwarf_arena_begin failed - %s\n", dwarf_errmsg(error));
+        error = 0;
     }
 
     Dwarf_Die cu_die;
@@ -157,31 +1263,26 @@ find_dwarf_symbol(Dwarf_Debug dbg,
         goto no_cu_die;
     }
 
-    search_func(dbg, cu_die, addr, &funcname);
-    if (funcname) {
-        info->functionname = funcname;
-        info->found = true;
-    }
-
     Dwarf_Line *linebuf;
     Dwarf_Signed linecount;
     if (dwarf_srclines(cu_die, &linebuf, &linecount, &error) == DW_DLV_OK) {
-        Dwarf_Unsigned lineno, plineno;
-        Dwarf_Addr lineaddr, plineaddr;
-        char *file, *file0, *pfile;
-        plineaddr = ~0ULL;
-        plineno = lineno = 0;
-        pfile = file = unknown;
+        /* Maps the line program's file numbers into table->files */
+        std::vector<uint32_t> filemap;
         Dwarf_Signed i;
 
+        table->rows.reserve(linecount);
+
         i = 0;
         while (i < linecount) {
-            if (dwarf_lineaddr(linebuf[i], &lineaddr, &error) != DW_DLV_OK) {
+            Dwarf_Line line = linebuf[i];
+            dwarf_line_row row;
+
+            if (dwarf_lineaddr(line, &row.addr, &error) != DW_DLV_OK) {
                 OutputDebug("MGWHELP: dwarf_lineaddr failed - %s\n", dwarf_errmsg(error));
                 break;
             }
 
-            if (lineaddr == 0) {
+            if (row.addr == 0) {
                 /* Per dwarfdump/print_lines.c, The SN Systems Linker generates
                  * line records with addr=0, when dealing with linkonce symbols
                  * and no stripping.  We need to skip records that do not have
@@ -189,10 +1290,10 @@ find_dwarf_symbol(Dwarf_Debug dbg,
                  */
                 ++i;
                 while (i < linecount) {
-                    Dwarf_Bool has_is_addr_set = FALSE;
+                    Dwarf_Bool has_is_addr_set = false;
                     if (dwarf_line_is_addr_set(linebuf[i], &has_is_addr_set, &error) != DW_DLV_OK) {
                         OutputDebug("MGWHELP: dwarf_line_is_addr_set failed - %s\n", dwarf_errmsg(error));
-                        has_is_addr_set = FALSE;
+                        has_is_addr_set = false;
                     }
                     if (has_is_addr_set) {
                         break;
@@ -202,53 +1303,351 @@ find_dwarf_symbol(Dwarf_Debug dbg,
                 continue;
             }
 
-            if (addr > plineaddr && addr < lineaddr) {
-                // Lines are past the address
-                lineno = plineno;
-                file = pfile;
-                break;
-            }
-
-            if (dwarf_lineno(linebuf[i], &lineno, &error) != DW_DLV_OK) {
+            Dwarf_Unsigned lineno;
+            if (dwarf_lineno(line, &lineno, &error) != DW_DLV_OK) {
                 OutputDebug("MGWHELP: dwarf_lineno failed - %s\n", dwarf_errmsg(error));
                 break;
             }
+            row.line = lineno;
 
-            if (dwarf_linesrc(linebuf[i], &file0, &error) != DW_DLV_OK) {
-                OutputDebug("MGWHELP: dwarf_linesrc failed - %s\n", dwarf_errmsg(error));
-            } else {
-                file = file0;
-            }
+            Dwarf_Bool end_sequence = false;
+            dwarf_lineendsequence(line, &end_sequence, &error);
+            row.end_sequence = end_sequence ? 1 : 0;
 
-            if (addr == lineaddr) {
-                // Exact match
-                break;
+            Dwarf_Unsigned fileno = 0;
+            dwarf_line_srcfileno(line, &fileno, &error);
+            if (fileno >= filemap.size()) {
+                filemap.resize(fileno + 1, UINT32_MAX);
+            }
+            if (filemap[fileno] == UINT32_MAX) {
+                char *file;
+                const char *interned = unknown;
+                if (dwarf_linesrc(line, &file, &error) != DW_DLV_OK) {
+                    OutputDebug("MGWHELP: dwarf_linesrc failed - %s\n", dwarf_errmsg(error));
+                } else {
+                    interned = cache->filenames.insert(file).first->c_str();
+                    dwarf_dealloc(dbg, file, DW_DLA_STRING);
+                }
+                filemap[fileno] = table->files.size();
+                table->files.push_back(interned);
             }
+            row.file = filemap[fileno];
 
-            plineaddr = lineaddr;
-            plineno = lineno;
-            pfile = file;
+            table->rows.push_back(row);
             ++i;
         }
 
-        info->filename = file;
-        info->line = lineno;
-
         dwarf_srclines_dealloc(dbg, linebuf, linecount);
     }
 
     dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
 no_cu_die:
-    ;
-no_die_offset:
-    ;
-no_arange:
-    for (Dwarf_Signed i = 0; i < arange_count; ++i) {
-        dwarf_dealloc(dbg, aranges[i], DW_DLA_ARANGE);
-    }
-    dwarf_dealloc(dbg, aranges, DW_DLA_LIST);
-no_aranges:
     if (error) {
         OutputDebug("MGWHELP: libdwarf error - %s\n", dwarf_errmsg(error));
     }
+    if (arena) {
+        dwarf_arena_end(dbg);
+    }
+
+    std::stable_sort(table->rows.begin(), table->rows.end(), line_row_less);
+    table->rows.shrink_to_fit();
+
+    return table;
+}
+
+
+const dwarf_line_row *
+dwarf_find_line(const dwarf_line_row *begin,
+                const dwarf_line_row *end,
+                Dwarf_Addr addr)
+{
+    auto it = std::upper_bound(begin, end, addr,
+                               [](Dwarf_Addr a, const dwarf_line_row &r) { return a < r.addr; });
+    if (it == begin) {
+        return NULL;
+    }
+    --it;
+
+    if (it->addr == addr) {
+        // Exact match -- prefer the first row for this address
+        while (it != begin && (it - 1)->addr == addr && !(it - 1)->end_sequence) {
+            --it;
+        }
+    }
+
+    if (it->end_sequence) {
+        // Address falls in a gap between sequences
+        return NULL;
+    }
+
+    return it;
+}
+
+
+const dwarf_line_table *
+dwarf_line_cache_table(struct dwarf_line_cache *cache,
+                       uint32_t cu)
+{
+    dwarf_line_table *table = cache->cus[cu].table.load(std::memory_order_acquire);
+    if (!table) {
+        dwarf_pe_lock(cache->dbg);
+        table = cache->cus[cu].table.load(std::memory_order_relaxed);
+        if (!table) {
+            table = decode_line_table(cache->dbg, cache, cache->cus[cu].cu_die_offset);
+            cache->cus[cu].table.store(table, std::memory_order_release);
+            dwarf_pe_trim(cache->dbg);
+        }
+        dwarf_pe_unlock(cache->dbg);
+    }
+    return table;
+}
+
+
+void
+find_dwarf_symbol(Dwarf_Debug dbg,
+                  const struct dwarf_function_index *functions,
+                  struct dwarf_line_cache *lines,
+                  Dwarf_Addr addr,
+                  struct find_dwarf_info *info)
+{
+    const dwarf_function *function = dwarf_find_function(functions->functions.data(),
+                                                         functions->functions.data() + functions->functions.size(),
+                                                         addr);
+    if (function) {
+        info->functionname = &functions->names[function->name];
+        info->functionaddr = function->lowpc;
+        info->functionsize = function->highpc - function->lowpc;
+        info->found = true;
+    }
+
+    const dwarf_cu_range *range = dwarf_find_cu_range(lines->cu_ranges.data(),
+                                                      lines->cu_ranges.data() + lines->cu_ranges.size(),
+                                                      addr);
+    if (!range) {
+        return;
+    }
+
+    const dwarf_line_table *table = dwarf_line_cache_table(lines, range->cu);
+    const dwarf_line_row *row = dwarf_find_line(table->rows.data(), table->rows.data() + table->rows.size(), addr);
+    if (row) {
+        info->filename = table->files[row->file];
+        info->lineaddr = row->addr;
+        info->line = row->line;
+    }
+}
+
+
+/*
+ * Last component of a qualified C++ name, ignoring any "::" within template
+ * or function arguments.
+ */
+static const char *
+get_base_name(const char *name)
+{
+    const char *base = name;
+    int depth = 0;
+    for (const char *p = name; *p; ++p) {
+        if (*p == '<' || *p == '(') {
+            ++depth;
+        } else if ((*p == '>' || *p == ')') && depth > 0) {
+            --depth;
+        } else if (depth == 0 && p[0] == ':' && p[1] == ':') {
+            base = p + 2;
+            ++p;
+        }
+    }
+    return base;
+}
+
+
+/*
+ * Find the function with the given name in a CU, preferring one whose
+ * qualified name, as gdb spells it, matches over one whose DW_AT_name does.
+ */
+static bool
+find_cu_function(Dwarf_Debug dbg,
+                 Dwarf_Off cu_die_offset,
+                 const char *name,
+                 struct find_dwarf_info *info)
+{
+    Dwarf_Error de = 0;
+    Dwarf_Die cu_die;
+    Dwarf_Die_Cursor cursor;
+    Dwarf_Die_Attrs attrs;
+    const char *base = get_base_name(name);
+    bool found = false;
+    bool exact = false;
+    int ret;
+
+    if (dwarf_offdie_b(dbg, cu_die_offset, 1, &cu_die, &de) != DW_DLV_OK) {
+        return false;
+    }
+    ret = dwarf_die_cursor_init_b(cu_die, &cursor, &de);
+    dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+    if (ret != DW_DLV_OK) {
+        return false;
+    }
+
+    /* Enclosing namespace and type names, by level, and the qualified names
+     * of the declarations out-of-line definitions refer to */
+    std::vector<const char *> scopes;
+    std::unordered_map<Dwarf_Off, std::string> declarations;
+    std::string qualified;
+
+    while (!exact && (ret = dwarf_die_cursor_next(&cursor, &de)) == DW_DLV_OK) {
+        scopes.resize(cursor.dc_level);
+
+        switch (cursor.dc_tag) {
+        case DW_TAG_subprogram:
+            break;
+        case DW_TAG_namespace:
+        case DW_TAG_class_type:
+        case DW_TAG_structure_type:
+        case DW_TAG_union_type:
+            if (dwarf_die_cursor_attrs(&cursor, DW_DCA_NAME, &attrs, &de) != DW_DLV_OK) {
+                return found;
+            }
+            if (attrs.dca_present & DW_DCA_NAME) {
+                scopes.push_back(attrs.dca_name);
+            } else {
+                scopes.push_back(cursor.dc_tag == DW_TAG_namespace ? "(anonymous namespace)" : NULL);
+            }
+            continue;
+        case DW_TAG_array_type:
+        case DW_TAG_enumeration_type:
+        case DW_TAG_subroutine_type:
+            dwarf_die_cursor_skip_children(&cursor);
+            /* fall-through */
+        default:
+            scopes.push_back(NULL);
+            continue;
+        }
+
+        if (dwarf_die_cursor_attrs(&cursor, DW_DCA_NAME | DW_DCA_HIGH_PC | DW_DCA_SPECIFICATION | DW_DCA_ABSTRACT_ORIGIN,
+                                   &attrs, &de) != DW_DLV_OK) {
+            return found;
+        }
+
+        auto it = declarations.end();
+        if (attrs.dca_present & DW_DCA_SPECIFICATION) {
+            it = declarations.find(attrs.dca_specification);
+        }
+        if (it != declarations.end()) {
+            qualified = it->second;
+        } else {
+            qualified.clear();
+            for (const char *scope : scopes) {
+                if (scope) {
+                    qualified.append(scope);
+                    qualified.append("::");
+                }
+            }
+            qualified.append(get_function_name(dbg, &cursor, &attrs));
+        }
+        scopes.push_back(NULL);
+
+        if (!(attrs.dca_present & DW_DCA_HIGH_PC) ||
+            attrs.dca_lowpc >= attrs.dca_highpc) {
+            declarations.emplace(cursor.dc_offset, qualified);
+            continue;
+        }
+
+        exact = qualified == name;
+        if (exact || (!found && strcmp(get_base_name(qualified.c_str()), base) == 0)) {
+            info->functionaddr = attrs.dca_lowpc;
+            info->functionsize = attrs.dca_highpc - attrs.dca_lowpc;
+            found = true;
+        }
+    }
+    if (ret == DW_DLV_ERROR) {
+        OutputDebug("MGWHELP: dwarf_die_cursor_next failed - %s\n", dwarf_errmsg(de));
+    }
+
+    return found;
+}
+
+
+/*
+ * Look the name up in .gdb_index's symbol table, and then in each CU it
+ * lists as defining a function by that name.
+ */
+static bool
+find_gdbindex_name(Dwarf_Debug dbg,
+                   struct dwarf_line_cache *cache,
+                   const char *name,
+                   struct find_dwarf_info *info)
+{
+    Dwarf_Error error = 0;
+    Dwarf_Unsigned symtab_index, cu_vector_offset, string_offset, cu_count;
+    const char *symbol;
+    bool found = false;
+
+    if (dwarf_gdbindex_symboltable_lookup(cache->gdbindex, name, &symtab_index, &cu_vector_offset, &error) !=
+            DW_DLV_OK ||
+        dwarf_gdbindex_symboltable_entry(cache->gdbindex, symtab_index, &string_offset, &cu_vector_offset,
+                                         &error) != DW_DLV_OK ||
+        dwarf_gdbindex_string_by_offset(cache->gdbindex, string_offset, &symbol, &error) != DW_DLV_OK ||
+        dwarf_gdbindex_cuvector_length(cache->gdbindex, cu_vector_offset, &cu_count, &error) != DW_DLV_OK) {
+        return false;
+    }
+
+    /* Release the CU DIEs, and whatever the slow paths allocate, in one go */
+    if (dwarf_arena_begin(dbg, &error) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: dwarf_arena_begin failed - %s\n", dwarf_errmsg(error));
+        return false;
+    }
+
+    for (Dwarf_Unsigned i = 0; i < cu_count && !found; ++i) {
+        Dwarf_Unsigned value, cu_index, reserved, kind, is_static;
+        if (dwarf_gdbindex_cuvector_inner_attributes(cache->gdbindex, cu_vector_offset, i, &value, &error) !=
+            DW_DLV_OK) {
+            break;
+        }
+        dwarf_gdbindex_cuvector_instance_expand_value(cache->gdbindex, value, &cu_index, &reserved, &kind,
+                                                      &is_static, &error);
+        /* GDB_INDEX_SYMBOL_KIND_FUNCTION; type units come after the CUs */
+        if (kind != 3 || cu_index >= cache->cu_count) {
+            continue;
+        }
+        found = find_cu_function(dbg, cache->cus[cu_index].cu_die_offset, name, info);
+    }
+
+    dwarf_arena_end(dbg);
+
+    if (found) {
+        info->functionname = symbol;
+        info->found = true;
+    }
+    return found;
+}
+
+
+void
+find_dwarf_name(Dwarf_Debug dbg,
+                const struct dwarf_function_index *functions,
+                struct dwarf_line_cache *lines,
+                const char *name,
+                struct find_dwarf_info *info)
+{
+    if (functions) {
+        const dwarf_function *function = dwarf_find_function_name(functions->functions.data(),
+                                                                  functions->by_name.data(),
+                                                                  functions->by_name.data() +
+                                                                      functions->by_name.size(),
+                                                                  functions->names.data(),
+                                                                  name);
+        if (function) {
+            info->functionname = &functions->names[function->name];
+            info->functionaddr = function->lowpc;
+            info->functionsize = function->highpc - function->lowpc;
+            info->found = true;
+            return;
+        }
+    }
+
+    if (lines && lines->gdbindex) {
+        dwarf_pe_lock(dbg);
+        find_gdbindex_name(dbg, lines, name, info);
+        dwarf_pe_unlock(dbg);
+    }
 }
@@ -34,16 +34,101 @@ struct find_dwarf_info
 {
     const char *filename;
     const char *functionname;
+    Dwarf_Addr functionaddr;
+    Dwarf_Unsigned functionsize;
+    Dwarf_Addr lineaddr;
     unsigned int line;
     bool found;
 };
 
 
+/*
+ * One DW_TAG_inlined_subroutine containing an address.
+ */
+struct find_dwarf_inline
+{
+    const char *functionname; /* the inlined function */
+    Dwarf_Addr functionaddr;
+    const char *callfile;     /* where it was inlined into its caller */
+    unsigned int callline;
+};
+
+
+/*
+ * Sorted address -> function index, built once per module from all
+ * DW_TAG_subprogram DIEs, along with the DW_TAG_inlined_subroutine trees
+ * within them.  Large modules get their CUs indexed over several threads.
+ */
+struct dwarf_function_index;
+
+
+struct dwarf_function_index *
+dwarf_function_index_create(Dwarf_Debug dbg);
+
+void
+dwarf_function_index_destroy(struct dwarf_function_index *index);
+
+/*
+ * How many threads dwarf_function_index_create splits the CUs over, zero
+ * meaning one per processor, which is the default.
+ */
+void
+dwarf_set_index_threads(unsigned count);
+
+
+/*
+ * Address-sorted line tables, decoded on demand once per compilation unit.
+ *
+ * Decoding is serialized internally, and decoded tables are published
+ * atomically, so once both indices are created find_dwarf_symbol may be
+ * called concurrently from any number of threads.
+ */
+struct dwarf_line_cache;
+
+
+struct dwarf_line_cache *
+dwarf_line_cache_create(Dwarf_Debug dbg);
+
+void
+dwarf_line_cache_destroy(struct dwarf_line_cache *cache);
+
+
 void
 find_dwarf_symbol(Dwarf_Debug dbg,
+                  const struct dwarf_function_index *functions,
+                  struct dwarf_line_cache *lines,
                   Dwarf_Addr addr,
                   struct find_dwarf_info *info);
 
+/*
+ * Inlined subroutines containing an address, innermost first, so that the
+ * caller of each is the next one, and the caller of the last one the function
+ * find_dwarf_symbol finds.  Fills in up to max_count frames, and returns how
+ * many there are.  Thread-safe.
+ */
+unsigned
+find_dwarf_inlines(const struct dwarf_function_index *functions,
+                   Dwarf_Addr addr,
+                   struct find_dwarf_inline *frames,
+                   unsigned max_count);
+
+/*
+ * Name -> function lookups, filling in info's function fields.
+ *
+ * Names are first looked up by DW_AT_name in the function index.  Failing
+ * that, and if the module has a .gdb_index, in its symbol table, which also
+ * knows qualified C++ names such as "ns::klass::method", and then in the
+ * DIEs of the CUs it lists.  Either index may be NULL, to skip it, as the
+ * line cache and its .gdb_index are much cheaper to create than the function
+ * index.  Thread-safe, like find_dwarf_symbol.
+ */
+void
+find_dwarf_name(Dwarf_Debug dbg,
+                const struct dwarf_function_index *functions,
+                struct dwarf_line_cache *lines,
+                const char *name,
+                struct find_dwarf_info *info);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Layout of the lookup tables behind dwarf_find.h.
+ *
+ * Private to dwarf_find.cpp and dwarf_cache.cpp.  The row types are plain
+ * data, so that the on-disk cache can store and map them verbatim.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "dwarf_find.h"
+
+
+struct dwarf_function
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    uint32_t name; /* offset into the names blob */
+    uint32_t reserved; /* zero, as written to the on-disk cache */
+};
+
+
+/*
+ * A DW_TAG_inlined_subroutine.
+ */
+struct dwarf_inline
+{
+    Dwarf_Addr lowpc;   /* of its first range */
+    uint32_t name;      /* offset into the names blob */
+    uint32_t call_file; /* offset into the names blob */
+    uint32_t call_line;
+    uint32_t parent;    /* index of the enclosing inline, or UINT32_MAX */
+};
+
+
+/*
+ * Disjoint address ranges, each mapped to the innermost inline containing
+ * it, whose parents give the rest of the inline stack.
+ */
+struct dwarf_inline_range
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    uint32_t inline_; /* index into inlines */
+    uint32_t reserved; /* zero, as written to the on-disk cache */
+};
+
+
+struct dwarf_function_index
+{
+    std::vector<dwarf_function> functions;
+    std::vector<char> names;
+
+    /* Indices into functions, sorted by name */
+    std::vector<uint32_t> by_name;
+
+    std::vector<dwarf_inline> inlines;
+    std::vector<dwarf_inline_range> inline_ranges;
+};
+
+
+struct dwarf_line_row
+{
+    Dwarf_Addr addr;
+    uint32_t line;
+    uint32_t file : 31; /* index into the file names */
+    uint32_t end_sequence : 1;
+};
+
+
+struct dwarf_line_table
+{
+    std::vector<dwarf_line_row> rows;
+    std::vector<const char *> files;
+};
+
+
+struct dwarf_cu_range
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    uint32_t cu; /* index into dwarf_line_cache::cus */
+    uint32_t reserved; /* zero, as written to the on-disk cache */
+};
+
+
+struct dwarf_cu
+{
+    Dwarf_Off cu_die_offset;
+
+    /* Published once decoded, and immutable thereafter */
+    std::atomic<dwarf_line_table *> table;
+};
+
+
+struct dwarf_line_cache
+{
+    Dwarf_Debug dbg;
+
+    std::vector<dwarf_cu_range> cu_ranges;
+    std::unique_ptr<dwarf_cu[]> cus;
+    size_t cu_count;
+
+    /* .gdb_index, if any, in which case cus follows its CU list */
+    Dwarf_Gdbindex gdbindex;
+    Dwarf_Unsigned gdbindex_version;
+
+    /* Interned file names, shared by all line tables, and only touched
+     * while decoding, under dwarf_pe_lock */
+    std::unordered_set<std::string> filenames;
+};
+
+
+const dwarf_function *
+dwarf_find_function(const dwarf_function *begin,
+                    const dwarf_function *end,
+                    Dwarf_Addr addr);
+
+/*
+ * Sort the indices of a function table by name, keeping address order
+ * among functions of the same name.
+ */
+void
+dwarf_sort_function_names(const dwarf_function *functions,
+                          size_t count,
+                          const char *names,
+                          std::vector<uint32_t> &by_name);
+
+/*
+ * Lowest addressed function with the given name, or NULL.
+ */
+const dwarf_function *
+dwarf_find_function_name(const dwarf_function *functions,
+                         const uint32_t *begin,
+                         const uint32_t *end,
+                         const char *names,
+                         const char *name);
+
+/*
+ * Walk the inline stack at an address, as find_dwarf_inlines does.
+ */
+unsigned
+dwarf_find_inlines(const dwarf_inline *inlines,
+                   const dwarf_inline_range *begin,
+                   const dwarf_inline_range *end,
+                   const char *names,
+                   Dwarf_Addr addr,
+                   struct find_dwarf_inline *frames,
+                   unsigned max_count);
+
+const dwarf_cu_range *
+dwarf_find_cu_range(const dwarf_cu_range *begin,
+                    const dwarf_cu_range *end,
+                    Dwarf_Addr addr);
+
+const dwarf_line_row *
+dwarf_find_line(const dwarf_line_row *begin,
+                const dwarf_line_row *end,
+                Dwarf_Addr addr);
+
+/*
+ * Get a CU's line table, decoding it if not done yet.
+ */
+const dwarf_line_table *
+dwarf_line_cache_table(struct dwarf_line_cache *cache,
+                       uint32_t cu);
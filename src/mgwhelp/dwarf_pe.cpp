@@ -21,31 +21,126 @@
 
 #include <assert.h>
 #include <stdlib.h>
-
-#include <windows.h>
+#include <string.h>
 
 #include <string>
 #include <vector>
 
+#include <zlib.h>
+
 #include "config.h"
 #include "dwarf_incl.h"
 
 #include "outdbg.h"
 #include "paths.h"
+#include "thread.h"
 
 
-typedef struct {
-    HANDLE hFileMapping;
-    SIZE_T nFileSize;
-    union {
-        PBYTE lpFileBase;
-        PIMAGE_DOS_HEADER pDosHeader;
-    };
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_SECTION_HEADER Sections;
-    PIMAGE_SYMBOL pSymbolTable;
-    PSTR pStringTable;
-} pe_access_object_t;
+/*
+ * A debug section as libdwarf sees it.
+ *
+ * Compressed .zdebug_* sections are presented as their .debug_* counterparts,
+ * and only inflated once libdwarf first loads them, so that resolving an
+ * address never inflates sections it doesn't need.
+ */
+struct pe_dwarf_section
+{
+    std::string name;
+    Dwarf_Unsigned size;
+
+    /* Within the file mapping */
+    Dwarf_Small *raw;
+    Dwarf_Unsigned raw_size;
+
+    bool compressed;
+    Dwarf_Small *inflated;
+};
+
+
+struct pe_dwarf_object
+{
+    struct pe_image *image;
+
+    /* Indexed like libdwarf, with the reserved 0th section left empty */
+    std::vector<pe_dwarf_section> sections;
+
+    /* Total size of the inflated buffers */
+    size_t inflated_size;
+
+    /* Serializes libdwarf calls, see dwarf_pe_lock */
+    mutex_t mutex;
+
+    /* For clones, the object whose inflated sections they share, and which
+     * inflate_mutex guards, as clones load sections concurrently */
+    struct pe_dwarf_object *parent;
+    mutex_t inflate_mutex;
+};
+
+
+/*
+ * Inflated sections get released by dwarf_pe_trim once they take more than
+ * this much memory.
+ */
+#define PE_DWARF_INFLATED_BUDGET (32 << 20)
+
+
+static struct pe_dwarf_object *
+pe_dwarf_object_create(struct pe_image *image)
+{
+    struct pe_dwarf_object *object = new pe_dwarf_object;
+    object->image = pe_image_ref(image);
+    object->inflated_size = 0;
+    mutex_init(&object->mutex);
+    object->parent = NULL;
+    mutex_init(&object->inflate_mutex);
+
+    PIMAGE_FILE_HEADER pFileHeader = &image->pNtHeaders->FileHeader;
+    object->sections.resize(pFileHeader->NumberOfSections + 1);
+    for (unsigned i = 1; i < object->sections.size(); ++i) {
+        pe_dwarf_section &section = object->sections[i];
+        PIMAGE_SECTION_HEADER pSection = image->Sections + i - 1;
+
+        section.name = pe_image_section_name(image, pSection);
+        if (pSection->Misc.VirtualSize < pSection->SizeOfRawData) {
+            section.raw_size = pSection->Misc.VirtualSize;
+        } else {
+            section.raw_size = pSection->SizeOfRawData;
+        }
+        section.raw = image->lpFileBase + pSection->PointerToRawData;
+        section.size = section.raw_size;
+        section.compressed = false;
+        section.inflated = NULL;
+
+        // GNU style compressed sections start with "ZLIB" and the big-endian
+        // 64-bit size of the inflated data
+        if (section.name.compare(0, 8, ".zdebug_") == 0 &&
+            section.raw_size >= 12 &&
+            memcmp(section.raw, "ZLIB", 4) == 0) {
+            Dwarf_Unsigned size = 0;
+            for (unsigned j = 4; j < 12; ++j) {
+                size = (size << 8) | section.raw[j];
+            }
+            section.name.erase(1, 1);
+            section.size = size;
+            section.compressed = true;
+        }
+    }
+
+    return object;
+}
+
+
+static void
+pe_dwarf_object_destroy(struct pe_dwarf_object *object)
+{
+    for (pe_dwarf_section &section : object->sections) {
+        free(section.inflated);
+    }
+    mutex_destroy(&object->inflate_mutex);
+    mutex_destroy(&object->mutex);
+    pe_image_unref(object->image);
+    delete object;
+}
 
 
 static int
@@ -54,7 +149,7 @@ pe_get_section_info(void *obj,
                     Dwarf_Obj_Access_Section *return_section,
                     int *error)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)obj;
 
     return_section->addr = 0;
     if (section_index == 0) {
@@ -63,16 +158,13 @@ pe_get_section_info(void *obj,
         return_section->size = 0;
         return_section->name = "";
     } else {
-        PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + section_index - 1;
-        if (pSection->Misc.VirtualSize < pSection->SizeOfRawData) {
-            return_section->size = pSection->Misc.VirtualSize;
-        } else {
-            return_section->size = pSection->SizeOfRawData;
-        }
-        return_section->name = (const char *)pSection->Name;
-        if (return_section->name[0] == '/') {
-            return_section->name = &pe_obj->pStringTable[atoi(&return_section->name[1])];
-        }
+        const pe_dwarf_section &section = object->sections[section_index];
+        return_section->size = section.size;
+        return_section->name = section.name.c_str();
+
+        // The VMA, which .eh_frame's PC-relative pointers are relative to
+        PIMAGE_SECTION_HEADER pSection = object->image->Sections + section_index - 1;
+        return_section->addr = object->image->ImageBase + pSection->VirtualAddress;
     }
     return_section->link = 0;
     return_section->entrysize = 0;
@@ -91,8 +183,8 @@ pe_get_byte_order(void *obj)
 static Dwarf_Small
 pe_get_length_pointer_size(void *obj)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader = &pe_obj->pNtHeaders->OptionalHeader;
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)obj;
+    PIMAGE_OPTIONAL_HEADER pOptionalHeader = &object->image->pNtHeaders->OptionalHeader;
 
     switch (pOptionalHeader->Magic) {
     case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
@@ -108,9 +200,8 @@ pe_get_length_pointer_size(void *obj)
 static Dwarf_Unsigned
 pe_get_section_count(void *obj)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
-    PIMAGE_FILE_HEADER pFileHeader = &pe_obj->pNtHeaders->FileHeader;
-    return pFileHeader->NumberOfSections + 1;
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)obj;
+    return object->sections.size();
 }
 
 
@@ -120,14 +211,45 @@ pe_load_section(void *obj,
                 Dwarf_Small **return_data,
                 int *error)
 {
-    pe_access_object_t *pe_obj = (pe_access_object_t *)obj;
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)obj;
     if (section_index == 0) {
         return DW_DLV_NO_ENTRY;
-    } else {
-        PIMAGE_SECTION_HEADER pSection = pe_obj->Sections + section_index - 1;
-        *return_data = pe_obj->lpFileBase + pSection->PointerToRawData;
+    }
+
+    if (object->parent) {
+        object = object->parent;
+    }
+
+    pe_dwarf_section &section = object->sections[section_index];
+    if (!section.compressed) {
+        *return_data = section.raw;
         return DW_DLV_OK;
     }
+
+    mutex_lock(&object->inflate_mutex);
+    if (!section.inflated) {
+        uLongf destLen = section.size;
+        Dwarf_Small *dest = (Dwarf_Small *)malloc(section.size ? section.size : 1);
+        if (!dest) {
+            mutex_unlock(&object->inflate_mutex);
+            *error = DW_DLE_ALLOC_FAIL;
+            return DW_DLV_ERROR;
+        }
+        if (uncompress(dest, &destLen, section.raw + 12, section.raw_size - 12) != Z_OK ||
+            destLen != section.size) {
+            OutputDebug("MGWHELP: failed to inflate %s section\n", section.name.c_str());
+            free(dest);
+            mutex_unlock(&object->inflate_mutex);
+            *error = DW_DLE_ZLIB_DATA_ERROR;
+            return DW_DLV_ERROR;
+        }
+        section.inflated = dest;
+        object->inflated_size += section.size;
+    }
+    *return_data = section.inflated;
+    mutex_unlock(&object->inflate_mutex);
+
+    return DW_DLV_OK;
 }
 
 
@@ -143,153 +265,115 @@ pe_methods = {
 
 
 int
-dwarf_pe_init(HANDLE hFile,
-              const char *image,
+dwarf_pe_init(struct pe_image *image,
+              const char *szImageName,
               Dwarf_Handler errhand,
               Dwarf_Ptr errarg,
               Dwarf_Debug *ret_dbg,
               Dwarf_Error *error)
 {
     int res = DW_DLV_ERROR;
-    pe_access_object_t *pe_obj;
-    DWORD dwFileSizeHi;
-    DWORD dwFileSizeLo;
-    Dwarf_Unsigned section_count;
-
-    /* Initialize the internal struct */
-    pe_obj = (pe_access_object_t *)calloc(1, sizeof *pe_obj);
-    if (!pe_obj) {
-        goto no_internals;
-    }
+    Dwarf_Obj_Access_Interface *intfc;
 
-    pe_obj->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!pe_obj->hFileMapping) {
-        goto no_file_mapping;
-    }
+    // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
+    PIMAGE_SECTION_HEADER pDebugLink = pe_image_find_section(image, ".gnu_debuglink");
+    if (pDebugLink && pDebugLink->SizeOfRawData) {
+        const char *debuglink = (const char *)(image->lpFileBase + pDebugLink->PointerToRawData);
 
-    pe_obj->lpFileBase = (PBYTE)MapViewOfFile(pe_obj->hFileMapping, FILE_MAP_READ, 0, 0, 0);
-    if (!pe_obj->lpFileBase) {
-        goto no_view_of_file;
-    }
+        std::vector<std::string> debugSearchDirs;
 
-    dwFileSizeHi = 0;
-    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
-    pe_obj->nFileSize = dwFileSizeLo;
-#ifdef _WIN64
-    pe_obj->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
-#else
-    assert(dwFileSizeHi == 0);
-#endif
+        // Search on the image directory
+        const char *pImageSep = getSeparator(szImageName);
+        std::string imageDir;
+        if (pImageSep) {
+            imageDir.append(szImageName, pImageSep);
+        }
+        debugSearchDirs.emplace_back(imageDir);
+
+        // Then search on a .debug subdirectory
+        imageDir.append(".debug/");
+        debugSearchDirs.emplace_back(imageDir);
+
+        for (auto const & debugSearchDir : debugSearchDirs) {
+            std::string debugImage(debugSearchDir);
+            debugImage.append(debuglink);
+            const char *debugImageStr = debugImage.c_str();
+            struct pe_image *debugImageView = pe_image_open_file(debugImageStr);
+            if (debugImageView) {
+                res = dwarf_pe_init(debugImageView, debugImageStr, errhand, errarg, ret_dbg, error);
+                pe_image_unref(debugImageView);
+                break;
+            }
+        }
+
+        if (res == DW_DLV_OK) {
+            return res;
+        }
+    }
 
-    pe_obj->pNtHeaders = (PIMAGE_NT_HEADERS) (
-        pe_obj->lpFileBase + 
-        pe_obj->pDosHeader->e_lfanew
-    );
-    pe_obj->Sections = (PIMAGE_SECTION_HEADER) (
-        (PBYTE)pe_obj->pNtHeaders + 
-        sizeof(DWORD) + 
-        sizeof(IMAGE_FILE_HEADER) + 
-        pe_obj->pNtHeaders->FileHeader.SizeOfOptionalHeader
-    );
-    pe_obj->pSymbolTable = (PIMAGE_SYMBOL) (
-        pe_obj->lpFileBase + 
-        pe_obj->pNtHeaders->FileHeader.PointerToSymbolTable
-    );
-    if (pe_obj->pNtHeaders->FileHeader.PointerToSymbolTable +
-        pe_obj->pNtHeaders->FileHeader.NumberOfSymbols * sizeof pe_obj->pSymbolTable[0] > pe_obj->nFileSize) {
-        OutputDebug("MGWHELP: %s - symbol table extends beyond image size\n", image);
-        goto no_intfc;
+    /* Initialize the interface struct */
+    intfc = (Dwarf_Obj_Access_Interface *)calloc(1, sizeof *intfc);
+    if (!intfc) {
+        return DW_DLV_ERROR;
+    }
+    intfc->object = pe_dwarf_object_create(image);
+    intfc->methods = &pe_methods;
+
+    res = dwarf_object_init(intfc, errhand, errarg, ret_dbg, error);
+    if (res == DW_DLV_OK) {
+        /*
+         * Our indices keep what they need from libdwarf objects until
+         * dwarf_finish, and per-CU temporaries go into sub-arenas, so spare
+         * libdwarf tracking each object individually.
+         */
+        dwarf_set_arena_mode(*ret_dbg, true);
+        return res;
     }
 
-    pe_obj->pStringTable = (PSTR)
-        &pe_obj->pSymbolTable[pe_obj->pNtHeaders->FileHeader.NumberOfSymbols];
+    // Warn if no symbols found, yet this looks like a PE file generated by
+    // MinGW.
+    // See also http://reverseengineering.stackexchange.com/a/1826
+    PIMAGE_OPTIONAL_HEADER pOptionalHeader;
+    pOptionalHeader = &image->pNtHeaders->OptionalHeader;
+    if (pOptionalHeader->MajorLinkerVersion == 2 &&
+        pOptionalHeader->MinorLinkerVersion >= 21) {
+        OutputDebug("MGWHELP: %s - no dwarf symbols\n", szImageName);
+    }
 
-    // https://sourceware.org/gdb/onlinedocs/gdb/Separate-Debug-Files.html
-    section_count = pe_get_section_count(pe_obj);
-    for (Dwarf_Unsigned section_index = 0; section_index < section_count; ++section_index) {
-        Dwarf_Obj_Access_Section doas;
-        memset(&doas, 0, sizeof doas);
-        int err = 0;
-        pe_get_section_info(pe_obj, section_index, &doas, &err);
-        if (!doas.size) {
-            continue;
-        }
+    pe_dwarf_object_destroy((struct pe_dwarf_object *)intfc->object);
+    free(intfc);
 
-        if (strcmp(doas.name, ".gnu_debuglink") == 0) {
-            Dwarf_Small *data;
-            pe_load_section(pe_obj, section_index, &data, &err);
-            const char *debuglink = (const char *)data;
+    return res;
+}
 
-            std::vector<std::string> debugSearchDirs;
 
-            // Search on the image directory
-            const char *pImageSep = getSeparator(image);
-            std::string imageDir;
-            if (pImageSep) {
-                imageDir.append(image, pImageSep);
-            }
-            debugSearchDirs.emplace_back(imageDir);
-
-            // Then search on a .debug subdirectory
-            imageDir.append(".debug\\");
-            debugSearchDirs.emplace_back(imageDir);
-
-            HANDLE hFile = INVALID_HANDLE_VALUE;
-            for (auto const & debugSearchDir : debugSearchDirs) {
-                std::string debugImage(debugSearchDir);
-                debugImage.append(debuglink);
-                const char *debugImageStr = debugImage.c_str();
-                hFile = CreateFileA(debugImageStr, GENERIC_READ, FILE_SHARE_READ, NULL,
-                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-                if (hFile == INVALID_HANDLE_VALUE) {
-                    OutputDebug("MGWHELP: %s - not found\n", debugImageStr);
-                } else {
-                    res = dwarf_pe_init(hFile, debugImageStr, errhand, errarg, ret_dbg, error);
-                    CloseHandle(hFile);
-                    break;
-                }
-            }
+int
+dwarf_pe_clone(Dwarf_Debug dbg,
+               Dwarf_Debug *ret_dbg,
+               Dwarf_Error *error)
+{
+    Dwarf_Obj_Access_Interface *parent_intfc = dbg->de_obj_file;
+    if (parent_intfc->methods != &pe_methods) {
+        return DW_DLV_ERROR;
+    }
+    struct pe_dwarf_object *parent = (struct pe_dwarf_object *)parent_intfc->object;
 
-            break;
-        }
+    Dwarf_Obj_Access_Interface *intfc = (Dwarf_Obj_Access_Interface *)calloc(1, sizeof *intfc);
+    if (!intfc) {
+        return DW_DLV_ERROR;
     }
+    struct pe_dwarf_object *object = pe_dwarf_object_create(parent->image);
+    object->parent = parent;
+    intfc->object = object;
+    intfc->methods = &pe_methods;
 
+    int res = dwarf_object_init(intfc, 0, 0, ret_dbg, error);
     if (res != DW_DLV_OK) {
-        Dwarf_Obj_Access_Interface *intfc;
-
-        /* Initialize the interface struct */
-        intfc = (Dwarf_Obj_Access_Interface *)calloc(1, sizeof *intfc);
-        if (!intfc) {
-            goto no_intfc;
-        }
-        intfc->object = pe_obj;
-        intfc->methods = &pe_methods;
-
-        res = dwarf_object_init(intfc, errhand, errarg, ret_dbg, error);
-        if (res == DW_DLV_OK) {
-            return res;
-        }
-
-        // Warn if no symbols found, yet this looks like a PE file generated by
-        // MinGW.
-        // See also http://reverseengineering.stackexchange.com/a/1826
-        PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-        pOptionalHeader = &pe_obj->pNtHeaders->OptionalHeader;
-        if (pOptionalHeader->MajorLinkerVersion == 2 &&
-            pOptionalHeader->MinorLinkerVersion >= 21) {
-            OutputDebug("MGWHELP: %s - no dwarf symbols\n", image);
-        }
-
+        pe_dwarf_object_destroy(object);
         free(intfc);
+        return res;
     }
-
-no_intfc:
-    UnmapViewOfFile(pe_obj->lpFileBase);
-no_view_of_file:
-    CloseHandle(pe_obj->hFileMapping);
-no_file_mapping:
-    free(pe_obj);
-no_internals:
+    dwarf_set_arena_mode(*ret_dbg, dbg->de_arena_mode);
     return res;
 }
 
@@ -299,10 +383,109 @@ dwarf_pe_finish(Dwarf_Debug dbg,
                 Dwarf_Error *error)
 {
     Dwarf_Obj_Access_Interface *intfc = dbg->de_obj_file;
-    pe_access_object_t *pe_obj = (pe_access_object_t *)intfc->object;
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)intfc->object;
+    int res = dwarf_object_finish(dbg, error);
     free(intfc);
-    UnmapViewOfFile(pe_obj->lpFileBase);
-    CloseHandle(pe_obj->hFileMapping);
-    free(pe_obj);
-    return dwarf_object_finish(dbg, error);
+    pe_dwarf_object_destroy(object);
+    return res;
+}
+
+
+static struct pe_dwarf_object *
+pe_dwarf_object_get(Dwarf_Debug dbg)
+{
+    Dwarf_Obj_Access_Interface *intfc = dbg->de_obj_file;
+    if (intfc->methods != &pe_methods) {
+        return NULL;
+    }
+    return (struct pe_dwarf_object *)intfc->object;
+}
+
+
+void
+dwarf_pe_lock(Dwarf_Debug dbg)
+{
+    struct pe_dwarf_object *object = pe_dwarf_object_get(dbg);
+    if (object) {
+        mutex_lock(&object->mutex);
+    }
+}
+
+
+void
+dwarf_pe_unlock(Dwarf_Debug dbg)
+{
+    struct pe_dwarf_object *object = pe_dwarf_object_get(dbg);
+    if (object) {
+        mutex_unlock(&object->mutex);
+    }
+}
+
+
+/*
+ * Sections which libdwarf only reads while a dwarf_srclines, dwarf_get_aranges
+ * or dwarf_get_ranges call is in progress, and which hold no pointers cached
+ * elsewhere.
+ */
+static bool
+pe_dwarf_section_releasable(const pe_dwarf_section &section)
+{
+    static const char *names[] = {
+        ".debug_aranges",
+        ".debug_line",
+        ".debug_ranges",
+    };
+    for (const char *name : names) {
+        if (section.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void
+dwarf_pe_trim(Dwarf_Debug dbg)
+{
+    Dwarf_Obj_Access_Interface *intfc = dbg->de_obj_file;
+    if (intfc->methods != &pe_methods) {
+        return;
+    }
+    struct pe_dwarf_object *object = (struct pe_dwarf_object *)intfc->object;
+
+    size_t budget = PE_DWARF_INFLATED_BUDGET;
+#ifdef _WIN32
+    MEMORYSTATUSEX MemoryStatus;
+    MemoryStatus.dwLength = sizeof MemoryStatus;
+    if (GlobalMemoryStatusEx(&MemoryStatus) && MemoryStatus.dwMemoryLoad >= 90) {
+        budget = 0;
+    }
+#endif
+    // Clones of dbg may be inflating sections meanwhile
+    mutex_lock(&object->inflate_mutex);
+    if (object->inflated_size <= budget) {
+        mutex_unlock(&object->inflate_mutex);
+        return;
+    }
+
+    // Have libdwarf load them again through pe_load_section, should they be
+    // needed later
+    for (unsigned i = 0; i < dbg->de_debug_sections_total_entries; ++i) {
+        struct Dwarf_Section_s *secdata = dbg->de_debug_sections[i].ds_secdata;
+        if (secdata->dss_index >= object->sections.size()) {
+            continue;
+        }
+        pe_dwarf_section &section = object->sections[secdata->dss_index];
+        if (section.inflated && pe_dwarf_section_releasable(section)) {
+            // A clone may have inflated a section dbg itself never loaded
+            if (secdata->dss_data && secdata->dss_data != section.inflated) {
+                continue;
+            }
+            secdata->dss_data = NULL;
+            free(section.inflated);
+            section.inflated = NULL;
+            object->inflated_size -= section.size;
+        }
+    }
+    mutex_unlock(&object->inflate_mutex);
 }
@@ -19,11 +19,11 @@
 
 #pragma once
 
-#include <windows.h>
-
 #include <dwarf.h>
 #include <libdwarf.h>
 
+#include "pe_image.h"
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,8 +31,8 @@ extern "C" {
 
 
 int
-dwarf_pe_init(HANDLE hFile,
-              const char *image,
+dwarf_pe_init(struct pe_image *image,
+              const char *szImageName,
               Dwarf_Handler errhand,
               Dwarf_Ptr errarg,
               Dwarf_Debug * ret_dbg, Dwarf_Error * error);
@@ -40,6 +40,34 @@ dwarf_pe_init(HANDLE hFile,
 int
 dwarf_pe_finish(Dwarf_Debug dbg, Dwarf_Error * error);
 
+/*
+ * Another Dwarf_Debug over the same debug information as dbg, so that another
+ * thread can read it at the same time.  Compressed sections get inflated once
+ * and shared with dbg, which must therefore outlive the clone, and not be
+ * trimmed meanwhile.
+ */
+int
+dwarf_pe_clone(Dwarf_Debug dbg, Dwarf_Debug * ret_dbg, Dwarf_Error * error);
+
+/*
+ * Release inflated .zdebug_* sections which can be reloaded on demand, if
+ * they take too much memory.  Must not be called while any line, arange, or
+ * range list obtained from dbg is still alive.
+ */
+void
+dwarf_pe_trim(Dwarf_Debug dbg);
+
+/*
+ * libdwarf is not thread-safe, so once any of a module's indices exists, all
+ * further libdwarf calls on its Dwarf_Debug, including those creating the
+ * other indices, must hold this lock.
+ */
+void
+dwarf_pe_lock(Dwarf_Debug dbg);
+
+void
+dwarf_pe_unlock(Dwarf_Debug dbg);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,417 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Stack unwinding with DWARF call frame information.
+ *
+ * See also:
+ * - http://www.dwarfstd.org/doc/DWARF4.pdf, section 6.4
+ * - http://refspecs.linuxfoundation.org/LSB_3.0.0/LSB-Core-generic/LSB-Core-generic/ehframechpt.html
+ */
+
+
+#include "dwarf_unwind.h"
+#include "dwarf_pe.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "outdbg.h"
+#include "thread.h"
+
+
+struct dwarf_frame_entry
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    Dwarf_Fde fde;
+};
+
+
+/*
+ * Outcome of decoding the rule for one pc, including failures, so that
+ * neither is paid for twice.
+ */
+struct dwarf_frame_cached
+{
+    bool found;
+    struct dwarf_unwind_rule rule;
+};
+
+
+struct dwarf_frame_index
+{
+    Dwarf_Debug dbg;
+    std::vector<dwarf_frame_entry> entries;
+    uint8_t sp_reg;
+    uint8_t address_size;
+
+    /* Decoded rules by pc, and the statistics about them, guarded by
+     * cache_mutex.  Stack traces keep hitting the same return addresses,
+     * so a plain hash map of those is enough. */
+    mutex_t cache_mutex;
+    std::unordered_map<Dwarf_Addr, dwarf_frame_cached> cache;
+    struct dwarf_frame_stats stats;
+};
+
+
+static void
+add_fdes(Dwarf_Fde *fdes, Dwarf_Signed fde_count,
+         std::vector<dwarf_frame_entry> &entries)
+{
+    Dwarf_Error error = 0;
+    for (Dwarf_Signed i = 0; i < fde_count; ++i) {
+        dwarf_frame_entry entry;
+        Dwarf_Unsigned length = 0;
+        if (dwarf_get_fde_range(fdes[i], &entry.lowpc, &length,
+                                NULL, NULL, NULL, NULL, NULL, &error) != DW_DLV_OK ||
+            length == 0) {
+            continue;
+        }
+        entry.highpc = entry.lowpc + length;
+        entry.fde = fdes[i];
+        entries.push_back(entry);
+    }
+}
+
+
+struct dwarf_frame_index *
+dwarf_frame_index_create(Dwarf_Debug dbg)
+{
+    struct dwarf_frame_index *index = new dwarf_frame_index;
+    index->dbg = dbg;
+    mutex_init(&index->cache_mutex);
+    memset(&index->stats, 0, sizeof index->stats);
+
+    Dwarf_Error error = 0;
+    Dwarf_Half address_size = 0;
+    if (dwarf_get_address_size(dbg, &address_size, &error) != DW_DLV_OK) {
+        address_size = 4;
+    }
+    index->address_size = address_size;
+    index->sp_reg = address_size == 8 ? DWARF_X86_64_RSP : DWARF_X86_ESP;
+
+    // .eh_frame goes first, so that it wins over .debug_frame below
+    Dwarf_Cie *cies;
+    Dwarf_Signed cie_count;
+    Dwarf_Fde *fdes;
+    Dwarf_Signed fde_count;
+    int res = dwarf_get_fde_list_eh(dbg, &cies, &cie_count, &fdes, &fde_count, &error);
+    if (res == DW_DLV_OK) {
+        add_fdes(fdes, fde_count, index->entries);
+    } else if (res == DW_DLV_ERROR) {
+        OutputDebug("MGWHELP: dwarf_get_fde_list_eh failed - %s\n", dwarf_errmsg(error));
+    }
+    res = dwarf_get_fde_list(dbg, &cies, &cie_count, &fdes, &fde_count, &error);
+    if (res == DW_DLV_OK) {
+        add_fdes(fdes, fde_count, index->entries);
+    } else if (res == DW_DLV_ERROR) {
+        OutputDebug("MGWHELP: dwarf_get_fde_list failed - %s\n", dwarf_errmsg(error));
+    }
+
+    // Sort, and drop FDEs overlapping an earlier one, such as the
+    // .debug_frame copy of an .eh_frame FDE
+    std::stable_sort(index->entries.begin(), index->entries.end(),
+                     [](const dwarf_frame_entry &a, const dwarf_frame_entry &b) { return a.lowpc < b.lowpc; });
+    std::vector<dwarf_frame_entry> &entries = index->entries;
+    size_t count = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (count && entries[i].lowpc < entries[count - 1].highpc) {
+            continue;
+        }
+        entries[count++] = entries[i];
+    }
+    entries.resize(count);
+    entries.shrink_to_fit();
+
+    return index;
+}
+
+
+void
+dwarf_frame_index_destroy(struct dwarf_frame_index *index)
+{
+    // The FDEs themselves live until dwarf_finish
+    mutex_destroy(&index->cache_mutex);
+    delete index;
+}
+
+
+void
+dwarf_frame_cache_clear(struct dwarf_frame_index *index)
+{
+    mutex_lock(&index->cache_mutex);
+    index->cache.clear();
+    mutex_unlock(&index->cache_mutex);
+}
+
+
+void
+dwarf_frame_get_stats(struct dwarf_frame_index *index,
+                      struct dwarf_frame_stats *stats)
+{
+    mutex_lock(&index->cache_mutex);
+    *stats = index->stats;
+    stats->rules = index->cache.size();
+    mutex_unlock(&index->cache_mutex);
+}
+
+
+/*
+ * Reduce libdwarf's register table to a rule, or fail for what the unwinder
+ * doesn't support, such as DWARF expressions.
+ */
+static bool
+make_rule(const Dwarf_Regtable3 *table, struct dwarf_unwind_rule *rule)
+{
+    const Dwarf_Regtable_Entry3 *cfa = &table->rt3_cfa_rule;
+    if (cfa->dw_value_type != DW_EXPR_OFFSET ||
+        cfa->dw_regnum >= DWARF_UNWIND_REGS) {
+        return false;
+    }
+    rule->cfa_reg = cfa->dw_regnum;
+    rule->cfa_offset = (Dwarf_Signed)cfa->dw_offset_or_block_len;
+
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        const Dwarf_Regtable_Entry3 *entry = &table->rt3_rules[reg];
+        rule->offset[reg] = 0;
+        if (entry->dw_regnum == DW_FRAME_SAME_VAL) {
+            rule->how[reg] = DWARF_UNWIND_SAME;
+        } else if (entry->dw_regnum == DW_FRAME_UNDEFINED_VAL) {
+            rule->how[reg] = DWARF_UNWIND_UNDEFINED;
+        } else if (entry->dw_regnum == DW_FRAME_CFA_COL3 &&
+                   entry->dw_value_type == DW_EXPR_OFFSET) {
+            rule->how[reg] = DWARF_UNWIND_OFFSET;
+            rule->offset[reg] = (Dwarf_Signed)entry->dw_offset_or_block_len;
+        } else if (entry->dw_regnum == DW_FRAME_CFA_COL3 &&
+                   entry->dw_value_type == DW_EXPR_VAL_OFFSET) {
+            rule->how[reg] = DWARF_UNWIND_VAL_OFFSET;
+            rule->offset[reg] = (Dwarf_Signed)entry->dw_offset_or_block_len;
+        } else if (entry->dw_value_type == DW_EXPR_OFFSET &&
+                   !entry->dw_offset_relevant &&
+                   entry->dw_regnum < DWARF_UNWIND_REGS) {
+            rule->how[reg] = DWARF_UNWIND_REGISTER;
+            rule->offset[reg] = entry->dw_regnum;
+        } else if (reg == rule->ra_reg) {
+            return false;
+        } else {
+            // Other registers recovered through expressions just get lost
+            rule->how[reg] = DWARF_UNWIND_UNDEFINED;
+        }
+    }
+
+    return true;
+}
+
+
+static bool
+decode_rule(struct dwarf_frame_index *index,
+            const dwarf_frame_entry *entry,
+            Dwarf_Addr pc,
+            struct dwarf_unwind_rule *rule)
+{
+    Dwarf_Error error = 0;
+
+    Dwarf_Cie cie;
+    Dwarf_Unsigned cie_size;
+    Dwarf_Half ra_reg = 0;
+    if (dwarf_get_cie_of_fde(entry->fde, &cie, &error) != DW_DLV_OK ||
+        dwarf_get_cie_info(cie, &cie_size, NULL, NULL, NULL, NULL, &ra_reg, NULL, NULL, &error) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: bad CIE - %s\n", dwarf_errmsg(error));
+        return false;
+    }
+    if (ra_reg >= DWARF_UNWIND_REGS) {
+        return false;
+    }
+
+    Dwarf_Regtable_Entry3 entries[DWARF_UNWIND_REGS];
+    Dwarf_Regtable3 table;
+    memset(&table, 0, sizeof table);
+    table.rt3_reg_table_size = DWARF_UNWIND_REGS;
+    table.rt3_rules = entries;
+
+    Dwarf_Addr row_pc = 0;
+    Dwarf_Bool has_more_rows = false;
+    Dwarf_Addr subsequent_pc = 0;
+    if (dwarf_get_fde_info_for_all_regs3_b(entry->fde, pc, &table, &row_pc,
+                                           &has_more_rows, &subsequent_pc, &error) != DW_DLV_OK) {
+        OutputDebug("MGWHELP: dwarf_get_fde_info_for_all_regs3_b failed - %s\n", dwarf_errmsg(error));
+        return false;
+    }
+
+    rule->lowpc = std::max(row_pc, entry->lowpc);
+    rule->highpc = has_more_rows ? std::min(subsequent_pc, entry->highpc) : entry->highpc;
+    rule->ra_reg = ra_reg;
+    rule->sp_reg = index->sp_reg;
+    rule->address_size = index->address_size;
+    return make_rule(&table, rule);
+}
+
+
+static bool
+lookup_rule(struct dwarf_frame_index *index,
+            Dwarf_Addr pc,
+            struct dwarf_unwind_rule *rule)
+{
+    const std::vector<dwarf_frame_entry> &entries = index->entries;
+    auto it = std::upper_bound(entries.begin(), entries.end(), pc,
+                               [](Dwarf_Addr a, const dwarf_frame_entry &e) { return a < e.lowpc; });
+    if (it == entries.begin()) {
+        return false;
+    }
+    --it;
+    if (pc >= it->highpc) {
+        return false;
+    }
+
+    dwarf_pe_lock(index->dbg);
+    bool found = decode_rule(index, &*it, pc, rule);
+    dwarf_pe_unlock(index->dbg);
+    return found;
+}
+
+
+bool
+dwarf_frame_find_rule(struct dwarf_frame_index *index,
+                      Dwarf_Addr pc,
+                      struct dwarf_unwind_rule *rule)
+{
+    mutex_lock(&index->cache_mutex);
+    auto it = index->cache.find(pc);
+    if (it != index->cache.end()) {
+        ++index->stats.hits;
+        bool found = it->second.found;
+        *rule = it->second.rule;
+        mutex_unlock(&index->cache_mutex);
+        return found;
+    }
+    ++index->stats.misses;
+    mutex_unlock(&index->cache_mutex);
+
+    // Decode without holding the cache lock, so that hits on other threads
+    // don't wait for libdwarf
+    dwarf_frame_cached cached;
+    memset(&cached, 0, sizeof cached);
+    cached.found = lookup_rule(index, pc, &cached.rule);
+
+    mutex_lock(&index->cache_mutex);
+    index->cache.emplace(pc, cached);
+    mutex_unlock(&index->cache_mutex);
+
+    *rule = cached.rule;
+    return cached.found;
+}
+
+
+static bool
+read_address(const struct dwarf_unwind_rule *rule,
+             dwarf_unwind_read_memory read_memory,
+             void *opaque,
+             Dwarf_Addr addr,
+             Dwarf_Addr *value)
+{
+    if (rule->address_size == 4) {
+        uint32_t value32;
+        if (!read_memory(opaque, addr, &value32, sizeof value32)) {
+            return false;
+        }
+        *value = value32;
+    } else {
+        uint64_t value64;
+        if (!read_memory(opaque, addr, &value64, sizeof value64)) {
+            return false;
+        }
+        *value = value64;
+    }
+    return true;
+}
+
+
+bool
+dwarf_unwind_apply(const struct dwarf_unwind_rule *rule,
+                   struct dwarf_unwind_regs *regs,
+                   dwarf_unwind_read_memory read_memory,
+                   void *opaque)
+{
+    if (!(regs->valid & (1U << rule->cfa_reg))) {
+        return false;
+    }
+    Dwarf_Addr cfa = regs->value[rule->cfa_reg] + rule->cfa_offset;
+    if (rule->address_size == 4) {
+        cfa &= 0xffffffff;
+    }
+
+    struct dwarf_unwind_regs caller = *regs;
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        uint32_t mask = 1U << reg;
+        switch (rule->how[reg]) {
+        case DWARF_UNWIND_SAME:
+            break;
+        case DWARF_UNWIND_UNDEFINED:
+            caller.valid &= ~mask;
+            break;
+        case DWARF_UNWIND_OFFSET:
+            if (read_address(rule, read_memory, opaque, cfa + rule->offset[reg], &caller.value[reg])) {
+                caller.valid |= mask;
+            } else {
+                caller.valid &= ~mask;
+            }
+            break;
+        case DWARF_UNWIND_VAL_OFFSET:
+            caller.value[reg] = cfa + rule->offset[reg];
+            caller.valid |= mask;
+            break;
+        case DWARF_UNWIND_REGISTER:
+            caller.value[reg] = regs->value[rule->offset[reg]];
+            if (regs->valid & (1U << rule->offset[reg])) {
+                caller.valid |= mask;
+            } else {
+                caller.valid &= ~mask;
+            }
+            break;
+        }
+    }
+
+    // The CFA is by definition the caller's stack pointer
+    caller.value[rule->sp_reg] = cfa;
+    caller.valid |= 1U << rule->sp_reg;
+
+    if (!(caller.valid & (1U << rule->ra_reg))) {
+        return false;
+    }
+
+    *regs = caller;
+    return true;
+}
+
+
+bool
+dwarf_unwind_step(struct dwarf_frame_index *index,
+                  Dwarf_Addr pc,
+                  struct dwarf_unwind_regs *regs,
+                  dwarf_unwind_read_memory read_memory,
+                  void *opaque)
+{
+    struct dwarf_unwind_rule rule;
+    return dwarf_frame_find_rule(index, pc, &rule) &&
+           dwarf_unwind_apply(&rule, regs, read_memory, opaque);
+}
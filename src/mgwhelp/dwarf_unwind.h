@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dwarf.h>
+#include <libdwarf.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Integer registers known to the unwinder, by DWARF register number: enough
+ * for x86 (eax..edi, and eip as 8) and x86-64 (rax..r15, and rip as 16).
+ */
+#define DWARF_UNWIND_REGS 17
+
+#define DWARF_X86_ESP 4
+#define DWARF_X86_EIP 8
+#define DWARF_X86_64_RSP 7
+#define DWARF_X86_64_RIP 16
+
+
+struct dwarf_unwind_regs
+{
+    Dwarf_Addr value[DWARF_UNWIND_REGS];
+    uint32_t valid; /* bit mask of the registers with a known value */
+};
+
+
+/*
+ * How the caller's value of a register is recovered.
+ */
+enum dwarf_unwind_how
+{
+    DWARF_UNWIND_SAME,       /* unchanged */
+    DWARF_UNWIND_UNDEFINED,  /* lost */
+    DWARF_UNWIND_OFFSET,     /* saved at CFA + offset */
+    DWARF_UNWIND_VAL_OFFSET, /* is CFA + offset */
+    DWARF_UNWIND_REGISTER,   /* in the register numbered offset */
+};
+
+
+/*
+ * Row of the call frame information for a range of addresses, reduced to
+ * what the unwinder needs.
+ */
+struct dwarf_unwind_rule
+{
+    Dwarf_Addr lowpc;
+    Dwarf_Addr highpc;
+    int32_t cfa_offset;
+    uint8_t cfa_reg;
+    uint8_t ra_reg;       /* the caller's program counter */
+    uint8_t sp_reg;       /* the caller's stack pointer, which is the CFA */
+    uint8_t address_size;
+    uint8_t how[DWARF_UNWIND_REGS];
+    int32_t offset[DWARF_UNWIND_REGS];
+};
+
+
+/*
+ * Reads size bytes of the target's memory at addr.
+ */
+typedef bool (*dwarf_unwind_read_memory)(void *opaque, Dwarf_Addr addr, void *buffer, size_t size);
+
+
+/*
+ * Address-sorted table of a module's FDEs, from both .eh_frame and
+ * .debug_frame, built once per module.
+ *
+ * Rules are decoded on demand, under dwarf_pe_lock, and cached by pc, so the
+ * functions below may be called concurrently from any number of threads.
+ */
+struct dwarf_frame_index;
+
+
+struct dwarf_frame_stats
+{
+    uint64_t hits;   /* lookups answered by the rule cache */
+    uint64_t misses; /* lookups that decoded the FDE's instructions */
+    uint64_t rules;  /* rules in the cache now */
+};
+
+
+struct dwarf_frame_index *
+dwarf_frame_index_create(Dwarf_Debug dbg);
+
+void
+dwarf_frame_index_destroy(struct dwarf_frame_index *index);
+
+void
+dwarf_frame_cache_clear(struct dwarf_frame_index *index);
+
+void
+dwarf_frame_get_stats(struct dwarf_frame_index *index,
+                      struct dwarf_frame_stats *stats);
+
+/*
+ * Rule for the frame of the function executing pc, an image VMA.
+ */
+bool
+dwarf_frame_find_rule(struct dwarf_frame_index *index,
+                      Dwarf_Addr pc,
+                      struct dwarf_unwind_rule *rule);
+
+/*
+ * Replace regs with the caller's registers.  Fails if the registers or memory
+ * the rule needs are unknown, or the return address is undefined, which
+ * marks the outermost frame.
+ */
+bool
+dwarf_unwind_apply(const struct dwarf_unwind_rule *rule,
+                   struct dwarf_unwind_regs *regs,
+                   dwarf_unwind_read_memory read_memory,
+                   void *opaque);
+
+/*
+ * Unwind regs by one frame, with the rule for pc: the image VMA of the
+ * instruction being executed, or, for all but the innermost frame, of the
+ * call instruction, i.e., the return address minus one.
+ */
+bool
+dwarf_unwind_step(struct dwarf_frame_index *index,
+                  Dwarf_Addr pc,
+                  struct dwarf_unwind_regs *regs,
+                  dwarf_unwind_read_memory read_memory,
+                  void *opaque);
+
+
+#ifdef __cplusplus
+}
+#endif
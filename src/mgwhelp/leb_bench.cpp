@@ -0,0 +1,377 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Times libdwarf's LEB128 decoders on the LEB128 values of a MinGW image:
+ *
+ * - abbrev: the whole .debug_abbrev section, which is a stream of ULEB128s;
+ * - line: the ULEB128 and SLEB128 operands of the .debug_line programs;
+ * - info: the abbreviation codes of all .debug_info DIEs.
+ *
+ * Each kernel is checked against a plain byte-at-a-time decoder.
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "pe_image.h"
+#include "dwarf_pe.h"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+struct leb_stream
+{
+    const char *name;
+    bool is_signed;
+    std::vector<Dwarf_Small> data;
+    size_t count;
+};
+
+
+static const Dwarf_Small *
+get_section(const struct pe_image *image, const char *name, size_t *size)
+{
+    PIMAGE_SECTION_HEADER pSection = pe_image_find_section(image, name);
+    if (!pSection) {
+        return NULL;
+    }
+    *size = pSection->Misc.VirtualSize < pSection->SizeOfRawData ? pSection->Misc.VirtualSize
+                                                                 : pSection->SizeOfRawData;
+    return image->lpFileBase + pSection->PointerToRawData;
+}
+
+
+/*
+ * Reference decoder.  Returns the length, or 0 past end.
+ */
+static size_t
+decode_leb128(const Dwarf_Small *p, const Dwarf_Small *end, bool is_signed, Dwarf_Unsigned *value)
+{
+    Dwarf_Unsigned result = 0;
+    unsigned shift = 0;
+    size_t len = 0;
+    Dwarf_Small byte;
+    do {
+        if (p + len >= end || len >= 10) {
+            return 0;
+        }
+        byte = p[len++];
+        if (shift < 64) {
+            result |= (Dwarf_Unsigned)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+    if (is_signed && shift < 64 && (byte & 0x40)) {
+        result |= ~(Dwarf_Unsigned)0 << shift;
+    }
+    *value = result;
+    return len;
+}
+
+
+/*
+ * Append the LEB128 at p to stream.
+ */
+static const Dwarf_Small *
+copy_leb128(struct leb_stream *stream, const Dwarf_Small *p, const Dwarf_Small *end)
+{
+    Dwarf_Unsigned value;
+    size_t len = decode_leb128(p, end, stream->is_signed, &value);
+    if (!len) {
+        return NULL;
+    }
+    stream->data.insert(stream->data.end(), p, p + len);
+    ++stream->count;
+    return p + len;
+}
+
+
+static void
+collect_abbrev(const struct pe_image *image, struct leb_stream *stream)
+{
+    size_t size = 0;
+    const Dwarf_Small *p = get_section(image, ".debug_abbrev", &size);
+    const Dwarf_Small *end = p + size;
+    while (p && p < end) {
+        p = copy_leb128(stream, p, end);
+    }
+}
+
+
+/*
+ * Walk the line number programs, as dwarf_srclines does.
+ */
+static void
+collect_line(const struct pe_image *image, struct leb_stream *ustream, struct leb_stream *sstream)
+{
+    size_t size = 0;
+    const Dwarf_Small *section = get_section(image, ".debug_line", &size);
+    if (!section) {
+        return;
+    }
+    const Dwarf_Small *section_end = section + size;
+    const Dwarf_Small *unit = section;
+    while (section_end - unit >= 4) {
+        uint32_t length32;
+        memcpy(&length32, unit, 4);
+        unsigned offset_size = 4;
+        uint64_t length = length32;
+        const Dwarf_Small *p = unit + 4;
+        if (length32 == 0xffffffff) {
+            if (section_end - p < 8) {
+                return;
+            }
+            memcpy(&length, p, 8);
+            p += 8;
+            offset_size = 8;
+        }
+        if (length > (uint64_t)(section_end - p)) {
+            return;
+        }
+        const Dwarf_Small *end = p + length;
+        unit = end;
+
+        uint16_t version;
+        memcpy(&version, p, 2);
+        p += 2;
+        if (version < 2 || version > 5) {
+            continue;
+        }
+        if (version >= 5) {
+            p += 2; /* address_size, segment_selector_size */
+        }
+        uint64_t header_length = 0;
+        memcpy(&header_length, p, offset_size);
+        p += offset_size;
+        if (header_length > (uint64_t)(end - p)) {
+            continue;
+        }
+        const Dwarf_Small *program = p + header_length;
+        p += 1; /* minimum_instruction_length */
+        if (version >= 4) {
+            p += 1; /* maximum_operations_per_instruction */
+        }
+        p += 3; /* default_is_stmt, line_base, line_range */
+        unsigned opcode_base = *p++;
+        const Dwarf_Small *opcode_lengths = p;
+
+        p = program;
+        while (p && p < end) {
+            unsigned opcode = *p++;
+            if (opcode >= opcode_base) {
+                continue;
+            }
+            switch (opcode) {
+            case 0: {
+                /* Extended opcode */
+                Dwarf_Unsigned len;
+                size_t leblen = decode_leb128(p, end, false, &len);
+                if (!leblen || len > (Dwarf_Unsigned)(end - p - leblen)) {
+                    p = NULL;
+                    break;
+                }
+                p += leblen + len;
+                break;
+            }
+            case 3: /* DW_LNS_advance_line */
+                p = copy_leb128(sstream, p, end);
+                break;
+            case 9: /* DW_LNS_fixed_advance_pc */
+                p += 2;
+                break;
+            default:
+                for (unsigned i = 0; p && i < opcode_lengths[opcode - 1]; ++i) {
+                    p = copy_leb128(ustream, p, end);
+                }
+                break;
+            }
+        }
+    }
+}
+
+
+static void
+collect_info(Dwarf_Debug dbg, const struct pe_image *image, struct leb_stream *stream)
+{
+    size_t size = 0;
+    const Dwarf_Small *section = get_section(image, ".debug_info", &size);
+    if (!section) {
+        return;
+    }
+
+    Dwarf_Error error = 0;
+    Dwarf_Unsigned next_cu_header = 0;
+    while (dwarf_next_cu_header_d(dbg, 1, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &next_cu_header,
+                                  NULL, &error) == DW_DLV_OK) {
+        Dwarf_Die_Cursor cursor;
+        if (dwarf_die_cursor_init(dbg, 1, &cursor, &error) != DW_DLV_OK) {
+            return;
+        }
+        while (dwarf_die_cursor_next(&cursor, &error) == DW_DLV_OK) {
+            if (cursor.dc_offset < size) {
+                copy_leb128(stream, section + cursor.dc_offset, section + size);
+            }
+        }
+    }
+}
+
+
+typedef int (*batch_fn)(const leb_stream &stream, Dwarf_Unsigned *values);
+
+
+static int
+decode_reference(const leb_stream &stream, Dwarf_Unsigned *values)
+{
+    const Dwarf_Small *p = stream.data.data();
+    const Dwarf_Small *end = p + stream.data.size();
+    for (size_t i = 0; i < stream.count; ++i) {
+        size_t len = decode_leb128(p, end, stream.is_signed, &values[i]);
+        if (!len) {
+            return DW_DLV_ERROR;
+        }
+        p += len;
+    }
+    return DW_DLV_OK;
+}
+
+
+static int
+decode_batch(const leb_stream &stream, Dwarf_Unsigned *values)
+{
+    Dwarf_Small *data = const_cast<Dwarf_Small *>(stream.data.data());
+    Dwarf_Small *end = data + stream.data.size();
+    Dwarf_Small *next = NULL;
+    int ret;
+    if (stream.is_signed) {
+        ret = dwarf_decode_signed_leb128_batch(data, end, (Dwarf_Signed *)values, stream.count, &next);
+    } else {
+        ret = dwarf_decode_leb128_batch(data, end, values, stream.count, &next);
+    }
+    if (ret == DW_DLV_OK && next != end) {
+        ret = DW_DLV_ERROR;
+    }
+    return ret;
+}
+
+
+/*
+ * Time one decoder, repeating it for at least 50 ms.
+ */
+static void
+time_decoder(const leb_stream &stream, const char *name, batch_fn fn, const std::vector<Dwarf_Unsigned> &expected)
+{
+    std::vector<Dwarf_Unsigned> values(stream.count);
+    if (fn(stream, values.data()) != DW_DLV_OK || values != expected) {
+        printf("%-8s %-10s MISMATCH\n", stream.name, name);
+        return;
+    }
+
+    unsigned repeats = 0;
+    double ms;
+    bench_clock::time_point start = bench_clock::now();
+    do {
+        fn(stream, values.data());
+        ++repeats;
+        ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+    } while (ms < 50.0);
+
+    double ns_per_value = ms * 1e6 / ((double)repeats * stream.count);
+    double mb_per_s = (double)stream.data.size() * repeats / (ms * 1e3);
+    printf("%-8s %-10s %6.2f ns/value %8.1f MB/s\n", stream.name, name, ns_per_value, mb_per_s);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s IMAGE\n", argv[0]);
+        return 1;
+    }
+    const char *szImageName = argv[1];
+
+    struct pe_image *image = pe_image_open_file(szImageName);
+    if (!image) {
+        fprintf(stderr, "error: failed to open %s\n", szImageName);
+        return 1;
+    }
+
+    Dwarf_Debug dbg = 0;
+    Dwarf_Error error = 0;
+    if (dwarf_pe_init(image, szImageName, 0, 0, &dbg, &error) != DW_DLV_OK) {
+        fprintf(stderr, "error: no DWARF information in %s\n", szImageName);
+        return 1;
+    }
+
+    /* Compressed .zdebug sections are not looked at */
+    leb_stream streams[4] = {
+        {"abbrev", false, {}, 0},
+        {"line", false, {}, 0},
+        {"line/s", true, {}, 0},
+        {"info", false, {}, 0},
+    };
+    collect_abbrev(image, &streams[0]);
+    collect_line(image, &streams[1], &streams[2]);
+    collect_info(dbg, image, &streams[3]);
+
+    static const struct {
+        const char *name;
+        int kernel;
+    } kernels[] = {
+        {"scalar", DW_LEB128_KERNEL_SCALAR},
+        {"sse2", DW_LEB128_KERNEL_SSE2},
+        {"avx2", DW_LEB128_KERNEL_AVX2},
+    };
+
+    for (const leb_stream &stream : streams) {
+        if (!stream.count) {
+            printf("%-8s no data\n", stream.name);
+            continue;
+        }
+        printf("%-8s %zu values, %zu bytes\n", stream.name, stream.count, stream.data.size());
+
+        std::vector<Dwarf_Unsigned> expected(stream.count);
+        decode_reference(stream, expected.data());
+        time_decoder(stream, "bytewise", decode_reference, expected);
+
+        for (const auto &kernel : kernels) {
+            if (dwarf_set_leb128_kernel(kernel.kernel) != kernel.kernel) {
+                printf("%-8s %-10s unsupported\n", stream.name, kernel.name);
+                continue;
+            }
+            time_decoder(stream, kernel.name, decode_batch, expected);
+        }
+    }
+    dwarf_set_leb128_kernel(DW_LEB128_KERNEL_AUTO);
+
+    dwarf_pe_finish(dbg, &error);
+    pe_image_unref(image);
+
+    return 0;
+}
@@ -27,13 +27,23 @@
 #include <psapi.h>
 
 #include "outdbg.h"
+#include "paths.h"
 
 #include "mgwhelp.h"
 
+#include "pe_image.h"
+#include "pe_find.h"
 #include "dwarf_pe.h"
 #include "dwarf_find.h"
+#include "dwarf_cache.h"
+#include "dwarf_unwind.h"
+#include "demangle_cache.h"
 
 #include "demangle.h"
+#include "thread.h"
+
+#include <algorithm>
+#include <vector>
 
 
 struct mgwhelp_module
@@ -43,13 +53,28 @@ struct mgwhelp_module
     DWORD64 Base;
     char LoadedImageName[MAX_PATH];
 
-    HANDLE hFileMapping;
-    PBYTE lpFileBase;
-    SIZE_T nFileSize;
+    struct pe_image *image;
 
     DWORD64 image_base_vma;
 
+    struct pe_symbol_index *pe_symbols;
+
     Dwarf_Debug dbg;
+    struct dwarf_function_index *functions;
+    struct dwarf_line_cache *lines;
+
+    /* Mapped from the on-disk cache, in which case there is no dbg until
+     * the frame index below needs one, so dbg is loaded atomically */
+    struct dwarf_cache *cache;
+
+    struct dwarf_frame_index *frames;
+
+    /* Names demangled for SYMOPT_UNDNAME */
+    struct demangle_cache *demangled;
+
+    /* Guards the lazy creation of the indices above, and of dbg, which are
+     * immutable once published. */
+    mutex_t mutex;
 };
 
 
@@ -60,173 +85,27 @@ struct mgwhelp_process
     HANDLE hProcess;
 
     struct mgwhelp_module *modules;
+
+    /* Whether all modules loaded in the process were looked up, for
+     * MgwSymFromName */
+    BOOL bModulesEnumerated;
 };
 
 
 struct mgwhelp_process *processes = NULL;
 
+/* Guards the processes list and each process' modules list */
+static mutex_t registry_mutex = MUTEX_INIT;
 
-static DWORD64 WINAPI
-GetModuleBase(HANDLE hProcess, DWORD64 dwAddress);
+/* DbgHelp is single threaded, so all calls into it must be serialized */
+static mutex_t dbghelp_mutex = MUTEX_INIT;
 
+/* Names undecorated by MgwUnDecorateSymbolName, which knows no module */
+static struct demangle_cache *undecorate_cache = NULL;
 
-/* We must use a memory map of the file, not read memory directly, as the
- * value of ImageBase in memory changes.
- */
-static DWORD64
-PEGetImageBase(PBYTE lpFileBase)
-{
-    PIMAGE_DOS_HEADER pDosHeader;
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-    PIMAGE_OPTIONAL_HEADER32 pOptionalHeader32;
-    PIMAGE_OPTIONAL_HEADER64 pOptionalHeader64;
-    DWORD64 ImageBase = 0;
-
-    pDosHeader = (PIMAGE_DOS_HEADER)lpFileBase;
-
-    pNtHeaders = (PIMAGE_NT_HEADERS)(lpFileBase + pDosHeader->e_lfanew);
-
-    pOptionalHeader = &pNtHeaders->OptionalHeader;
-    pOptionalHeader32 = (PIMAGE_OPTIONAL_HEADER32)pOptionalHeader;
-    pOptionalHeader64 = (PIMAGE_OPTIONAL_HEADER64)pOptionalHeader;
-
-    switch (pOptionalHeader->Magic) {
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC :
-        ImageBase = pOptionalHeader32->ImageBase;
-        break;
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC :
-        ImageBase = pOptionalHeader64->ImageBase;
-        break;
-    default:
-        assert(0);
-    }
-
-    return ImageBase;
-}
-
-
-/*
- * Search for the symbol on PE's symbol table.
- *
- * Symbols for which there's no DWARF debugging information might still appear there, put by MinGW linker.
- *
- * - https://msdn.microsoft.com/en-gb/library/ms809762.aspx
- *   - https://www.microsoft.com/msj/backissues86.aspx
- * - http://go.microsoft.com/fwlink/p/?linkid=84140
- */
-static BOOL
-pe_find_symbol(struct mgwhelp_module *module,
-               DWORD64 Addr,
-               ULONG MaxSymbolNameLen,
-               LPSTR pSymbolName,
-               PDWORD64 pDisplacement)
-{
-    PBYTE lpFileBase = module->lpFileBase;
-    PIMAGE_DOS_HEADER pDosHeader;
-    PIMAGE_NT_HEADERS pNtHeaders;
-    PIMAGE_OPTIONAL_HEADER pOptionalHeader;
-    PIMAGE_OPTIONAL_HEADER32 pOptionalHeader32;
-    PIMAGE_OPTIONAL_HEADER64 pOptionalHeader64;
-    DWORD64 ImageBase = 0;
-    BOOL bUnderscore = TRUE;
-
-    pDosHeader = (PIMAGE_DOS_HEADER)lpFileBase;
-    pNtHeaders = (PIMAGE_NT_HEADERS)(lpFileBase + pDosHeader->e_lfanew);
-    PIMAGE_SECTION_HEADER Sections = (PIMAGE_SECTION_HEADER) (
-        (PBYTE)pNtHeaders +
-        sizeof(DWORD) +
-        sizeof(IMAGE_FILE_HEADER) +
-        pNtHeaders->FileHeader.SizeOfOptionalHeader
-    );
-    PIMAGE_SYMBOL pSymbolTable = (PIMAGE_SYMBOL) (
-        lpFileBase +
-        pNtHeaders->FileHeader.PointerToSymbolTable
-    );
-    PSTR pStringTable = (PSTR)
-        &pSymbolTable[pNtHeaders->FileHeader.NumberOfSymbols];
-    pOptionalHeader = &pNtHeaders->OptionalHeader;
-    pOptionalHeader32 = (PIMAGE_OPTIONAL_HEADER32)pOptionalHeader;
-    pOptionalHeader64 = (PIMAGE_OPTIONAL_HEADER64)pOptionalHeader;
-
-    if (pNtHeaders->FileHeader.PointerToSymbolTable +
-        pNtHeaders->FileHeader.NumberOfSymbols * sizeof pSymbolTable[0] > module->nFileSize) {
-        OutputDebug("MGWHELP: %s - symbol table extends beyond image size\n", module->LoadedImageName);
-        return FALSE;
-    }
-
-    switch (pOptionalHeader->Magic) {
-    case IMAGE_NT_OPTIONAL_HDR32_MAGIC :
-        ImageBase = pOptionalHeader32->ImageBase;
-        break;
-    case IMAGE_NT_OPTIONAL_HDR64_MAGIC :
-        ImageBase = pOptionalHeader64->ImageBase;
-        bUnderscore = FALSE;
-        break;
-    default:
-        assert(0);
-        return FALSE;
-    }
-
-    DWORD64 Displacement = ~(DWORD64)0;
-    BOOL bRet = FALSE;
-
-    DWORD i;
-    for (i = 0; i < pNtHeaders->FileHeader.NumberOfSymbols; ++i) {
-        PIMAGE_SYMBOL pSymbol = &pSymbolTable[i];
-
-        if (ISFCN(pSymbol->Type)) {
-            DWORD64 SymbolAddr = pSymbol->Value;
-            SHORT SectionNumber = pSymbol->SectionNumber;
-            if (SectionNumber > 0) {
-                PIMAGE_SECTION_HEADER pSection = Sections + SectionNumber - 1;
-                SymbolAddr += ImageBase + pSection->VirtualAddress;
-            }
-
-            LPCSTR SymbolName;
-            char ShortName[9];
-            if (pSymbol->N.Name.Short != 0) {
-                strncpy(ShortName, (LPCSTR)pSymbol->N.ShortName, 8);
-                ShortName[8] = '\0';
-                SymbolName = ShortName;
-            } else {
-                SymbolName = &pStringTable[pSymbol->N.Name.Long];
-            }
-
-            if (bUnderscore && SymbolName[0] == '_') {
-                SymbolName = &SymbolName[1];
-            }
-
-            if (0) {
-                OutputDebug("%04lu: 0x%08I64X %s\n", i, SymbolAddr, SymbolName);
-            }
-
-            if (SymbolAddr <= Addr &&
-                SymbolName[0] != '.') {
-                DWORD64 SymbolDisp = Addr - SymbolAddr;
-                if (SymbolDisp < Displacement) {
-                    strncpy(pSymbolName, SymbolName, MaxSymbolNameLen);
-
-                    bRet = TRUE;
-
-                    Displacement = SymbolDisp;
-
-                    if (Displacement == 0) {
-                        break;
-                    }
-                }
-            }
-        }
 
-        i += pSymbol->NumberOfAuxSymbols;
-    }
-
-    if (pDisplacement) {
-        *pDisplacement = Displacement;
-    }
-
-    return bRet;
-}
+static DWORD64 WINAPI
+GetModuleBase(HANDLE hProcess, DWORD64 dwAddress);
 
 
 static struct mgwhelp_module *
@@ -237,8 +116,7 @@ mgwhelp_module_create(struct mgwhelp_process * process,
 {
     struct mgwhelp_module *module;
     BOOL bOwnFile;
-    DWORD dwFileSizeHi;
-    DWORD dwFileSizeLo;
+    const char *szCacheDir;
     Dwarf_Error error;
 
     module = (struct mgwhelp_module *)calloc(1, sizeof *module);
@@ -247,6 +125,8 @@ mgwhelp_module_create(struct mgwhelp_process * process,
     }
 
     module->Base = Base;
+    mutex_init(&module->mutex);
+    module->demangled = demangle_cache_create(DMGL_NO_OPTS);
 
     if (ImageName) {
         strncpy(module->LoadedImageName, ImageName, sizeof module->LoadedImageName);
@@ -276,48 +156,41 @@ mgwhelp_module_create(struct mgwhelp_process * process,
         bOwnFile = TRUE;
     }
 
-    module->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    if (!module->hFileMapping) {
-        goto no_file_mapping;
+    /* We must use a memory map of the file, not read memory directly, as the
+     * value of ImageBase in memory changes.
+     */
+    module->image = pe_image_open(hFile, module->LoadedImageName);
+
+    if (bOwnFile) {
+        CloseHandle(hFile);
     }
 
-    module->lpFileBase = (PBYTE)MapViewOfFile(module->hFileMapping, FILE_MAP_READ, 0, 0, 0);
-    if (!module->lpFileBase) {
-        goto no_view_of_file;
+    if (!module->image) {
+        goto no_image;
     }
 
-    dwFileSizeHi = 0;
-    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
-    module->nFileSize = dwFileSizeLo;
-#ifdef _WIN64
-    module->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
-#else
-    assert(dwFileSizeHi == 0);
-#endif
+    module->image_base_vma = module->image->ImageBase;
 
-    module->image_base_vma = PEGetImageBase(module->lpFileBase);
+    szCacheDir = dwarf_cache_dir();
+    if (szCacheDir) {
+        module->cache = dwarf_cache_open(szCacheDir, module->LoadedImageName, module->image);
+    }
 
     error = 0;
-    if (dwarf_pe_init(hFile, module->LoadedImageName, 0, 0, &module->dbg, &error) != DW_DLV_OK) {
+    if (!module->cache &&
+        dwarf_pe_init(module->image, module->LoadedImageName, 0, 0, &module->dbg, &error) != DW_DLV_OK) {
         /* do nothing */
     }
 
-    if (bOwnFile) {
-        CloseHandle(hFile);
-    }
-
     module->next = process->modules;
     process->modules = module;
 
     return module;
 
-no_view_of_file:
-    CloseHandle(module->hFileMapping);
-no_file_mapping:
-    if (bOwnFile) {
-        CloseHandle(hFile);
-    }
+no_image:
 no_module_name:
+    demangle_cache_destroy(module->demangled);
+    mutex_destroy(&module->mutex);
     free(module);
 no_module:
     return NULL;
@@ -327,12 +200,30 @@ no_module:
 static void
 mgwhelp_module_destroy(struct mgwhelp_module * module)
 {
+    if (module->frames) {
+        dwarf_frame_index_destroy(module->frames);
+    }
+    if (module->functions) {
+        dwarf_function_index_destroy(module->functions);
+    }
+    if (module->lines) {
+        dwarf_line_cache_destroy(module->lines);
+    }
+    if (module->pe_symbols) {
+        pe_symbol_index_destroy(module->pe_symbols);
+    }
+    if (module->cache) {
+        dwarf_cache_close(module->cache);
+    }
+
     if (module->dbg) {
         Dwarf_Error error = 0;
         dwarf_pe_finish(module->dbg, &error);
     }
 
-    UnmapViewOfFile(module->lpFileBase);
+    pe_image_unref(module->image);
+    demangle_cache_destroy(module->demangled);
+    mutex_destroy(&module->mutex);
     free(module);
 }
 
@@ -349,20 +240,27 @@ mgwhelp_module_lookup(HANDLE hProcess,
     struct mgwhelp_process *process;
     struct mgwhelp_module *module;
 
+    mutex_lock(&registry_mutex);
+
     process = mgwhelp_process_lookup(hProcess);
     if (!process) {
-        return NULL;
+        module = NULL;
+        goto done;
     }
 
     module = process->modules;
     while (module) {
         if (module->Base == Base)
-            return module;
+            goto done;
 
         module = module->next;
     }
 
-    return mgwhelp_module_create(process, hFile, ImageName, Base);
+    module = mgwhelp_module_create(process, hFile, ImageName, Base);
+
+done:
+    mutex_unlock(&registry_mutex);
+    return module;
 }
 
 
@@ -405,30 +303,186 @@ mgwhelp_find_module(HANDLE hProcess, DWORD64 Address, PDWORD64 pOffset)
 }
 
 
+/*
+ * Get a module's line cache, creating it on first use.  This only reads the
+ * CU ranges, or .gdb_index, so is much cheaper than the function index.
+ */
+static struct dwarf_line_cache *
+mgwhelp_module_lines(struct mgwhelp_module *module)
+{
+    struct dwarf_line_cache *lines = __atomic_load_n(&module->lines, __ATOMIC_ACQUIRE);
+    if (!lines) {
+        mutex_lock(&module->mutex);
+        lines = module->lines;
+        if (!lines) {
+            lines = dwarf_line_cache_create(module->dbg);
+            __atomic_store_n(&module->lines, lines, __ATOMIC_RELEASE);
+        }
+        mutex_unlock(&module->mutex);
+    }
+    return lines;
+}
+
+
+/*
+ * Get a module's function index, creating it, and the line cache, on first
+ * use.
+ */
+static struct dwarf_function_index *
+mgwhelp_module_functions(struct mgwhelp_module *module)
+{
+    struct dwarf_function_index *functions = __atomic_load_n(&module->functions, __ATOMIC_ACQUIRE);
+    if (!functions) {
+        struct dwarf_line_cache *lines = mgwhelp_module_lines(module);
+
+        BOOL bCreated = FALSE;
+        mutex_lock(&module->mutex);
+        functions = module->functions;
+        if (!functions) {
+            functions = dwarf_function_index_create(module->dbg);
+            __atomic_store_n(&module->functions, functions, __ATOMIC_RELEASE);
+            bCreated = TRUE;
+        }
+        mutex_unlock(&module->mutex);
+
+        // Pay for decoding all line tables once, so that later runs can skip
+        // libdwarf altogether.  Both indices are immutable by now, so other
+        // threads need not wait for this.
+        const char *szCacheDir = dwarf_cache_dir();
+        if (bCreated && szCacheDir) {
+            dwarf_cache_save(szCacheDir, module->LoadedImageName, module->image, functions, lines);
+        }
+    }
+    return functions;
+}
+
+
+/*
+ * Get a module's frame index, creating it on first use.
+ */
+static struct dwarf_frame_index *
+mgwhelp_module_frames(struct mgwhelp_module *module)
+{
+    if (!module->cache && !__atomic_load_n(&module->dbg, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    struct dwarf_frame_index *frames = __atomic_load_n(&module->frames, __ATOMIC_ACQUIRE);
+    if (!frames) {
+        mutex_lock(&module->mutex);
+        frames = module->frames;
+        if (!frames) {
+            // The on-disk cache has no call frame information
+            Dwarf_Debug dbg = module->dbg;
+            if (!dbg) {
+                Dwarf_Error error = 0;
+                if (dwarf_pe_init(module->image, module->LoadedImageName, 0, 0, &dbg, &error) != DW_DLV_OK) {
+                    dbg = 0;
+                }
+            }
+            if (dbg) {
+                // The function and line indices may be in use already, and
+                // they call into libdwarf under this lock too
+                dwarf_pe_lock(dbg);
+                frames = dwarf_frame_index_create(dbg);
+                dwarf_pe_unlock(dbg);
+                __atomic_store_n(&module->dbg, dbg, __ATOMIC_RELEASE);
+                __atomic_store_n(&module->frames, frames, __ATOMIC_RELEASE);
+            }
+        }
+        mutex_unlock(&module->mutex);
+    }
+    return frames;
+}
+
+
 static BOOL
-mgwhelp_find_symbol(HANDLE hProcess, DWORD64 Address, struct find_dwarf_info *info)
+mgwhelp_module_find_symbol(struct mgwhelp_module *module, DWORD64 Offset, struct find_dwarf_info *info)
 {
-    struct mgwhelp_module *module;
+    memset(info, 0, sizeof *info);
 
-    DWORD64 Offset;
-    module = mgwhelp_find_module(hProcess, Address, &Offset);
-    if (!module) {
-        return FALSE;
+    Dwarf_Debug dbg;
+    if (module->cache) {
+        dwarf_cache_find(module->cache, Offset, info);
+    } else if ((dbg = __atomic_load_n(&module->dbg, __ATOMIC_ACQUIRE))) {
+        struct dwarf_function_index *functions = mgwhelp_module_functions(module);
+        find_dwarf_symbol(dbg, functions, mgwhelp_module_lines(module), Offset, info);
+    }
+
+    if (info->found) {
+        // Rebase to the process address space
+        info->functionaddr += (DWORD64)module->Base - module->image_base_vma;
+        info->lineaddr += (DWORD64)module->Base - module->image_base_vma;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+static unsigned
+mgwhelp_module_find_inlines(struct mgwhelp_module *module, DWORD64 Offset, struct find_dwarf_inline *frames, unsigned max_count)
+{
+    unsigned count = 0;
+
+    if (module->cache) {
+        count = dwarf_cache_find_inlines(module->cache, Offset, frames, max_count);
+    } else if (__atomic_load_n(&module->dbg, __ATOMIC_ACQUIRE)) {
+        count = find_dwarf_inlines(mgwhelp_module_functions(module), Offset, frames, max_count);
+    }
+
+    for (unsigned i = 0; i < std::min(count, max_count); ++i) {
+        frames[i].functionaddr += (DWORD64)module->Base - module->image_base_vma;
     }
 
+    return count;
+}
+
+
+/*
+ * Look up a function by name, in the on-disk cache, the .gdb_index, or the
+ * function index if it already exists, or if bBuild is set.
+ */
+static BOOL
+mgwhelp_module_find_name(struct mgwhelp_module *module, PCSTR Name, BOOL bBuild, struct find_dwarf_info *info)
+{
     memset(info, 0, sizeof *info);
 
-    if (module->dbg) {
-        find_dwarf_symbol(module->dbg, Offset, info);
-        if (info->found) {
-            return TRUE;
+    Dwarf_Debug dbg;
+    if (module->cache) {
+        dwarf_cache_find_name(module->cache, Name, info);
+    } else if ((dbg = __atomic_load_n(&module->dbg, __ATOMIC_ACQUIRE))) {
+        struct dwarf_function_index *functions = __atomic_load_n(&module->functions, __ATOMIC_ACQUIRE);
+        find_dwarf_name(dbg, functions, mgwhelp_module_lines(module), Name, info);
+        if (!info->found && !functions && bBuild) {
+            find_dwarf_name(dbg, mgwhelp_module_functions(module), NULL, Name, info);
         }
     }
 
+    if (info->found) {
+        info->functionaddr += (DWORD64)module->Base - module->image_base_vma;
+        return TRUE;
+    }
+
     return FALSE;
 }
 
 
+static BOOL
+mgwhelp_find_symbol(HANDLE hProcess, DWORD64 Address, struct find_dwarf_info *info)
+{
+    struct mgwhelp_module *module;
+
+    DWORD64 Offset;
+    module = mgwhelp_find_module(hProcess, Address, &Offset);
+    if (!module) {
+        return FALSE;
+    }
+
+    return mgwhelp_module_find_symbol(module, Offset, info);
+}
+
+
 static void
 mgwhelp_initialize(HANDLE hProcess)
 {
@@ -438,8 +492,10 @@ mgwhelp_initialize(HANDLE hProcess)
     if (process) {
         process->hProcess = hProcess;
 
+        mutex_lock(&registry_mutex);
         process->next = processes;
         processes = process;
+        mutex_unlock(&registry_mutex);
     }
 }
 
@@ -449,7 +505,9 @@ MgwSymInitialize(HANDLE hProcess, PCSTR UserSearchPath, BOOL fInvadeProcess)
 {
     BOOL ret;
 
+    mutex_lock(&dbghelp_mutex);
     ret = SymInitialize(hProcess, UserSearchPath, fInvadeProcess);
+    mutex_unlock(&dbghelp_mutex);
 
     if (ret) {
         mgwhelp_initialize(hProcess);
@@ -464,7 +522,9 @@ MgwSymInitializeW(HANDLE hProcess, PCWSTR UserSearchPath, BOOL fInvadeProcess)
 {
     BOOL ret;
 
+    mutex_lock(&dbghelp_mutex);
     ret = SymInitializeW(hProcess, UserSearchPath, fInvadeProcess);
+    mutex_unlock(&dbghelp_mutex);
 
     if (ret) {
         mgwhelp_initialize(hProcess);
@@ -493,7 +553,9 @@ MgwSymLoadModuleEx(HANDLE hProcess,
 {
     DWORD dwRet;
 
+    mutex_lock(&dbghelp_mutex);
     dwRet = SymLoadModuleEx(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
+    mutex_unlock(&dbghelp_mutex);
 
     if (BaseOfDll) {
         mgwhelp_module_lookup(hProcess, hFile, ImageName, BaseOfDll);
@@ -515,7 +577,9 @@ MgwSymLoadModuleExW(HANDLE hProcess,
 {
     DWORD dwRet;
 
+    mutex_lock(&dbghelp_mutex);
     dwRet = SymLoadModuleExW(hProcess, hFile, ImageName, ModuleName, BaseOfDll, DllSize, Data, Flags);
+    mutex_unlock(&dbghelp_mutex);
 
     if (BaseOfDll) {
         char ImageNameBuf[MAX_PATH];
@@ -560,20 +624,16 @@ GetModuleBase(HANDLE hProcess, DWORD64 dwAddress)
         return (DWORD64)(UINT_PTR)Buffer.AllocationBase;
     }
 
-    return SymGetModuleBase64(hProcess, dwAddress);
+    mutex_lock(&dbghelp_mutex);
+    DWORD64 dwBase = SymGetModuleBase64(hProcess, dwAddress);
+    mutex_unlock(&dbghelp_mutex);
+    return dwBase;
 }
 
 
-static char *
-demangle(const char *mangled, DWORD Flags)
+static int
+demangle_options(DWORD Flags)
 {
-    assert(mangled);
-
-    // There can be false negatives, such as "_ZwTerminateProcess@8"
-    if (mangled[0] != '_' || mangled[1] != 'Z') {
-        return NULL;
-    }
-
     int options = DMGL_PARAMS | DMGL_TYPES;
     if (Flags & UNDNAME_NAME_ONLY) {
         options = DMGL_NO_OPTS;
@@ -581,8 +641,23 @@ demangle(const char *mangled, DWORD Flags)
     if (Flags & UNDNAME_NO_ARGUMENTS) {
         options &= ~DMGL_PARAMS;
     }
+    return options;
+}
+
 
-    return cplus_demangle_v3(mangled, options);
+/*
+ * Name of a symbol as SymFromAddr would return it, given the SymGetOptions.
+ */
+static const char *
+mgwhelp_module_symbol_name(struct mgwhelp_module *module, const char *Name, DWORD dwOptions)
+{
+    if (dwOptions & SYMOPT_UNDNAME) {
+        const char *szDemangled = demangle_cache_lookup(module->demangled, Name);
+        if (szDemangled) {
+            return szDemangled;
+        }
+    }
+    return Name;
 }
 
 
@@ -593,48 +668,141 @@ MgwSymFromAddr(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_
 
     DWORD dwOptions = SymGetOptions();
 
-    if (mgwhelp_find_symbol(hProcess, Address, &info)) {
-        char *output_buffer = NULL;
-        if (dwOptions & SYMOPT_UNDNAME) {
-            output_buffer = demangle(info.functionname, UNDNAME_NAME_ONLY);
-        }
-        if (output_buffer) {
-            strncpy(Symbol->Name, output_buffer, Symbol->MaxNameLen);
-            free(output_buffer);
-        } else {
-            strncpy(Symbol->Name, info.functionname, Symbol->MaxNameLen);
-        }
+    struct mgwhelp_module *module;
+    DWORD64 Offset;
+    module = mgwhelp_find_module(hProcess, Address, &Offset);
+    if (module && mgwhelp_module_find_symbol(module, Offset, &info)) {
+        strncpy(Symbol->Name,
+                mgwhelp_module_symbol_name(module, info.functionname, dwOptions),
+                Symbol->MaxNameLen);
+
+        Symbol->Address = info.functionaddr;
+        Symbol->Size = info.functionsize;
 
         if (Displacement) {
-            /* TODO */
-            *Displacement = 0;
+            *Displacement = Address - info.functionaddr;
         }
 
         return TRUE;
     }
 
-    struct mgwhelp_module *module;
-    DWORD64 Offset;
-    module = mgwhelp_find_module(hProcess, Address, &Offset);
-    if (module && module->lpFileBase) {
-        if (pe_find_symbol(module,
+    if (module) {
+        struct pe_symbol_index *pe_symbols = __atomic_load_n(&module->pe_symbols, __ATOMIC_ACQUIRE);
+        if (!pe_symbols) {
+            mutex_lock(&module->mutex);
+            pe_symbols = module->pe_symbols;
+            if (!pe_symbols) {
+                pe_symbols = pe_symbol_index_create(module->image);
+                __atomic_store_n(&module->pe_symbols, pe_symbols, __ATOMIC_RELEASE);
+            }
+            mutex_unlock(&module->mutex);
+        }
+
+        DWORD64 SymbolAddr;
+        DWORD64 SymbolSize;
+        if (pe_find_symbol(pe_symbols,
                            Offset,
                            Symbol->MaxNameLen,
                            Symbol->Name,
-                           Displacement)) {
-            char *output_buffer = NULL;
-            if (dwOptions & SYMOPT_UNDNAME) {
-                output_buffer = demangle(Symbol->Name, UNDNAME_NAME_ONLY);
+                           &SymbolAddr,
+                           &SymbolSize)) {
+            Symbol->Address = SymbolAddr - module->image_base_vma + (DWORD64)module->Base;
+            Symbol->Size = SymbolSize;
+            if (Displacement) {
+                *Displacement = Offset - SymbolAddr;
             }
-            if (output_buffer) {
-                strncpy(Symbol->Name, output_buffer, Symbol->MaxNameLen);
-                free(output_buffer);
+
+            const char *szName = mgwhelp_module_symbol_name(module, Symbol->Name, dwOptions);
+            if (szName != Symbol->Name) {
+                strncpy(Symbol->Name, szName, Symbol->MaxNameLen);
             }
             return TRUE;
         }
     }
 
-    return SymFromAddr(hProcess, Address, Displacement, Symbol);
+    mutex_lock(&dbghelp_mutex);
+    BOOL bRet = SymFromAddr(hProcess, Address, Displacement, Symbol);
+    mutex_unlock(&dbghelp_mutex);
+    return bRet;
+}
+
+
+/*
+ * Whether szModule, cchModule characters long, names the module, as in the
+ * "Module!Name" syntax of SymFromName.
+ */
+static BOOL
+mgwhelp_module_match(struct mgwhelp_module *module, const char *szModule, size_t cchModule)
+{
+    const char *szBaseName = getBaseName(module->LoadedImageName);
+    const char *szExtension = strrchr(szBaseName, '.');
+    size_t cchBaseName = szExtension ? (size_t)(szExtension - szBaseName) : strlen(szBaseName);
+    return cchBaseName == cchModule && strnicmp(szBaseName, szModule, cchModule) == 0;
+}
+
+
+BOOL WINAPI
+MgwSymFromName(HANDLE hProcess, PCSTR Name, PSYMBOL_INFO Symbol)
+{
+    const char *szModule = NULL;
+    size_t cchModule = 0;
+    const char *szName = strchr(Name, '!');
+    if (szName) {
+        szModule = Name;
+        cchModule = szName - Name;
+        ++szName;
+    } else {
+        szName = Name;
+    }
+
+    mutex_lock(&registry_mutex);
+    struct mgwhelp_process *process = mgwhelp_process_lookup(hProcess);
+    mutex_unlock(&registry_mutex);
+
+    // Make sure all the modules loaded in the process are known, not just
+    // those looked up so far, but only once, as this opens every module
+    if (process && !__atomic_load_n(&process->bModulesEnumerated, __ATOMIC_ACQUIRE)) {
+        HMODULE hModules[1024];
+        DWORD cbNeeded = 0;
+        if (EnumProcessModules(hProcess, hModules, sizeof hModules, &cbNeeded)) {
+            DWORD dwCount = std::min<DWORD>(cbNeeded / sizeof hModules[0], ARRAYSIZE(hModules));
+            for (DWORD i = 0; i < dwCount; ++i) {
+                mgwhelp_module_lookup(hProcess, 0, NULL, (DWORD64)(UINT_PTR)hModules[i]);
+            }
+        }
+        __atomic_store_n(&process->bModulesEnumerated, TRUE, __ATOMIC_RELEASE);
+    }
+
+    // Modules are only ever prepended, and live until MgwSymCleanup, so the
+    // list can be walked without holding the lock
+    mutex_lock(&registry_mutex);
+    struct mgwhelp_module *modules = process ? process->modules : NULL;
+    mutex_unlock(&registry_mutex);
+
+    // Building a function index walks all of .debug_info, so only do it for
+    // a module named explicitly, and only when nothing cheaper knows the name
+    for (struct mgwhelp_module *module = modules; module; module = module->next) {
+        if (szModule && !mgwhelp_module_match(module, szModule, cchModule)) {
+            continue;
+        }
+
+        struct find_dwarf_info info;
+        if (mgwhelp_module_find_name(module, szName, szModule != NULL, &info)) {
+            strncpy(Symbol->Name,
+                    mgwhelp_module_symbol_name(module, info.functionname, SymGetOptions()),
+                    Symbol->MaxNameLen);
+
+            Symbol->ModBase = module->Base;
+            Symbol->Address = info.functionaddr;
+            Symbol->Size = info.functionsize;
+            return TRUE;
+        }
+    }
+
+    mutex_lock(&dbghelp_mutex);
+    BOOL bRet = SymFromName(hProcess, Name, Symbol);
+    mutex_unlock(&dbghelp_mutex);
+    return bRet;
 }
 
 
@@ -643,19 +811,310 @@ MgwSymGetLineFromAddr64(HANDLE hProcess, DWORD64 dwAddr, PDWORD pdwDisplacement,
 {
     struct find_dwarf_info info;
 
-    if (mgwhelp_find_symbol(hProcess, dwAddr, &info)) {
+    if (mgwhelp_find_symbol(hProcess, dwAddr, &info) &&
+        info.filename) {
         Line->FileName = (char *)info.filename;
         Line->LineNumber = info.line;
+        Line->Address = info.lineaddr;
 
         if (pdwDisplacement) {
-            /* TODO */
-            *pdwDisplacement = 0;
+            *pdwDisplacement = dwAddr - info.lineaddr;
         }
 
         return TRUE;
     }
 
-    return SymGetLineFromAddr64(hProcess, dwAddr, pdwDisplacement, Line);
+    mutex_lock(&dbghelp_mutex);
+    BOOL bRet = SymGetLineFromAddr64(hProcess, dwAddr, pdwDisplacement, Line);
+    mutex_unlock(&dbghelp_mutex);
+    return bRet;
+}
+
+
+DWORD WINAPI
+MgwSymGetInlineFrames(HANDLE hProcess, DWORD64 Address, DWORD Count, PMGWHELP_INLINE_FRAME Frames)
+{
+    struct mgwhelp_module *module;
+    DWORD64 Offset;
+    module = mgwhelp_find_module(hProcess, Address, &Offset);
+    if (!module) {
+        return 0;
+    }
+
+    struct find_dwarf_inline frames[64];
+    unsigned count = mgwhelp_module_find_inlines(module, Offset, frames, _countof(frames));
+    for (unsigned i = 0; i < std::min<unsigned>(count, std::min<DWORD>(Count, _countof(frames))); ++i) {
+        Frames[i].Name = frames[i].functionname;
+        Frames[i].Address = frames[i].functionaddr;
+        Frames[i].CallFileName = frames[i].callfile;
+        Frames[i].CallLineNumber = frames[i].callline;
+    }
+
+    return count;
+}
+
+
+static bool
+mgwhelp_read_memory(void *opaque, Dwarf_Addr addr, void *buffer, size_t size)
+{
+    HANDLE hProcess = (HANDLE)opaque;
+    SIZE_T NumberOfBytesRead = 0;
+    return ReadProcessMemory(hProcess, (LPCVOID)(UINT_PTR)addr, buffer, size, &NumberOfBytesRead) &&
+           NumberOfBytesRead == size;
+}
+
+
+/*
+ * x86 registers, by DWARF register number, in either a CONTEXT or a
+ * WOW64_CONTEXT.
+ */
+template <class Context>
+static DWORD Context::*
+mgwhelp_x86_register(unsigned reg)
+{
+    static DWORD Context::* const registers[] = {
+        &Context::Eax, &Context::Ecx, &Context::Edx, &Context::Ebx,
+        &Context::Esp, &Context::Ebp, &Context::Esi, &Context::Edi,
+        &Context::Eip,
+    };
+    return reg < _countof(registers) ? registers[reg] : NULL;
+}
+
+
+template <class Context>
+static BOOL
+mgwhelp_unwind_x86(HANDLE hProcess, Context *pContext, BOOL bCaller)
+{
+    struct dwarf_unwind_regs regs;
+    memset(&regs, 0, sizeof regs);
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        DWORD Context::* field = mgwhelp_x86_register<Context>(reg);
+        if (field) {
+            regs.value[reg] = pContext->*field;
+            regs.valid |= 1U << reg;
+        }
+    }
+
+    DWORD64 Address = pContext->Eip - (bCaller ? 1 : 0);
+    struct mgwhelp_module *module;
+    DWORD64 Offset;
+    module = mgwhelp_find_module(hProcess, Address, &Offset);
+    if (!module) {
+        return FALSE;
+    }
+    struct dwarf_frame_index *frames = mgwhelp_module_frames(module);
+    if (!frames ||
+        !dwarf_unwind_step(frames, Offset, &regs, mgwhelp_read_memory, hProcess)) {
+        return FALSE;
+    }
+
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        DWORD Context::* field = mgwhelp_x86_register<Context>(reg);
+        if (field && (regs.valid & (1U << reg))) {
+            pContext->*field = (DWORD)regs.value[reg];
+        }
+    }
+    return TRUE;
+}
+
+
+#ifdef _WIN64
+
+static DWORD64 CONTEXT::*
+mgwhelp_x86_64_register(unsigned reg)
+{
+    static DWORD64 CONTEXT::* const registers[] = {
+        &CONTEXT::Rax, &CONTEXT::Rdx, &CONTEXT::Rcx, &CONTEXT::Rbx,
+        &CONTEXT::Rsi, &CONTEXT::Rdi, &CONTEXT::Rbp, &CONTEXT::Rsp,
+        &CONTEXT::R8,  &CONTEXT::R9,  &CONTEXT::R10, &CONTEXT::R11,
+        &CONTEXT::R12, &CONTEXT::R13, &CONTEXT::R14, &CONTEXT::R15,
+        &CONTEXT::Rip,
+    };
+    return reg < _countof(registers) ? registers[reg] : NULL;
+}
+
+
+static BOOL
+mgwhelp_unwind_x86_64(HANDLE hProcess, CONTEXT *pContext, BOOL bCaller)
+{
+    struct dwarf_unwind_regs regs;
+    memset(&regs, 0, sizeof regs);
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        regs.value[reg] = pContext->*mgwhelp_x86_64_register(reg);
+    }
+    regs.valid = (1U << DWARF_UNWIND_REGS) - 1;
+
+    DWORD64 Address = pContext->Rip - (bCaller ? 1 : 0);
+    struct mgwhelp_module *module;
+    DWORD64 Offset;
+    module = mgwhelp_find_module(hProcess, Address, &Offset);
+    if (!module) {
+        return FALSE;
+    }
+    struct dwarf_frame_index *frames = mgwhelp_module_frames(module);
+    if (!frames ||
+        !dwarf_unwind_step(frames, Offset, &regs, mgwhelp_read_memory, hProcess)) {
+        return FALSE;
+    }
+
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        if (regs.valid & (1U << reg)) {
+            pContext->*mgwhelp_x86_64_register(reg) = regs.value[reg];
+        }
+    }
+    return TRUE;
+}
+
+#endif /* _WIN64 */
+
+
+BOOL WINAPI
+MgwUnwindContext(HANDLE hProcess, DWORD MachineType, PVOID ContextRecord, BOOL bCaller)
+{
+    switch (MachineType) {
+    case IMAGE_FILE_MACHINE_I386:
+#ifdef _WIN64
+        return mgwhelp_unwind_x86(hProcess, (PWOW64_CONTEXT)ContextRecord, bCaller);
+#else
+        return mgwhelp_unwind_x86(hProcess, (PCONTEXT)ContextRecord, bCaller);
+#endif
+#ifdef _WIN64
+    case IMAGE_FILE_MACHINE_AMD64:
+        return mgwhelp_unwind_x86_64(hProcess, (PCONTEXT)ContextRecord, bCaller);
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+
+static void
+mgwhelp_addr_info_symbol(PMGWHELP_ADDR_INFO AddrInfo, const char *Name)
+{
+    if (AddrInfo->Name && AddrInfo->MaxNameLen) {
+        strncpy(AddrInfo->Name, Name, AddrInfo->MaxNameLen);
+        AddrInfo->Name[AddrInfo->MaxNameLen - 1] = '\0';
+    }
+}
+
+
+static void
+mgwhelp_addr_info_line(PMGWHELP_ADDR_INFO AddrInfo, const char *FileName, DWORD LineNumber, DWORD64 LineAddress)
+{
+    AddrInfo->bLine = TRUE;
+    strncpy(AddrInfo->FileName, FileName, sizeof AddrInfo->FileName);
+    AddrInfo->FileName[sizeof AddrInfo->FileName - 1] = '\0';
+    AddrInfo->LineNumber = LineNumber;
+    AddrInfo->LineDisplacement = AddrInfo->Address - LineAddress;
+}
+
+
+/*
+ * Resolve an address the per-address entry points would, for those that
+ * DWARF couldn't.
+ */
+static void
+mgwhelp_addr_info_fallback(HANDLE hProcess, PMGWHELP_ADDR_INFO AddrInfo, PSYMBOL_INFO Symbol, BOOL bNeedSymbol)
+{
+    if (bNeedSymbol) {
+        ZeroMemory(Symbol, sizeof *Symbol);
+        Symbol->SizeOfStruct = sizeof *Symbol;
+        Symbol->MaxNameLen = MAX_SYM_NAME;
+
+        DWORD64 Displacement = 0;
+        if (MgwSymFromAddr(hProcess, AddrInfo->Address, &Displacement, Symbol)) {
+            AddrInfo->bSymbol = TRUE;
+            AddrInfo->SymbolAddress = Symbol->Address;
+            AddrInfo->SymbolSize = Symbol->Size;
+            AddrInfo->Displacement = Displacement;
+            mgwhelp_addr_info_symbol(AddrInfo, Symbol->Name);
+        }
+    }
+
+    DWORD dwDisplacement = 0;
+    IMAGEHLP_LINE64 Line;
+    ZeroMemory(&Line, sizeof Line);
+    Line.SizeOfStruct = sizeof Line;
+    if (MgwSymGetLineFromAddr64(hProcess, AddrInfo->Address, &dwDisplacement, &Line)) {
+        mgwhelp_addr_info_line(AddrInfo, Line.FileName, Line.LineNumber, AddrInfo->Address - dwDisplacement);
+    }
+}
+
+
+DWORD WINAPI
+MgwSymFromAddrBatch(HANDLE hProcess, DWORD Count, PMGWHELP_ADDR_INFO AddrInfos)
+{
+    DWORD dwOptions = SymGetOptions();
+    DWORD dwFound = 0;
+
+    // Visit addresses in ascending order, so that consecutive ones fall on
+    // the same module and compilation unit
+    std::vector<DWORD> order(Count);
+    for (DWORD i = 0; i < Count; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [AddrInfos](DWORD a, DWORD b) { return AddrInfos[a].Address < AddrInfos[b].Address; });
+
+    PSYMBOL_INFO Symbol = (PSYMBOL_INFO)malloc(sizeof(SYMBOL_INFO) + MAX_SYM_NAME);
+    if (!Symbol) {
+        return 0;
+    }
+
+    struct mgwhelp_module *module = NULL;
+
+    for (DWORD i : order) {
+        PMGWHELP_ADDR_INFO AddrInfo = &AddrInfos[i];
+        DWORD64 Address = AddrInfo->Address;
+
+        AddrInfo->bSymbol = FALSE;
+        AddrInfo->SymbolAddress = 0;
+        AddrInfo->SymbolSize = 0;
+        AddrInfo->Displacement = 0;
+        AddrInfo->bLine = FALSE;
+        AddrInfo->LineNumber = 0;
+        AddrInfo->LineDisplacement = 0;
+        AddrInfo->FileName[0] = '\0';
+        if (AddrInfo->Name && AddrInfo->MaxNameLen) {
+            AddrInfo->Name[0] = '\0';
+        }
+
+        // Only query the process when leaving the previous module's image
+        DWORD64 Offset;
+        if (module &&
+            Address >= module->Base &&
+            Address - module->Base < module->image->SizeOfImage) {
+            Offset = module->image_base_vma + Address - module->Base;
+        } else {
+            module = mgwhelp_find_module(hProcess, Address, &Offset);
+        }
+
+        struct find_dwarf_info info;
+        if (!module || !mgwhelp_module_find_symbol(module, Offset, &info)) {
+            mgwhelp_addr_info_fallback(hProcess, AddrInfo, Symbol, TRUE);
+        } else {
+            AddrInfo->bSymbol = TRUE;
+            AddrInfo->SymbolAddress = info.functionaddr;
+            AddrInfo->SymbolSize = info.functionsize;
+            AddrInfo->Displacement = Address - info.functionaddr;
+
+            mgwhelp_addr_info_symbol(AddrInfo, mgwhelp_module_symbol_name(module, info.functionname, dwOptions));
+
+            if (info.filename) {
+                mgwhelp_addr_info_line(AddrInfo, info.filename, info.line, info.lineaddr);
+            } else {
+                mgwhelp_addr_info_fallback(hProcess, AddrInfo, Symbol, FALSE);
+            }
+        }
+
+        if (AddrInfo->bSymbol) {
+            ++dwFound;
+        }
+    }
+
+    free(Symbol);
+
+    return dwFound;
 }
 
 
@@ -664,14 +1123,34 @@ MgwUnDecorateSymbolName(PCSTR DecoratedName, PSTR UnDecoratedName, DWORD Undecor
 {
     assert(DecoratedName != NULL);
 
-    char *output_buffer = demangle(DecoratedName, Flags);
-    if (output_buffer) {
-        strncpy(UnDecoratedName, output_buffer, UndecoratedLength);
-        free(output_buffer);
+    // GetSymFromAddr undecorates every frame of a stack trace like this
+    if (Flags == UNDNAME_NAME_ONLY) {
+        struct demangle_cache *cache = __atomic_load_n(&undecorate_cache, __ATOMIC_ACQUIRE);
+        if (!cache) {
+            mutex_lock(&registry_mutex);
+            cache = undecorate_cache;
+            if (!cache) {
+                cache = demangle_cache_create(demangle_options(Flags));
+                __atomic_store_n(&undecorate_cache, cache, __ATOMIC_RELEASE);
+            }
+            mutex_unlock(&registry_mutex);
+        }
+
+        const char *szDemangled = demangle_cache_lookup(cache, DecoratedName);
+        if (szDemangled && UndecoratedLength) {
+            strncpy(UnDecoratedName, szDemangled, UndecoratedLength - 1);
+            UnDecoratedName[UndecoratedLength - 1] = '\0';
+            return strlen(UnDecoratedName);
+        }
+    } else if (UndecoratedLength &&
+               demangle_to_buffer(DecoratedName, demangle_options(Flags), UnDecoratedName, UndecoratedLength)) {
         return strlen(UnDecoratedName);
     }
 
-    return UnDecorateSymbolName(DecoratedName, UnDecoratedName, UndecoratedLength, Flags);
+    mutex_lock(&dbghelp_mutex);
+    DWORD dwRet = UnDecorateSymbolName(DecoratedName, UnDecoratedName, UndecoratedLength, Flags);
+    mutex_unlock(&dbghelp_mutex);
+    return dwRet;
 }
 
 
@@ -682,29 +1161,38 @@ MgwSymCleanup(HANDLE hProcess)
     struct mgwhelp_process *process;
     struct mgwhelp_module *module;
 
+    mutex_lock(&registry_mutex);
     link = &processes;
     process = *link;
     while (process) {
         if (process->hProcess == hProcess) {
-            module = process->modules;
-            while (module) {
-                struct mgwhelp_module *next = module->next;
-
-                mgwhelp_module_destroy(module);
-
-                module = next;
-            }
-
             *link = process->next;
-            free(process);
             break;
         }
 
         link = &process->next;
         process = *link;
     }
+    mutex_unlock(&registry_mutex);
+
+    // No lookups on this process may be in flight by now
+    if (process) {
+        module = process->modules;
+        while (module) {
+            struct mgwhelp_module *next = module->next;
+
+            mgwhelp_module_destroy(module);
 
-    return SymCleanup(hProcess);
+            module = next;
+        }
+
+        free(process);
+    }
+
+    mutex_lock(&dbghelp_mutex);
+    BOOL bRet = SymCleanup(hProcess);
+    mutex_unlock(&dbghelp_mutex);
+    return bRet;
 }
 
 
@@ -734,8 +1222,9 @@ MgwSymGetLineFromAddrW64(HANDLE hProcess, DWORD64 dwAddr, PDWORD pdwDisplacement
         // states that SymGetLineFromAddrW64 "returns a pointer to a buffer
         // that may be reused by another function" and that callers should be
         // "sure to copy the data returned to another buffer immediately",
-        // therefore the static buffer should be safe.
-        static WCHAR FileName[MAX_PATH];
+        // therefore a static buffer should be safe, provided each thread
+        // gets its own.
+        static __thread WCHAR FileName[MAX_PATH];
         MultiByteToWideChar(CP_ACP, 0, LineA.FileName, -1, FileName, MAX_PATH);
         memcpy(LineW, &LineA, sizeof LineA);
         LineW->FileName = FileName;
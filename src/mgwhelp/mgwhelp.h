@@ -39,6 +39,13 @@ MgwSymLoadModuleExW(HANDLE hProcess, HANDLE hFile, PCWSTR ImageName, PCWSTR Modu
 EXTERN_C BOOL WINAPI
 MgwSymFromAddr(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL_INFO Symbol);
 
+/*
+ * Same as SymFromName, but resolving names through the DWARF of MinGW
+ * modules first, without scanning their .debug_info on each call.
+ */
+EXTERN_C BOOL WINAPI
+MgwSymFromName(HANDLE hProcess, PCSTR Name, PSYMBOL_INFO Symbol);
+
 EXTERN_C BOOL WINAPI
 MgwSymGetLineFromAddr64(HANDLE hProcess, DWORD64 dwAddr, PDWORD pdwDisplacement, PIMAGEHLP_LINE64 Line);
 
@@ -53,3 +60,72 @@ MgwSymFromAddrW(HANDLE hProcess, DWORD64 Address, PDWORD64 Displacement, PSYMBOL
 
 EXTERN_C BOOL WINAPI
 MgwSymGetLineFromAddrW64(HANDLE hProcess, DWORD64 dwAddr, PDWORD pdwDisplacement, PIMAGEHLP_LINEW64 LineW);
+
+
+/*
+ * Symbol and line information for one address, as filled by
+ * MgwSymFromAddrBatch.
+ */
+typedef struct _MGWHELP_ADDR_INFO {
+    // Input
+    DWORD64 Address;
+    PSTR Name;          // buffer for the symbol name, may be NULL
+    ULONG MaxNameLen;
+
+    // Output
+    BOOL bSymbol;
+    DWORD64 SymbolAddress;
+    DWORD64 SymbolSize;
+    DWORD64 Displacement;
+    BOOL bLine;
+    DWORD LineNumber;
+    DWORD LineDisplacement;
+    CHAR FileName[MAX_PATH];
+} MGWHELP_ADDR_INFO, *PMGWHELP_ADDR_INFO;
+
+/*
+ * Equivalent to calling MgwSymFromAddr and MgwSymGetLineFromAddr64 for each
+ * address, but addresses are visited in sorted order so that modules are
+ * looked up and compilation units' debug info decoded once per batch.
+ *
+ * Returns the number of addresses for which a symbol was found.
+ */
+EXTERN_C DWORD WINAPI
+MgwSymFromAddrBatch(HANDLE hProcess, DWORD Count, PMGWHELP_ADDR_INFO AddrInfos);
+
+
+/*
+ * One inlined function call containing an address, as filled by
+ * MgwSymGetInlineFrames.  Strings remain valid until MgwSymCleanup.
+ */
+typedef struct _MGWHELP_INLINE_FRAME {
+    PCSTR Name;             // the inlined function
+    DWORD64 Address;        // its lowest address, in the process
+    PCSTR CallFileName;     // where it was inlined into its caller
+    DWORD CallLineNumber;
+} MGWHELP_INLINE_FRAME, *PMGWHELP_INLINE_FRAME;
+
+/*
+ * Inlined function calls containing an address, innermost first, so that
+ * the caller of each is the next one, and the caller of the last one the
+ * function MgwSymFromAddr finds.
+ *
+ * Fills in up to Count frames, and returns how many there are, or zero for
+ * modules without DWARF.
+ */
+EXTERN_C DWORD WINAPI
+MgwSymGetInlineFrames(HANDLE hProcess, DWORD64 Address, DWORD Count, PMGWHELP_INLINE_FRAME Frames);
+
+
+/*
+ * Unwind ContextRecord -- a CONTEXT, or a WOW64_CONTEXT for
+ * IMAGE_FILE_MACHINE_I386 on 64-bit Windows -- by one frame, with the DWARF
+ * call frame information (.eh_frame or .debug_frame) of the module executing
+ * it.  bCaller tells that the program counter is a return address, as is the
+ * case for all but the innermost frame.
+ *
+ * Fails for modules without DWARF call frame information, leaving
+ * ContextRecord untouched, so that callers can fall back to StackWalk64.
+ */
+EXTERN_C BOOL WINAPI
+MgwUnwindContext(HANDLE hProcess, DWORD MachineType, PVOID ContextRecord, BOOL bCaller);
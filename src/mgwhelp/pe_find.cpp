@@ -0,0 +1,186 @@
+/*
+ * Copyright 2002-2016 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "pe_find.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "outdbg.h"
+
+
+struct pe_symbol
+{
+    DWORD64 Address;
+    DWORD Index; // into the COFF symbol table
+};
+
+
+/*
+ * Function symbols from the PE's COFF symbol table, sorted by address.
+ * Names are only resolved from the string table when a symbol is returned.
+ */
+struct pe_symbol_index
+{
+    PIMAGE_SYMBOL pSymbolTable;
+    PSTR pStringTable;
+    BOOL bUnderscore;
+
+    std::vector<pe_symbol> Symbols;
+};
+
+
+static bool
+pe_symbol_less(const pe_symbol &a, const pe_symbol &b)
+{
+    return a.Address < b.Address;
+}
+
+
+static bool
+pe_symbol_same_address(const pe_symbol &a, const pe_symbol &b)
+{
+    return a.Address == b.Address;
+}
+
+
+static LPCSTR
+pe_symbol_name(const struct pe_symbol_index *index,
+               const PIMAGE_SYMBOL pSymbol,
+               char ShortName[9])
+{
+    LPCSTR SymbolName;
+    if (pSymbol->N.Name.Short != 0) {
+        memcpy(ShortName, pSymbol->N.ShortName, 8);
+        ShortName[8] = '\0';
+        SymbolName = ShortName;
+    } else {
+        SymbolName = &index->pStringTable[pSymbol->N.Name.Long];
+    }
+
+    if (index->bUnderscore && SymbolName[0] == '_') {
+        SymbolName = &SymbolName[1];
+    }
+
+    return SymbolName;
+}
+
+
+/*
+ * Index the function symbols in the PE's symbol table.
+ *
+ * Symbols for which there's no DWARF debugging information might still appear there, put by MinGW linker.
+ *
+ * - https://msdn.microsoft.com/en-gb/library/ms809762.aspx
+ *   - https://www.microsoft.com/msj/backissues86.aspx
+ * - http://go.microsoft.com/fwlink/p/?linkid=84140
+ */
+struct pe_symbol_index *
+pe_symbol_index_create(struct pe_image *image)
+{
+    struct pe_symbol_index *index = new pe_symbol_index;
+    index->pSymbolTable = image->pSymbolTable;
+    index->pStringTable = image->pStringTable;
+    index->bUnderscore = image->pNtHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC;
+
+    if (!index->pSymbolTable) {
+        return index;
+    }
+
+    PIMAGE_FILE_HEADER pFileHeader = &image->pNtHeaders->FileHeader;
+
+    DWORD i;
+    for (i = 0; i < pFileHeader->NumberOfSymbols; ++i) {
+        PIMAGE_SYMBOL pSymbol = &index->pSymbolTable[i];
+
+        if (ISFCN(pSymbol->Type) &&
+            pSymbol->SectionNumber > 0 &&
+            pSymbol->SectionNumber <= pFileHeader->NumberOfSections) {
+            PIMAGE_SECTION_HEADER pSection = image->Sections + pSymbol->SectionNumber - 1;
+            DWORD64 SymbolAddr = image->ImageBase + pSection->VirtualAddress + pSymbol->Value;
+
+            char ShortName[9];
+            LPCSTR SymbolName = pe_symbol_name(index, pSymbol, ShortName);
+
+            if (0) {
+                OutputDebug("%04lu: 0x%08" PRIX64 " %s\n", (unsigned long)i, (uint64_t)SymbolAddr, SymbolName);
+            }
+
+            if (SymbolName[0] != '.') {
+                pe_symbol Symbol;
+                Symbol.Address = SymbolAddr;
+                Symbol.Index = i;
+                index->Symbols.push_back(Symbol);
+            }
+        }
+
+        i += pSymbol->NumberOfAuxSymbols;
+    }
+
+    // For aliases, the first symbol in the table wins
+    std::stable_sort(index->Symbols.begin(), index->Symbols.end(), pe_symbol_less);
+    index->Symbols.erase(std::unique(index->Symbols.begin(), index->Symbols.end(), pe_symbol_same_address),
+                         index->Symbols.end());
+    index->Symbols.shrink_to_fit();
+
+    return index;
+}
+
+
+void
+pe_symbol_index_destroy(struct pe_symbol_index *index)
+{
+    delete index;
+}
+
+
+/*
+ * Search for the nearest symbol preceding Addr on PE's symbol table.
+ *
+ * The symbol size is only known when followed by another symbol.
+ */
+BOOL
+pe_find_symbol(const struct pe_symbol_index *index,
+               DWORD64 Addr,
+               ULONG MaxSymbolNameLen,
+               LPSTR pSymbolName,
+               PDWORD64 pSymbolAddr,
+               PDWORD64 pSymbolSize)
+{
+    auto it = std::upper_bound(index->Symbols.begin(), index->Symbols.end(), Addr,
+                               [](DWORD64 a, const pe_symbol &s) { return a < s.Address; });
+    if (it == index->Symbols.begin()) {
+        return FALSE;
+    }
+    --it;
+
+    char ShortName[9];
+    LPCSTR SymbolName = pe_symbol_name(index, &index->pSymbolTable[it->Index], ShortName);
+    strncpy(pSymbolName, SymbolName, MaxSymbolNameLen);
+
+    *pSymbolAddr = it->Address;
+
+    auto next = it + 1;
+    *pSymbolSize = next != index->Symbols.end() ? next->Address - it->Address : 0;
+
+    return TRUE;
+}
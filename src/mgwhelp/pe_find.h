@@ -0,0 +1,49 @@
+/*
+ * Copyright 2002-2016 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include "pe_image.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct pe_symbol_index;
+
+struct pe_symbol_index *
+pe_symbol_index_create(struct pe_image *image);
+
+void
+pe_symbol_index_destroy(struct pe_symbol_index *index);
+
+BOOL
+pe_find_symbol(const struct pe_symbol_index *index,
+               DWORD64 Addr,
+               ULONG MaxSymbolNameLen,
+               LPSTR pSymbolName,
+               PDWORD64 pSymbolAddr,
+               PDWORD64 pSymbolSize);
+
+
+#ifdef __cplusplus
+}
+#endif
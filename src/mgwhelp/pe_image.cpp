@@ -0,0 +1,297 @@
+/*
+ * Copyright 2012-2016 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "pe_image.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "outdbg.h"
+
+
+static BOOL
+pe_image_parse(struct pe_image *image, const char *szImageName)
+{
+    if (image->nFileSize < sizeof(IMAGE_DOS_HEADER) ||
+        image->pDosHeader->e_magic != IMAGE_DOS_SIGNATURE ||
+        image->pDosHeader->e_lfanew < 0 ||
+        (SIZE_T)image->pDosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS) > image->nFileSize) {
+        OutputDebug("MGWHELP: %s - not a PE image\n", szImageName);
+        return FALSE;
+    }
+
+    image->pNtHeaders = (PIMAGE_NT_HEADERS) (
+        image->lpFileBase +
+        image->pDosHeader->e_lfanew
+    );
+    if (image->pNtHeaders->Signature != IMAGE_NT_SIGNATURE) {
+        OutputDebug("MGWHELP: %s - not a PE image\n", szImageName);
+        return FALSE;
+    }
+
+    PIMAGE_FILE_HEADER pFileHeader = &image->pNtHeaders->FileHeader;
+
+    image->Sections = (PIMAGE_SECTION_HEADER) (
+        (PBYTE)image->pNtHeaders +
+        sizeof(DWORD) +
+        sizeof(IMAGE_FILE_HEADER) +
+        pFileHeader->SizeOfOptionalHeader
+    );
+    if ((PBYTE)(image->Sections + pFileHeader->NumberOfSections) > image->lpFileBase + image->nFileSize) {
+        OutputDebug("MGWHELP: %s - section table extends beyond image size\n", szImageName);
+        return FALSE;
+    }
+
+    PIMAGE_OPTIONAL_HEADER pOptionalHeader = &image->pNtHeaders->OptionalHeader;
+    switch (pOptionalHeader->Magic) {
+    case IMAGE_NT_OPTIONAL_HDR32_MAGIC :
+        image->ImageBase = ((PIMAGE_OPTIONAL_HEADER32)pOptionalHeader)->ImageBase;
+        image->SizeOfImage = ((PIMAGE_OPTIONAL_HEADER32)pOptionalHeader)->SizeOfImage;
+        break;
+    case IMAGE_NT_OPTIONAL_HDR64_MAGIC :
+        image->ImageBase = ((PIMAGE_OPTIONAL_HEADER64)pOptionalHeader)->ImageBase;
+        image->SizeOfImage = ((PIMAGE_OPTIONAL_HEADER64)pOptionalHeader)->SizeOfImage;
+        break;
+    default:
+        OutputDebug("MGWHELP: %s - unexpected optional header magic\n", szImageName);
+        return FALSE;
+    }
+
+    if (pFileHeader->PointerToSymbolTable) {
+        if (pFileHeader->PointerToSymbolTable +
+            pFileHeader->NumberOfSymbols * sizeof image->pSymbolTable[0] > image->nFileSize) {
+            OutputDebug("MGWHELP: %s - symbol table extends beyond image size\n", szImageName);
+        } else {
+            image->pSymbolTable = (PIMAGE_SYMBOL) (
+                image->lpFileBase +
+                pFileHeader->PointerToSymbolTable
+            );
+            image->pStringTable = (PSTR)
+                &image->pSymbolTable[pFileHeader->NumberOfSymbols];
+        }
+    }
+
+    return TRUE;
+}
+
+
+static struct pe_image *
+pe_image_alloc(void)
+{
+    struct pe_image *image = (struct pe_image *)calloc(1, sizeof *image);
+    if (image) {
+        image->cRefs = 1;
+    }
+    return image;
+}
+
+
+struct pe_image *
+pe_image_create(const uint8_t *pData, size_t nSize, const char *szImageName)
+{
+    struct pe_image *image = pe_image_alloc();
+    if (!image) {
+        return NULL;
+    }
+
+    image->lpFileBase = (PBYTE)pData;
+    image->nFileSize = nSize;
+
+    if (!pe_image_parse(image, szImageName)) {
+        free(image);
+        return NULL;
+    }
+
+    return image;
+}
+
+
+#ifdef _WIN32
+
+struct pe_image *
+pe_image_open(HANDLE hFile, const char *szImageName)
+{
+    struct pe_image *image;
+    DWORD dwFileSizeHi;
+    DWORD dwFileSizeLo;
+
+    image = pe_image_alloc();
+    if (!image) {
+        goto no_image;
+    }
+
+    image->hFileMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!image->hFileMapping) {
+        goto no_file_mapping;
+    }
+
+    image->lpFileBase = (PBYTE)MapViewOfFile(image->hFileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!image->lpFileBase) {
+        goto no_view_of_file;
+    }
+    image->bMapped = TRUE;
+
+    dwFileSizeHi = 0;
+    dwFileSizeLo = GetFileSize(hFile, &dwFileSizeHi);
+    image->nFileSize = dwFileSizeLo;
+#ifdef _WIN64
+    image->nFileSize |= (SIZE_T)dwFileSizeHi << 32;
+#else
+    assert(dwFileSizeHi == 0);
+#endif
+
+    if (!pe_image_parse(image, szImageName)) {
+        goto no_headers;
+    }
+
+    return image;
+
+no_headers:
+    UnmapViewOfFile(image->lpFileBase);
+no_view_of_file:
+    CloseHandle(image->hFileMapping);
+no_file_mapping:
+    free(image);
+no_image:
+    return NULL;
+}
+
+
+struct pe_image *
+pe_image_open_file(const char *szFileName)
+{
+    HANDLE hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        OutputDebug("MGWHELP: %s - not found\n", szFileName);
+        return NULL;
+    }
+
+    struct pe_image *image = pe_image_open(hFile, szFileName);
+    CloseHandle(hFile);
+    return image;
+}
+
+#else /* !_WIN32 */
+
+struct pe_image *
+pe_image_open_file(const char *szFileName)
+{
+    struct pe_image *image;
+    struct stat st;
+    void *pData;
+
+    int fd = open(szFileName, O_RDONLY);
+    if (fd < 0) {
+        OutputDebug("MGWHELP: %s - not found\n", szFileName);
+        goto no_file;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        goto no_map;
+    }
+
+    pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pData == MAP_FAILED) {
+        goto no_map;
+    }
+
+    image = pe_image_create((const uint8_t *)pData, st.st_size, szFileName);
+    if (!image) {
+        goto no_image;
+    }
+    image->bMapped = TRUE;
+
+    close(fd);
+    return image;
+
+no_image:
+    munmap(pData, st.st_size);
+no_map:
+    close(fd);
+no_file:
+    return NULL;
+}
+
+#endif /* !_WIN32 */
+
+
+struct pe_image *
+pe_image_ref(struct pe_image *image)
+{
+    __sync_add_and_fetch(&image->cRefs, 1);
+    return image;
+}
+
+
+void
+pe_image_unref(struct pe_image *image)
+{
+    if (__sync_sub_and_fetch(&image->cRefs, 1) == 0) {
+        if (image->bMapped) {
+#ifdef _WIN32
+            UnmapViewOfFile(image->lpFileBase);
+            CloseHandle(image->hFileMapping);
+#else
+            munmap(image->lpFileBase, image->nFileSize);
+#endif
+        }
+        free(image);
+    }
+}
+
+
+const char *
+pe_image_section_name(const struct pe_image *image, PIMAGE_SECTION_HEADER pSection)
+{
+    const char *szName = (const char *)pSection->Name;
+    if (szName[0] == '/' && image->pStringTable) {
+        szName = &image->pStringTable[atoi(&szName[1])];
+    }
+    return szName;
+}
+
+
+PIMAGE_SECTION_HEADER
+pe_image_find_section(const struct pe_image *image, const char *szSectionName)
+{
+    WORD NumberOfSections = image->pNtHeaders->FileHeader.NumberOfSections;
+    for (WORD i = 0; i < NumberOfSections; ++i) {
+        PIMAGE_SECTION_HEADER pSection = image->Sections + i;
+        const char *szName = pe_image_section_name(image, pSection);
+        if (szName == (const char *)pSection->Name) {
+            // Short names are not NUL terminated when they use all 8 chars
+            if (strlen(szSectionName) <= IMAGE_SIZEOF_SHORT_NAME &&
+                strncmp(szName, szSectionName, IMAGE_SIZEOF_SHORT_NAME) == 0) {
+                return pSection;
+            }
+        } else if (strcmp(szName, szSectionName) == 0) {
+            return pSection;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2012-2016 Jose Fonseca
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pe_format.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Read-only view of a PE image file, with its headers parsed once.
+ *
+ * Reference counted, so that the same mapping can be shared by mgwhelp's
+ * symbol table lookups and libdwarf's object access methods.
+ *
+ * Nothing here depends on Windows besides opening a file handle, so the
+ * same code runs on other hosts over a mmap'ed file or an in-memory buffer.
+ */
+struct pe_image
+{
+    long cRefs;
+
+#ifdef _WIN32
+    HANDLE hFileMapping;
+#endif
+    BOOL bMapped;
+
+    SIZE_T nFileSize;
+    union {
+        PBYTE lpFileBase;
+        PIMAGE_DOS_HEADER pDosHeader;
+    };
+    PIMAGE_NT_HEADERS pNtHeaders;
+    PIMAGE_SECTION_HEADER Sections;
+    PIMAGE_SYMBOL pSymbolTable;
+    PSTR pStringTable;
+
+    DWORD64 ImageBase;
+    DWORD SizeOfImage;
+};
+
+
+/*
+ * Parse an image already in memory.  The buffer is not copied, and must
+ * outlive the returned object.
+ */
+struct pe_image *
+pe_image_create(const uint8_t *pData, size_t nSize, const char *szImageName);
+
+struct pe_image *
+pe_image_open_file(const char *szFileName);
+
+#ifdef _WIN32
+struct pe_image *
+pe_image_open(HANDLE hFile, const char *szImageName);
+#endif
+
+struct pe_image *
+pe_image_ref(struct pe_image *image);
+
+void
+pe_image_unref(struct pe_image *image);
+
+PIMAGE_SECTION_HEADER
+pe_image_find_section(const struct pe_image *image, const char *szSectionName);
+
+const char *
+pe_image_section_name(const struct pe_image *image, PIMAGE_SECTION_HEADER pSection);
+
+
+#ifdef __cplusplus
+}
+#endif
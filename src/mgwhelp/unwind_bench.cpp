@@ -0,0 +1,352 @@
+/*
+ * Copyright 2026 Dr. Mingw contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Replays mgwhelp's DWARF stack unwinder over captured stack snapshots of a
+ * MinGW image, without a live process, so it also runs on non-Windows hosts.
+ *
+ * A snapshot is a text file with lines like
+ *
+ *   base 00400000                          (where the image was loaded)
+ *   reg 4 0022fe40                         (DWARF register number, value)
+ *   mem 0022fe40 8c13400000000000...       (address, bytes in hex)
+ *
+ * With -r, the decoded rules for all code in the image are dumped instead,
+ * which can be compared against `objdump --dwarf=frames-interp`.  With -C,
+ * the rule cache is cleared before each timed unwind, to measure decoding.
+ */
+
+
+#define __STDC_FORMAT_MACROS 1
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "pe_image.h"
+#include "dwarf_pe.h"
+#include "dwarf_find.h"
+#include "dwarf_unwind.h"
+
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+static double
+elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+
+struct snapshot
+{
+    Dwarf_Addr base;
+    struct dwarf_unwind_regs regs;
+
+    /* Contiguous runs of captured memory, by start address */
+    std::map<Dwarf_Addr, std::vector<uint8_t>> memory;
+};
+
+
+static bool
+read_snapshot(const char *szFileName, struct snapshot *snap)
+{
+    FILE *fp = fopen(szFileName, "rt");
+    if (!fp) {
+        return false;
+    }
+
+    snap->base = 0;
+    memset(&snap->regs, 0, sizeof snap->regs);
+
+    char line[4096];
+    while (fgets(line, sizeof line, fp)) {
+        char *p = line;
+        if (strncmp(p, "base ", 5) == 0) {
+            snap->base = strtoull(p + 5, NULL, 16);
+        } else if (strncmp(p, "reg ", 4) == 0) {
+            unsigned reg = strtoul(p + 4, &p, 10);
+            if (reg < DWARF_UNWIND_REGS) {
+                snap->regs.value[reg] = strtoull(p, NULL, 16);
+                snap->regs.valid |= 1U << reg;
+            }
+        } else if (strncmp(p, "mem ", 4) == 0) {
+            Dwarf_Addr addr = strtoull(p + 4, &p, 16);
+            std::vector<uint8_t> bytes;
+            while (*p == ' ') {
+                ++p;
+            }
+            for (; p[0] && p[1] && p[0] != '\n'; p += 2) {
+                char byte[3] = {p[0], p[1], 0};
+                bytes.push_back(strtoul(byte, NULL, 16));
+            }
+
+            // Append to the previous run when contiguous
+            auto it = snap->memory.lower_bound(addr);
+            if (it != snap->memory.begin()) {
+                --it;
+                if (it->first + it->second.size() == addr) {
+                    it->second.insert(it->second.end(), bytes.begin(), bytes.end());
+                    continue;
+                }
+            }
+            snap->memory[addr].swap(bytes);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+static bool
+read_snapshot_memory(void *opaque, Dwarf_Addr addr, void *buffer, size_t size)
+{
+    const struct snapshot *snap = (const struct snapshot *)opaque;
+    auto it = snap->memory.upper_bound(addr);
+    if (it == snap->memory.begin()) {
+        return false;
+    }
+    --it;
+    if (addr + size > it->first + it->second.size()) {
+        return false;
+    }
+    memcpy(buffer, &it->second[addr - it->first], size);
+    return true;
+}
+
+
+/*
+ * Unwind a snapshot, returning the program counters of all frames.
+ */
+static void
+unwind(struct dwarf_frame_index *frames,
+       const struct snapshot *snap,
+       Dwarf_Addr image_base,
+       unsigned pc_reg,
+       std::vector<Dwarf_Addr> &pcs)
+{
+    Dwarf_Addr bias = snap->base ? snap->base - image_base : 0;
+    struct dwarf_unwind_regs regs = snap->regs;
+
+    pcs.clear();
+    while (regs.valid & (1U << pc_reg)) {
+        Dwarf_Addr pc = regs.value[pc_reg];
+        pcs.push_back(pc);
+        if (pcs.size() >= 1024) {
+            break;
+        }
+
+        // Return addresses point after the call instruction
+        Dwarf_Addr lookup = pcs.size() > 1 ? pc - 1 : pc;
+        if (!dwarf_unwind_step(frames, lookup - bias, &regs, read_snapshot_memory, (void *)snap)) {
+            break;
+        }
+    }
+}
+
+
+static void
+print_rule(const struct dwarf_unwind_rule *rule)
+{
+    static const char *x86[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "eip"};
+    static const char *x86_64[] = {"rax", "rdx", "rcx", "rbx", "rsi", "rdi", "rbp", "rsp",
+                                   "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "rip"};
+
+    auto name = [&](unsigned reg) -> const char * {
+        if (rule->address_size == 4) {
+            return reg < sizeof x86 / sizeof x86[0] ? x86[reg] : "?";
+        }
+        return x86_64[reg];
+    };
+
+    printf("%08" PRIx64 "..%08" PRIx64 " cfa=%s%+d",
+           (uint64_t)rule->lowpc, (uint64_t)rule->highpc,
+           name(rule->cfa_reg), (int)rule->cfa_offset);
+    for (unsigned reg = 0; reg < DWARF_UNWIND_REGS; ++reg) {
+        switch (rule->how[reg]) {
+        case DWARF_UNWIND_SAME:
+            break;
+        case DWARF_UNWIND_UNDEFINED:
+            printf(" %s=u", name(reg));
+            break;
+        case DWARF_UNWIND_OFFSET:
+            printf(" %s=c%+d", name(reg), (int)rule->offset[reg]);
+            break;
+        case DWARF_UNWIND_VAL_OFFSET:
+            printf(" %s=v%+d", name(reg), (int)rule->offset[reg]);
+            break;
+        case DWARF_UNWIND_REGISTER:
+            printf(" %s=%s", name(reg), name(rule->offset[reg]));
+            break;
+        }
+    }
+    printf("\n");
+}
+
+
+static void
+dump_rules(const struct pe_image *image, struct dwarf_frame_index *frames)
+{
+    PIMAGE_FILE_HEADER pFileHeader = &image->pNtHeaders->FileHeader;
+    for (unsigned i = 0; i < pFileHeader->NumberOfSections; ++i) {
+        PIMAGE_SECTION_HEADER pSection = image->Sections + i;
+        if (!(pSection->Characteristics & IMAGE_SCN_CNT_CODE)) {
+            continue;
+        }
+        Dwarf_Addr pc = image->ImageBase + pSection->VirtualAddress;
+        Dwarf_Addr end = pc + pSection->Misc.VirtualSize;
+        while (pc < end) {
+            struct dwarf_unwind_rule rule;
+            if (dwarf_frame_find_rule(frames, pc, &rule) && rule.highpc > pc) {
+                print_rule(&rule);
+                pc = rule.highpc;
+            } else {
+                ++pc;
+            }
+        }
+    }
+}
+
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n COUNT] [-r] [-C] IMAGE [SNAPSHOT...]\n", argv0);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned count = 10000;
+    bool rules = false;
+    bool uncached = false;
+
+    int i;
+    for (i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            break;
+        }
+        if (strcmp(arg, "-n") == 0 && i + 1 < argc) {
+            count = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "-r") == 0) {
+            rules = true;
+        } else if (strcmp(arg, "-C") == 0) {
+            uncached = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *szImageName = argv[i++];
+
+    struct pe_image *image = pe_image_open_file(szImageName);
+    if (!image) {
+        fprintf(stderr, "error: failed to open %s\n", szImageName);
+        return 1;
+    }
+
+    Dwarf_Debug dbg = 0;
+    Dwarf_Error error = 0;
+    if (dwarf_pe_init(image, szImageName, 0, 0, &dbg, &error) != DW_DLV_OK) {
+        fprintf(stderr, "error: no DWARF information in %s\n", szImageName);
+        return 1;
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    struct dwarf_frame_index *frames = dwarf_frame_index_create(dbg);
+    printf("frame index: %.3f ms\n", elapsed_ms(start));
+
+    if (rules) {
+        dump_rules(image, frames);
+        dwarf_frame_cache_clear(frames);
+    }
+
+    struct dwarf_function_index *functions = dwarf_function_index_create(dbg);
+    struct dwarf_line_cache *lines = dwarf_line_cache_create(dbg);
+
+    bool is64 = image->pNtHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+    unsigned pc_reg = is64 ? DWARF_X86_64_RIP : DWARF_X86_EIP;
+
+    int ret = 0;
+    for (; i < argc; ++i) {
+        struct snapshot snap;
+        if (!read_snapshot(argv[i], &snap)) {
+            fprintf(stderr, "error: failed to read %s\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        Dwarf_Addr bias = snap.base ? snap.base - image->ImageBase : 0;
+
+        std::vector<Dwarf_Addr> pcs;
+        unwind(frames, &snap, image->ImageBase, pc_reg, pcs);
+
+        printf("%s:\n", argv[i]);
+        for (size_t j = 0; j < pcs.size(); ++j) {
+            struct find_dwarf_info info;
+            memset(&info, 0, sizeof info);
+            Dwarf_Addr lookup = j ? pcs[j] - 1 : pcs[j];
+            find_dwarf_symbol(dbg, functions, lines, lookup - bias, &info);
+            printf("  #%u 0x%08" PRIx64 " %s", (unsigned)j, (uint64_t)pcs[j],
+                   info.functionname ? info.functionname : "??");
+            if (info.filename) {
+                printf(" %s:%u", info.filename, info.line);
+            }
+            printf("\n");
+        }
+
+        if (count) {
+            start = bench_clock::now();
+            for (unsigned k = 0; k < count; ++k) {
+                if (uncached) {
+                    dwarf_frame_cache_clear(frames);
+                }
+                unwind(frames, &snap, image->ImageBase, pc_reg, pcs);
+            }
+            double ms = elapsed_ms(start);
+            printf("unwind: %.1f ns/frame (%u frames)\n",
+                   ms * 1e6 / ((double)count * pcs.size()), (unsigned)pcs.size());
+        }
+    }
+
+    struct dwarf_frame_stats stats;
+    dwarf_frame_get_stats(frames, &stats);
+    printf("rule cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " rules\n",
+           stats.hits, stats.misses, stats.rules);
+
+    dwarf_line_cache_destroy(lines);
+    dwarf_function_index_destroy(functions);
+    dwarf_frame_index_destroy(frames);
+    dwarf_pe_finish(dbg, &error);
+    pe_image_unref(image);
+
+    return ret;
+}
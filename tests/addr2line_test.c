@@ -25,21 +25,11 @@
 #include <windows.h>
 
 
-int
-main(int argc, char **argv)
+static bool
+checkCommand(const char *szCommand, const char *szExpected)
 {
-    const char *szModuleName = "kernel32.dll";
-    const char *szSymbolName = "Sleep";
     bool ok;
 
-    HMODULE hModule = GetModuleHandleA(szModuleName);
-    PVOID pvSymbol = (PVOID)GetProcAddress(hModule, szSymbolName);
-
-    DWORD64 dwSymbolOffset = (DWORD64)(UINT_PTR)pvSymbol - (DWORD64)(UINT_PTR)hModule;
-
-    char szCommand[1024];
-    _snprintf(szCommand, sizeof szCommand, "addr2line.exe %s 0x%I64x", szModuleName, dwSymbolOffset);
-
     FILE *fp = _popen(szCommand, "rt");
     ok = fp != NULL;
     test_line(ok, "_popen(\"%s\")", szCommand);
@@ -49,15 +39,99 @@ main(int argc, char **argv)
 
         while (fgets(szLine, sizeof szLine, fp)) {
             fprintf(stdout, "%s\n", szLine);
-            if (strstr(szLine, szSymbolName)) {
+            if (strstr(szLine, szExpected)) {
                 found = true;
             }
         }
 
-        test_line(found, "strstr(\"%s\")", szSymbolName);
+        test_line(found, "strstr(\"%s\")", szExpected);
+
+        _pclose(fp);
+    }
+
+    return ok;
+}
+
 
+/*
+ * Read the preferred image base from the file, as the in-memory headers get
+ * updated on relocation.
+ */
+static DWORD64
+getImageBase(const char *szFileName)
+{
+    DWORD64 ImageBase = 0;
+    FILE *fp = fopen(szFileName, "rb");
+    if (fp) {
+        IMAGE_DOS_HEADER DosHeader;
+        IMAGE_NT_HEADERS NtHeaders;
+        if (fread(&DosHeader, sizeof DosHeader, 1, fp) == 1 &&
+            fseek(fp, DosHeader.e_lfanew, SEEK_SET) == 0 &&
+            fread(&NtHeaders, sizeof NtHeaders, 1, fp) == 1) {
+            ImageBase = NtHeaders.OptionalHeader.ImageBase;
+        }
         fclose(fp);
     }
+    return ImageBase;
+}
+
+
+static __attribute__((noinline)) PVOID
+getReturnAddress(void)
+{
+    return __builtin_return_address(0);
+}
+
+
+static unsigned g_uInlineLine;
+
+/*
+ * Address of a call within this function, once inlined into the caller.
+ */
+static inline __attribute__((always_inline)) PVOID
+inlineFunction(void)
+{
+    g_uInlineLine = __LINE__; return getReturnAddress();
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *szModuleName = "kernel32.dll";
+    const char *szSymbolName = "Sleep";
+
+    HMODULE hModule = GetModuleHandleA(szModuleName);
+    PVOID pvSymbol = (PVOID)GetProcAddress(hModule, szSymbolName);
+
+    DWORD64 dwSymbolOffset = (DWORD64)(UINT_PTR)pvSymbol - (DWORD64)(UINT_PTR)hModule;
+
+    char szCommand[1024];
+    _snprintf(szCommand, sizeof szCommand, "addr2line.exe %s 0x%I64x", szModuleName, dwSymbolOffset);
+    checkCommand(szCommand, szSymbolName);
+
+    // GNU addr2line style, on our own image
+    char szExeName[MAX_PATH];
+    GetModuleFileNameA(NULL, szExeName, sizeof szExeName);
+    DWORD64 dwMainOffset = (DWORD64)(UINT_PTR)&main - (DWORD64)(UINT_PTR)GetModuleHandleA(NULL);
+    DWORD64 dwMainAddr = getImageBase(szExeName) + dwMainOffset;
+    _snprintf(szCommand, sizeof szCommand, "addr2line.exe -f -C -e \"%s\" 0x%I64x", szExeName, dwMainAddr);
+    checkCommand(szCommand, "main");
+    checkCommand(szCommand, "addr2line_test.c");
+
+    _snprintf(szCommand, sizeof szCommand, "addr2line.exe -j 2 -f -e \"%s\" 0x%I64x", szExeName, dwMainAddr);
+    checkCommand(szCommand, "main");
+
+    // Inlined frames, innermost first
+    PVOID pvInline = inlineFunction(); unsigned uCallLine = __LINE__;
+    DWORD64 dwInlineOffset = (DWORD64)(UINT_PTR)pvInline - 1 - (DWORD64)(UINT_PTR)GetModuleHandleA(NULL);
+    _snprintf(szCommand, sizeof szCommand, "addr2line.exe -f -i -p -s -e \"%s\" 0x%I64x", szExeName,
+              getImageBase(szExeName) + dwInlineOffset);
+    char szExpected[256];
+    _snprintf(szExpected, sizeof szExpected, "inlineFunction at addr2line_test.c:%u", g_uInlineLine);
+    checkCommand(szCommand, szExpected);
+    _snprintf(szExpected, sizeof szExpected, " (inlined by) main at addr2line_test.c:%u", uCallLine);
+    checkCommand(szCommand, szExpected);
 
     test_exit();
 }
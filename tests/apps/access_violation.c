@@ -34,4 +34,7 @@ main(int argc, char *argv[])
 }
 
 // CHECK_STDERR: /  access_violation\.exe\!main  \[.*\baccess_violation\.c @ 31\]/
+// CHECK_STDERR: /^    30: \{\n>   31:     \*\(\(int \*\)0\) = 0;\n    32: $/
+// CHECK_JSON: {"type": "exception", "code": "0xc0000005", "module": "access_violation.exe", "access": "write", "location": "0x0"}
+// CHECK_JSON: {"type": "frame", "frame": 0, "module": "access_violation.exe", "symbol": "main", "file": "/\\baccess_violation\\.c$/", "line": 31}
 // CHECK_EXIT_CODE: 0xc0000005
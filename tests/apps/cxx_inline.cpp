@@ -30,4 +30,5 @@ int main()
 }
 
 // CHECK_STDERR: /  cxx_inline\.exe\!main  \[.*\bcxx_inline\.cpp @ (21|28)\]/
+// CHECK_STDERR_DWARF: /  cxx_inline\.exe\!(Test::)?length  \[.*\bcxx_inline\.cpp @ 21\]\n(.*\n)*?.*  cxx_inline\.exe\!main  \[.*\bcxx_inline\.cpp @ 28\]/
 // CHECK_EXIT_CODE: 0xc0000005
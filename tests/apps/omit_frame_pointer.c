@@ -0,0 +1,63 @@
+/**************************************************************************
+ *
+ * Copyright 2026 Dr. Mingw contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Built with -fomit-frame-pointer by MinGW, so that only the DWARF call frame
+ * information (catchsegv -u) can unwind past inner().
+ */
+
+#include "macros.h"
+
+NO_INLINE void
+inner(volatile int *p)
+{
+    *p = 0;
+}
+
+NO_INLINE void
+middle(volatile int *p)
+{
+    inner(p); LINE_BARRIER
+}
+
+NO_INLINE void
+outer(volatile int *p)
+{
+    middle(p); LINE_BARRIER
+}
+
+int
+main(int argc, char *argv[])
+{
+    outer(NULL); LINE_BARRIER
+
+    return 0;
+}
+
+// CHECK_STDERR: /  omit_frame_pointer\.exe\!inner  \[.*\bomit_frame_pointer\.c @ 38\]/
+// CHECK_UNWIND_DWARF: /  omit_frame_pointer\.exe\!inner  \[.*\bomit_frame_pointer\.c @ 38\]\n(.*\n)*?[0-9A-F]+ 0+ 0+ 0+  omit_frame_pointer\.exe\!middle  \[.*\bomit_frame_pointer\.c @ 44\]\n(.*\n)*?[0-9A-F]+ 0+ 0+ 0+  omit_frame_pointer\.exe\!outer  \[.*\bomit_frame_pointer\.c @ 50\]\n(.*\n)*?[0-9A-F]+ 0+ 0+ 0+  omit_frame_pointer\.exe\!main  \[.*\bomit_frame_pointer\.c @ 56\]/
+// CHECK_EXIT_CODE: 0xc0000005
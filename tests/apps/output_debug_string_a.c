@@ -36,4 +36,5 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdS
 }
 
 // CHECK_STDERR: /^Debug message from the application\.$/
+// CHECK_JSON: {"report": 0, "type": "debug_string", "text": "/^Debug message from the application\\.$/"}
 // CHECK_EXIT_CODE: 0
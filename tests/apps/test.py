@@ -28,11 +28,13 @@
 
 
 import glob
+import json
 import sys
 import subprocess
 import os.path
 import re
 import optparse
+import struct
 import tempfile
 import threading
 import multiprocessing.dummy as multiprocessing
@@ -61,6 +63,28 @@ def checkString(needle, haystack):
     return needleRe.search(haystack) is not None
 
 
+def hasDwarf(exe):
+    '''Whether the PE image carries DWARF debug information, as MinGW
+    builds do, unlike MSVC ones.'''
+
+    with open(exe, 'rb') as f:
+        data = f.read()
+    peOffset, = struct.unpack_from('<I', data, 0x3c)
+    numberOfSections, = struct.unpack_from('<H', data, peOffset + 6)
+    pointerToSymbolTable, numberOfSymbols = struct.unpack_from('<II', data, peOffset + 12)
+    sizeOfOptionalHeader, = struct.unpack_from('<H', data, peOffset + 20)
+    sectionOffset = peOffset + 24 + sizeOfOptionalHeader
+    for i in range(numberOfSections):
+        name = data[sectionOffset + 40*i : sectionOffset + 40*i + 8].rstrip(b'\0')
+        if name.startswith(b'/'):
+            # Long names live in the COFF string table
+            stringOffset = pointerToSymbolTable + 18*numberOfSymbols + int(name[1:])
+            name = data[stringOffset : data.index(b'\0', stringOffset)]
+        if name in (b'.debug_info', b'.zdebug_info'):
+            return True
+    return False
+
+
 def haveAnsiEscapes():
     if sys.platform != 'win32':
         return True
@@ -97,17 +121,8 @@ else:
     GREEN = ''
 
 
-def test(args):
-    catchsegvExe, testExe, testSrc = args
-
-    result = True
-
-    cmd = [
-        catchsegvExe,
-        '-v',
-        '-t', '30',
-        testExe
-    ]
+def runCatchsegv(catchsegvExe, flags, testExe, testSrc):
+    cmd = [catchsegvExe] + flags + [testExe]
 
     if sys.platform != 'win32':
         cmd = ['wine'] + cmd
@@ -154,6 +169,61 @@ def test(args):
     if exitCode == 0x4000001f:
         exitCode = 0x80000003
 
+    return exitCode, stdout, stderr
+
+
+def parseJsonReport(stderr):
+    '''Parse the JSON lines of a catchsegv -j report, checking that each
+    report's records are numbered in order.  Other lines can only come from
+    the test app itself or from catchsegv's own messages.'''
+
+    records = []
+    seqs = {}
+    for line in stderr.split('\n'):
+        if not line.startswith('{'):
+            assert not line or line.startswith('catchsegv: ') or '{"report":' not in line
+            continue
+        record = json.loads(line)
+        report = record['report']
+        if report == 0:
+            # Debug strings and such, outside of any report
+            assert record['seq'] == 0
+        else:
+            assert record['seq'] == seqs.get(report, 0)
+            seqs[report] = record['seq'] + 1
+        records.append(record)
+    return records
+
+
+def checkJson(expected, records):
+    '''Whether any record has all the expected fields, where string values
+    between slashes are regular expressions.'''
+
+    expected = json.loads(expected)
+    for record in records:
+        for key, value in expected.items():
+            if key not in record:
+                break
+            if isinstance(value, str) and value.startswith('/'):
+                if not checkString(value, str(record[key])):
+                    break
+            elif record[key] != value:
+                break
+        else:
+            return True
+    return False
+
+
+def test(args):
+    catchsegvExe, testExe, testSrc = args
+
+    result = True
+
+    exitCode, stdout, stderr = runCatchsegv(catchsegvExe, ['-v', '-t', '30'], testExe, testSrc)
+
+    jsonRecords = None
+    unwindStderr = None
+
     if exitCode == 125:
         # skip
         writeStdout('%sok - %s # skip%s\n' % (GREEN, testExe, NORMAL))
@@ -161,13 +231,22 @@ def test(args):
         # Search the source file for '// CHECK_...' annotations and process
         # them.
 
+        # Checks suffixed with _DWARF only apply to images with DWARF debug
+        # information, e.g., for inlined frames.
         checkCommentRe = re.compile(r'^// CHECK_([_0-9A-Z]+):\s+(.*)$')
+        dwarf = None
         for line in open(testSrc, 'rt'):
             line = line.rstrip('\n')
             mo = checkCommentRe.match(line)
             if mo:
                 checkName = mo.group(1)
                 checkExpr = mo.group(2)
+                if checkName.endswith('_DWARF'):
+                    if dwarf is None:
+                        dwarf = hasDwarf(testExe)
+                    if not dwarf:
+                        continue
+                    checkName = checkName[:-len('_DWARF')]
                 if checkName == 'EXIT_CODE':
                     inverse = False
                     if checkExpr.startswith('!'):
@@ -188,6 +267,21 @@ def test(args):
                     ok = checkString(checkExpr, stdout)
                 elif checkName == 'STDERR':
                     ok = checkString(checkExpr, stderr)
+                elif checkName == 'UNWIND':
+                    # Like STDERR, but unwinding with DWARF call frame
+                    # information, whose frames have no parameters
+                    if unwindStderr is None:
+                        _, _, unwindStderr = runCatchsegv(catchsegvExe, ['-u', '-v', '-t', '30'], testExe, testSrc)
+                    ok = checkString(checkExpr, unwindStderr)
+                elif checkName == 'JSON':
+                    if jsonRecords is None:
+                        _, _, jsonStderr = runCatchsegv(catchsegvExe, ['-j', '-t', '30'], testExe, testSrc)
+                        try:
+                            jsonRecords = parseJsonReport(jsonStderr)
+                        except (ValueError, KeyError, AssertionError):
+                            writeStdout('# invalid JSON report\n')
+                            jsonRecords = []
+                    ok = checkJson(checkExpr, jsonRecords)
                 else:
                     assert False
 
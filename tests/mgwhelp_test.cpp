@@ -25,6 +25,8 @@
 #include <windows.h>
 #include <dbghelp.h>
 
+#include "mgwhelp.h"
+
 
 static bool
 comparePath(const char *s1, const char *s2)
@@ -90,6 +92,39 @@ checkSym(HANDLE hProcess,
 }
 
 
+static void
+checkSymDisplacement(HANDLE hProcess,
+                     PVOID pvSymbol,
+                     DWORD64 dwOffset,
+                     const char *szSymbolName)
+{
+    bool ok;
+
+    DWORD64 dwAddr = (DWORD64)(UINT_PTR)pvSymbol + dwOffset;
+
+    DWORD64 Displacement = ~(DWORD64)0;
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[256];
+    } s;
+    memset(&s, 0, sizeof s);
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = sizeof s.Symbol.Name + sizeof s.Name;
+    ok = SymFromAddr(hProcess, dwAddr, &Displacement, &s.Symbol);
+    test_line(ok, "SymFromAddr(&%s + %I64u)", szSymbolName, dwOffset);
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        ok = Displacement == dwOffset;
+        test_line(ok, "SymFromAddr(&%s + %I64u).Displacement", szSymbolName, dwOffset);
+        if (!ok) {
+            test_diagnostic("Displacement = %I64u != %I64u",
+                            Displacement, dwOffset);
+        }
+    }
+}
+
+
 static void
 checkSymLine(HANDLE hProcess,
              PVOID pvSymbol,
@@ -130,6 +165,12 @@ checkSymLine(HANDLE hProcess,
             test_diagnostic("LineNumber = %lu != %lu",
                             Line.LineNumber, dwLineNumber);
         }
+        ok = Line.Address + dwDisplacement == dwAddr;
+        test_line(ok, "SymGetLineFromAddr64(&%s).Address", szSymbolName);
+        if (!ok) {
+            test_diagnostic("Address + Displacement = 0x%I64x + 0x%lx != 0x%I64x",
+                            Line.Address, dwDisplacement, dwAddr);
+        }
     }
 }
 
@@ -163,6 +204,151 @@ static const DWORD foo_line = __LINE__; static int foo(int a, int b) {
 }
 
 
+static void
+checkSymBatch(HANDLE hProcess,
+              PVOID pvFoo,
+              const char *szFileName,
+              DWORD dwFooLine)
+{
+    bool ok;
+
+    HMODULE hKernel32 = GetModuleHandleA("kernel32");
+    PVOID pvSleep = (PVOID)GetProcAddress(hKernel32, "Sleep");
+
+    // Deliberately unsorted
+    static const char *szNames[] = { "Sleep", "foo", "foo" };
+    const DWORD64 dwOffsets[] = { 0, 1, 0 };
+    const PVOID pvSymbols[] = { pvSleep, pvFoo, pvFoo };
+    const DWORD Count = _countof(szNames);
+
+    MGWHELP_ADDR_INFO AddrInfos[Count];
+    CHAR Names[Count][256];
+    ZeroMemory(AddrInfos, sizeof AddrInfos);
+    for (DWORD i = 0; i < Count; ++i) {
+        AddrInfos[i].Address = (DWORD64)(UINT_PTR)pvSymbols[i] + dwOffsets[i];
+        AddrInfos[i].Name = Names[i];
+        AddrInfos[i].MaxNameLen = sizeof Names[i];
+    }
+
+    DWORD dwFound = MgwSymFromAddrBatch(hProcess, Count, AddrInfos);
+    test_line(dwFound == Count, "MgwSymFromAddrBatch()");
+    if (dwFound != Count) {
+        test_diagnostic("Found = %lu != %lu", dwFound, Count);
+    }
+
+    for (DWORD i = 0; i < Count; ++i) {
+        const char *szSymbolName = szNames[i];
+        const MGWHELP_ADDR_INFO *AddrInfo = &AddrInfos[i];
+
+        ok = AddrInfo->bSymbol &&
+             strncmp(szSymbolName, AddrInfo->Name, strlen(szSymbolName)) == 0;
+        test_line(ok, "MgwSymFromAddrBatch(&%s + %I64u).Name", szSymbolName, dwOffsets[i]);
+        if (!ok) {
+            test_diagnostic("Name = \"%s\" != \"%s\"", AddrInfo->Name, szSymbolName);
+        }
+
+        ok = AddrInfo->Displacement == dwOffsets[i];
+        test_line(ok, "MgwSymFromAddrBatch(&%s + %I64u).Displacement", szSymbolName, dwOffsets[i]);
+        if (!ok) {
+            test_diagnostic("Displacement = %I64u != %I64u", AddrInfo->Displacement, dwOffsets[i]);
+        }
+
+        if (pvSymbols[i] == pvFoo && dwOffsets[i] == 0 && !g_bStripped) {
+            ok = AddrInfo->bLine &&
+                 comparePath(AddrInfo->FileName, szFileName) &&
+                 AddrInfo->LineNumber == dwFooLine;
+            test_line(ok, "MgwSymFromAddrBatch(&%s).Line", szSymbolName);
+            if (!ok) {
+                test_diagnostic("Line = %s:%lu != %s:%lu",
+                                AddrInfo->FileName, AddrInfo->LineNumber,
+                                szFileName, dwFooLine);
+            }
+        }
+    }
+}
+
+
+static void
+checkSymFromName(HANDLE hProcess,
+                 PVOID pvSymbol,
+                 const char *szSymbolName)
+{
+    bool ok;
+
+    DWORD64 dwAddr = (DWORD64)(UINT_PTR)pvSymbol;
+
+    struct {
+        SYMBOL_INFO Symbol;
+        CHAR Name[256];
+    } s;
+    memset(&s, 0, sizeof s);
+    s.Symbol.SizeOfStruct = sizeof s.Symbol;
+    s.Symbol.MaxNameLen = sizeof s.Symbol.Name + sizeof s.Name;
+    ok = MgwSymFromName(hProcess, szSymbolName, &s.Symbol);
+    test_line(ok, "MgwSymFromName(\"%s\")", szSymbolName);
+    if (!ok) {
+        test_diagnostic_last_error();
+    } else {
+        ok = s.Symbol.Address == dwAddr;
+        test_line(ok, "MgwSymFromName(\"%s\").Address", szSymbolName);
+        if (!ok) {
+            test_diagnostic("Address = 0x%I64x != 0x%I64x",
+                            s.Symbol.Address, dwAddr);
+        }
+    }
+}
+
+
+/*
+ * Unwind this function's frame with its DWARF call frame information twice,
+ * the second time with the rules cached by the first.
+ */
+static void
+    __attribute__ ((noinline))
+checkUnwind(HANDLE hProcess)
+{
+    CONTEXT Context;
+    ZeroMemory(&Context, sizeof Context);
+    Context.ContextFlags = CONTEXT_FULL;
+    RtlCaptureContext(&Context);
+
+    DWORD64 dwReturnAddress = (DWORD64)(UINT_PTR)__builtin_return_address(0);
+    DWORD64 dwFirstSP = 0;
+    for (unsigned i = 0; i < 2; ++i) {
+        CONTEXT Caller = Context;
+#ifdef _WIN64
+        BOOL ok = MgwUnwindContext(hProcess, IMAGE_FILE_MACHINE_AMD64, &Caller, TRUE);
+        DWORD64 dwPC = Caller.Rip;
+        DWORD64 dwSP = Caller.Rsp;
+#else
+        BOOL ok = MgwUnwindContext(hProcess, IMAGE_FILE_MACHINE_I386, &Caller, TRUE);
+        DWORD64 dwPC = Caller.Eip;
+        DWORD64 dwSP = Caller.Esp;
+#endif
+        test_line(ok, "MgwUnwindContext() #%u", i + 1);
+        if (!ok) {
+            return;
+        }
+
+        ok = dwPC == dwReturnAddress;
+        test_line(ok, "MgwUnwindContext() #%u pc", i + 1);
+        if (!ok) {
+            test_diagnostic("pc = 0x%I64x != 0x%I64x", dwPC, dwReturnAddress);
+        }
+
+        if (i == 0) {
+            dwFirstSP = dwSP;
+        } else {
+            ok = dwSP == dwFirstSP;
+            test_line(ok, "MgwUnwindContext() #%u sp", i + 1);
+            if (!ok) {
+                test_diagnostic("sp = 0x%I64x != 0x%I64x", dwSP, dwFirstSP);
+            }
+        }
+    }
+}
+
+
 #define LINE_BARRIER rand();
 
 
@@ -191,8 +377,20 @@ main(int argc, char **argv)
     } {
         checkSymLine(hProcess, (PVOID)&foo, "foo", __FILE__, foo_line);
 
+        checkSymDisplacement(hProcess, (PVOID)&foo, 1, "foo");
+
+        checkSymBatch(hProcess, (PVOID)&foo, __FILE__, foo_line);
+
+        if (!g_bStripped) {
+            checkSymFromName(hProcess, (PVOID)&foo, "foo");
+        }
+
         checkCaller(hProcess, "main", __FILE__, __LINE__); LINE_BARRIER
 
+        if (!g_bStripped) {
+            checkUnwind(hProcess);
+        }
+
         // Test DbgHelp fallback
         checkExport(hProcess, "kernel32", "Sleep");
 
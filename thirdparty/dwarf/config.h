@@ -1,7 +1,9 @@
 #define HAVE_INTTYPES_H 1
 #define HAVE_ELF_H 1
 #define HAVE_MEMORY_H 1
+#ifdef _WIN32
 #define HAVE_NONSTANDARD_PRINTF_64_FORMAT 1
+#endif
 #define HAVE_STDINT_H 1
 #define HAVE_STDLIB_H 1
 #define HAVE_STRINGS_H 1
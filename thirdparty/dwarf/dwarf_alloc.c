@@ -323,6 +323,144 @@ simple_compare_function(const void *l, const void *r)
     return 0;
 }
 
+/*  Arena allocation.
+
+    An arena is a list of chunks carved up by bumping a pointer.
+    Objects placed in one keep the usual reserve prefix, with
+    DW_RESERVE_ARENA or-ed into rd_type, but are not entered in
+    de_alloc_tree: dwarf_dealloc() ignores them and they are
+    freed along with their arena. */
+#define DW_RESERVE_ARENA 0x8000
+#define DW_ARENA_ALIGN 16
+#define DW_ARENA_CHUNK_SIZE (64*1024)
+
+struct Dwarf_Arena_Chunk_s {
+    struct Dwarf_Arena_Chunk_s *ac_next;
+    /* Usable bytes, which follow the (padded) header. */
+    Dwarf_Unsigned ac_size;
+};
+#define DW_ARENA_CHUNK_HDR \
+    ((sizeof(struct Dwarf_Arena_Chunk_s) + DW_ARENA_ALIGN - 1) & \
+    ~(DW_ARENA_ALIGN - 1))
+
+struct Dwarf_Arena_s {
+    struct Dwarf_Arena_Chunk_s *ar_chunks;
+    char *ar_next;
+    char *ar_end;
+    /* Enclosing sub-arena, if any. */
+    struct Dwarf_Arena_s *ar_outer;
+};
+
+static char *
+arena_alloc(Dwarf_Debug dbg, struct Dwarf_Arena_s *arena,
+    Dwarf_Unsigned size)
+{
+    struct Dwarf_Arena_Chunk_s *chunk = 0;
+    char *mem = 0;
+
+    size = (size + DW_ARENA_ALIGN - 1) &
+        ~(Dwarf_Unsigned)(DW_ARENA_ALIGN - 1);
+    if (size <= (Dwarf_Unsigned)(arena->ar_end - arena->ar_next)) {
+        mem = arena->ar_next;
+        arena->ar_next += size;
+        return mem;
+    }
+    if (size > DW_ARENA_CHUNK_SIZE/4) {
+        /*  Big objects get a chunk of their own, linked behind
+            the current chunk so its free space is not lost. */
+        chunk = malloc(DW_ARENA_CHUNK_HDR + size);
+        if (!chunk) {
+            return NULL;
+        }
+        dbg->de_malloc_count++;
+        chunk->ac_size = size;
+        if (arena->ar_chunks) {
+            chunk->ac_next = arena->ar_chunks->ac_next;
+            arena->ar_chunks->ac_next = chunk;
+        } else {
+            chunk->ac_next = 0;
+            arena->ar_chunks = chunk;
+        }
+        return (char *)chunk + DW_ARENA_CHUNK_HDR;
+    }
+    chunk = dbg->de_arena_free_chunks;
+    if (chunk) {
+        dbg->de_arena_free_chunks = chunk->ac_next;
+    } else {
+        chunk = malloc(DW_ARENA_CHUNK_HDR + DW_ARENA_CHUNK_SIZE);
+        if (!chunk) {
+            return NULL;
+        }
+        dbg->de_malloc_count++;
+        chunk->ac_size = DW_ARENA_CHUNK_SIZE;
+    }
+    chunk->ac_next = arena->ar_chunks;
+    arena->ar_chunks = chunk;
+    mem = (char *)chunk + DW_ARENA_CHUNK_HDR;
+    arena->ar_next = mem + size;
+    arena->ar_end = mem + DW_ARENA_CHUNK_SIZE;
+    return mem;
+}
+
+/*  Free an arena's chunks, keeping the standard sized ones
+    for reuse by later sub-arenas if recycle is set. */
+static void
+arena_free(Dwarf_Debug dbg, struct Dwarf_Arena_s *arena, int recycle)
+{
+    struct Dwarf_Arena_Chunk_s *chunk = arena->ar_chunks;
+
+    while (chunk) {
+        struct Dwarf_Arena_Chunk_s *next = chunk->ac_next;
+        if (recycle && chunk->ac_size == DW_ARENA_CHUNK_SIZE) {
+            chunk->ac_next = dbg->de_arena_free_chunks;
+            dbg->de_arena_free_chunks = chunk;
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    free(arena);
+}
+
+/*  Types only ever owned by whoever asked for them, never
+    referenced from libdwarf's own caches, and so safe to
+    place in a sub-arena. */
+static int
+alloc_type_is_transient(unsigned type)
+{
+    switch (type) {
+    case DW_DLA_STRING:
+    case DW_DLA_LOC:
+    case DW_DLA_LOCDESC:
+    case DW_DLA_BLOCK:
+    case DW_DLA_DIE:
+    case DW_DLA_LINE:
+    case DW_DLA_ATTR:
+    case DW_DLA_ERROR:
+    case DW_DLA_LIST:
+    case DW_DLA_ARANGE:
+    case DW_DLA_ABBREV:
+    case DW_DLA_FRAME_OP:
+    case DW_DLA_LOC_BLOCK:
+    case DW_DLA_FRAME_BLOCK:
+    case DW_DLA_ADDR:
+    case DW_DLA_RANGES:
+    case DW_DLA_CHAIN:
+    case DW_DLA_LOC_CHAIN:
+    case DW_DLA_LOC_BLOCK_C:
+    case DW_DLA_LOCDESC_C:
+    case DW_DLA_LOC_HEAD_C:
+    case DW_DLA_CHAIN_2:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static char *
+get_alloc(Dwarf_Debug dbg,
+    Dwarf_Small alloc_type, Dwarf_Unsigned count, int persistent);
+
 /*  This function returns a pointer to a region
     of memory.  For alloc_types that are not
     strings or lists of pointers, only 1 struct
@@ -342,12 +480,30 @@ simple_compare_function(const void *l, const void *r)
 char *
 _dwarf_get_alloc(Dwarf_Debug dbg,
     Dwarf_Small alloc_type, Dwarf_Unsigned count)
+{
+    return get_alloc(dbg, alloc_type, count, FALSE);
+}
+
+/*  Same as _dwarf_get_alloc(), for objects of a normally
+    transient type that libdwarf keeps beyond the current
+    sub-arena, such as the cached frame lists. */
+char *
+_dwarf_get_alloc_persistent(Dwarf_Debug dbg,
+    Dwarf_Small alloc_type, Dwarf_Unsigned count)
+{
+    return get_alloc(dbg, alloc_type, count, TRUE);
+}
+
+static char *
+get_alloc(Dwarf_Debug dbg,
+    Dwarf_Small alloc_type, Dwarf_Unsigned count, int persistent)
 {
     char * alloc_mem = 0;
     Dwarf_Signed basesize = 0;
     Dwarf_Signed size = 0;
     unsigned int type = alloc_type;
     short action = 0;
+    struct Dwarf_Arena_s *arena = 0;
 
     if (dbg == NULL) {
         return NULL;
@@ -371,10 +527,28 @@ _dwarf_get_alloc(Dwarf_Debug dbg,
             sizeof(Dwarf_Addr) : sizeof(Dwarf_Off));
     }
     size += DW_RESERVE;
-    alloc_mem = malloc(size);
+    if (!alloc_instance_basics[type].specialconstructor &&
+        !alloc_instance_basics[type].specialdestructor) {
+        if (!dbg->de_arena_mode) {
+            arena = 0;
+        } else if (dbg->de_sub_arena && !persistent &&
+            alloc_type_is_transient(type)) {
+            arena = dbg->de_sub_arena;
+        } else {
+            arena = dbg->de_arena;
+        }
+    }
+    if (arena) {
+        alloc_mem = arena_alloc(dbg, arena, size);
+    } else {
+        alloc_mem = malloc(size);
+        dbg->de_malloc_count++;
+    }
     if (!alloc_mem) {
         return NULL;
     }
+    dbg->de_alloc_count++;
+    dbg->de_alloc_bytes += size;
     {
         char * ret_mem = alloc_mem + DW_RESERVE;
         void *key = ret_mem;
@@ -386,6 +560,11 @@ _dwarf_get_alloc(Dwarf_Debug dbg,
         r->rd_dbg = dbg;
         r->rd_type = alloc_type;
         r->rd_length = size;
+        if (arena) {
+            /*  Freed along with the arena, so not tracked. */
+            r->rd_type |= DW_RESERVE_ARENA;
+            return (ret_mem);
+        }
         if (alloc_instance_basics[type].specialconstructor) {
             int res =
                 alloc_instance_basics[type].specialconstructor(dbg, ret_mem);
@@ -499,6 +678,10 @@ dwarf_dealloc(Dwarf_Debug dbg,
         /* internal or user app error */
         return;
     }
+    if (r->rd_type & DW_RESERVE_ARENA) {
+        /* Freed along with its arena. */
+        return;
+    }
 
 
     if (type == DW_DLA_STRING && string_is_in_debug_section(dbg,space)) {
@@ -555,6 +738,76 @@ _dwarf_get_debug(void)
     return (dbg);
 }
 
+Dwarf_Bool
+dwarf_set_arena_mode(Dwarf_Debug dbg, Dwarf_Bool on)
+{
+    Dwarf_Bool previous = 0;
+
+    if (dbg == NULL) {
+        return FALSE;
+    }
+    previous = dbg->de_arena_mode;
+    if (on && !dbg->de_arena) {
+        dbg->de_arena = calloc(1, sizeof(struct Dwarf_Arena_s));
+        if (!dbg->de_arena) {
+            return previous;
+        }
+        dbg->de_malloc_count++;
+    }
+    /*  Turning it off again keeps the arena, as objects in it
+        are still live. */
+    dbg->de_arena_mode = on ? TRUE : FALSE;
+    return previous;
+}
+
+int
+dwarf_arena_begin(Dwarf_Debug dbg, Dwarf_Error *error)
+{
+    struct Dwarf_Arena_s *arena = 0;
+
+    if (dbg == NULL) {
+        _dwarf_error(NULL, error, DW_DLE_DBG_NULL);
+        return DW_DLV_ERROR;
+    }
+    arena = calloc(1, sizeof(struct Dwarf_Arena_s));
+    if (!arena) {
+        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+        return DW_DLV_ERROR;
+    }
+    dbg->de_malloc_count++;
+    arena->ar_outer = dbg->de_sub_arena;
+    dbg->de_sub_arena = arena;
+    return DW_DLV_OK;
+}
+
+void
+dwarf_arena_end(Dwarf_Debug dbg)
+{
+    struct Dwarf_Arena_s *arena = 0;
+
+    if (dbg == NULL || !dbg->de_sub_arena) {
+        return;
+    }
+    arena = dbg->de_sub_arena;
+    dbg->de_sub_arena = arena->ar_outer;
+    arena_free(dbg, arena, TRUE);
+}
+
+int
+dwarf_get_alloc_stats(Dwarf_Debug dbg,
+    Dwarf_Unsigned *alloc_count,
+    Dwarf_Unsigned *alloc_bytes,
+    Dwarf_Unsigned *malloc_count)
+{
+    if (dbg == NULL) {
+        return DW_DLV_ERROR;
+    }
+    *alloc_count = dbg->de_alloc_count;
+    *alloc_bytes = dbg->de_alloc_bytes;
+    *malloc_count = dbg->de_malloc_count;
+    return DW_DLV_OK;
+}
+
 /*
     This function prints out the statistics
     collected on allocation of memory chunks.
@@ -586,11 +839,10 @@ freecontextlist(Dwarf_Debug dbg, Dwarf_Debug_InfoTypes dis)
     Dwarf_CU_Context nextcontext = 0;
     for (context = dis->de_cu_context_list;
         context; context = nextcontext) {
-        Dwarf_Hash_Table hash_table = context->cc_abbrev_hash_table;
-        _dwarf_free_abbrev_hash_table_contents(dbg,hash_table);
         nextcontext = context->cc_next;
-        dwarf_dealloc(dbg, hash_table, DW_DLA_HASH_TABLE);
-        context->cc_abbrev_hash_table = 0;
+        /*  Abbreviation tables are shared, and freed by
+            _dwarf_free_abbrev_tables(). */
+        context->cc_abbrev_table = 0;
         dwarf_dealloc(dbg, context, DW_DLA_CU_CONTEXT);
     }
     dis->de_cu_context_list = 0;
@@ -625,6 +877,7 @@ _dwarf_free_all_of_one_debug(Dwarf_Debug dbg)
 
     freecontextlist(dbg,&dbg->de_info_reading);
     freecontextlist(dbg,&dbg->de_types_reading);
+    _dwarf_free_abbrev_tables(dbg);
 
     /* Housecleaning done. Now really free all the space. */
     rela_free(&dbg->de_debug_info);
@@ -662,6 +915,26 @@ _dwarf_free_all_of_one_debug(Dwarf_Debug dbg)
 
     dwarf_tdestroy(dbg->de_alloc_tree,tdestroy_free_node);
     dbg->de_alloc_tree = 0;
+    /*  Only now, as destructors above may still look at
+        arena objects. */
+    while (dbg->de_sub_arena) {
+        struct Dwarf_Arena_s *outer = dbg->de_sub_arena->ar_outer;
+        arena_free(dbg, dbg->de_sub_arena, FALSE);
+        dbg->de_sub_arena = outer;
+    }
+    if (dbg->de_arena) {
+        arena_free(dbg, dbg->de_arena, FALSE);
+        dbg->de_arena = 0;
+    }
+    {
+        struct Dwarf_Arena_Chunk_s *chunk = dbg->de_arena_free_chunks;
+        while (chunk) {
+            struct Dwarf_Arena_Chunk_s *next = chunk->ac_next;
+            free(chunk);
+            chunk = next;
+        }
+        dbg->de_arena_free_chunks = 0;
+    }
     if (dbg->de_tied_data.td_tied_search) {
         dwarf_tdestroy(dbg->de_tied_data.td_tied_search,
             _dwarf_tied_destroy_free_node);
@@ -27,6 +27,7 @@
 /* #define DWARF_SIMPLE_MALLOC 1  */
 
 char * _dwarf_get_alloc(Dwarf_Debug, Dwarf_Small, Dwarf_Unsigned);
+char * _dwarf_get_alloc_persistent(Dwarf_Debug, Dwarf_Small, Dwarf_Unsigned);
 Dwarf_Debug _dwarf_get_debug(void);
 int _dwarf_free_all_of_one_debug(Dwarf_Debug);
 struct Dwarf_Error_s * _dwarf_special_no_dbg_error_malloc(void);
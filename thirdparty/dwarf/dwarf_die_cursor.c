@@ -0,0 +1,713 @@
+/*
+
+  Copyright (C) 2026 Dr. Mingw contributors. All Rights Reserved.
+
+  This program is free software; you can redistribute it and/or modify it
+  under the terms of version 2.1 of the GNU Lesser General Public License
+  as published by the Free Software Foundation.
+
+  This program is distributed in the hope that it would be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+  Further, this software is distributed without any warranty that it is
+  free of the rightful claim of any third person regarding infringement
+  or the like.  Any license provided herein, whether implied or
+  otherwise, applies only to this software file.  Patent licenses, if
+  any, provided herein do not apply to combinations of this program with
+  other software, or any other product whatsoever.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this program; if not, write the Free Software
+  Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston MA 02110-1301,
+  USA.
+
+*/
+
+/*  Allocation-free DIE walking, see Dwarf_Die_Cursor in libdwarf.h.
+
+    This is the same traversal dwarf_child() and dwarf_siblingof_b()
+    do, minus the Dwarf_Die objects: the cursor keeps pointers into
+    .debug_info and the abbreviation of the current DIE, and its
+    attributes are only looked at when asked for, in one pass.  */
+
+#include "config.h"
+#include "dwarf_incl.h"
+#include <string.h>
+#include "dwarf_die_deliv.h"
+
+#define TRUE 1
+#define FALSE 0
+
+
+static Dwarf_Unsigned
+attr_bit(Dwarf_Unsigned attr)
+{
+    switch (attr) {
+    case DW_AT_name:
+        return DW_DCA_NAME;
+    case DW_AT_low_pc:
+        return DW_DCA_LOW_PC;
+    case DW_AT_high_pc:
+        return DW_DCA_HIGH_PC;
+    case DW_AT_specification:
+        return DW_DCA_SPECIFICATION;
+    case DW_AT_abstract_origin:
+        return DW_DCA_ABSTRACT_ORIGIN;
+    case DW_AT_ranges:
+        return DW_DCA_RANGES;
+    case DW_AT_call_file:
+        return DW_DCA_CALL_FILE;
+    case DW_AT_call_line:
+        return DW_DCA_CALL_LINE;
+    default:
+        return 0;
+    }
+}
+
+/*  Reads a reference as a section-global offset.
+    DW_DLV_NO_ENTRY for forms not referring into this section.  */
+static int
+read_ref(Dwarf_CU_Context context,
+    Dwarf_Unsigned form,
+    Dwarf_Small *ptr,
+    Dwarf_Small *end,
+    Dwarf_Off *offset_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Unsigned offset = 0;
+
+    switch (form) {
+    case DW_FORM_ref1:
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr, 1, error, end);
+        break;
+    case DW_FORM_ref2:
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr, 2, error, end);
+        break;
+    case DW_FORM_ref4:
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr, 4, error, end);
+        break;
+    case DW_FORM_ref8:
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr, 8, error, end);
+        break;
+    case DW_FORM_ref_udata:
+        DECODE_LEB128_UWORD_CK(ptr, offset, dbg, error, end);
+        break;
+    case DW_FORM_ref_addr: {
+        /*  Already section-global.  Address sized in DWARF2. */
+        unsigned size = context->cc_version_stamp == 2 ?
+            context->cc_address_size : context->cc_length_size;
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr, size,
+            error, end);
+        *offset_out = offset;
+        return DW_DLV_OK;
+    }
+    default:
+        return DW_DLV_NO_ENTRY;
+    }
+    *offset_out = context->cc_debug_offset + offset;
+    return DW_DLV_OK;
+}
+
+static int
+read_string(Dwarf_CU_Context context,
+    Dwarf_Unsigned attr,
+    Dwarf_Unsigned form,
+    Dwarf_Small *section,
+    Dwarf_Small *ptr,
+    Dwarf_Small *end,
+    const char **str_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Unsigned offset = 0;
+    char *str = 0;
+    int res = 0;
+
+    switch (form) {
+    case DW_FORM_string:
+        res = _dwarf_check_string_valid(dbg, section, ptr, end, error);
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+        *str_out = (const char *)ptr;
+        return DW_DLV_OK;
+    case DW_FORM_strp:
+    case DW_FORM_line_strp:
+        READ_UNALIGNED_CK(dbg, offset, Dwarf_Unsigned, ptr,
+            context->cc_length_size, error, end);
+        break;
+    case DW_FORM_strx:
+    case DW_FORM_GNU_str_index:
+        res = _dwarf_extract_string_offset_via_str_offsets(dbg, ptr,
+            attr, form, context, &offset, error);
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+        break;
+    default:
+        return DW_DLV_NO_ENTRY;
+    }
+    res = _dwarf_extract_local_debug_str_string_given_offset(dbg,
+        form, offset, &str, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    *str_out = str;
+    return DW_DLV_OK;
+}
+
+static int
+read_address(Dwarf_CU_Context context,
+    Dwarf_Unsigned form,
+    Dwarf_Small *ptr,
+    Dwarf_Small *end,
+    Dwarf_Addr *addr_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Addr addr = 0;
+
+    switch (form) {
+    case DW_FORM_addr:
+        READ_UNALIGNED_CK(dbg, addr, Dwarf_Addr, ptr,
+            context->cc_address_size, error, end);
+        *addr_out = addr;
+        return DW_DLV_OK;
+    case DW_FORM_addrx:
+    case DW_FORM_GNU_addr_index:
+        return _dwarf_look_in_local_and_tied(form, context, ptr,
+            addr_out, error);
+    default:
+        return DW_DLV_NO_ENTRY;
+    }
+}
+
+static int
+read_constant(Dwarf_CU_Context context,
+    Dwarf_Unsigned form,
+    Dwarf_Small *ptr,
+    Dwarf_Small *end,
+    Dwarf_Unsigned *value_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Unsigned value = 0;
+    Dwarf_Signed svalue = 0;
+
+    switch (form) {
+    case DW_FORM_data1:
+        READ_UNALIGNED_CK(dbg, value, Dwarf_Unsigned, ptr, 1, error, end);
+        break;
+    case DW_FORM_data2:
+        READ_UNALIGNED_CK(dbg, value, Dwarf_Unsigned, ptr, 2, error, end);
+        break;
+    case DW_FORM_data4:
+        READ_UNALIGNED_CK(dbg, value, Dwarf_Unsigned, ptr, 4, error, end);
+        break;
+    case DW_FORM_data8:
+        READ_UNALIGNED_CK(dbg, value, Dwarf_Unsigned, ptr, 8, error, end);
+        break;
+    case DW_FORM_sec_offset:
+        READ_UNALIGNED_CK(dbg, value, Dwarf_Unsigned, ptr,
+            context->cc_length_size, error, end);
+        break;
+    case DW_FORM_udata:
+        DECODE_LEB128_UWORD_CK(ptr, value, dbg, error, end);
+        break;
+    case DW_FORM_sdata:
+        DECODE_LEB128_SWORD_CK(ptr, svalue, dbg, error, end);
+        value = (Dwarf_Unsigned)svalue;
+        break;
+    default:
+        return DW_DLV_NO_ENTRY;
+    }
+    *value_out = value;
+    return DW_DLV_OK;
+}
+
+/*  Decodes one wanted attribute into attrs.  */
+static int
+read_attr(Dwarf_Die_Cursor *cursor,
+    Dwarf_Unsigned attr,
+    Dwarf_Unsigned form,
+    Dwarf_Unsigned bit,
+    Dwarf_Small *ptr,
+    Dwarf_Die_Attrs *attrs,
+    Dwarf_Bool *highpc_is_offset,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = cursor->dc_context;
+    Dwarf_Small *end = cursor->dc_end;
+    int res = DW_DLV_NO_ENTRY;
+
+    switch (bit) {
+    case DW_DCA_NAME:
+        res = read_string(context, attr, form, cursor->dc_section,
+            ptr, end, &attrs->dca_name, error);
+        break;
+    case DW_DCA_LOW_PC:
+        res = read_address(context, form, ptr, end,
+            &attrs->dca_lowpc, error);
+        break;
+    case DW_DCA_HIGH_PC:
+        res = read_address(context, form, ptr, end,
+            &attrs->dca_highpc, error);
+        if (res == DW_DLV_NO_ENTRY) {
+            res = read_constant(context, form, ptr, end,
+                &attrs->dca_highpc, error);
+            *highpc_is_offset = (res == DW_DLV_OK);
+        }
+        break;
+    case DW_DCA_SPECIFICATION:
+        res = read_ref(context, form, ptr, end,
+            &attrs->dca_specification, error);
+        break;
+    case DW_DCA_ABSTRACT_ORIGIN:
+        res = read_ref(context, form, ptr, end,
+            &attrs->dca_abstract_origin, error);
+        break;
+    case DW_DCA_RANGES:
+        res = read_constant(context, form, ptr, end,
+            &attrs->dca_ranges, error);
+        break;
+    case DW_DCA_CALL_FILE:
+        res = read_constant(context, form, ptr, end,
+            &attrs->dca_call_file, error);
+        break;
+    case DW_DCA_CALL_LINE:
+        res = read_constant(context, form, ptr, end,
+            &attrs->dca_call_line, error);
+        break;
+    }
+    if (res == DW_DLV_OK) {
+        attrs->dca_present |= bit;
+    } else if (res == DW_DLV_NO_ENTRY) {
+        attrs->dca_other_form |= bit;
+        res = DW_DLV_OK;
+    }
+    return res;
+}
+
+static int
+check_sibling(Dwarf_Die_Cursor *cursor,
+    Dwarf_Small *info_ptr,
+    Dwarf_Off offset,
+    Dwarf_Small **sibling_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Small *sibling = cursor->dc_section + offset;
+    Dwarf_Debug dbg = ((Dwarf_CU_Context)cursor->dc_context)->cc_dbg;
+
+    if (sibling <= info_ptr) {
+        _dwarf_error(dbg, error, DW_DLE_NEXT_DIE_LOW_ERROR);
+        return DW_DLV_ERROR;
+    }
+    if (sibling > cursor->dc_end) {
+        _dwarf_error(dbg, error, DW_DLE_NEXT_DIE_PAST_END);
+        return DW_DLV_ERROR;
+    }
+    *sibling_out = sibling;
+    return DW_DLV_OK;
+}
+
+/*  Walks the attributes of a DIE, starting at info_ptr, with their
+    specifications at abbrev_ptr.  Decodes those selected by want
+    into attrs, and returns where the DIE ends, and where its
+    DW_AT_sibling points to (NULL if absent).  */
+static int
+read_attrs(Dwarf_Die_Cursor *cursor,
+    Dwarf_Small *abbrev_ptr,
+    Dwarf_Small *info_ptr,
+    Dwarf_Unsigned want,
+    Dwarf_Die_Attrs *attrs,
+    Dwarf_Small **die_end_out,
+    Dwarf_Small **sibling_out,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = cursor->dc_context;
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Small *abbrev_end = _dwarf_calculate_abbrev_section_end_ptr(context);
+    Dwarf_Small *end = cursor->dc_end;
+    Dwarf_Small *die_ptr = info_ptr;
+    Dwarf_Small *sibling = 0;
+    Dwarf_Bool highpc_is_offset = FALSE;
+    int res = 0;
+
+    if (want & DW_DCA_HIGH_PC) {
+        /*  Needed to make sense of a DWARF4 constant high_pc. */
+        want |= DW_DCA_LOW_PC;
+    }
+    if (attrs) {
+        memset(attrs, 0, sizeof *attrs);
+    }
+    for (;;) {
+        Dwarf_Unsigned attr = 0;
+        Dwarf_Unsigned form = 0;
+        Dwarf_Unsigned bit = 0;
+        Dwarf_Unsigned size = 0;
+
+        DECODE_LEB128_UWORD_CK(abbrev_ptr, attr, dbg, error, abbrev_end);
+        DECODE_LEB128_UWORD_CK(abbrev_ptr, form, dbg, error, abbrev_end);
+        if (attr == 0 && form == 0) {
+            break;
+        }
+        if (form == DW_FORM_indirect) {
+            DECODE_LEB128_UWORD_CK(info_ptr, form, dbg, error, end);
+        }
+        if (attr == DW_AT_sibling) {
+            Dwarf_Off offset = 0;
+            res = read_ref(context, form, info_ptr, end, &offset, error);
+            if (res == DW_DLV_ERROR) {
+                return res;
+            }
+            /*  DW_FORM_ref_addr siblings are ignored, as
+                _dwarf_next_die_info_ptr() does. */
+            if (res == DW_DLV_OK && form != DW_FORM_ref_addr) {
+                res = check_sibling(cursor, die_ptr, offset, &sibling,
+                    error);
+                if (res != DW_DLV_OK) {
+                    return res;
+                }
+            }
+        } else if ((bit = attr_bit(attr) & want) != 0) {
+            res = read_attr(cursor, attr, form, bit, info_ptr, attrs,
+                &highpc_is_offset, error);
+            if (res != DW_DLV_OK) {
+                return res;
+            }
+        }
+        res = _dwarf_get_size_of_val(dbg, form,
+            context->cc_version_stamp,
+            context->cc_address_size,
+            info_ptr,
+            context->cc_length_size,
+            &size, end, error);
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+        info_ptr += size;
+        if (info_ptr > end) {
+            _dwarf_error(dbg, error, DW_DLE_NEXT_DIE_PAST_END);
+            return DW_DLV_ERROR;
+        }
+    }
+    if (highpc_is_offset) {
+        if (attrs->dca_present & DW_DCA_LOW_PC) {
+            attrs->dca_highpc += attrs->dca_lowpc;
+        } else {
+            attrs->dca_present &= ~(Dwarf_Unsigned)DW_DCA_HIGH_PC;
+            attrs->dca_other_form |= DW_DCA_HIGH_PC;
+        }
+    }
+    *die_end_out = info_ptr;
+    *sibling_out = sibling;
+    return DW_DLV_OK;
+}
+
+/*  Reads the DW_AT_sibling of a DIE whose abbreviation has it at
+    a fixed offset.  */
+static int
+read_fixed_sibling(Dwarf_Die_Cursor *cursor,
+    Dwarf_Abbrev_List abbrev,
+    Dwarf_Small *info_ptr,
+    Dwarf_Small **sibling_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Off offset = 0;
+    int res = read_ref(cursor->dc_context, abbrev->abl_sibling_form,
+        info_ptr + abbrev->abl_sibling_offset, cursor->dc_end, &offset,
+        error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    return check_sibling(cursor, info_ptr, offset, sibling_out, error);
+}
+
+/*  Same as read_attrs() without decoding any attribute, and in a
+    single step when all forms have a fixed size.  */
+static int
+skip_attrs(Dwarf_Die_Cursor *cursor,
+    Dwarf_Abbrev_List abbrev,
+    Dwarf_Small *info_ptr,
+    Dwarf_Small **die_end_out,
+    Dwarf_Small **sibling_out,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = cursor->dc_context;
+
+    if (!abbrev->abl_has_fixed_size) {
+        return read_attrs(cursor, abbrev->abl_abbrev_ptr, info_ptr, 0,
+            NULL, die_end_out, sibling_out, error);
+    }
+    if (abbrev->abl_fixed_size >
+        (Dwarf_Unsigned)(cursor->dc_end - info_ptr)) {
+        _dwarf_error(context->cc_dbg, error, DW_DLE_NEXT_DIE_PAST_END);
+        return DW_DLV_ERROR;
+    }
+    *die_end_out = info_ptr + abbrev->abl_fixed_size;
+    *sibling_out = 0;
+    if (abbrev->abl_sibling_form) {
+        return read_fixed_sibling(cursor, abbrev, info_ptr, sibling_out,
+            error);
+    }
+    return DW_DLV_OK;
+}
+
+/*  Reads the abbreviation code of the (non-null) DIE at ptr.  */
+static int
+read_abbrev(Dwarf_Die_Cursor *cursor,
+    Dwarf_Small *ptr,
+    Dwarf_Abbrev_List *abbrev_out,
+    Dwarf_Small **attrs_out,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = cursor->dc_context;
+    Dwarf_Debug dbg = context->cc_dbg;
+    Dwarf_Unsigned code = 0;
+    int res = 0;
+
+    DECODE_LEB128_UWORD_CK(ptr, code, dbg, error, cursor->dc_end);
+    res = _dwarf_get_abbrev_for_code(context, code, abbrev_out, error);
+    if (res == DW_DLV_NO_ENTRY) {
+        _dwarf_error(dbg, error, DW_DLE_DIE_ABBREV_LIST_NULL);
+        return DW_DLV_ERROR;
+    }
+    *attrs_out = ptr;
+    return res;
+}
+
+/*  Skips the children of a DIE, starting at the first one, and
+    leaves ptr after the null entry ending them.  */
+static int
+skip_subtree(Dwarf_Die_Cursor *cursor,
+    Dwarf_Small **ptr_inout,
+    Dwarf_Error *error)
+{
+    Dwarf_Small *ptr = *ptr_inout;
+    Dwarf_Small *end = cursor->dc_end;
+    int depth = 1;
+
+    while (depth > 0 && ptr < end) {
+        Dwarf_Abbrev_List abbrev = 0;
+        Dwarf_Small *attrs = 0;
+        Dwarf_Small *die_end = 0;
+        Dwarf_Small *sibling = 0;
+        int res = 0;
+
+        if (*ptr == 0) {
+            --depth;
+            ++ptr;
+            continue;
+        }
+        res = read_abbrev(cursor, ptr, &abbrev, &attrs, error);
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+        if (abbrev->abl_has_child && abbrev->abl_sibling_form) {
+            res = read_fixed_sibling(cursor, abbrev, attrs, &sibling, error);
+            if (res != DW_DLV_OK) {
+                return res;
+            }
+            ptr = sibling;
+            continue;
+        }
+        res = skip_attrs(cursor, abbrev, attrs, &die_end, &sibling, error);
+        if (res != DW_DLV_OK) {
+            return res;
+        }
+        if (!abbrev->abl_has_child) {
+            ptr = die_end;
+        } else if (sibling) {
+            ptr = sibling;
+        } else {
+            ptr = die_end;
+            ++depth;
+        }
+    }
+    *ptr_inout = ptr;
+    return DW_DLV_OK;
+}
+
+static int
+init_cursor(Dwarf_Debug dbg,
+    Dwarf_CU_Context context,
+    Dwarf_Die_Cursor *cursor,
+    Dwarf_Error *error)
+{
+    Dwarf_Bool is_info = context->cc_is_info;
+    Dwarf_Unsigned headerlen = 0;
+    int res = 0;
+
+    res = _dwarf_length_of_cu_header(dbg, context->cc_debug_offset,
+        is_info, &headerlen, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    memset(cursor, 0, sizeof *cursor);
+    cursor->dc_context = context;
+    cursor->dc_section = is_info ? dbg->de_debug_info.dss_data :
+        dbg->de_debug_types.dss_data;
+    cursor->dc_end = _dwarf_calculate_info_section_end_ptr(context);
+    cursor->dc_next = cursor->dc_section + context->cc_debug_offset +
+        headerlen;
+    cursor->dc_level = -1;
+
+    /*  As dwarf_siblingof_b() does, for the DWARF5 forms relying
+        on the CU DIE. */
+    context->cc_cu_die_offset_present = TRUE;
+    context->cc_cu_die_global_sec_offset = context->cc_debug_offset +
+        headerlen;
+    return DW_DLV_OK;
+}
+
+int
+dwarf_die_cursor_init(Dwarf_Debug dbg,
+    Dwarf_Bool is_info,
+    Dwarf_Die_Cursor *cursor,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = 0;
+
+    if (dbg == NULL) {
+        _dwarf_error(NULL, error, DW_DLE_DBG_NULL);
+        return DW_DLV_ERROR;
+    }
+    context = is_info ? dbg->de_info_reading.de_cu_context :
+        dbg->de_types_reading.de_cu_context;
+    if (context == NULL) {
+        _dwarf_error(dbg, error, DW_DLE_DBG_NO_CU_CONTEXT);
+        return DW_DLV_ERROR;
+    }
+    return init_cursor(dbg, context, cursor, error);
+}
+
+int
+dwarf_die_cursor_init_b(Dwarf_Die die,
+    Dwarf_Die_Cursor *cursor,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = 0;
+
+    CHECK_DIE(die, DW_DLV_ERROR);
+    context = die->di_cu_context;
+    return init_cursor(context->cc_dbg, context, cursor, error);
+}
+
+int
+dwarf_die_cursor_next(Dwarf_Die_Cursor *cursor,
+    Dwarf_Error *error)
+{
+    Dwarf_Small *ptr = cursor->dc_next;
+    Dwarf_Small *end = cursor->dc_end;
+    Dwarf_Abbrev_List abbrev = 0;
+    Dwarf_Small *attrs = 0;
+    int level = cursor->dc_level + 1;
+    int res = 0;
+
+    if (cursor->dc_attrs) {
+        /*  Move past the current DIE, and maybe its children. */
+        if (!cursor->dc_die_end) {
+            res = skip_attrs(cursor, cursor->dc_abbrev, cursor->dc_attrs,
+                &cursor->dc_die_end, &cursor->dc_sibling, error);
+            if (res != DW_DLV_OK) {
+                return res;
+            }
+        }
+        ptr = cursor->dc_die_end;
+        level = cursor->dc_level;
+        if (cursor->dc_has_children) {
+            if (!cursor->dc_skip) {
+                ++level;
+            } else if (cursor->dc_sibling) {
+                ptr = cursor->dc_sibling;
+            } else {
+                res = skip_subtree(cursor, &ptr, error);
+                if (res != DW_DLV_OK) {
+                    return res;
+                }
+            }
+        }
+        cursor->dc_attrs = 0;
+    }
+
+    /*  Null entries end lists of siblings. */
+    while (ptr < end && *ptr == 0) {
+        --level;
+        ++ptr;
+    }
+    if (ptr >= end || level < 0 || (level == 0 && cursor->dc_level >= 0)) {
+        /*  Nothing follows the CU DIE's children. */
+        cursor->dc_next = end;
+        return DW_DLV_NO_ENTRY;
+    }
+
+    res = read_abbrev(cursor, ptr, &abbrev, &attrs, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    cursor->dc_next = 0;
+    cursor->dc_attrs = attrs;
+    cursor->dc_abbrev = abbrev;
+    cursor->dc_die_end = 0;
+    cursor->dc_sibling = 0;
+    cursor->dc_skip = FALSE;
+    cursor->dc_offset = ptr - cursor->dc_section;
+    cursor->dc_tag = abbrev->abl_tag;
+    cursor->dc_has_children = abbrev->abl_has_child;
+    cursor->dc_level = level;
+    return DW_DLV_OK;
+}
+
+void
+dwarf_die_cursor_skip_children(Dwarf_Die_Cursor *cursor)
+{
+    cursor->dc_skip = TRUE;
+}
+
+int
+dwarf_die_cursor_attrs(Dwarf_Die_Cursor *cursor,
+    Dwarf_Unsigned want,
+    Dwarf_Die_Attrs *attrs,
+    Dwarf_Error *error)
+{
+    Dwarf_Abbrev_List abbrev = cursor->dc_abbrev;
+
+    if (!cursor->dc_attrs) {
+        Dwarf_CU_Context context = cursor->dc_context;
+        _dwarf_error(context ? context->cc_dbg : NULL, error,
+            DW_DLE_DIE_NULL);
+        return DW_DLV_ERROR;
+    }
+    /*  Also tells dwarf_die_cursor_next() where to go. */
+    return read_attrs(cursor, abbrev->abl_abbrev_ptr, cursor->dc_attrs,
+        want, attrs, &cursor->dc_die_end, &cursor->dc_sibling, error);
+}
+
+int
+dwarf_die_cursor_attrs_at(Dwarf_Die_Cursor *cursor,
+    Dwarf_Off offset,
+    Dwarf_Unsigned want,
+    Dwarf_Die_Attrs *attrs,
+    Dwarf_Error *error)
+{
+    Dwarf_CU_Context context = cursor->dc_context;
+    Dwarf_Small *ptr = cursor->dc_section + offset;
+    Dwarf_Abbrev_List abbrev = 0;
+    Dwarf_Small *die_attrs = 0;
+    Dwarf_Small *die_end = 0;
+    Dwarf_Small *sibling = 0;
+    int res = 0;
+
+    if (offset <= context->cc_debug_offset || ptr >= cursor->dc_end ||
+        *ptr == 0) {
+        return DW_DLV_NO_ENTRY;
+    }
+    res = read_abbrev(cursor, ptr, &abbrev, &die_attrs, error);
+    if (res != DW_DLV_OK) {
+        return res;
+    }
+    return read_attrs(cursor, abbrev->abl_abbrev_ptr, die_attrs, want,
+        attrs, &die_end, &sibling, error);
+}
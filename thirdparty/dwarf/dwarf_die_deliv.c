@@ -463,13 +463,6 @@ _dwarf_make_CU_Context(Dwarf_Debug dbg,
         return DW_DLV_ERROR;
     }
 
-    cu_context->cc_abbrev_hash_table =
-        (Dwarf_Hash_Table) _dwarf_get_alloc(dbg, DW_DLA_HASH_TABLE, 1);
-    if (cu_context->cc_abbrev_hash_table == NULL) {
-        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
-        return DW_DLV_ERROR;
-    }
-
     cu_context->cc_debug_offset = offset;
 
     dis->de_last_offset = max_cu_global_offset;
@@ -1254,6 +1247,18 @@ _dwarf_next_die_info_ptr(Dwarf_Byte_Ptr die_info_ptr,
 
     *has_die_child = abbrev_list->abl_has_child;
 
+    if (abbrev_list->abl_has_fixed_size &&
+        !(want_AT_sibling && abbrev_list->abl_has_sibling)) {
+        /*  Skip all the attributes at once. */
+        if (abbrev_list->abl_fixed_size >
+            (Dwarf_Unsigned)(die_info_end - info_ptr)) {
+            _dwarf_error(dbg, error, DW_DLE_NEXT_DIE_PAST_END);
+            return DW_DLV_ERROR;
+        }
+        *next_die_ptr_out = info_ptr + abbrev_list->abl_fixed_size;
+        return DW_DLV_OK;
+    }
+
     abbrev_ptr = abbrev_list->abl_abbrev_ptr;
     abbrev_end = _dwarf_calculate_abbrev_section_end_ptr(cu_context);
 
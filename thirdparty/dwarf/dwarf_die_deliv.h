@@ -30,14 +30,26 @@
 
 /*
     This struct holds information about an abbreviation.
-    It is put in the hash table for abbreviations for
-    a compile-unit.
+    It is put in the abbreviation table for the compile-units
+    using it.
 */
 struct Dwarf_Abbrev_List_s {
     Dwarf_Unsigned abl_code;
     Dwarf_Half abl_tag;
     Dwarf_Half abl_has_child;
 
+    /*  Whether all attribute forms have a fixed size, so that
+        a DIE with this abbreviation can be skipped by adding
+        abl_fixed_size to the pointer past its code. */
+    Dwarf_Bool abl_has_fixed_size;
+    Dwarf_Bool abl_has_sibling;
+    Dwarf_Unsigned abl_fixed_size;
+    /*  When all forms before DW_AT_sibling have a fixed size, its
+        form (one of DW_FORM_ref1/2/4/8) and offset in the DIE
+        attribute values; else 0. */
+    Dwarf_Half abl_sibling_form;
+    Dwarf_Unsigned abl_sibling_offset;
+
     /*  Points to start of attribute and form pairs in the .debug_abbrev
         section for the abbrev. */
     Dwarf_Byte_Ptr abl_abbrev_ptr;
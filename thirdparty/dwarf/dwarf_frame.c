@@ -1740,6 +1740,26 @@ dwarf_get_fde_info_for_all_regs3(Dwarf_Fde fde,
     Dwarf_Addr * row_pc,
     Dwarf_Error * error)
 {
+    return dwarf_get_fde_info_for_all_regs3_b(fde,
+        pc_requested,
+        reg_table,
+        row_pc,
+        NULL,NULL,
+        error);
+}
+
+/*  Like dwarf_get_fde_info_for_all_regs3, but also returning
+    whether there are rows after the one returned, and
+    the pc at which the next row starts. */
+int
+dwarf_get_fde_info_for_all_regs3_b(Dwarf_Fde fde,
+    Dwarf_Addr pc_requested,
+    Dwarf_Regtable3 * reg_table,
+    Dwarf_Addr * row_pc,
+    Dwarf_Bool * has_more_rows,
+    Dwarf_Addr * subsequent_pc,
+    Dwarf_Error * error)
+{
 
     struct Dwarf_Frame_s fde_table;
     Dwarf_Sword i = 0;
@@ -1764,7 +1784,7 @@ dwarf_get_fde_info_for_all_regs3(Dwarf_Fde fde,
     res = _dwarf_get_fde_info_for_a_pc_row(fde, pc_requested,
         &fde_table,
         dbg->de_frame_cfa_col_number,
-        NULL,NULL,
+        has_more_rows,subsequent_pc,
         error);
     if (res != DW_DLV_OK) {
         dwarf_free_fde_table(&fde_table);
@@ -453,7 +453,7 @@ _dwarf_get_fde_list_internal(Dwarf_Debug dbg, Dwarf_Cie ** cie_data,
         there should be no FDEs. */
     if (cie_count > 0) {
         cie_list_ptr = (Dwarf_Cie *)
-            _dwarf_get_alloc(dbg, DW_DLA_LIST, cie_count);
+            _dwarf_get_alloc_persistent(dbg, DW_DLA_LIST, cie_count);
     } else {
         if (fde_count > 0) {
             dealloc_fde_cie_list_internal(head_fde_ptr, head_cie_ptr);
@@ -479,7 +479,7 @@ _dwarf_get_fde_list_internal(Dwarf_Debug dbg, Dwarf_Cie ** cie_data,
         lets not return DW_DLV_NO_ENTRY */
     if (fde_count > 0) {
         fde_list_ptr = (Dwarf_Fde *)
-            _dwarf_get_alloc(dbg, DW_DLA_LIST, fde_count);
+            _dwarf_get_alloc_persistent(dbg, DW_DLA_LIST, fde_count);
     }
 
     /* It is ok if fde_list_ptr is NULL, we just have no fdes. */
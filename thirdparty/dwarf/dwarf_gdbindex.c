@@ -182,6 +182,23 @@ dwarf_gdbindex_header(Dwarf_Debug dbg,
         dbg->de_debug_gdbindex.dss_data + 5*sizeof(gdbindex_offset_type),
         sizeof(gdbindex_offset_type));
 
+    /*  The areas must be in order and within the section, or the
+        entry accessors would read outside of it. */
+    if (indexptr->gi_cu_list_offset < sizeof(struct gi_fileheader_s) ||
+        indexptr->gi_types_cu_list_offset < indexptr->gi_cu_list_offset ||
+        indexptr->gi_address_area_offset <
+            indexptr->gi_types_cu_list_offset ||
+        indexptr->gi_symbol_table_offset <
+            indexptr->gi_address_area_offset ||
+        indexptr->gi_constant_pool_offset <
+            indexptr->gi_symbol_table_offset ||
+        indexptr->gi_constant_pool_offset >
+            indexptr->gi_section_length) {
+        dwarf_dealloc(dbg,indexptr,DW_DLA_GDBINDEX);
+        _dwarf_error(dbg, error, DW_DLE_ERRONEOUS_GDB_INDEX_SECTION);
+        return (DW_DLV_ERROR);
+    }
+
     res = set_base(dbg,&indexptr->gi_culisthdr,
         dbg->de_debug_gdbindex.dss_data + indexptr->gi_cu_list_offset,
         dbg->de_debug_gdbindex.dss_data + indexptr->gi_types_cu_list_offset,
@@ -424,8 +441,12 @@ dwarf_gdbindex_cuvector_length(Dwarf_Gdbindex gdbindex,
     Dwarf_Unsigned val = 0;
     unsigned fieldlen =  gdbindex->gi_cuvectorhdr.dg_entry_length;
 
+    if (cuvector_offset >= (Dwarf_Unsigned)(end - base)) {
+        _dwarf_error(gdbindex->gi_dbg, error,DW_DLE_GDB_INDEX_INDEX_ERROR);
+        return DW_DLV_ERROR;
+    }
     base += cuvector_offset;
-    if ((base + fieldlen) >= end) {
+    if ((base + fieldlen) > end) {
         _dwarf_error(gdbindex->gi_dbg, error,DW_DLE_GDB_INDEX_INDEX_ERROR);
         return DW_DLV_ERROR;
     }
@@ -452,13 +473,19 @@ dwarf_gdbindex_cuvector_inner_attributes(Dwarf_Gdbindex gdbindexptr,
     Dwarf_Unsigned val = 0;
     unsigned fieldlen = gdbindexptr->gi_cuvectorhdr.dg_entry_length;
 
-    base += cuvector_offset;
-    if ((base+fieldlen) >= end) {
+    if (cuvector_offset >= (Dwarf_Unsigned)(end - base) ||
+        innerindex >= (Dwarf_Unsigned)(end - base - cuvector_offset) /
+            fieldlen) {
         _dwarf_error(gdbindexptr->gi_dbg, error,DW_DLE_GDB_INDEX_INDEX_ERROR);
         return DW_DLV_ERROR;
     }
+    base += cuvector_offset;
     base += fieldlen;
     base += innerindex*fieldlen;
+    if ((base+fieldlen) > end) {
+        _dwarf_error(gdbindexptr->gi_dbg, error,DW_DLE_GDB_INDEX_INDEX_ERROR);
+        return DW_DLV_ERROR;
+    }
 
     READ_GDBINDEX(val ,Dwarf_Unsigned,
         base,
@@ -513,6 +540,76 @@ dwarf_gdbindex_string_by_offset(Dwarf_Gdbindex gdbindexptr,
     return DW_DLV_OK;
 }
 
+/*  The symbol table is an open addressing hash table,
+    with gdb's mapped_index_string_hash() as the hash
+    function (case insensitive from version 5 on).
+    Names are compared case sensitively, as gdb does
+    by default. */
+int
+dwarf_gdbindex_symboltable_lookup(Dwarf_Gdbindex gdbindexptr,
+    const char     * name,
+    Dwarf_Unsigned * symtab_index,
+    Dwarf_Unsigned * cu_vector_offset,
+    Dwarf_Error    * error)
+{
+    Dwarf_Unsigned count = gdbindexptr->gi_symboltablehdr.dg_count;
+    Dwarf_Small *pool = gdbindexptr->gi_string_pool;
+    Dwarf_Small *section_end = gdbindexptr->gi_section_data +
+        gdbindexptr->gi_section_length;
+    Dwarf_Unsigned namelen = strlen(name) + 1;
+    Dwarf_Unsigned mask = count - 1;
+    Dwarf_Unsigned probes = 0;
+    gdbindex_offset_type hash = 0;
+    Dwarf_Unsigned slot = 0;
+    Dwarf_Unsigned step = 0;
+    const unsigned char *p = 0;
+
+    if (count == 0) {
+        return DW_DLV_NO_ENTRY;
+    }
+    if (count & mask) {
+        _dwarf_error(gdbindexptr->gi_dbg, error,
+            DW_DLE_GDB_INDEX_COUNT_ERROR);
+        return DW_DLV_ERROR;
+    }
+    for (p = (const unsigned char *)name; *p; ++p) {
+        unsigned c = *p;
+        if (gdbindexptr->gi_version >= 5 && c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = hash * 67 + c - 113;
+    }
+    slot = hash & mask;
+    step = ((hash * 17) & mask) | 1;
+    for (probes = 0; probes < count; ++probes) {
+        Dwarf_Small *base = gdbindexptr->gi_symboltablehdr.dg_base +
+            slot*gdbindexptr->gi_symboltablehdr.dg_entry_length;
+        unsigned fieldlen = gdbindexptr->gi_symboltablehdr.dg_fieldlen;
+        Dwarf_Unsigned stroffset = 0;
+        Dwarf_Unsigned cuoffset = 0;
+
+        READ_GDBINDEX(stroffset ,Dwarf_Unsigned,
+            base,
+            fieldlen);
+        READ_GDBINDEX(cuoffset ,Dwarf_Unsigned,
+            base + fieldlen,
+            fieldlen);
+        if (!stroffset && !cuoffset) {
+            /* Empty slot. */
+            return DW_DLV_NO_ENTRY;
+        }
+        if (stroffset <= (Dwarf_Unsigned)(section_end - pool) &&
+            namelen <= (Dwarf_Unsigned)(section_end - pool) - stroffset &&
+            memcmp(pool + stroffset, name, namelen) == 0) {
+            *symtab_index = slot;
+            *cu_vector_offset = cuoffset;
+            return DW_DLV_OK;
+        }
+        slot = (slot + step) & mask;
+    }
+    return DW_DLV_NO_ENTRY;
+}
+
 
 
 
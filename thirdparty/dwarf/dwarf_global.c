@@ -587,11 +587,27 @@ dwarf_get_cu_die_offset_given_cu_header_offset_b(Dwarf_Debug dbg,
     Dwarf_Off in_cu_header_offset,
     Dwarf_Bool is_info,
     Dwarf_Off * out_cu_die_offset,
-    UNUSEDARG Dwarf_Error * err)
+    Dwarf_Error * err)
 {
     Dwarf_Off headerlen = 0;
+    Dwarf_Unsigned section_size = 0;
     int cres = 0;
 
+    /*  Callers may get here before anything else has read
+        the section, e.g. with offsets from .gdb_index. */
+    cres = is_info ? _dwarf_load_debug_info(dbg, err) :
+        _dwarf_load_debug_types(dbg, err);
+    if (cres != DW_DLV_OK) {
+        return cres;
+    }
+    section_size = is_info ? dbg->de_debug_info.dss_size :
+        dbg->de_debug_types.dss_size;
+    /*  Same heuristic as dwarf_global_name_offsets(). */
+    if ((in_cu_header_offset + 10) >= section_size) {
+        _dwarf_error(dbg, err, DW_DLE_OFFSET_BAD);
+        return DW_DLV_ERROR;
+    }
+
     cres = _dwarf_length_of_cu_header(dbg, in_cu_header_offset,is_info,
         &headerlen,err);
     if (cres != DW_DLV_OK) {
@@ -38,6 +38,74 @@
 */
 #define BYTESLEBMAX 10
 
+#define TRUE  1
+#define FALSE 0
+
+/*  Word-at-a-time decoding.  When at least 8 bytes are readable, a
+    value of up to 8 bytes (56 bits) is decoded from a single
+    little-endian load: the first clear continuation bit gives the
+    length, and the 7-bit groups are packed with three mask-and-shift
+    steps, without a data-dependent branch per byte.  Single-byte
+    values are still tested for first: that branch predicts well and,
+    unlike the length computation, does not delay finding where the
+    next value starts.  Longer values and the last bytes of a section
+    take the byte loop. */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LEB_WORD_AT_A_TIME 1
+#endif
+
+#if defined(LEB_WORD_AT_A_TIME) && defined(__x86_64__)
+#define LEB_X86_64 1
+#include <immintrin.h>
+#endif
+
+#ifdef LEB_WORD_AT_A_TIME
+#define LEB_CONT_BITS 0x8080808080808080ULL
+#define LEB_DATA_BITS 0x7f7f7f7f7f7f7f7fULL
+
+static inline Dwarf_Unsigned
+leb_load_word(const Dwarf_Small *p)
+{
+    Dwarf_Unsigned word = 0;
+    memcpy(&word, p, sizeof word);
+    return word;
+}
+
+/*  Packs the 7-bit groups of the low len bytes of word, 1 <= len <= 8. */
+static inline Dwarf_Unsigned
+leb_pack_word(Dwarf_Unsigned word, unsigned len)
+{
+    word &= LEB_DATA_BITS >> (64 - 8 * len);
+    word = ((word & 0x7f007f007f007f00ULL) >> 1) |
+        (word & 0x007f007f007f007fULL);
+    word = ((word & 0x3fff00003fff0000ULL) >> 2) |
+        (word & 0x00003fff00003fffULL);
+    word = ((word & 0x0fffffff00000000ULL) >> 4) |
+        (word & 0x000000000fffffffULL);
+    return word;
+}
+
+static inline Dwarf_Signed
+leb_sign_extend(Dwarf_Unsigned number, unsigned len)
+{
+    unsigned shift = 64 - 7 * len;
+    return ((Dwarf_Signed)(number << shift)) >> shift;
+}
+
+/*  Returns the length of the value in the low bytes of word, or 0
+    if it is longer than 8 bytes. */
+static inline unsigned
+leb_word_length(Dwarf_Unsigned word)
+{
+    Dwarf_Unsigned stops = ~word & LEB_CONT_BITS;
+    if (!stops) {
+        return 0;
+    }
+    return (__builtin_ctzll(stops) >> 3) + 1;
+}
+#endif /* LEB_WORD_AT_A_TIME */
+
 
 /* Decode ULEB */
 Dwarf_Unsigned
@@ -143,21 +211,33 @@ _dwarf_decode_u_leb128_chk(Dwarf_Small * leb128, Dwarf_Word * leb128_length,
         }
         *outval = *leb128;
         return DW_DLV_OK;
-    } else {
-        if ((leb128+1) >=endptr) {
-            return DW_DLV_ERROR;
-        }
-        if ((*(leb128 + 1) & 0x80) == 0) {
+    }
+#ifdef LEB_WORD_AT_A_TIME
+    if (endptr - leb128 >= 8) {
+        Dwarf_Unsigned word = leb_load_word(leb128);
+        unsigned len = leb_word_length(word);
+        if (len) {
             if (leb128_length) {
-                *leb128_length = 2;
+                *leb128_length = len;
             }
-            word_number = *leb128 & 0x7f;
-            word_number |= (*(leb128 + 1) & 0x7f) << 7;
-            *outval = word_number;
+            *outval = leb_pack_word(word, len);
             return DW_DLV_OK;
         }
-        /* Gets messy to hand-inline more byte checking. */
     }
+#endif
+    if ((leb128+1) >=endptr) {
+        return DW_DLV_ERROR;
+    }
+    if ((*(leb128 + 1) & 0x80) == 0) {
+        if (leb128_length) {
+            *leb128_length = 2;
+        }
+        word_number = *leb128 & 0x7f;
+        word_number |= (*(leb128 + 1) & 0x7f) << 7;
+        *outval = word_number;
+        return DW_DLV_OK;
+    }
+    /* Gets messy to hand-inline more byte checking. */
 
     /*  The rest handles long numbers Because the 'number' may be larger
         than the default int/unsigned, we must cast the 'byte' before
@@ -262,6 +342,26 @@ _dwarf_decode_s_leb128_chk(Dwarf_Small * leb128, Dwarf_Word * leb128_length,
     if (leb128 >= endptr) {
         return DW_DLV_ERROR;
     }
+    if ((*leb128 & 0x80) == 0) {
+        if (leb128_length) {
+            *leb128_length = 1;
+        }
+        *outval = (Dwarf_Signed)(*leb128 ^ 0x40) - 0x40;
+        return DW_DLV_OK;
+    }
+#ifdef LEB_WORD_AT_A_TIME
+    if (endptr - leb128 >= 8) {
+        Dwarf_Unsigned word = leb_load_word(leb128);
+        unsigned len = leb_word_length(word);
+        if (len) {
+            if (leb128_length) {
+                *leb128_length = len;
+            }
+            *outval = leb_sign_extend(leb_pack_word(word, len), len);
+            return DW_DLV_OK;
+        }
+    }
+#endif
     byte   = *leb128;
     for (;;) {
         sign = byte & 0x40;
@@ -297,3 +397,362 @@ _dwarf_decode_s_leb128_chk(Dwarf_Small * leb128, Dwarf_Word * leb128_length,
     return DW_DLV_OK;
 }
 
+
+
+/*  Batch decoding.
+
+    The kernels decode count consecutive values starting at data,
+    stopping with DW_DLV_ERROR at the first malformed or truncated
+    one.  The SIMD kernels find all value boundaries of a 16 or 32
+    byte block at once from the sign bits.  Blocks of single-byte
+    values, the common case in DWARF, are widened without looking at
+    the values one by one, and blocks of one and two byte values are
+    assembled in SIMD registers.  Other values are packed with
+    leb_pack_word; values longer than 8 bytes, and the last bytes of
+    the buffer, go through the checked single-value decoders. */
+
+typedef int (*leb_batch_kernel)(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned count, int is_signed,
+    Dwarf_Small **next);
+
+static int
+leb_decode_one(Dwarf_Small *p, Dwarf_Small *end,
+    Dwarf_Unsigned *value, int is_signed, Dwarf_Word *len)
+{
+    if (is_signed) {
+        Dwarf_Signed svalue = 0;
+        int res = _dwarf_decode_s_leb128_chk(p, len, &svalue, end);
+        *value = (Dwarf_Unsigned)svalue;
+        return res;
+    }
+    return _dwarf_decode_u_leb128_chk(p, len, value, end);
+}
+
+static int
+leb_batch_scalar(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned count, int is_signed,
+    Dwarf_Small **next)
+{
+    Dwarf_Unsigned n = 0;
+
+    for (n = 0; n < count; ++n) {
+        Dwarf_Word len = 0;
+        if (leb_decode_one(data, end, &values[n], is_signed, &len) !=
+            DW_DLV_OK) {
+            *next = data;
+            return DW_DLV_ERROR;
+        }
+        data += len;
+    }
+    *next = data;
+    return DW_DLV_OK;
+}
+
+#ifdef LEB_X86_64
+/*  Decodes the values ending in a block, whose terminating bytes are
+    flagged in stops, up to the first one longer than 8 bytes.
+    Returns the number of bytes consumed. */
+static inline unsigned
+leb_decode_words(Dwarf_Small *p, unsigned stops,
+    Dwarf_Unsigned *values, Dwarf_Unsigned *n, Dwarf_Unsigned count,
+    int is_signed)
+{
+    unsigned start = 0;
+
+    while (stops && *n < count) {
+        unsigned stop = __builtin_ctz(stops);
+        unsigned len = stop - start + 1;
+        Dwarf_Unsigned value = 0;
+
+        if (len > 8) {
+            break;
+        }
+        value = leb_pack_word(leb_load_word(p + start), len);
+        values[*n] = is_signed ?
+            (Dwarf_Unsigned)leb_sign_extend(value, len) : value;
+        ++*n;
+        start = stop + 1;
+        stops &= stops - 1;
+    }
+    return start;
+}
+
+/*  Sign extends the 7-bit values in the bytes of v. */
+static inline __m128i
+leb_sign_extend_bytes(__m128i v)
+{
+    __m128i bit6 = _mm_set1_epi8(0x40);
+    return _mm_sub_epi8(_mm_xor_si128(v, bit6), bit6);
+}
+
+/*  Widens a block of 16 single-byte values. */
+static inline void
+leb_store_bytes_sse2(Dwarf_Unsigned *values, __m128i v, int is_signed)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v16[2], v32[4];
+    int i = 0;
+
+    if (is_signed) {
+        v = leb_sign_extend_bytes(v);
+    }
+    v16[0] = _mm_unpacklo_epi8(v, is_signed ? _mm_cmpgt_epi8(zero, v) : zero);
+    v16[1] = _mm_unpackhi_epi8(v, is_signed ? _mm_cmpgt_epi8(zero, v) : zero);
+    for (i = 0; i < 2; ++i) {
+        __m128i ext = is_signed ? _mm_srai_epi16(v16[i], 15) : zero;
+        v32[2 * i] = _mm_unpacklo_epi16(v16[i], ext);
+        v32[2 * i + 1] = _mm_unpackhi_epi16(v16[i], ext);
+    }
+    for (i = 0; i < 4; ++i) {
+        __m128i ext = is_signed ? _mm_srai_epi32(v32[i], 31) : zero;
+        _mm_storeu_si128((__m128i *)(values + 4 * i),
+            _mm_unpacklo_epi32(v32[i], ext));
+        _mm_storeu_si128((__m128i *)(values + 4 * i + 2),
+            _mm_unpackhi_epi32(v32[i], ext));
+    }
+}
+
+/*  Decodes the values ending in a block of one and two byte values,
+    cont flagging its continuation bytes.  The 14-bit value ending at
+    each byte is assembled for all 16 positions at once, and the ones
+    at the terminating bytes picked.  Returns the bytes consumed. */
+static inline unsigned
+leb_decode_short_sse2(__m128i block, unsigned cont,
+    Dwarf_Unsigned *values, Dwarf_Unsigned *n, int is_signed)
+{
+    __m128i low7 = _mm_set1_epi16(0x00ff);
+    __m128i data = _mm_and_si128(block, _mm_set1_epi8(0x7f));
+    /*  Bytes preceded by a continuation byte. */
+    __m128i second = _mm_slli_si128(
+        _mm_cmplt_epi8(block, _mm_setzero_si128()), 1);
+    __m128i lo = _mm_or_si128(
+        _mm_and_si128(second, _mm_slli_si128(data, 1)),
+        _mm_andnot_si128(second, data));
+    __m128i hi = _mm_and_si128(second, data);
+    __m128i words[2];
+    unsigned short lanes[16];
+    unsigned stops = ~cont & 0xffff;
+    unsigned used = 32 - __builtin_clz(stops);
+    int i = 0;
+
+    words[0] = _mm_unpacklo_epi8(lo, hi);
+    words[1] = _mm_unpackhi_epi8(lo, hi);
+    for (i = 0; i < 2; ++i) {
+        words[i] = _mm_or_si128(_mm_and_si128(words[i], low7),
+            _mm_srli_epi16(_mm_andnot_si128(low7, words[i]), 1));
+        _mm_storeu_si128((__m128i *)(lanes + 8 * i), words[i]);
+    }
+    do {
+        unsigned stop = __builtin_ctz(stops);
+        Dwarf_Unsigned value = lanes[stop];
+        if (is_signed) {
+            /*  Shift the sign bit, 6 or 13, into bit 15. */
+            unsigned shift = 9 - 7 * (((cont << 1) >> stop) & 1);
+            value = (Dwarf_Unsigned)(Dwarf_Signed)
+                ((short)(value << shift) >> shift);
+        }
+        values[(*n)++] = value;
+        stops &= stops - 1;
+    } while (stops);
+    return used;
+}
+
+/*  Decodes the values ending in the 16 bytes at p.  Returns the bytes
+    consumed, or 0 if the value at p is longer than 8 bytes. */
+static inline unsigned
+leb_decode_block16(Dwarf_Small *p, __m128i block,
+    Dwarf_Unsigned *values, Dwarf_Unsigned *n, Dwarf_Unsigned count,
+    int is_signed)
+{
+    unsigned cont = (unsigned)_mm_movemask_epi8(block);
+    unsigned stops = ~cont & 0xffff;
+
+    if (count - *n >= 16) {
+        if (!cont) {
+            leb_store_bytes_sse2(values + *n, block, is_signed);
+            *n += 16;
+            return 16;
+        }
+        if (stops && !(cont & (cont << 1))) {
+            return leb_decode_short_sse2(block, cont, values, n,
+                is_signed);
+        }
+    }
+    return leb_decode_words(p, stops, values, n, count, is_signed);
+}
+
+/*  Falls back to the scalar decoder for one value. */
+static inline int
+leb_decode_long(Dwarf_Small **data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned *n, int is_signed)
+{
+    Dwarf_Word len = 0;
+    int res = leb_decode_one(*data, end, &values[*n], is_signed, &len);
+    if (res == DW_DLV_OK) {
+        *data += len;
+        ++*n;
+    }
+    return res;
+}
+
+static int
+leb_batch_sse2(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned count, int is_signed,
+    Dwarf_Small **next)
+{
+    Dwarf_Unsigned n = 0;
+
+    /*  8 bytes of slack after each block for the word loads. */
+    while (n < count && end - data >= 16 + 8) {
+        __m128i block = _mm_loadu_si128((const __m128i *)data);
+        unsigned used = leb_decode_block16(data, block, values, &n,
+            count, is_signed);
+        if (!used) {
+            if (leb_decode_long(&data, end, values, &n, is_signed) !=
+                DW_DLV_OK) {
+                *next = data;
+                return DW_DLV_ERROR;
+            }
+            continue;
+        }
+        data += used;
+    }
+    return leb_batch_scalar(data, end, values + n, count - n, is_signed,
+        next);
+}
+
+__attribute__((target("avx2"))) static inline void
+leb_store_bytes_avx2(Dwarf_Unsigned *values, __m256i v, int is_signed)
+{
+    __m128i halves[2];
+    int i = 0;
+
+    halves[0] = _mm256_castsi256_si128(v);
+    halves[1] = _mm256_extracti128_si256(v, 1);
+    for (i = 0; i < 2; ++i) {
+        __m128i half = halves[i];
+        int j = 0;
+
+        if (is_signed) {
+            half = leb_sign_extend_bytes(half);
+        }
+        for (j = 0; j < 4; ++j) {
+            __m256i wide = is_signed ? _mm256_cvtepi8_epi64(half) :
+                _mm256_cvtepu8_epi64(half);
+            _mm256_storeu_si256((__m256i *)(values + 16 * i + 4 * j),
+                wide);
+            half = _mm_srli_si128(half, 4);
+        }
+    }
+}
+
+/*  Same as leb_batch_sse2, but takes runs of single-byte values 32 at
+    a time. */
+__attribute__((target("avx2"))) static int
+leb_batch_avx2(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned count, int is_signed,
+    Dwarf_Small **next)
+{
+    Dwarf_Unsigned n = 0;
+
+    while (n < count && end - data >= 32 + 8) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)data);
+        unsigned used = 0;
+
+        if (!_mm256_movemask_epi8(block) && count - n >= 32) {
+            leb_store_bytes_avx2(values + n, block, is_signed);
+            n += 32;
+            data += 32;
+            continue;
+        }
+        used = leb_decode_block16(data, _mm256_castsi256_si128(block),
+            values, &n, count, is_signed);
+        if (!used) {
+            if (leb_decode_long(&data, end, values, &n, is_signed) !=
+                DW_DLV_OK) {
+                *next = data;
+                return DW_DLV_ERROR;
+            }
+            continue;
+        }
+        data += used;
+    }
+    return leb_batch_sse2(data, end, values + n, count - n, is_signed,
+        next);
+}
+#endif /* LEB_X86_64 */
+
+static leb_batch_kernel
+leb_kernel_for(int kernel)
+{
+    switch (kernel) {
+#ifdef LEB_X86_64
+    case DW_LEB128_KERNEL_SSE2:
+        return leb_batch_sse2;
+    case DW_LEB128_KERNEL_AVX2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return leb_batch_avx2;
+        }
+        return 0;
+#endif
+    case DW_LEB128_KERNEL_SCALAR:
+        return leb_batch_scalar;
+    default:
+        return 0;
+    }
+}
+
+static int
+leb_kernel_best(void)
+{
+    if (leb_kernel_for(DW_LEB128_KERNEL_AVX2)) {
+        return DW_LEB128_KERNEL_AVX2;
+    }
+    if (leb_kernel_for(DW_LEB128_KERNEL_SSE2)) {
+        return DW_LEB128_KERNEL_SSE2;
+    }
+    return DW_LEB128_KERNEL_SCALAR;
+}
+
+/*  Selected on first use.  Racing initializations store the same
+    value. */
+static int leb_kernel_current;
+
+static leb_batch_kernel
+leb_kernel_get(void)
+{
+    int kernel = __atomic_load_n(&leb_kernel_current, __ATOMIC_RELAXED);
+    if (kernel == DW_LEB128_KERNEL_AUTO) {
+        kernel = leb_kernel_best();
+        __atomic_store_n(&leb_kernel_current, kernel, __ATOMIC_RELAXED);
+    }
+    return leb_kernel_for(kernel);
+}
+
+int
+dwarf_set_leb128_kernel(int kernel)
+{
+    if (kernel == DW_LEB128_KERNEL_AUTO || !leb_kernel_for(kernel)) {
+        kernel = leb_kernel_best();
+    }
+    __atomic_store_n(&leb_kernel_current, kernel, __ATOMIC_RELAXED);
+    return kernel;
+}
+
+int
+dwarf_decode_leb128_batch(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Unsigned *values, Dwarf_Unsigned count,
+    Dwarf_Small **next)
+{
+    return leb_kernel_get()(data, end, values, count, FALSE, next);
+}
+
+int
+dwarf_decode_signed_leb128_batch(Dwarf_Small *data, Dwarf_Small *end,
+    Dwarf_Signed *values, Dwarf_Unsigned count,
+    Dwarf_Small **next)
+{
+    return leb_kernel_get()(data, end, (Dwarf_Unsigned *)values, count,
+        TRUE, next);
+}
@@ -243,9 +243,9 @@ struct Dwarf_CU_Context_s {
         Set when the CU die is accessed by dwarf_siblingof(). */
     Dwarf_Unsigned cc_cu_die_global_sec_offset;
 
-    Dwarf_Byte_Ptr cc_last_abbrev_ptr;
-    Dwarf_Byte_Ptr cc_last_abbrev_endptr;
-    Dwarf_Hash_Table cc_abbrev_hash_table;
+    /*  Shared with the other CUs using the same abbreviations,
+        see _dwarf_get_abbrev_for_code().  Null until first used. */
+    Dwarf_Abbrev_Table cc_abbrev_table;
     Dwarf_CU_Context cc_next;
 
     /*unsigned char cc_offset_length; */
@@ -554,6 +554,27 @@ struct Dwarf_Debug_s {
         Null till a tree is created */
     void * de_alloc_tree;
 
+    /*  Bump-pointer arenas, see dwarf_alloc.c.
+        de_arena is the whole-Dwarf_Debug arena (null until
+        dwarf_set_arena_mode() first enables it), de_sub_arena the
+        innermost dwarf_arena_begin() scope (null outside any). */
+    struct Dwarf_Arena_s *de_arena;
+    Dwarf_Bool de_arena_mode;
+    struct Dwarf_Arena_s *de_sub_arena;
+    /*  Chunks released by dwarf_arena_end(), for reuse. */
+    void *de_arena_free_chunks;
+
+    /*  Counters reported by dwarf_get_alloc_stats(). */
+    Dwarf_Unsigned de_alloc_count;
+    Dwarf_Unsigned de_alloc_bytes;
+    Dwarf_Unsigned de_malloc_count;
+
+    /*  Abbreviation tables of all CU contexts, hashed by their
+        .debug_abbrev offset.  See dwarf_util.c. */
+    Dwarf_Abbrev_Table *de_abbrev_tables;
+    Dwarf_Unsigned de_abbrev_table_buckets;
+    Dwarf_Unsigned de_abbrev_table_count;
+
     /*  These fields are used to process debug_frame section.  **Updated
         by dwarf_get_fde_list in dwarf_frame.h */
     /*  Points to contiguous block of pointers to Dwarf_Cie_s structs. */
@@ -426,54 +426,62 @@ _dwarf_valid_form_we_know(UNUSEDARG Dwarf_Debug dbg,
     return FALSE;
 }
 
-/*  This function returns a pointer to a Dwarf_Abbrev_List_s
-    struct for the abbrev with the given code.  It puts the
-    struct on the appropriate hash table.  It also adds all
-    the abbrev between the last abbrev added and this one to
-    the hash table.  In other words, the .debug_abbrev section
-    is scanned sequentially from the top for an abbrev with
-    the given code.  All intervening abbrevs are also put
-    into the hash table.
-
-    This function hashes the given code, and checks the chain
-    at that hash table entry to see if a Dwarf_Abbrev_List_s
-    with the given code exists.  If yes, it returns a pointer
-    to that struct.  Otherwise, it scans the .debug_abbrev
-    section from the last byte scanned for that CU till either
-    an abbrev with the given code is found, or an abbrev code
-    of 0 is read.  It puts Dwarf_Abbrev_List_s entries for all
-    abbrev's read till that point into the hash table.  The
-    hash table contains both a head pointer and a tail pointer
-    for each entry.
-
-    While the lists can move and entries can be moved between
-    lists on reallocation, any given Dwarf_Abbrev_list entry
-    never moves once allocated, so the pointer is safe to return.
-
-    See also dwarf_get_abbrev() in dwarf_abbrev.c.
+/*  Abbreviation codes up to this much past the number of
+    abbreviations read so far are stored in the flat array.  */
+#define ABBREV_FLAT_SLACK 64
+
+/*  Size of the values of a form in the DIEs of the CUs using
+    table, if it does not depend on the value.  */
+static Dwarf_Bool
+fixed_form_size(Dwarf_Debug dbg, Dwarf_Abbrev_Table table,
+    Dwarf_Unsigned form, Dwarf_Unsigned *size_out)
+{
+    switch (form) {
+    case DW_FORM_flag_present:
+        *size_out = 0;
+        return TRUE;
+    case DW_FORM_data1:
+    case DW_FORM_ref1:
+    case DW_FORM_flag:
+        *size_out = 1;
+        return TRUE;
+    case DW_FORM_data2:
+    case DW_FORM_ref2:
+        *size_out = 2;
+        return TRUE;
+    case DW_FORM_data4:
+    case DW_FORM_ref4:
+        *size_out = 4;
+        return TRUE;
+    case DW_FORM_data8:
+    case DW_FORM_ref8:
+    case DW_FORM_ref_sig8:
+        *size_out = 8;
+        return TRUE;
+    case DW_FORM_addr:
+        *size_out = table->abt_address_size ? table->abt_address_size :
+            dbg->de_pointer_size;
+        return TRUE;
+    case DW_FORM_ref_addr:
+        *size_out = table->abt_ref_addr_size;
+        return TRUE;
+    case DW_FORM_strp:
+    case DW_FORM_sec_offset:
+    case DW_FORM_GNU_ref_alt:
+    case DW_FORM_GNU_strp_alt:
+    case DW_FORM_strp_sup:
+        *size_out = table->abt_length_size;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
 
-    Returns NULL on error.  */
-int
-_dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
-    Dwarf_Abbrev_List *list_out,
-    Dwarf_Error *error)
+static int
+abbrev_sparse_insert(Dwarf_Debug dbg, Dwarf_Hash_Table hash_table_base,
+    Dwarf_Abbrev_List entry)
 {
-    Dwarf_Debug dbg = cu_context->cc_dbg;
-    Dwarf_Hash_Table hash_table_base = cu_context->cc_abbrev_hash_table;
-    Dwarf_Hash_Table_Entry entry_base = 0;
     Dwarf_Hash_Table_Entry entry_cur = 0;
-    Dwarf_Word hash_num = 0;
-    Dwarf_Unsigned abbrev_code = 0;
-    Dwarf_Unsigned abbrev_tag  = 0;
-    Dwarf_Unsigned attr_name = 0;
-    Dwarf_Unsigned attr_form = 0;
-    Dwarf_Abbrev_List hash_abbrev_entry = 0;
-    Dwarf_Abbrev_List inner_list_entry = 0;
-    Dwarf_Hash_Table_Entry inner_hash_entry = 0;
-
-    Dwarf_Byte_Ptr abbrev_ptr = 0;
-    Dwarf_Byte_Ptr end_abbrev_ptr = 0;
-    unsigned hashable_val = 0;
 
     if (!hash_table_base->tb_entries) {
         hash_table_base->tb_table_entry_count =  HT_MULTIPLE;
@@ -483,9 +491,8 @@ _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
             DW_DLA_HASH_TABLE_ENTRY,
             hash_table_base->tb_table_entry_count);
         if (!hash_table_base->tb_entries) {
-            return DW_DLV_NO_ENTRY;
+            return DW_DLV_ERROR;
         }
-
     } else if (hash_table_base->tb_total_abbrev_count >
         ( hash_table_base->tb_table_entry_count * HT_MULTIPLE) ) {
         struct Dwarf_Hash_Table_s newht;
@@ -496,9 +503,8 @@ _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
             (struct  Dwarf_Hash_Table_Entry_s *)_dwarf_get_alloc(dbg,
             DW_DLA_HASH_TABLE_ENTRY,
             newht.tb_table_entry_count);
-
         if (!newht.tb_entries) {
-            return DW_DLV_NO_ENTRY;
+            return DW_DLV_ERROR;
         }
         /*  Copy the existing entries to the new table,
             rehashing each.  */
@@ -512,67 +518,253 @@ _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
         *hash_table_base = newht;
     } /* Else is ok as is, add entry */
 
-    hashable_val = code;
-    hash_num = hashable_val %
-        hash_table_base->tb_table_entry_count;
-    entry_base = hash_table_base->tb_entries;
-    entry_cur  = entry_base + hash_num;
+    entry_cur = hash_table_base->tb_entries +
+        entry->abl_code % hash_table_base->tb_table_entry_count;
+    entry->abl_next = entry_cur->at_head;
+    entry_cur->at_head = entry;
+    hash_table_base->tb_total_abbrev_count++;
+    return DW_DLV_OK;
+}
 
-    /* Determine if the 'code' is the list of synonyms already. */
-    for (hash_abbrev_entry = entry_cur->at_head;
+static Dwarf_Abbrev_List
+abbrev_table_find(Dwarf_Abbrev_Table table, Dwarf_Unsigned code)
+{
+    Dwarf_Hash_Table hash_table_base = &table->abt_sparse;
+    Dwarf_Abbrev_List hash_abbrev_entry = 0;
+
+    if (code < table->abt_flat_size) {
+        return table->abt_flat[code];
+    }
+    if (!hash_table_base->tb_entries) {
+        return NULL;
+    }
+    for (hash_abbrev_entry = hash_table_base->tb_entries[code %
+            hash_table_base->tb_table_entry_count].at_head;
         hash_abbrev_entry != NULL && hash_abbrev_entry->abl_code != code;
         hash_abbrev_entry = hash_abbrev_entry->abl_next);
-    if (hash_abbrev_entry != NULL) {
-        /*  This returns a pointer to an abbrev list entry, not
-            the list itself. */
-        *list_out = hash_abbrev_entry;
+    return hash_abbrev_entry;
+}
+
+/*  Adds a newly read abbreviation.  The first one read with a
+    given code wins.  */
+static int
+abbrev_table_insert(Dwarf_Debug dbg, Dwarf_Abbrev_Table table,
+    Dwarf_Abbrev_List entry)
+{
+    Dwarf_Unsigned code = entry->abl_code;
+
+    if (abbrev_table_find(table, code)) {
+        dwarf_dealloc(dbg, entry, DW_DLA_ABBREV_LIST);
         return DW_DLV_OK;
     }
+    table->abt_count++;
+    if (code >= table->abt_flat_size &&
+        code <= table->abt_count + ABBREV_FLAT_SLACK) {
+        Dwarf_Unsigned new_size = table->abt_flat_size * 2;
+        Dwarf_Abbrev_List *new_flat = 0;
+
+        if (new_size < code + 1) {
+            new_size = code + 1 + ABBREV_FLAT_SLACK;
+        }
+        new_flat = (Dwarf_Abbrev_List *)realloc(table->abt_flat,
+            new_size * sizeof(Dwarf_Abbrev_List));
+        if (!new_flat) {
+            return DW_DLV_ERROR;
+        }
+        memset(new_flat + table->abt_flat_size, 0,
+            (new_size - table->abt_flat_size) * sizeof(Dwarf_Abbrev_List));
+        table->abt_flat = new_flat;
+        table->abt_flat_size = new_size;
+    }
+    if (code < table->abt_flat_size) {
+        /*  Codes already in the sparse table stay there, as they
+            were found there first.  */
+        table->abt_flat[code] = entry;
+        return DW_DLV_OK;
+    }
+    return abbrev_sparse_insert(dbg, &table->abt_sparse, entry);
+}
 
-    if (cu_context->cc_last_abbrev_ptr) {
-        abbrev_ptr = cu_context->cc_last_abbrev_ptr;
-        end_abbrev_ptr = cu_context->cc_last_abbrev_endptr;
+/*  Finds, or creates, the abbreviation table for a CU.  */
+static int
+get_abbrev_table(Dwarf_CU_Context cu_context, Dwarf_Abbrev_Table *table_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = cu_context->cc_dbg;
+    Dwarf_Abbrev_Table table = 0;
+    Dwarf_Unsigned offset = cu_context->cc_abbrev_offset;
+    Dwarf_Byte_Ptr abbrev_ptr = 0;
+    Dwarf_Byte_Ptr end_abbrev_ptr = 0;
+    Dwarf_Half ref_addr_size = 0;
+    Dwarf_Unsigned bucket = 0;
+
+    if (cu_context->cc_abbrev_table) {
+        *table_out = cu_context->cc_abbrev_table;
+        return DW_DLV_OK;
+    }
+
+    /*  This is ok because cc_abbrev_offset includes DWP
+        offset if appropriate. */
+    abbrev_ptr = dbg->de_debug_abbrev.dss_data + offset;
+    if (cu_context->cc_dwp_offsets.pcu_type)  {
+        /*  In a DWP the abbrevs
+            for this context are known quite precisely. */
+        Dwarf_Unsigned size = 0;
+        /* Ignore the offset returned. Already in cc_abbrev_offset. */
+        _dwarf_get_dwp_extra_offset(&cu_context->cc_dwp_offsets,
+            DW_SECT_ABBREV,&size);
+        /*  ASSERT: size != 0 */
+        end_abbrev_ptr = abbrev_ptr + size;
     } else {
-        /*  This is ok because cc_abbrev_offset includes DWP
-            offset if appropriate. */
-        abbrev_ptr = dbg->de_debug_abbrev.dss_data +
-            cu_context->cc_abbrev_offset;
-
-        if (cu_context->cc_dwp_offsets.pcu_type)  {
-            /*  In a DWP the abbrevs
-                for this context are known quite precisely. */
-            Dwarf_Unsigned size = 0;
-            /* Ignore the offset returned. Already in cc_abbrev_offset. */
-            _dwarf_get_dwp_extra_offset(&cu_context->cc_dwp_offsets,
-                DW_SECT_ABBREV,&size);
-            /*  ASSERT: size != 0 */
-            end_abbrev_ptr = abbrev_ptr + size;
-        } else {
-            end_abbrev_ptr = abbrev_ptr +
-                dbg->de_debug_abbrev.dss_size;
+        end_abbrev_ptr = dbg->de_debug_abbrev.dss_data +
+            dbg->de_debug_abbrev.dss_size;
+    }
+    ref_addr_size = cu_context->cc_version_stamp == DW_CU_VERSION2 ?
+        cu_context->cc_address_size : cu_context->cc_length_size;
+
+    if (dbg->de_abbrev_table_buckets) {
+        bucket = offset % dbg->de_abbrev_table_buckets;
+        for (table = dbg->de_abbrev_tables[bucket]; table;
+            table = table->abt_next) {
+            if (table->abt_offset == offset &&
+                table->abt_end == end_abbrev_ptr &&
+                table->abt_address_size == cu_context->cc_address_size &&
+                table->abt_length_size == cu_context->cc_length_size &&
+                table->abt_ref_addr_size == ref_addr_size) {
+                cu_context->cc_abbrev_table = table;
+                *table_out = table;
+                return DW_DLV_OK;
+            }
+        }
+    }
+
+    if (dbg->de_abbrev_table_count >= dbg->de_abbrev_table_buckets) {
+        /*  Rehash into twice as many buckets. */
+        Dwarf_Unsigned new_buckets = dbg->de_abbrev_table_buckets ?
+            dbg->de_abbrev_table_buckets * 2 : 64;
+        Dwarf_Abbrev_Table *new_tables = (Dwarf_Abbrev_Table *)
+            calloc(new_buckets, sizeof(Dwarf_Abbrev_Table));
+        Dwarf_Unsigned i = 0;
+
+        if (!new_tables) {
+            _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+            return DW_DLV_ERROR;
+        }
+        for (i = 0; i < dbg->de_abbrev_table_buckets; ++i) {
+            Dwarf_Abbrev_Table next = 0;
+            for (table = dbg->de_abbrev_tables[i]; table; table = next) {
+                Dwarf_Abbrev_Table *head =
+                    &new_tables[table->abt_offset % new_buckets];
+                next = table->abt_next;
+                table->abt_next = *head;
+                *head = table;
+            }
+        }
+        free(dbg->de_abbrev_tables);
+        dbg->de_abbrev_tables = new_tables;
+        dbg->de_abbrev_table_buckets = new_buckets;
+    }
+
+    table = (Dwarf_Abbrev_Table)calloc(1, sizeof(struct Dwarf_Abbrev_Table_s));
+    if (!table) {
+        _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+        return DW_DLV_ERROR;
+    }
+    table->abt_offset = offset;
+    table->abt_end = end_abbrev_ptr;
+    table->abt_address_size = cu_context->cc_address_size;
+    table->abt_length_size = cu_context->cc_length_size;
+    table->abt_ref_addr_size = ref_addr_size;
+    table->abt_next_abbrev = abbrev_ptr;
+    bucket = offset % dbg->de_abbrev_table_buckets;
+    table->abt_next = dbg->de_abbrev_tables[bucket];
+    dbg->de_abbrev_tables[bucket] = table;
+    dbg->de_abbrev_table_count++;
+
+    cu_context->cc_abbrev_table = table;
+    *table_out = table;
+    return DW_DLV_OK;
+}
+
+/*  This function returns a pointer to a Dwarf_Abbrev_List_s
+    struct for the abbrev with the given code.
+
+    The CU's abbreviation table is first looked up (CUs sharing
+    the same abbreviations share the table).  If the code is not
+    in it yet, the .debug_abbrev section is scanned from the last
+    abbrev read for that table till either an abbrev with the
+    given code is found, or an abbrev code of 0 is read.  All
+    intervening abbrevs are also put into the table, together
+    with the fixed size of their DIEs, if any.
+
+    Any given Dwarf_Abbrev_list entry never moves once
+    allocated, so the pointer is safe to return.
+
+    See also dwarf_get_abbrev() in dwarf_abbrev.c.
+
+    Returns DW_DLV_NO_ENTRY if there is no such abbrev.  */
+int
+_dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
+    Dwarf_Abbrev_List *list_out,
+    Dwarf_Error *error)
+{
+    Dwarf_Debug dbg = cu_context->cc_dbg;
+    Dwarf_Abbrev_Table table = 0;
+    Dwarf_Unsigned abbrev_code = 0;
+    Dwarf_Unsigned abbrev_tag  = 0;
+    Dwarf_Unsigned attr_name = 0;
+    Dwarf_Unsigned attr_form = 0;
+    Dwarf_Abbrev_List inner_list_entry = 0;
+
+    Dwarf_Byte_Ptr abbrev_ptr = 0;
+    Dwarf_Byte_Ptr end_abbrev_ptr = 0;
+    int res = 0;
+
+    table = cu_context->cc_abbrev_table;
+    if (!table) {
+        res = get_abbrev_table(cu_context, &table, error);
+        if (res != DW_DLV_OK) {
+            return res;
         }
     }
 
+    /* Determine if the 'code' has been read already. */
+    inner_list_entry = abbrev_table_find(table, code);
+    if (inner_list_entry) {
+        *list_out = inner_list_entry;
+        return DW_DLV_OK;
+    }
+
+    abbrev_ptr = table->abt_next_abbrev;
+    end_abbrev_ptr = table->abt_end;
+
     /*  End of abbrev's as we are past the end entirely.
         This can happen. */
-    if (abbrev_ptr > end_abbrev_ptr) {
+    if (!abbrev_ptr || abbrev_ptr >= end_abbrev_ptr) {
+        table->abt_next_abbrev = 0;
         return DW_DLV_NO_ENTRY;
     }
     /*  End of abbrev's for this cu, since abbrev code is 0. */
     if (*abbrev_ptr == 0) {
+        table->abt_next_abbrev = 0;
         return DW_DLV_NO_ENTRY;
     }
 
     do {
-        unsigned new_hashable_val = 0;
         Dwarf_Off  abb_goff = 0;
         Dwarf_Unsigned atcount = 0;
+        Dwarf_Bool fixed = TRUE;
+        Dwarf_Unsigned fixed_size = 0;
 
         abb_goff = abbrev_ptr - dbg->de_debug_abbrev.dss_data;
         DECODE_LEB128_UWORD_CK(abbrev_ptr, abbrev_code,
             dbg,error,end_abbrev_ptr);
         DECODE_LEB128_UWORD_CK(abbrev_ptr, abbrev_tag,
             dbg,error,end_abbrev_ptr);
+        if (abbrev_ptr >= end_abbrev_ptr) {
+            _dwarf_error(dbg, error, DW_DLE_ABBREV_DECODE_ERROR);
+            return DW_DLV_ERROR;
+        }
 
         inner_list_entry = (Dwarf_Abbrev_List)
             _dwarf_get_alloc(cu_context->cc_dbg, DW_DLA_ABBREV_LIST, 1);
@@ -581,40 +773,53 @@ _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
             return DW_DLV_ERROR;
         }
 
-        new_hashable_val = abbrev_code;
-        hash_num = new_hashable_val %
-            hash_table_base->tb_table_entry_count;
-        inner_hash_entry = entry_base + hash_num;
-        /* Move_entry_to_new_hash */
-        inner_list_entry->abl_next = inner_hash_entry->at_head;
-        inner_hash_entry->at_head = inner_list_entry;
-
-        hash_table_base->tb_total_abbrev_count++;
-
         inner_list_entry->abl_code = abbrev_code;
         inner_list_entry->abl_tag = abbrev_tag;
         inner_list_entry->abl_has_child = *(abbrev_ptr++);
         inner_list_entry->abl_abbrev_ptr = abbrev_ptr;
         inner_list_entry->abl_goffset =  abb_goff;
 
-        hash_table_base->tb_total_abbrev_count++;
-
         /*  Cycle thru the abbrev content, ignoring the content except
-            to find the end of the content. */
+            to find the end of the content, and the DIE layout. */
         do {
+            Dwarf_Unsigned form_size = 0;
+
             DECODE_LEB128_UWORD_CK(abbrev_ptr, attr_name,
                 dbg,error,end_abbrev_ptr);
             DECODE_LEB128_UWORD_CK(abbrev_ptr, attr_form,
                 dbg,error,end_abbrev_ptr);
             if (!_dwarf_valid_form_we_know(dbg,attr_form,attr_name)) {
+                dwarf_dealloc(dbg, inner_list_entry, DW_DLA_ABBREV_LIST);
                 _dwarf_error(dbg,error,DW_DLE_UNKNOWN_FORM);
                 return DW_DLV_ERROR;
             }
+            if (attr_name == DW_AT_sibling) {
+                inner_list_entry->abl_has_sibling = TRUE;
+                if (fixed && (attr_form == DW_FORM_ref1 ||
+                    attr_form == DW_FORM_ref2 ||
+                    attr_form == DW_FORM_ref4 ||
+                    attr_form == DW_FORM_ref8)) {
+                    inner_list_entry->abl_sibling_form = attr_form;
+                    inner_list_entry->abl_sibling_offset = fixed_size;
+                }
+            }
+            if (fixed && attr_form != 0) {
+                fixed = fixed_form_size(dbg, table, attr_form, &form_size);
+                fixed_size += form_size;
+            }
             atcount++;
         } while (attr_name != 0 && attr_form != 0);
         /*  We counted one too high, by counting the NUL
             byte pair at end of list. So decrement. */
         inner_list_entry->abl_count = atcount-1;
+        inner_list_entry->abl_has_fixed_size = fixed;
+        inner_list_entry->abl_fixed_size = fixed ? fixed_size : 0;
+
+        res = abbrev_table_insert(dbg, table, inner_list_entry);
+        if (res != DW_DLV_OK) {
+            _dwarf_error(dbg, error, DW_DLE_ALLOC_FAIL);
+            return res;
+        }
 
         /*  We may have fallen off the end of content,  that is not
             a botch in the section, as there is no rule that the last
@@ -623,15 +828,49 @@ _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context, Dwarf_Unsigned code,
     } while ((abbrev_ptr < end_abbrev_ptr) &&
         *abbrev_ptr != 0 && abbrev_code != code);
 
-    cu_context->cc_last_abbrev_ptr = abbrev_ptr;
-    cu_context->cc_last_abbrev_endptr = end_abbrev_ptr;
-    if(abbrev_code == code) {
-        *list_out = inner_list_entry;
+    table->abt_next_abbrev = (abbrev_ptr < end_abbrev_ptr &&
+        *abbrev_ptr != 0) ? abbrev_ptr : 0;
+    if (abbrev_code == code) {
+        *list_out = abbrev_table_find(table, code);
         return DW_DLV_OK;
     }
     return DW_DLV_NO_ENTRY;
 }
 
+/*  Frees the abbreviation tables of all CU contexts.  */
+void
+_dwarf_free_abbrev_tables(Dwarf_Debug dbg)
+{
+    Dwarf_Unsigned i = 0;
+
+    for (i = 0; i < dbg->de_abbrev_table_buckets; ++i) {
+        Dwarf_Abbrev_Table table = dbg->de_abbrev_tables[i];
+        Dwarf_Abbrev_Table next = 0;
+
+        for (; table; table = next) {
+            Dwarf_Unsigned code = 0;
+
+            next = table->abt_next;
+            for (code = 0; code < table->abt_flat_size; ++code) {
+                if (table->abt_flat[code]) {
+                    dwarf_dealloc(dbg, table->abt_flat[code],
+                        DW_DLA_ABBREV_LIST);
+                }
+            }
+            free(table->abt_flat);
+            if (table->abt_sparse.tb_entries) {
+                _dwarf_free_abbrev_hash_table_contents(dbg,
+                    &table->abt_sparse);
+            }
+            free(table);
+        }
+    }
+    free(dbg->de_abbrev_tables);
+    dbg->de_abbrev_tables = 0;
+    dbg->de_abbrev_table_buckets = 0;
+    dbg->de_abbrev_table_count = 0;
+}
+
 
 /*
     We check that:
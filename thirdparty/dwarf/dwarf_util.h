@@ -38,12 +38,21 @@
     April 2016: now uses a reader that is careful.
     'return' only in case of error
     else falls through.
+
+    Single-byte values, the vast majority of abbreviation
+    codes, attribute and form numbers, and line program
+    operands, are decoded inline.
 */
 #define DECODE_LEB128_UWORD_CK(ptr, value,dbg,errptr,endptr) \
     do {                                              \
         Dwarf_Word lu_leblen = 0;                     \
         Dwarf_Unsigned lu_local = 0;                  \
         int lu_res = 0;                               \
+        if ((ptr) < (endptr) && !(*(ptr) & 0x80)) {   \
+            value = *(ptr);                           \
+            ptr += 1;                                 \
+            break;                                    \
+        }                                             \
         lu_res = _dwarf_decode_u_leb128_chk(ptr,&lu_leblen,&lu_local,endptr); \
         if (lu_res == DW_DLV_ERROR) {                 \
             _dwarf_error(dbg, errptr, DW_DLE_LEB_IMPROPER);  \
@@ -95,6 +104,11 @@
         Dwarf_Word uleblen = 0;                       \
         Dwarf_Signed local = 0;                       \
         int lu_res = 0;                               \
+        if ((ptr) < (endptr) && !(*(ptr) & 0x80)) {   \
+            value = (Dwarf_Signed)(*(ptr) ^ 0x40) - 0x40; \
+            ptr += 1;                                 \
+            break;                                    \
+        }                                             \
         lu_res = _dwarf_decode_s_leb128_chk(ptr,&uleblen,&local,endptr); \
         if (lu_res == DW_DLV_ERROR) {                 \
             _dwarf_error(dbg, errptr, DW_DLE_LEB_IMPROPER);  \
@@ -497,9 +511,38 @@ struct Dwarf_Hash_Table_Entry_s {
 
 
 
+/*  The abbreviations at one .debug_abbrev offset, shared by
+    all CUs using them with the same address and offset sizes
+    (which the fixed DIE sizes depend on).
+
+    Abbreviations are read lazily, up to the code asked for.
+    Codes are almost always small dense integers, numbered from 1,
+    and index abt_flat directly; a code much larger than the
+    number of abbreviations read so far goes to abt_sparse
+    instead.  */
+struct Dwarf_Abbrev_Table_s {
+    Dwarf_Abbrev_Table abt_next;
+
+    Dwarf_Unsigned abt_offset;
+    Dwarf_Byte_Ptr abt_end;
+    Dwarf_Half abt_address_size;
+    Dwarf_Half abt_length_size;
+    Dwarf_Half abt_ref_addr_size;
+
+    /*  Where to resume reading; null once the terminating
+        null entry or the end of the section is reached. */
+    Dwarf_Byte_Ptr abt_next_abbrev;
+    Dwarf_Unsigned abt_count;
+
+    Dwarf_Abbrev_List *abt_flat;
+    Dwarf_Unsigned abt_flat_size;
+    struct Dwarf_Hash_Table_s abt_sparse;
+};
+
 int _dwarf_get_abbrev_for_code(Dwarf_CU_Context cu_context,
     Dwarf_Unsigned code,
     Dwarf_Abbrev_List *list_out,Dwarf_Error *error);
+void _dwarf_free_abbrev_tables(Dwarf_Debug dbg);
 
 
 /* return 1 if string ends before 'endptr' else
@@ -1488,6 +1488,101 @@ int dwarf_offdie_b(Dwarf_Debug /*dbg*/,
     Dwarf_Die*       /*return_die*/,
     Dwarf_Error*     /*error*/);
 
+/*  DIE cursor.
+    A forward-only, depth-first walk over the DIEs of the current
+    CU (as set by dwarf_next_cu_header_d), reading .debug_info in
+    place.  Unlike Dwarf_Die it lives wherever the caller puts it
+    (typically the stack) and allocates nothing per DIE.
+    The fields after the private ones describe the current DIE.
+    To use the regular DIE interfaces on it, call
+    dwarf_offdie_b() with dc_offset.  */
+typedef struct Dwarf_Die_Cursor_s {
+    /*  Private. */
+    void *          dc_context;
+    Dwarf_Small *   dc_section;
+    Dwarf_Small *   dc_end;
+    Dwarf_Small *   dc_next;
+    Dwarf_Small *   dc_attrs;
+    void *          dc_abbrev;
+    Dwarf_Small *   dc_die_end;
+    Dwarf_Small *   dc_sibling;
+    Dwarf_Bool      dc_skip;
+
+    /*  Section-global offset of the current DIE. */
+    Dwarf_Off       dc_offset;
+    Dwarf_Half      dc_tag;
+    Dwarf_Bool      dc_has_children;
+    /*  0 for the CU DIE, 1 for its children, and so on. */
+    int             dc_level;
+} Dwarf_Die_Cursor;
+
+/*  Attributes dwarf_die_cursor_attrs() can decode. */
+#define DW_DCA_NAME             0x01
+#define DW_DCA_LOW_PC           0x02
+#define DW_DCA_HIGH_PC          0x04
+#define DW_DCA_SPECIFICATION    0x08
+#define DW_DCA_ABSTRACT_ORIGIN  0x10
+#define DW_DCA_RANGES           0x20
+#define DW_DCA_CALL_FILE        0x40
+#define DW_DCA_CALL_LINE        0x80
+
+typedef struct Dwarf_Die_Attrs_s {
+    /*  DW_DCA_ bits of the attributes found and decoded. */
+    Dwarf_Unsigned  dca_present;
+    /*  DW_DCA_ bits of attributes that were asked for and are
+        present, but in a form this interface does not decode
+        (e.g. DW_FORM_ref_sig8): use the regular DIE interfaces. */
+    Dwarf_Unsigned  dca_other_form;
+    const char *    dca_name;
+    Dwarf_Addr      dca_lowpc;
+    /*  Always an address: asking for DW_DCA_HIGH_PC also
+        decodes DW_AT_low_pc, to resolve DWARF4 offsets. */
+    Dwarf_Addr      dca_highpc;
+    /*  Section-global .debug_info offsets. */
+    Dwarf_Off       dca_specification;
+    Dwarf_Off       dca_abstract_origin;
+    /*  Offset into .debug_ranges. */
+    Dwarf_Unsigned  dca_ranges;
+    /*  Line table file number and line of an inlined call. */
+    Dwarf_Unsigned  dca_call_file;
+    Dwarf_Unsigned  dca_call_line;
+} Dwarf_Die_Attrs;
+
+int dwarf_die_cursor_init(Dwarf_Debug /*dbg*/,
+    Dwarf_Bool       /*is_info*/,
+    Dwarf_Die_Cursor* /*cursor*/,
+    Dwarf_Error*     /*error*/);
+
+/*  Same, for the CU the given DIE belongs to (e.g. from
+    dwarf_offdie_b()), rather than the current one.  */
+int dwarf_die_cursor_init_b(Dwarf_Die /*die*/,
+    Dwarf_Die_Cursor* /*cursor*/,
+    Dwarf_Error*     /*error*/);
+
+/*  Moves to the next DIE in depth-first order, the CU DIE
+    first.  Returns DW_DLV_NO_ENTRY at the end of the CU.  */
+int dwarf_die_cursor_next(Dwarf_Die_Cursor* /*cursor*/,
+    Dwarf_Error*     /*error*/);
+
+/*  Makes the next dwarf_die_cursor_next() skip the children of
+    the current DIE, jumping by DW_AT_sibling when present.  */
+void dwarf_die_cursor_skip_children(Dwarf_Die_Cursor* /*cursor*/);
+
+/*  Decodes the attributes selected by the DW_DCA_ mask.  */
+int dwarf_die_cursor_attrs(Dwarf_Die_Cursor* /*cursor*/,
+    Dwarf_Unsigned   /*want*/,
+    Dwarf_Die_Attrs* /*attrs*/,
+    Dwarf_Error*     /*error*/);
+
+/*  Same, for the DIE at a section-global offset in the cursor's
+    CU (such as dca_specification), without moving the cursor.
+    Returns DW_DLV_NO_ENTRY if the offset is outside the CU.  */
+int dwarf_die_cursor_attrs_at(Dwarf_Die_Cursor* /*cursor*/,
+    Dwarf_Off        /*offset*/,
+    Dwarf_Unsigned   /*want*/,
+    Dwarf_Die_Attrs* /*attrs*/,
+    Dwarf_Error*     /*error*/);
+
 /*  Returns the is_info flag through the pointer if the function returns
     DW_DLV_OK. Needed so client software knows if a DIE is in debug_info
     or debug_types.
@@ -2476,6 +2571,17 @@ int dwarf_get_fde_info_for_all_regs3(Dwarf_Fde /*fde*/,
     Dwarf_Addr*      /*row_pc*/,
     Dwarf_Error*     /*error*/);
 
+/*  Same as dwarf_get_fde_info_for_all_regs3, but also telling
+    where the next row starts, so that callers can tell the
+    range of addresses the returned rules apply to. */
+int dwarf_get_fde_info_for_all_regs3_b(Dwarf_Fde /*fde*/,
+    Dwarf_Addr       /*pc_requested*/,
+    Dwarf_Regtable3* /*reg_table*/,
+    Dwarf_Addr*      /*row_pc*/,
+    Dwarf_Bool*      /*has_more_rows*/,
+    Dwarf_Addr*      /*subsequent_pc*/,
+    Dwarf_Error*     /*error*/);
+
 /* In this older interface DW_FRAME_CFA_COL is a meaningful
     column (which does not work well with DWARF3 or
     non-MIPS architectures). */
@@ -2948,6 +3054,14 @@ int dwarf_gdbindex_symboltable_entry(
     Dwarf_Unsigned * /*cu_vector_offset*/,
     Dwarf_Error    * /*error*/);
 
+/*  Finds a name through the symbol table's hash, without
+    scanning it.  Returns DW_DLV_NO_ENTRY if not there. */
+int dwarf_gdbindex_symboltable_lookup(Dwarf_Gdbindex /*gdbindexptr*/,
+    const char     * /*name*/,
+    Dwarf_Unsigned * /*symtab_index*/,
+    Dwarf_Unsigned * /*cu_vector_offset*/,
+    Dwarf_Error    * /*error*/);
+
 int dwarf_gdbindex_cuvector_length(Dwarf_Gdbindex /*gdbindex*/,
     Dwarf_Unsigned   /*cuvector_offset*/,
     Dwarf_Unsigned * /*innercount*/,
@@ -3127,6 +3241,33 @@ Dwarf_Ptr dwarf_seterrarg(Dwarf_Debug /*dbg*/, Dwarf_Ptr /*errarg*/);
 void dwarf_dealloc(Dwarf_Debug /*dbg*/, void* /*space*/,
     Dwarf_Unsigned /*type*/);
 
+/*  Arena allocation.
+    With arena mode on, objects are carved out of large chunks
+    owned by the Dwarf_Debug instead of being malloc-ed and tracked
+    one by one, dwarf_dealloc() of them does nothing, and
+    dwarf_finish() frees all chunks at once.
+    Returns the previous mode.  */
+Dwarf_Bool dwarf_set_arena_mode(Dwarf_Debug /*dbg*/, Dwarf_Bool /*on*/);
+
+/*  Scoped sub-arenas, which may nest.  Short-lived objects
+    (DIEs, attributes, lines, strings, lists, errors, ...)
+    created between dwarf_arena_begin() and the matching
+    dwarf_arena_end() are all freed by dwarf_arena_end(),
+    whether or not they were passed to dwarf_dealloc().
+    Nothing obtained inside the scope may be used after it.
+    Internal caches (CU contexts, abbreviations, frame
+    tables) are never placed in sub-arenas.
+    Sub-arenas only take effect in arena mode.  */
+int dwarf_arena_begin(Dwarf_Debug /*dbg*/, Dwarf_Error* /*error*/);
+void dwarf_arena_end(Dwarf_Debug /*dbg*/);
+
+/*  Counts of objects and bytes handed out by the allocator,
+    and of the underlying malloc calls, since dwarf_init.  */
+int dwarf_get_alloc_stats(Dwarf_Debug /*dbg*/,
+    Dwarf_Unsigned * /*alloc_count*/,
+    Dwarf_Unsigned * /*alloc_bytes*/,
+    Dwarf_Unsigned * /*malloc_count*/);
+
 
 /* DWARF Producer Interface */
 
@@ -3942,6 +4083,31 @@ int dwarf_encode_signed_leb128(Dwarf_Signed /*val*/,
     char * /*space*/,
     int /*splen*/);
 
+/*  Decode count consecutive LEB128 values from data, not reading
+    at or past end.  On DW_DLV_OK *next points past the last value;
+    on DW_DLV_ERROR (malformed or truncated input) at the value that
+    could not be decoded, and the values before it are filled in. */
+int dwarf_decode_leb128_batch(Dwarf_Small * /*data*/,
+    Dwarf_Small * /*end*/,
+    Dwarf_Unsigned * /*values*/,
+    Dwarf_Unsigned /*count*/,
+    Dwarf_Small ** /*next*/);
+int dwarf_decode_signed_leb128_batch(Dwarf_Small * /*data*/,
+    Dwarf_Small * /*end*/,
+    Dwarf_Signed * /*values*/,
+    Dwarf_Unsigned /*count*/,
+    Dwarf_Small ** /*next*/);
+
+/*  Kernel behind the batch decoders.  By default the fastest one the
+    CPU supports is picked on first use.  Kernels the CPU or the build
+    lacks are replaced by the default.  Returns the kernel in use;
+    intended for benchmarks. */
+#define DW_LEB128_KERNEL_AUTO   0
+#define DW_LEB128_KERNEL_SCALAR 1
+#define DW_LEB128_KERNEL_SSE2   2
+#define DW_LEB128_KERNEL_AVX2   3
+int dwarf_set_leb128_kernel(int /*kernel*/);
+
 /*  Record some application command line options in libdwarf.
     This is not arc/argv processing, just precooked setting
     of a flag in libdwarf based on something the application